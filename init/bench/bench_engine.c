@@ -0,0 +1,407 @@
+/* upstart
+ *
+ * bench_engine.c - benchmark of the event and job engine
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/main.h>
+#include <nih/option.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include "control.h"
+#include "job_class.h"
+#include "job_process.h"
+#include "job.h"
+#include "event.h"
+#include "parse_job.h"
+
+#include "bench_util.h"
+
+
+/**
+ * bench_default_sizes:
+ *
+ * Numbers of job classes benchmarked when none are given on the
+ * command-line.
+ **/
+static const size_t bench_default_sizes[] = { 1000, 10000, 50000, 0 };
+
+/**
+ * BENCH_INTERFACES, BENCH_MOUNTS, BENCH_CUSTOM:
+ *
+ * Number of distinct network interfaces, mount points and custom events
+ * referred to by the synthetic job classes; several classes share each.
+ **/
+#define BENCH_INTERFACES 64
+#define BENCH_MOUNTS     256
+#define BENCH_CUSTOM     1024
+
+
+/* Prototypes for static functions */
+static char * bench_job_config  (const void *parent, size_t i)
+	__attribute__ ((warn_unused_result, malloc));
+static void   bench_storm_event (void);
+static size_t bench_instances   (void);
+static void   bench_emit        (BenchSamples *samples, const char *name,
+				 const char *var);
+static void   bench_engine      (size_t classes);
+
+
+/**
+ * storm_events:
+ *
+ * Number of events emitted in the event storm for each set of classes.
+ **/
+static int storm_events = 10000;
+
+/**
+ * options:
+ *
+ * Command-line options accepted.
+ **/
+static NihOption options[] = {
+	{ 0, "events", N_("number of events to emit in each storm"),
+		NULL, "COUNT", &storm_events, nih_option_int },
+
+	NIH_OPTION_LAST
+};
+
+
+/**
+ * bench_job_config:
+ * @parent: parent object for new string,
+ * @i: index of job class.
+ *
+ * Generates the configuration of the @i'th synthetic job class.  Every
+ * fourth class starts on a runlevel change, the others start on network
+ * interfaces coming up, on another class having started and a
+ * filesystem being mounted, or on either of a mount or custom event;
+ * each has a matching stop on condition.  None have processes, so the
+ * benchmark exercises the event and state machinery alone.
+ *
+ * Returns: newly allocated string.
+ **/
+static char *
+bench_job_config (const void *parent,
+		  size_t      i)
+{
+	switch (i % 4) {
+	case 0:
+		return NIH_MUST (nih_sprintf (parent,
+				"description \"runlevel job %zu\"\n"
+				"start on runlevel [2345]\n"
+				"stop on runlevel [!2345]\n"
+				"console none\n", i));
+	case 1:
+		return NIH_MUST (nih_sprintf (parent,
+				"start on net-device-up IFACE=eth%zu\n"
+				"stop on net-device-down IFACE=eth%zu\n"
+				"console none\n",
+				i % BENCH_INTERFACES, i % BENCH_INTERFACES));
+	case 2:
+		return NIH_MUST (nih_sprintf (parent,
+				"start on started job-%zu and filesystem\n"
+				"stop on stopping job-%zu\n"
+				"console none\n", i - 2, i - 2));
+	case 3:
+		return NIH_MUST (nih_sprintf (parent,
+				"start on (custom-%zu\n"
+				"          or mounted MOUNTPOINT=/m%zu)\n"
+				"stop on custom-stop-%zu or runlevel [016]\n"
+				"console none\n",
+				i % BENCH_CUSTOM, i % BENCH_MOUNTS,
+				i % BENCH_CUSTOM));
+	default:
+		nih_assert_not_reached ();
+	}
+}
+
+/**
+ * bench_storm_event:
+ *
+ * Queues a random event for the event storm; most are of interest to a
+ * few classes, some to none.
+ **/
+static void
+bench_storm_event (void)
+{
+	nih_local char  *name = NULL;
+	nih_local char **env = NULL;
+	int              n = rand ();
+
+	env = NIH_MUST (nih_str_array_new (NULL));
+
+	switch (n % 6) {
+	case 0:
+		name = NIH_MUST (nih_strdup (NULL, "net-device-up"));
+		NIH_MUST (nih_str_array_addp (&env, NULL, NULL,
+			NIH_MUST (nih_sprintf (env, "IFACE=eth%d",
+					       (n / 6) % BENCH_INTERFACES))));
+		break;
+	case 1:
+		name = NIH_MUST (nih_strdup (NULL, "net-device-down"));
+		NIH_MUST (nih_str_array_addp (&env, NULL, NULL,
+			NIH_MUST (nih_sprintf (env, "IFACE=eth%d",
+					       (n / 6) % BENCH_INTERFACES))));
+		break;
+	case 2:
+		name = NIH_MUST (nih_strdup (NULL, "mounted"));
+		NIH_MUST (nih_str_array_addp (&env, NULL, NULL,
+			NIH_MUST (nih_sprintf (env, "MOUNTPOINT=/m%d",
+					       (n / 6) % BENCH_MOUNTS))));
+		break;
+	case 3:
+		name = NIH_MUST (nih_sprintf (NULL, "custom-%d",
+					      (n / 6) % BENCH_CUSTOM));
+		break;
+	case 4:
+		name = NIH_MUST (nih_sprintf (NULL, "custom-stop-%d",
+					      (n / 6) % BENCH_CUSTOM));
+		break;
+	case 5:
+		name = NIH_MUST (nih_sprintf (NULL, "unrelated-%d", n / 6));
+		break;
+	default:
+		nih_assert_not_reached ();
+	}
+
+	NIH_MUST (event_new (NULL, name, env));
+}
+
+/**
+ * bench_instances:
+ *
+ * Returns: number of job instances that exist.
+ **/
+static size_t
+bench_instances (void)
+{
+	size_t count = 0;
+
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *class = (JobClass *)iter;
+
+		NIH_HASH_FOREACH (class->instances, job_iter)
+			count++;
+	}
+
+	return count;
+}
+
+/**
+ * bench_emit:
+ * @samples: samples to add to,
+ * @name: name of event,
+ * @var: environment variable for event, or NULL.
+ *
+ * Emits an event named @name and handles it, along with all of the
+ * events and state changes that follow, adding the time taken to
+ * @samples.
+ **/
+static void
+bench_emit (BenchSamples *samples,
+	    const char   *name,
+	    const char   *var)
+{
+	nih_local char **env = NULL;
+	uint64_t         start;
+
+	nih_assert (samples != NULL);
+	nih_assert (name != NULL);
+
+	env = NIH_MUST (nih_str_array_new (NULL));
+	if (var)
+		NIH_MUST (nih_str_array_add (&env, NULL, NULL, var));
+
+	start = bench_now ();
+	NIH_MUST (event_new (NULL, name, env));
+	event_poll ();
+	bench_samples_add (samples, bench_now () - start);
+}
+
+/**
+ * bench_engine:
+ * @classes: number of job classes.
+ *
+ * Parses and registers @classes synthetic job classes, then measures
+ * booting them with the filesystem and runlevel events, a storm of
+ * random events, shutting down to runlevel 0 and finally stopping
+ * whatever remains one instance at a time.
+ **/
+static void
+bench_engine (size_t classes)
+{
+	nih_local BenchSamples *parse = NULL;
+	nih_local BenchSamples *add = NULL;
+	nih_local BenchSamples *boot = NULL;
+	nih_local BenchSamples *storm = NULL;
+	nih_local BenchSamples *shutdown = NULL;
+	nih_local BenchSamples *stop = NULL;
+	uint64_t                start;
+
+	printf ("\n%zu job classes:\n", classes);
+
+	parse = bench_samples_new (NULL, "parse_job");
+	add = bench_samples_new (NULL, "job_class_add_safe");
+	boot = bench_samples_new (NULL, "boot event_poll");
+	storm = bench_samples_new (NULL, "storm event_poll");
+	shutdown = bench_samples_new (NULL, "shutdown event_poll");
+	stop = bench_samples_new (NULL, "job_change_goal stop");
+
+	for (size_t i = 0; i < classes; i++) {
+		nih_local char *name = NULL;
+		nih_local char *file = NULL;
+		JobClass       *class;
+		size_t          pos = 0, lineno = 1;
+
+		name = NIH_MUST (nih_sprintf (NULL, "job-%zu", i));
+		file = bench_job_config (NULL, i);
+
+		start = bench_now ();
+		class = parse_job (NULL, NULL, NULL, name, file, strlen (file),
+				   &pos, &lineno);
+		bench_samples_add (parse, bench_now () - start);
+
+		if (! class) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_fatal ("%s: %s", name, err->message);
+			exit (1);
+		}
+
+		start = bench_now ();
+		job_class_add_safe (class);
+		bench_samples_add (add, bench_now () - start);
+	}
+
+	bench_report (parse);
+	bench_report (add);
+
+	bench_emit (boot, "filesystem", NULL);
+	bench_emit (boot, "runlevel", "RUNLEVEL=2");
+	bench_report (boot);
+	printf ("  %zu instances running after boot\n", bench_instances ());
+
+	srand (1);
+	for (int i = 0; i < storm_events; i++) {
+		start = bench_now ();
+		bench_storm_event ();
+		event_poll ();
+		bench_samples_add (storm, bench_now () - start);
+	}
+
+	bench_report (storm);
+	printf ("  %zu instances running after storm\n", bench_instances ());
+
+	bench_emit (shutdown, "runlevel", "RUNLEVEL=0");
+	bench_report (shutdown);
+	printf ("  %zu instances running after shutdown\n", bench_instances ());
+
+	NIH_HASH_FOREACH_SAFE (job_classes, iter) {
+		JobClass *class = (JobClass *)iter;
+
+		NIH_HASH_FOREACH_SAFE (class->instances, job_iter) {
+			Job *job = (Job *)job_iter;
+
+			start = bench_now ();
+			job_change_goal (job, JOB_STOP);
+			event_poll ();
+			bench_samples_add (stop, bench_now () - start);
+		}
+	}
+
+	bench_report (stop);
+	printf ("  %zu instances running after stop\n", bench_instances ());
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	char **args;
+
+	nih_main_init (argv[0]);
+
+	nih_option_set_usage (_("[CLASSES]..."));
+	nih_option_set_synopsis (_("Benchmark the event and job engine."));
+
+	args = nih_option_parser (NULL, argc, argv, options, FALSE);
+	if (! args)
+		exit (1);
+
+	/* Run as for the test suites, with neither sessions nor a bus */
+	setenv ("UPSTART_NO_SESSIONS", "1", 1);
+	nih_log_set_priority (NIH_LOG_WARN);
+
+	job_class_environment_init ();
+
+	for (size_t i = 0; args[0] ? (args[i] != NULL)
+		     : (bench_default_sizes[i] != 0); i++) {
+		size_t classes;
+		pid_t  pid;
+		int    status;
+
+		classes = args[0] ? strtoul (args[i], NULL, 10)
+			: bench_default_sizes[i];
+
+		/* Each set of classes is benchmarked in a child so that
+		 * they start with the same empty tables and heap.
+		 */
+		fflush (stdout);
+		pid = fork ();
+		if (pid < 0) {
+			nih_fatal ("%s", strerror (errno));
+			exit (1);
+		} else if (! pid) {
+			job_class_init ();
+			job_process_init ();
+			event_init ();
+			control_init ();
+
+			bench_engine (classes);
+			exit (0);
+		}
+
+		if ((waitpid (pid, &status, 0) < 0)
+		    || (! WIFEXITED (status)) || WEXITSTATUS (status))
+			exit (1);
+	}
+
+	return 0;
+}
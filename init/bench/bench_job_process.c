@@ -0,0 +1,319 @@
+/* upstart
+ *
+ * bench_job_process.c - benchmark of job process lookup and spawning
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/main.h>
+#include <nih/option.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include "control.h"
+#include "job_class.h"
+#include "job_process.h"
+#include "job.h"
+#include "event.h"
+#include "log.h"
+
+#include "bench_util.h"
+
+
+/**
+ * BENCH_PID_BASE:
+ *
+ * First of the made-up process ids given to the synthetic jobs; they
+ * are never signalled or waited for.
+ **/
+#define BENCH_PID_BASE 100000
+
+
+/* Prototypes for static functions */
+static Job *bench_scan_find (pid_t pid, ProcessType *process)
+	__attribute__ ((warn_unused_result));
+static void bench_reap      (void);
+static void bench_spawn     (int count, int use_fork);
+
+
+extern int disable_clone_spawn;
+
+/**
+ * tasks:
+ *
+ * Number of jobs with a running process for the lookup benchmark.
+ **/
+static int tasks = 10000;
+
+/**
+ * options:
+ *
+ * Command-line options accepted.
+ **/
+static NihOption options[] = {
+	{ 0, "tasks", N_("number of running jobs to look processes up among"),
+		NULL, "COUNT", &tasks, nih_option_int },
+
+	NIH_OPTION_LAST
+};
+
+
+/**
+ * bench_scan_find:
+ * @pid: process id to find,
+ * @process: pointer to place process which is running @pid.
+ *
+ * Finds the job with a process of the given @pid by iterating every
+ * instance of every class, as job_process_find() did before the
+ * job_process_pids table was introduced; kept for comparison.
+ *
+ * Returns: job found or NULL if not known.
+ **/
+static Job *
+bench_scan_find (pid_t        pid,
+		 ProcessType *process)
+{
+	nih_assert (pid > 0);
+
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *class = (JobClass *)iter;
+
+		NIH_HASH_FOREACH (class->instances, job_iter) {
+			Job *job = (Job *)job_iter;
+			int  i;
+
+			for (i = 0; i < PROCESS_LAST; i++) {
+				if (job->pid[i] == pid) {
+					if (process)
+						*process = i;
+					return job;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * bench_reap:
+ *
+ * Creates @tasks jobs each with a running main process, then measures
+ * finding the job for every process id in a random order, as happens
+ * for each child reaped, both by scanning every job and by the
+ * job_process_pids table; and finally clearing each process id.
+ **/
+static void
+bench_reap (void)
+{
+	nih_local BenchSamples *scan = NULL;
+	nih_local BenchSamples *find = NULL;
+	nih_local BenchSamples *clear = NULL;
+	nih_local pid_t        *order = NULL;
+	nih_local Job         **jobs = NULL;
+	uint64_t                start;
+
+	printf ("\n%d running jobs:\n", tasks);
+
+	scan = bench_samples_new (NULL, "scan find");
+	find = bench_samples_new (NULL, "job_process_find");
+	clear = bench_samples_new (NULL, "job_process_set_pid clear");
+
+	jobs = NIH_MUST (nih_alloc (NULL, sizeof (Job *) * tasks));
+	order = NIH_MUST (nih_alloc (NULL, sizeof (pid_t) * tasks));
+
+	for (int i = 0; i < tasks; i++) {
+		nih_local char *name = NULL;
+		JobClass       *class;
+
+		name = NIH_MUST (nih_sprintf (NULL, "job-%d", i));
+
+		class = NIH_MUST (job_class_new (NULL, name, NULL));
+		class->console = CONSOLE_NONE;
+		nih_hash_add (job_classes, &class->entry);
+
+		jobs[i] = NIH_MUST (job_new (class, ""));
+		job_process_set_pid (jobs[i], PROCESS_MAIN, BENCH_PID_BASE + i);
+
+		order[i] = BENCH_PID_BASE + i;
+	}
+
+	srand (1);
+	for (int i = tasks - 1; i > 0; i--) {
+		int   j = rand () % (i + 1);
+		pid_t tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (int i = 0; i < tasks; i++) {
+		ProcessType process;
+		Job        *job;
+
+		start = bench_now ();
+		job = bench_scan_find (order[i], &process);
+		bench_samples_add (scan, bench_now () - start);
+
+		nih_assert (job == jobs[order[i] - BENCH_PID_BASE]);
+		nih_assert (process == PROCESS_MAIN);
+	}
+
+	bench_report (scan);
+
+	for (int i = 0; i < tasks; i++) {
+		ProcessType process;
+		Job        *job;
+
+		start = bench_now ();
+		job = job_process_find (order[i], &process);
+		bench_samples_add (find, bench_now () - start);
+
+		nih_assert (job == jobs[order[i] - BENCH_PID_BASE]);
+		nih_assert (process == PROCESS_MAIN);
+	}
+
+	bench_report (find);
+
+	for (int i = 0; i < tasks; i++) {
+		Job *job = jobs[order[i] - BENCH_PID_BASE];
+
+		start = bench_now ();
+		job_process_set_pid (job, PROCESS_MAIN, 0);
+		bench_samples_add (clear, bench_now () - start);
+	}
+
+	bench_report (clear);
+}
+
+/**
+ * bench_spawn:
+ * @count: number of processes to spawn,
+ * @use_fork: TRUE to spawn with fork() rather than clone().
+ *
+ * Measures job_process_spawn_with_fd() starting @count processes of a
+ * simple job one after another, waiting for each to exit before the
+ * next.  The jobs created by bench_reap() are left in place so that the
+ * cost of fork() reflects an init managing many jobs.
+ **/
+static void
+bench_spawn (int count,
+	     int use_fork)
+{
+	nih_local BenchSamples *spawn = NULL;
+	nih_local char         *name = NULL;
+	nih_local JobClass     *class = NULL;
+	Job                    *job;
+	char                   *argv[] = { "/bin/true", NULL };
+	uint64_t                start;
+
+	name = NIH_MUST (nih_sprintf (NULL, "job_process_spawn %s x%d",
+				      use_fork ? "fork" : "clone", count));
+	spawn = bench_samples_new (NULL, name);
+
+	class = NIH_MUST (job_class_new (NULL, "spawn", NULL));
+	class->console = CONSOLE_NONE;
+	job = NIH_MUST (job_new (class, ""));
+
+	disable_clone_spawn = use_fork;
+
+	for (int i = 0; i < count; i++) {
+		int   job_process_fd = -1;
+		pid_t pid;
+
+		start = bench_now ();
+		pid = job_process_spawn_with_fd (job, argv, NULL, FALSE, -1,
+						 PROCESS_MAIN, &job_process_fd);
+		bench_samples_add (spawn, bench_now () - start);
+
+		if (pid < 0) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_fatal ("%s", err->message);
+			exit (1);
+		}
+
+		if (job_process_fd >= 0)
+			close (job_process_fd);
+
+		waitpid (pid, NULL, 0);
+	}
+
+	disable_clone_spawn = FALSE;
+
+	bench_report (spawn);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	char **args;
+
+	nih_main_init (argv[0]);
+
+	nih_option_set_synopsis (_("Benchmark job process lookup and spawning."));
+
+	args = nih_option_parser (NULL, argc, argv, options, FALSE);
+	if (! args)
+		exit (1);
+
+	if (tasks < 1) {
+		fprintf (stderr, _("%s: --tasks must be positive\n"),
+			 program_name);
+		exit (1);
+	}
+
+	/* Run as for the test suites, with neither sessions nor a bus */
+	setenv ("UPSTART_NO_SESSIONS", "1", 1);
+	nih_log_set_priority (NIH_LOG_WARN);
+
+	job_class_environment_init ();
+	job_class_init ();
+	job_process_init ();
+	event_init ();
+	control_init ();
+	log_unflushed_init ();
+
+	bench_reap ();
+
+	printf ("\nspawning with %d jobs in memory:\n", tasks);
+	bench_spawn (100, FALSE);
+	bench_spawn (100, TRUE);
+	bench_spawn (1000, FALSE);
+	bench_spawn (1000, TRUE);
+
+	return 0;
+}
@@ -0,0 +1,236 @@
+/* upstart
+ *
+ * bench_state.c - benchmark of state snapshot encoding and decoding
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/file.h>
+#include <nih/io.h>
+#include <nih/main.h>
+#include <nih/option.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include <json.h>
+
+#include "state.h"
+
+#include "bench_util.h"
+
+
+#ifndef TEST_DATA_DIR
+#error ERROR: TEST_DATA_DIR not defined
+#endif
+
+
+/* Prototypes for static functions */
+static int  bench_state_filter (const struct dirent *entry);
+static void bench_state        (const char *path);
+
+
+/**
+ * repeat:
+ *
+ * Number of times each data file is encoded and decoded.
+ **/
+static int repeat = 1000;
+
+/**
+ * options:
+ *
+ * Command-line options accepted.
+ **/
+static NihOption options[] = {
+	{ 0, "repeat", N_("number of times to encode and decode each file"),
+		NULL, "COUNT", &repeat, nih_option_int },
+
+	NIH_OPTION_LAST
+};
+
+
+/**
+ * bench_state_filter:
+ * @entry: directory entry.
+ *
+ * scandir() filter selecting JSON state files.
+ *
+ * Returns: TRUE if @entry should be benchmarked.
+ **/
+static int
+bench_state_filter (const struct dirent *entry)
+{
+	size_t len;
+
+	nih_assert (entry != NULL);
+
+	len = strlen (entry->d_name);
+
+	return (len > 5) && (! strcmp (entry->d_name + len - 5, ".json"));
+}
+
+/**
+ * bench_state:
+ * @path: path of JSON state file.
+ *
+ * Measures encoding the state in @path to JSON text and to a binary
+ * snapshot, and decoding each back to a JSON object tree, as is done
+ * either side of a stateful re-exec.
+ **/
+static void
+bench_state (const char *path)
+{
+	nih_local char         *name = NULL;
+	nih_local char         *data = NULL;
+	nih_local char         *json_string = NULL;
+	nih_local NihIoBuffer  *buffer = NULL;
+	nih_local BenchSamples *json_encode = NULL;
+	nih_local BenchSamples *json_decode = NULL;
+	nih_local BenchSamples *binary_encode = NULL;
+	nih_local BenchSamples *binary_decode = NULL;
+	json_object            *json;
+	size_t                  len;
+	uint64_t                start;
+
+	nih_assert (path != NULL);
+
+	data = nih_file_read (NULL, path, &len);
+	if (! data) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_fatal ("%s: %s", path, err->message);
+		exit (1);
+	}
+
+	json_string = NIH_MUST (nih_strndup (NULL, data, len));
+
+	json = json_tokener_parse (json_string);
+	if (! json) {
+		nih_fatal ("%s: %s", path, _("Invalid JSON"));
+		exit (1);
+	}
+
+	buffer = NIH_MUST (nih_io_buffer_new (NULL));
+	if (state_json_to_binary (buffer, json) < 0) {
+		nih_fatal ("%s: %s", path, _("Unable to encode binary state"));
+		exit (1);
+	}
+
+	printf ("\n%s: %zu bytes JSON, %zu bytes binary\n",
+		strrchr (path, '/') ? strrchr (path, '/') + 1 : path,
+		strlen (json_object_to_json_string (json)), buffer->len);
+
+	json_encode = bench_samples_new (NULL, "json_object_to_json_string");
+	json_decode = bench_samples_new (NULL, "json_tokener_parse");
+	binary_encode = bench_samples_new (NULL, "state_json_to_binary");
+	binary_decode = bench_samples_new (NULL, "state_binary_to_json");
+
+	for (int i = 0; i < repeat; i++) {
+		nih_local NihIoBuffer *new_buffer = NULL;
+		json_object           *new_json;
+		const char            *str;
+
+		start = bench_now ();
+		str = json_object_to_json_string (json);
+		bench_samples_add (json_encode, bench_now () - start);
+		nih_assert (str != NULL);
+
+		start = bench_now ();
+		new_json = json_tokener_parse (str);
+		bench_samples_add (json_decode, bench_now () - start);
+		nih_assert (new_json != NULL);
+		json_object_put (new_json);
+
+		new_buffer = NIH_MUST (nih_io_buffer_new (NULL));
+
+		start = bench_now ();
+		NIH_ZERO (state_json_to_binary (new_buffer, json));
+		bench_samples_add (binary_encode, bench_now () - start);
+
+		start = bench_now ();
+		new_json = state_binary_to_json (new_buffer->buf,
+						 new_buffer->len);
+		bench_samples_add (binary_decode, bench_now () - start);
+		nih_assert (new_json != NULL);
+		json_object_put (new_json);
+	}
+
+	json_object_put (json);
+
+	bench_report (json_encode);
+	bench_report (json_decode);
+	bench_report (binary_encode);
+	bench_report (binary_decode);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	char           **args;
+	struct dirent  **entries;
+	const char      *dir;
+	int              n;
+
+	nih_main_init (argv[0]);
+
+	nih_option_set_usage (_("[DIR]"));
+	nih_option_set_synopsis (_("Benchmark state snapshot encoding and decoding."));
+
+	args = nih_option_parser (NULL, argc, argv, options, FALSE);
+	if (! args)
+		exit (1);
+
+	dir = args[0] ? args[0] : TEST_DATA_DIR;
+
+	n = scandir (dir, &entries, bench_state_filter, alphasort);
+	if (n < 0) {
+		nih_fatal ("%s: %s", dir, strerror (errno));
+		exit (1);
+	}
+
+	for (int i = 0; i < n; i++) {
+		nih_local char *path = NULL;
+
+		path = NIH_MUST (nih_sprintf (NULL, "%s/%s",
+					      dir, entries[i]->d_name));
+		bench_state (path);
+
+		free (entries[i]);
+	}
+
+	free (entries);
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+/* upstart
+ *
+ * bench_util.c - timing helpers shared by the benchmarks
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/logging.h>
+
+#include "bench_util.h"
+
+
+/* Prototypes for static functions */
+static int      bench_cmp        (const void *a, const void *b);
+static uint64_t bench_percentile (const BenchSamples *samples,
+				  unsigned int percent);
+
+
+/**
+ * bench_now:
+ *
+ * Returns: current value of the monotonic clock in nanoseconds.
+ **/
+uint64_t
+bench_now (void)
+{
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) < 0)
+		nih_assert_not_reached ();
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * bench_samples_new:
+ * @parent: parent object for new structure,
+ * @name: what is being measured.
+ *
+ * Allocates and returns a new, empty, BenchSamples structure.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned structure.  When all parents
+ * of the returned structure are freed, the returned structure will also be
+ * freed.
+ *
+ * Returns: newly allocated BenchSamples structure.
+ **/
+BenchSamples *
+bench_samples_new (const void *parent,
+		   const char *name)
+{
+	BenchSamples *samples;
+
+	nih_assert (name != NULL);
+
+	samples = NIH_MUST (nih_new (parent, BenchSamples));
+
+	samples->name = NIH_MUST (nih_strdup (samples, name));
+	samples->size = 1024;
+	samples->len = 0;
+	samples->ns = NIH_MUST (nih_alloc (samples,
+					   sizeof (uint64_t) * samples->size));
+
+	return samples;
+}
+
+/**
+ * bench_samples_add:
+ * @samples: samples to add to,
+ * @ns: duration of the operation in nanoseconds.
+ *
+ * Records the duration of one more operation in @samples.
+ **/
+void
+bench_samples_add (BenchSamples *samples,
+		   uint64_t      ns)
+{
+	nih_assert (samples != NULL);
+
+	if (samples->len == samples->size) {
+		samples->size *= 2;
+		samples->ns = NIH_MUST (nih_realloc (samples->ns, samples,
+						     sizeof (uint64_t)
+						     * samples->size));
+	}
+
+	samples->ns[samples->len++] = ns;
+}
+
+/**
+ * bench_report:
+ * @samples: samples to report on.
+ *
+ * Outputs a line giving the number of operations in @samples, the
+ * throughput in operations per second over their total duration and the
+ * 50th, 90th and 99th percentile and maximum latency.  The samples are
+ * sorted as a side-effect.
+ **/
+void
+bench_report (BenchSamples *samples)
+{
+	uint64_t total = 0;
+
+	nih_assert (samples != NULL);
+
+	if (! samples->len) {
+		printf ("%-44s %8s\n", samples->name, "-");
+		return;
+	}
+
+	for (size_t i = 0; i < samples->len; i++)
+		total += samples->ns[i];
+
+	qsort (samples->ns, samples->len, sizeof (uint64_t), bench_cmp);
+
+	printf ("%-44s %8zu ops %12.0f ops/s  "
+		"p50 %9.2fus  p90 %9.2fus  p99 %9.2fus  max %9.2fus\n",
+		samples->name, samples->len,
+		total ? samples->len * 1e9 / total : 0.0,
+		bench_percentile (samples, 50) / 1e3,
+		bench_percentile (samples, 90) / 1e3,
+		bench_percentile (samples, 99) / 1e3,
+		samples->ns[samples->len - 1] / 1e3);
+	fflush (stdout);
+}
+
+
+/**
+ * bench_cmp:
+ * @a: first duration,
+ * @b: second duration.
+ *
+ * qsort() comparison function for durations.
+ *
+ * Returns: negative, zero or positive as @a is less than, equal to or
+ * greater than @b.
+ **/
+static int
+bench_cmp (const void *a,
+	   const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * bench_percentile:
+ * @samples: sorted samples,
+ * @percent: percentile to return.
+ *
+ * Returns: duration below which @percent percent of @samples lie.
+ **/
+static uint64_t
+bench_percentile (const BenchSamples *samples,
+		  unsigned int        percent)
+{
+	size_t i;
+
+	nih_assert (samples != NULL);
+	nih_assert (samples->len > 0);
+	nih_assert (percent <= 100);
+
+	i = (samples->len * percent + 99) / 100;
+
+	return samples->ns[i ? i - 1 : 0];
+}
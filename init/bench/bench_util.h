@@ -0,0 +1,62 @@
+/* upstart
+ *
+ * bench_util.h - timing helpers shared by the benchmarks
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_BENCH_UTIL_H
+#define INIT_BENCH_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nih/macros.h>
+
+
+/**
+ * BenchSamples:
+ * @name: what was measured,
+ * @ns: duration of each operation in nanoseconds,
+ * @len: number of entries in @ns,
+ * @size: allocated size of @ns.
+ *
+ * This structure holds the latencies of a number of operations of the
+ * same kind, from which bench_report() derives the throughput and
+ * percentiles.
+ **/
+typedef struct bench_samples {
+	char     *name;
+	uint64_t *ns;
+	size_t    len;
+	size_t    size;
+} BenchSamples;
+
+
+NIH_BEGIN_EXTERN
+
+uint64_t      bench_now         (void);
+
+BenchSamples *bench_samples_new (const void *parent, const char *name)
+	__attribute__ ((warn_unused_result, malloc));
+
+void          bench_samples_add (BenchSamples *samples, uint64_t ns);
+
+void          bench_report      (BenchSamples *samples);
+
+NIH_END_EXTERN
+
+#endif /* INIT_BENCH_UTIL_H */
@@ -81,10 +81,45 @@ char *cgroup_manager_address = NULL;
  **/
 NihDBusProxy *cgroup_manager = NULL;
 
+/**
+ * cgroup_manager_async:
+ *
+ * Proxy to the cgroup manager used by init itself to create and
+ * configure cgroups asynchronously before spawning job processes.
+ *
+ * Note: Never used by child processes.
+ **/
+static NihDBusProxy *cgroup_manager_async = NULL;
+
 static void cgroup_manager_disconnected (DBusConnection *connection);
+static void cgroup_manager_async_disconnected (DBusConnection *connection);
+
+static NihDBusProxy *cgroup_manager_proxy_new (NihDBusDisconnectHandler handler)
+	__attribute__ ((warn_unused_result));
 
 static void cgroup_name_remap (char *str);
 
+static char **cgroup_environment (const void *parent, char * const *env)
+	__attribute__ ((warn_unused_result));
+
+static char *cgroup_name_expand (const void *parent, const char *name,
+		char * const *cgroup_env)
+	__attribute__ ((warn_unused_result));
+
+static int  cgroup_request_destroy      (CGroupRequest *request);
+static int  cgroup_request_add_call     (CGroupRequest *request,
+					 DBusPendingCall *call)
+	__attribute__ ((warn_unused_result));
+static void cgroup_request_reply        (CGroupRequest *request,
+					 NihDBusMessage *message);
+static void cgroup_request_create_reply (CGroupRequest *request,
+					 NihDBusMessage *message,
+					 int32_t existed);
+static void cgroup_request_error        (CGroupRequest *request,
+					 NihDBusMessage *message);
+static void cgroup_request_complete     (CGroupRequest *request);
+static void cgroup_request_release      (CGroupRequest *request);
+
 /**
  * cgroup_support_enabled:
  *
@@ -372,25 +407,10 @@ cgroup_setup (NihList       *cgroups,
 	      uid_t          uid,
 	      gid_t          gid)
 {
-	const char       *upstart_job = NULL;
-	const char       *upstart_instance = NULL;
-	nih_local char   *suffix = NULL;
 	nih_local char  **cgroup_env = NULL;
-	nih_local char   *envvar = NULL;
-	int               instance = FALSE;
 	uid_t             current_uid;
 	gid_t             current_gid;
 
-	/* Value of $UPSTART_CGROUP which takes the form:
-	 *
-	 *     upstart/${UPSTART_JOB}
-	 *
-	 * Or for instance jobs:
-	 *
-	 *     upstart/${UPSTART_JOB}-${UPSTART_INSTANCE}
-	 */
-	nih_local char   *upstart_cgroup = NULL;
-
 	nih_assert (cgroups);
 	nih_assert (env);
 
@@ -405,46 +425,9 @@ cgroup_setup (NihList       *cgroups,
 	current_uid = geteuid ();
 	current_gid = getegid ();
 
-	cgroup_env = nih_str_array_new (NULL);
+	cgroup_env = cgroup_environment (NULL, env);
 	if (! cgroup_env)
-		nih_return_no_memory_error (FALSE);
-
-	/* Copy the existing environment table */
-	if (! environ_append (&cgroup_env, NULL, NULL, TRUE, env))
-		nih_return_no_memory_error (FALSE);
-
-	upstart_job = environ_get (cgroup_env, "UPSTART_JOB");
-	nih_assert (upstart_job);
-
-	upstart_instance = environ_get (cgroup_env, "UPSTART_INSTANCE");
-	nih_assert (upstart_instance);
-
-	if (*upstart_instance)
-		instance = TRUE;
-
-	/* Construct the value of $UPSTART_CGROUP */
-	suffix = nih_sprintf (NULL, "%s%s%s",
-			upstart_job,
-			instance ? "-" : "",
-			instance ? upstart_instance : "");
-
-	if (! suffix)
-		nih_return_no_memory_error (FALSE);
-
-	/* Remap the standard prefix to avoid creating sub-cgroups erroneously */
-	cgroup_name_remap (suffix);
-
-	upstart_cgroup = nih_sprintf (NULL, "upstart/%s", suffix);
-
-	if (! upstart_cgroup)
-		nih_return_no_memory_error (FALSE);
-
-	envvar = NIH_MUST (nih_sprintf (NULL, "%s=%s",
-				UPSTART_CGROUP_ENVVAR,
-				upstart_cgroup));
-
-	if (! environ_add (&cgroup_env, NULL, NULL, TRUE, envvar))
-		nih_return_no_memory_error (FALSE);
+		return FALSE;
 
 	NIH_LIST_FOREACH (cgroups, iter) {
 		CGroup *cgroup = (CGroup *)iter;
@@ -452,35 +435,14 @@ cgroup_setup (NihList       *cgroups,
 		NIH_LIST_FOREACH (&cgroup->names, iter2) {
 			CGroupName   *cgname = (CGroupName *)iter2;
 			char         *cgpath;
-			char         *p;
-
-			/* TRUE if the path *starts with* '$UPSTART_CGROUP' */
-			int           has_var = FALSE;
-			size_t        len;
 
-			/* Note that we don't support "${UPSTART_CGROUP}" */
-			p = strstr (cgname->name, UPSTART_CGROUP_SHELL_ENVVAR);
-
-			/* cgroup specifies UPSTART_CGROUP initially */
-			if (p && p == cgname->name)
-				has_var = TRUE;
-
-			cgname->expanded = environ_expand (cgname,
+			cgname->expanded = cgroup_name_expand (cgname,
 						cgname->name,
 						cgroup_env);
 
 			if (! cgname->expanded)
 				return FALSE;
 
-			len = strlen (cgname->expanded);
-
-			/* Remap slash to underscore to avoid unexpected
-			 * sub-cgroup creation.
-			 */
-			cgroup_name_remap (has_var && len > strlen (UPSTART_CGROUP_SHELL_ENVVAR)
-					? cgname->expanded + strlen (UPSTART_CGROUP_SHELL_ENVVAR)
-					: cgname->expanded);
-
 			if (! strcmp (cgname->name, cgname->expanded)) {
 				/* expanded value is the same as the
 				 * original, so don't bother storing the
@@ -513,6 +475,138 @@ cgroup_setup (NihList       *cgroups,
 	return TRUE;
 }
 
+/**
+ * cgroup_environment:
+ *
+ * @parent: parent of returned environment,
+ * @env: environment table.
+ *
+ * Construct the environment used to expand cgroup names, which is
+ * a copy of @env with UPSTART_CGROUP_ENVVAR added.
+ *
+ * Returns: newly-allocated environment table, or NULL on raised error.
+ **/
+static char **
+cgroup_environment (const void    *parent,
+		    char * const  *env)
+{
+	const char       *upstart_job = NULL;
+	const char       *upstart_instance = NULL;
+	nih_local char   *suffix = NULL;
+	char            **cgroup_env = NULL;
+	nih_local char   *envvar = NULL;
+	int               instance = FALSE;
+
+	/* Value of $UPSTART_CGROUP which takes the form:
+	 *
+	 *     upstart/${UPSTART_JOB}
+	 *
+	 * Or for instance jobs:
+	 *
+	 *     upstart/${UPSTART_JOB}-${UPSTART_INSTANCE}
+	 */
+	nih_local char   *upstart_cgroup = NULL;
+
+	nih_assert (env);
+
+	cgroup_env = nih_str_array_new (parent);
+	if (! cgroup_env)
+		nih_return_no_memory_error (NULL);
+
+	/* Copy the existing environment table */
+	if (! environ_append (&cgroup_env, parent, NULL, TRUE, env))
+		goto no_memory;
+
+	upstart_job = environ_get (cgroup_env, "UPSTART_JOB");
+	nih_assert (upstart_job);
+
+	upstart_instance = environ_get (cgroup_env, "UPSTART_INSTANCE");
+	nih_assert (upstart_instance);
+
+	if (*upstart_instance)
+		instance = TRUE;
+
+	/* Construct the value of $UPSTART_CGROUP */
+	suffix = nih_sprintf (NULL, "%s%s%s",
+			upstart_job,
+			instance ? "-" : "",
+			instance ? upstart_instance : "");
+
+	if (! suffix)
+		goto no_memory;
+
+	/* Remap the standard prefix to avoid creating sub-cgroups erroneously */
+	cgroup_name_remap (suffix);
+
+	upstart_cgroup = nih_sprintf (NULL, "upstart/%s", suffix);
+
+	if (! upstart_cgroup)
+		goto no_memory;
+
+	envvar = NIH_MUST (nih_sprintf (NULL, "%s=%s",
+				UPSTART_CGROUP_ENVVAR,
+				upstart_cgroup));
+
+	if (! environ_add (&cgroup_env, parent, NULL, TRUE, envvar))
+		goto no_memory;
+
+	return cgroup_env;
+
+no_memory:
+	nih_free (cgroup_env);
+	nih_return_no_memory_error (NULL);
+}
+
+/**
+ * cgroup_name_expand:
+ *
+ * @parent: parent of returned string,
+ * @name: cgroup name to expand,
+ * @cgroup_env: environment returned by cgroup_environment().
+ *
+ * Expand all variables in @name using @cgroup_env and remap any slashes
+ * introduced by the expansion to avoid unexpected sub-cgroup creation.
+ *
+ * Returns: newly-allocated expanded name, or NULL on raised error.
+ **/
+static char *
+cgroup_name_expand (const void    *parent,
+		    const char    *name,
+		    char * const  *cgroup_env)
+{
+	char         *expanded;
+	char         *p;
+
+	/* TRUE if the path *starts with* '$UPSTART_CGROUP' */
+	int           has_var = FALSE;
+	size_t        len;
+
+	nih_assert (name);
+	nih_assert (cgroup_env);
+
+	/* Note that we don't support "${UPSTART_CGROUP}" */
+	p = strstr (name, UPSTART_CGROUP_SHELL_ENVVAR);
+
+	/* cgroup specifies UPSTART_CGROUP initially */
+	if (p && p == name)
+		has_var = TRUE;
+
+	expanded = environ_expand (parent, name, cgroup_env);
+	if (! expanded)
+		return NULL;
+
+	len = strlen (expanded);
+
+	/* Remap slash to underscore to avoid unexpected
+	 * sub-cgroup creation.
+	 */
+	cgroup_name_remap (has_var && len > strlen (UPSTART_CGROUP_SHELL_ENVVAR)
+			? expanded + strlen (UPSTART_CGROUP_SHELL_ENVVAR)
+			: expanded);
+
+	return expanded;
+}
+
 /**
  * cgroup_name_new:
  *
@@ -1028,37 +1122,60 @@ cgroup_manager_set_address (const char *address)
  **/
 int
 cgroup_manager_connect (void)
+{
+	nih_assert (cgroup_manager_address);
+	nih_assert (! cgroup_manager);
+
+	cgroup_manager = cgroup_manager_proxy_new (cgroup_manager_disconnected);
+	if (! cgroup_manager)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * cgroup_manager_proxy_new:
+ *
+ * @handler: function to call if the connection is dropped.
+ *
+ * Connect to the cgroup manager and create a proxy for it.
+ *
+ * Returns: newly-allocated proxy, or NULL on raised error.
+ **/
+static NihDBusProxy *
+cgroup_manager_proxy_new (NihDBusDisconnectHandler handler)
 {
 	DBusConnection  *connection;
 	DBusError        dbus_error;
+	NihDBusProxy    *proxy;
 
 	nih_assert (cgroup_manager_address);
-	nih_assert (! cgroup_manager);
+	nih_assert (handler);
 
 	dbus_error_init (&dbus_error);
 
-	connection = nih_dbus_connect (cgroup_manager_address, cgroup_manager_disconnected);
+	connection = nih_dbus_connect (cgroup_manager_address, handler);
 	if (! connection)
-		return -1;
+		return NULL;
 
 	dbus_connection_set_exit_on_disconnect (connection, FALSE);
 	dbus_error_free (&dbus_error);
 
-	cgroup_manager = nih_dbus_proxy_new (NULL, connection,
-					     NULL, /* peer-to-peer connection */
-					     DBUS_PATH_CGMANAGER,
-					     NULL, NULL);
-	if (! cgroup_manager) {
+	proxy = nih_dbus_proxy_new (NULL, connection,
+				    NULL, /* peer-to-peer connection */
+				    DBUS_PATH_CGMANAGER,
+				    NULL, NULL);
+	if (! proxy) {
 		dbus_connection_unref (connection);
-		return -1;
+		return NULL;
 	}
 
-	cgroup_manager->auto_start = FALSE;
+	proxy->auto_start = FALSE;
 
 	/* Drop initial reference now the proxy holds one */
 	dbus_connection_unref (connection);
 
-	return 0;
+	return proxy;
 }
 
 /**
@@ -1078,6 +1195,25 @@ cgroup_manager_disconnected (DBusConnection *connection)
 	cgroup_manager_address = NULL;
 }
 
+/**
+ * cgroup_manager_async_disconnected:
+ *
+ * This function is called when the connection init itself holds to the
+ * cgroup manager is dropped.
+ *
+ * Outstanding requests fail as their calls are answered with errors;
+ * the next request will reconnect.
+ **/
+static void
+cgroup_manager_async_disconnected (DBusConnection *connection)
+{
+	nih_assert (connection);
+
+	nih_warn (_("Disconnected from cgroup manager"));
+
+	cgroup_manager_async = NULL;
+}
+
 /**
  * cgroup_create:
  * @controller: cgroup controller,
@@ -1463,3 +1599,380 @@ cgroup_chown (const char  *controller,
 
 	return TRUE;
 }
+
+/**
+ * cgroup_chown_groups:
+ *
+ * @cgroups: list of CGroup objects with expanded names,
+ * @uid: user id to change ownership to,
+ * @gid: group id to change ownership to.
+ *
+ * Change the ownership of every cgroup in @cgroups, unless @uid and
+ * @gid are those the caller is already running as.
+ *
+ * Returns: TRUE on success, FALSE on raised error.
+ **/
+int
+cgroup_chown_groups (NihList  *cgroups,
+		     uid_t     uid,
+		     gid_t     gid)
+{
+	nih_assert (cgroups);
+
+	if ((uid == geteuid ()) && (gid == getegid ())) {
+		/* No need to chown */
+		return TRUE;
+	}
+
+	NIH_LIST_FOREACH (cgroups, iter) {
+		CGroup *cgroup = (CGroup *)iter;
+
+		NIH_LIST_FOREACH (&cgroup->names, iter2) {
+			CGroupName      *cgname = (CGroupName *)iter2;
+
+			if (! cgroup_chown (cgroup->controller,
+						cgname->expanded
+						? cgname->expanded
+						: cgname->name,
+						uid, gid))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * cgroup_request_new:
+ *
+ * @parent: parent of new CGroupRequest,
+ * @cgroups: list of CGroup objects,
+ * @env: environment table,
+ * @clear: TRUE to have the cgroups removed once empty,
+ * @handler: function to call on completion,
+ * @data: pointer to pass to @handler.
+ *
+ * Use @env to expand all variables in the cgroup names specified in
+ * @cgroups and ask the cgroup manager to create the resulting cgroups
+ * and apply their settings; if @clear is TRUE, the cgroup manager is
+ * also asked to remove the cgroups once no processes remain in them.
+ *
+ * Unlike cgroup_setup(), this is called by init itself and does not
+ * block: all of the calls are sent at once over a single connection,
+ * which the cgroup manager answers in order, and @handler is called
+ * from the main loop once every one of them has been replied to.  The
+ * cgroups are created relative to the cgroup of init rather than that
+ * of the job process, which is where the process would otherwise have
+ * moved itself to first.
+ *
+ * The returned request holds the expanded names, which may be passed
+ * to cgroup_chown_groups() and cgroup_enter_groups() in the job
+ * process.  Freeing it cancels any calls not yet replied to, in which
+ * case @handler is not called.
+ *
+ * If @parent is not NULL, it should be a pointer to another allocated
+ * block which will be used as the parent for this block.  When @parent
+ * is freed, the returned block will be freed too.
+ *
+ * Returns: newly-allocated CGroupRequest, or NULL on raised error.
+ **/
+CGroupRequest *
+cgroup_request_new (const void            *parent,
+		    NihList               *cgroups,
+		    char * const          *env,
+		    int                    clear,
+		    CGroupRequestHandler   handler,
+		    void                  *data)
+{
+	CGroupRequest    *request;
+	nih_local char  **cgroup_env = NULL;
+
+	nih_assert (cgroups);
+	nih_assert (env);
+	nih_assert (handler);
+	nih_assert (cgroup_manager_available ());
+
+	if (! cgroup_manager_async) {
+		cgroup_manager_async = cgroup_manager_proxy_new (
+				cgroup_manager_async_disconnected);
+		if (! cgroup_manager_async)
+			return NULL;
+	}
+
+	cgroup_env = cgroup_environment (NULL, env);
+	if (! cgroup_env)
+		return NULL;
+
+	request = nih_new (parent, CGroupRequest);
+	if (! request)
+		nih_return_no_memory_error (NULL);
+
+	nih_list_init (&request->cgroups);
+
+	request->calls = 0;
+	request->pending = NULL;
+	request->num_pending = 0;
+	request->error = NULL;
+	request->handler = handler;
+	request->data = data;
+
+	nih_alloc_set_destructor (request, cgroup_request_destroy);
+
+	NIH_LIST_FOREACH (cgroups, iter) {
+		CGroup *cgroup = (CGroup *)iter;
+		CGroup *copy;
+
+		copy = cgroup_new (request, cgroup->controller);
+		if (! copy)
+			goto no_memory;
+
+		nih_list_add (&request->cgroups, &copy->entry);
+
+		NIH_LIST_FOREACH (&cgroup->names, iter2) {
+			CGroupName      *cgname = (CGroupName *)iter2;
+			CGroupName      *name;
+			nih_local char  *cgpath = NULL;
+			DBusPendingCall *call;
+
+			cgpath = cgroup_name_expand (NULL, cgname->name,
+						     cgroup_env);
+			if (! cgpath)
+				goto error;
+
+			name = cgroup_name_new (copy, cgpath);
+			if (! name)
+				goto no_memory;
+
+			nih_list_add (&copy->names, &name->entry);
+
+			call = cgmanager_create (cgroup_manager_async,
+					cgroup->controller,
+					cgpath,
+					(CgmanagerCreateReply)cgroup_request_create_reply,
+					(NihDBusErrorHandler)cgroup_request_error,
+					request,
+					NIH_DBUS_TIMEOUT_DEFAULT);
+			if (! cgroup_request_add_call (request, call))
+				goto error;
+
+			NIH_LIST_FOREACH (&cgname->settings, iter3) {
+				CGroupSetting  *setting = (CGroupSetting *)iter3;
+				nih_local char *setting_key = NULL;
+
+				/* setting files in a cgroup directory take the form "controller.key" */
+				setting_key = nih_sprintf (NULL, "%s.%s",
+						cgroup->controller, setting->key);
+				if (! setting_key)
+					goto no_memory;
+
+				call = cgmanager_set_value (cgroup_manager_async,
+						cgroup->controller,
+						cgpath,
+						setting_key,
+						setting->value ? setting->value : "",
+						(CgmanagerSetValueReply)cgroup_request_reply,
+						(NihDBusErrorHandler)cgroup_request_error,
+						request,
+						NIH_DBUS_TIMEOUT_DEFAULT);
+				if (! cgroup_request_add_call (request, call))
+					goto error;
+			}
+
+			if (! clear)
+				continue;
+
+			call = cgmanager_remove_on_empty (cgroup_manager_async,
+					cgroup->controller,
+					cgpath,
+					(CgmanagerRemoveOnEmptyReply)cgroup_request_reply,
+					(NihDBusErrorHandler)cgroup_request_error,
+					request,
+					NIH_DBUS_TIMEOUT_DEFAULT);
+			if (! cgroup_request_add_call (request, call))
+				goto error;
+		}
+	}
+
+	return request;
+
+no_memory:
+	nih_error_raise_no_memory ();
+
+error:
+	nih_free (request);
+	return NULL;
+}
+
+/**
+ * cgroup_request_destroy:
+ *
+ * @request: request being destroyed.
+ *
+ * Cancel any calls made for @request that have not yet been replied to,
+ * so that their handlers are not called.
+ *
+ * Returns: zero.
+ **/
+static int
+cgroup_request_destroy (CGroupRequest *request)
+{
+	nih_assert (request);
+
+	for (size_t i = 0; i < request->num_pending; i++)
+		dbus_pending_call_cancel (request->pending[i]);
+
+	cgroup_request_release (request);
+
+	return 0;
+}
+
+/**
+ * cgroup_request_add_call:
+ *
+ * @request: request,
+ * @call: pending call made for @request, or NULL on raised error.
+ *
+ * Record @call against @request.
+ *
+ * Returns: TRUE on success, FALSE on raised error.
+ **/
+static int
+cgroup_request_add_call (CGroupRequest    *request,
+			 DBusPendingCall  *call)
+{
+	DBusPendingCall **pending;
+
+	nih_assert (request);
+
+	if (! call)
+		return FALSE;
+
+	pending = nih_realloc (request->pending, request,
+			       sizeof (DBusPendingCall *)
+			       * (request->num_pending + 1));
+	if (! pending) {
+		dbus_pending_call_cancel (call);
+		dbus_pending_call_unref (call);
+		nih_return_no_memory_error (FALSE);
+	}
+
+	request->pending = pending;
+	request->pending[request->num_pending++] = call;
+	request->calls++;
+
+	return TRUE;
+}
+
+/**
+ * cgroup_request_reply:
+ *
+ * @request: request,
+ * @message: reply message.
+ *
+ * Called when the cgroup manager replies successfully to a call made
+ * for @request.
+ **/
+static void
+cgroup_request_reply (CGroupRequest   *request,
+		      NihDBusMessage  *message)
+{
+	nih_assert (request);
+	nih_assert (message);
+
+	cgroup_request_complete (request);
+}
+
+/**
+ * cgroup_request_create_reply:
+ *
+ * @request: request,
+ * @message: reply message,
+ * @existed: TRUE if the cgroup already existed.
+ *
+ * Called when the cgroup manager replies successfully to a request to
+ * create a cgroup for @request.
+ **/
+static void
+cgroup_request_create_reply (CGroupRequest   *request,
+			     NihDBusMessage  *message,
+			     int32_t          existed)
+{
+	nih_assert (request);
+	nih_assert (message);
+
+	cgroup_request_complete (request);
+}
+
+/**
+ * cgroup_request_error:
+ *
+ * @request: request,
+ * @message: reply message.
+ *
+ * Called with an error raised when a call made for @request fails;
+ * the first such error is stored in @request.
+ **/
+static void
+cgroup_request_error (CGroupRequest   *request,
+		      NihDBusMessage  *message)
+{
+	NihError *err;
+
+	nih_assert (request);
+
+	err = nih_error_get ();
+
+	if (! request->error) {
+		request->error = err;
+		nih_ref (err, request);
+	} else {
+		nih_free (err);
+	}
+
+	cgroup_request_complete (request);
+}
+
+/**
+ * cgroup_request_complete:
+ *
+ * @request: request.
+ *
+ * Account for a reply to one of the calls made for @request, calling
+ * the handler once all have been replied to.  The handler may free
+ * @request.
+ **/
+static void
+cgroup_request_complete (CGroupRequest *request)
+{
+	nih_assert (request);
+	nih_assert (request->calls > 0);
+
+	if (--request->calls)
+		return;
+
+	cgroup_request_release (request);
+
+	request->handler (request->data, request);
+}
+
+/**
+ * cgroup_request_release:
+ *
+ * @request: request.
+ *
+ * Drop our references to the pending calls made for @request.
+ **/
+static void
+cgroup_request_release (CGroupRequest *request)
+{
+	nih_assert (request);
+
+	for (size_t i = 0; i < request->num_pending; i++)
+		dbus_pending_call_unref (request->pending[i]);
+
+	if (request->pending)
+		nih_free (request->pending);
+
+	request->pending = NULL;
+	request->num_pending = 0;
+}
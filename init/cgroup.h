@@ -22,7 +22,11 @@
 #ifndef INIT_CGROUP_H
 #define INIT_CGROUP_H
 
+#include <dbus/dbus.h>
+
 #include <nih/hash.h>
+#include <nih/list.h>
+#include <nih/error.h>
 #include <json.h>
 
 /**
@@ -118,6 +122,45 @@ typedef struct cgroup {
 	NihList         names;
 } CGroup;
 
+typedef struct cgroup_request CGroupRequest;
+
+/**
+ * CGroupRequestHandler:
+ * @data: data pointer passed to cgroup_request_new(),
+ * @request: request that has completed.
+ *
+ * A request handler is called once the cgroup manager has replied to
+ * every call made for @request; the error member of @request is set if
+ * any of those calls failed.
+ **/
+typedef void (*CGroupRequestHandler) (void *data, CGroupRequest *request);
+
+/**
+ * CGroupRequest:
+ *
+ * @cgroups: list of CGroup objects naming the cgroups being set up, with
+ *  all variables in their names expanded,
+ * @calls: number of calls to the cgroup manager not yet replied to,
+ * @pending: array of pending calls to the cgroup manager,
+ * @num_pending: number of entries in @pending,
+ * @error: first error returned by the cgroup manager, or NULL,
+ * @handler: function to call once @calls reaches zero,
+ * @data: pointer to pass to @handler.
+ *
+ * Representation of a batch of asynchronous calls made by init to the
+ * cgroup manager to create and configure the cgroups for a job process
+ * before that process is spawned.
+ **/
+struct cgroup_request {
+	NihList               cgroups;
+	size_t                calls;
+	DBusPendingCall     **pending;
+	size_t                num_pending;
+	NihError             *error;
+	CGroupRequestHandler  handler;
+	void                 *data;
+};
+
 NIH_BEGIN_EXTERN
 
 void cgroup_init (void);
@@ -183,6 +226,14 @@ int cgroup_chown (const char *controller,
 		  uid_t uid, gid_t gid)
 	__attribute__ ((warn_unused_result));
 
+int cgroup_chown_groups (NihList *cgroups, uid_t uid, gid_t gid)
+	__attribute__ ((warn_unused_result));
+
+CGroupRequest *cgroup_request_new (const void *parent, NihList *cgroups,
+		char * const *env, int clear,
+		CGroupRequestHandler handler, void *data)
+	__attribute__ ((warn_unused_result));
+
 json_object *cgroup_manager_serialise (void)
 	__attribute__ ((warn_unused_result));
 
@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <libgen.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <nih/macros.h>
@@ -47,9 +48,11 @@
 #include "parse_job.h"
 #include "parse_conf.h"
 #include "conf.h"
+#include "job_process.h"
 #include "errors.h"
 #include "paths.h"
 #include "environ.h"
+#include "stats.h"
 
 /* Prototypes for static functions */
 static int  conf_source_reload_file    (ConfSource *source)
@@ -75,6 +78,17 @@ static int  conf_reload_path           (ConfSource *source, const char *path,
 					const char *override_path)
 	__attribute__ ((warn_unused_result));
 
+static int  conf_file_unchanged        (ConfFile *file)
+	__attribute__ ((warn_unused_result));
+static void conf_fingerprint_set       (ConfFingerprint *fp,
+					const struct stat *statbuf,
+					const char *buf, size_t len);
+static int  conf_fingerprint_check     (ConfFingerprint *fp,
+					const char *path)
+	__attribute__ ((warn_unused_result));
+static uint64_t conf_fingerprint_hash  (const char *buf, size_t len)
+	__attribute__ ((warn_unused_result));
+
 static inline int  is_conf_file        (const char *path)
 	__attribute__ ((warn_unused_result));
 
@@ -87,10 +101,24 @@ static inline int is_conf_file_override(const char *path)
 static inline char *toggle_conf_name   (const void *parent, const char *path)
 	__attribute__ ((warn_unused_result));
 
+static inline const char *conf_job_name_span (const char *source_path,
+					      const char *conf_path,
+					      size_t     *len);
+
 static inline char * conf_to_job_name  (const char *source_path,
                                         const char *conf_path)
 	__attribute__ ((warn_unused_result));
 
+static ConfIndexEntry *conf_index_add  (NihHash *hash, const char *name,
+					ConfFile *file)
+	__attribute__ ((warn_unused_result));
+static int  conf_index_destroy         (ConfIndex *index);
+static int  conf_index_hash_destroy    (NihHash *hash);
+static void conf_index_remove          (ConfIndexEntry **entry);
+static int  conf_source_before         (const ConfSource *source,
+					const ConfSource *other);
+static void conf_file_unindex          (ConfFile *file);
+
 static char * conf_get_best_override   (const char *name,
                                         const ConfSource *last_source)
 	__attribute__ ((warn_unused_result));
@@ -121,6 +149,25 @@ const char *session_file = NULL;
  **/
 NihList *conf_sources = NULL;
 
+/**
+ * conf_job_index:
+ *
+ * This hash table indexes the files of job configuration sources by the
+ * name of the job they define, so that the best job of a given name can
+ * be found without searching every file of every source.  Each item is a
+ * ConfIndex structure listing the files in order of the priority of
+ * their sources.
+ **/
+NihHash *conf_job_index = NULL;
+
+/**
+ * conf_file_index:
+ *
+ * This hash table indexes the files of all configuration sources by
+ * their name without directory, in the same way as conf_job_index.
+ **/
+NihHash *conf_file_index = NULL;
+
 extern json_object *json_conf_sources;
 
 /**
@@ -196,26 +243,28 @@ is_conf_file (const char *path)
 }
 
 /**
- * conf_to_job_name:
+ * conf_job_name_span:
  * @source_path: path to ConfSource
  * @conf_path: path to configuration file
+ * @len: pointer to set to length of name.
  *
- * Constructs the job name for a given @conf_path. Removes
- * @source_path directory name from the front of @conf_path and
- * extension from the end.
- *
- * Returns: newly-allocated name.
+ * Finds the job name for a given @conf_path within it, without
+ * @source_path directory name at the front of @conf_path or extension
+ * at the end.
  *
+ * Returns: start of name within @conf_path.
  **/
-static inline char *
-conf_to_job_name (const char * source_path, const char * conf_path)
+static inline const char *
+conf_job_name_span (const char *source_path,
+		    const char *conf_path,
+		    size_t     *len)
 {
 	const char *start, *end;
-	char       *name = NULL;
 	int        source_len;
 
 	nih_assert (source_path != NULL);
 	nih_assert (conf_path != NULL);
+	nih_assert (len != NULL);
 
 	start = conf_path;
 	source_len = strlen (source_path);
@@ -227,12 +276,36 @@ conf_to_job_name (const char * source_path, const char * conf_path)
 		start++;
 
 	end = strrchr (start, '.');
-	if (end && IS_CONF_EXT (end))
-		name = NIH_MUST (nih_strndup (NULL, start, end - start));
-	else
-		name = NIH_MUST (nih_strdup (NULL, start));
+	if (end && IS_CONF_EXT (end)) {
+		*len = end - start;
+	} else {
+		*len = strlen (start);
+	}
+
+	return start;
+}
+
+/**
+ * conf_to_job_name:
+ * @source_path: path to ConfSource
+ * @conf_path: path to configuration file
+ *
+ * Constructs the job name for a given @conf_path. Removes
+ * @source_path directory name from the front of @conf_path and
+ * extension from the end.
+ *
+ * Returns: newly-allocated name.
+ *
+ **/
+static inline char *
+conf_to_job_name (const char * source_path, const char * conf_path)
+{
+	const char *start;
+	size_t      len;
+
+	start = conf_job_name_span (source_path, conf_path, &len);
 
-	return name;
+	return NIH_MUST (nih_strndup (NULL, start, len));
 }
 
 
@@ -336,8 +409,18 @@ toggle_conf_name (const void     *parent,
 void
 conf_init (void)
 {
-	if (! conf_sources)
+	if (! conf_sources) {
 		conf_sources = NIH_MUST (nih_list_new (NULL));
+
+		/* The indexes go with the sources they index */
+		conf_job_index = NIH_MUST (nih_hash_string_new (conf_sources, 0));
+		nih_alloc_set_destructor (conf_job_index,
+					  conf_index_hash_destroy);
+
+		conf_file_index = NIH_MUST (nih_hash_string_new (conf_sources, 0));
+		nih_alloc_set_destructor (conf_file_index,
+					  conf_index_hash_destroy);
+	}
 }
 
 /**
@@ -425,8 +508,9 @@ conf_source_new (const void     *parent,
  * Allocates and returns a new ConfFile structure for the given @source,
  * with @path indicating which file it is.
  *
- * The returned structure is automatically placed in the @source's files hash
- * and the flag of the returned ConfFile will be set to that of the @source.
+ * The returned structure is automatically placed in the @source's files hash,
+ * and in conf_job_index and conf_file_index, and the flag of the returned
+ * ConfFile will be set to that of the @source.
  *
  * Returns: newly allocated ConfFile structure or NULL if insufficient memory.
  **/
@@ -434,11 +518,15 @@ ConfFile *
 conf_file_new (ConfSource *source,
 	       const char *path)
 {
-	ConfFile *file;
+	ConfFile   *file;
+	const char *name;
+	size_t      len;
 
 	nih_assert (source != NULL);
 	nih_assert (path != NULL);
 
+	conf_init ();
+
 	file = nih_new (source, ConfFile);
 	if (! file)
 		return NULL;
@@ -455,11 +543,232 @@ conf_file_new (ConfSource *source,
 	file->flag = source->flag;
 	file->data = NULL;
 
+	memset (&file->fingerprint, 0, sizeof (ConfFingerprint));
+	file->override_path = NULL;
+	memset (&file->override_fingerprint, 0, sizeof (ConfFingerprint));
+
+	file->job_entry = NULL;
+	file->name_entry = NULL;
+
 	nih_alloc_set_destructor (file, conf_file_destroy);
 
 	nih_hash_add (source->files, &file->entry);
 
+	if (source->type == CONF_JOB_DIR) {
+		nih_local char *job_name = NULL;
+
+		name = conf_job_name_span (source->path, path, &len);
+
+		job_name = nih_strndup (NULL, name, len);
+		if (! job_name)
+			goto error;
+
+		file->job_entry = conf_index_add (conf_job_index, job_name, file);
+		if (! file->job_entry)
+			goto error;
+	}
+
+	name = strrchr (path, '/');
+	name = name ? name + 1 : path;
+
+	file->name_entry = conf_index_add (conf_file_index, name, file);
+	if (! file->name_entry)
+		goto error;
+
 	return file;
+
+error:
+	nih_free (file);
+	return NULL;
+}
+
+/**
+ * conf_index_add:
+ * @hash: index to add to,
+ * @name: name to index @file by,
+ * @file: file to add.
+ *
+ * Adds @file to the list of files with @name in @hash, creating the list
+ * if there isn't one yet, ahead of any files of lower priority sources.
+ *
+ * Returns: newly allocated ConfIndexEntry structure or NULL if
+ * insufficient memory.
+ **/
+static ConfIndexEntry *
+conf_index_add (NihHash    *hash,
+		const char *name,
+		ConfFile   *file)
+{
+	ConfIndex      *index;
+	ConfIndexEntry *entry;
+
+	nih_assert (hash != NULL);
+	nih_assert (name != NULL);
+	nih_assert (file != NULL);
+
+	index = (ConfIndex *)nih_hash_lookup (hash, name);
+	if (! index) {
+		index = nih_new (hash, ConfIndex);
+		if (! index)
+			return NULL;
+
+		nih_list_init (&index->entry);
+		nih_list_init (&index->files);
+
+		index->name = nih_strdup (index, name);
+		if (! index->name) {
+			nih_free (index);
+			return NULL;
+		}
+
+		nih_alloc_set_destructor (index, conf_index_destroy);
+
+		nih_hash_add (hash, &index->entry);
+	}
+
+	entry = nih_new (file, ConfIndexEntry);
+	if (! entry) {
+		if (NIH_LIST_EMPTY (&index->files))
+			nih_free (index);
+		return NULL;
+	}
+
+	nih_list_init (&entry->entry);
+	entry->index = index;
+	entry->file = file;
+
+	nih_alloc_set_destructor (entry, nih_list_destroy);
+
+	NIH_LIST_FOREACH (&index->files, iter) {
+		ConfIndexEntry *other = (ConfIndexEntry *)iter;
+
+		if (conf_source_before (file->source, other->file->source)) {
+			nih_list_add (&other->entry, &entry->entry);
+			return entry;
+		}
+	}
+
+	nih_list_add (&index->files, &entry->entry);
+
+	return entry;
+}
+
+/**
+ * conf_index_destroy:
+ * @index: ConfIndex being destroyed.
+ *
+ * Removes @index from its hash table, and its entries from it, leaving
+ * them to be freed along with their files.
+ *
+ * Returns: zero.
+ **/
+static int
+conf_index_destroy (ConfIndex *index)
+{
+	nih_assert (index != NULL);
+
+	nih_list_destroy (&index->entry);
+
+	NIH_LIST_FOREACH_SAFE (&index->files, iter) {
+		ConfIndexEntry *entry = (ConfIndexEntry *)iter;
+
+		entry->index = NULL;
+		nih_list_remove (&entry->entry);
+	}
+
+	return 0;
+}
+
+/**
+ * conf_index_hash_destroy:
+ * @hash: conf_job_index or conf_file_index being destroyed.
+ *
+ * Frees the lists in @hash while its bins, from which they must remove
+ * themselves, still exist.
+ *
+ * Returns: zero.
+ **/
+static int
+conf_index_hash_destroy (NihHash *hash)
+{
+	nih_assert (hash != NULL);
+
+	NIH_HASH_FOREACH_SAFE (hash, iter) {
+		nih_free (iter);
+	}
+
+	return 0;
+}
+
+/**
+ * conf_index_remove:
+ * @entry: pointer to entry to remove.
+ *
+ * Frees the entry pointed to by @entry, if any, and the list it was in
+ * if that is now empty, and sets @entry to NULL.
+ **/
+static void
+conf_index_remove (ConfIndexEntry **entry)
+{
+	ConfIndex *index;
+
+	nih_assert (entry != NULL);
+
+	if (! *entry)
+		return;
+
+	index = (*entry)->index;
+
+	nih_free (*entry);
+	*entry = NULL;
+
+	if (index && NIH_LIST_EMPTY (&index->files))
+		nih_free (index);
+}
+
+/**
+ * conf_source_before:
+ * @source: configuration source,
+ * @other: configuration source to compare with.
+ *
+ * Returns: TRUE if @source has a higher priority than @other,
+ * FALSE otherwise.
+ **/
+static int
+conf_source_before (const ConfSource *source,
+		    const ConfSource *other)
+{
+	nih_assert (source != NULL);
+	nih_assert (other != NULL);
+
+	if (source == other)
+		return FALSE;
+
+	NIH_LIST_FOREACH (conf_sources, iter) {
+		if (iter == &source->entry)
+			return TRUE;
+
+		if (iter == &other->entry)
+			return FALSE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * conf_file_unindex:
+ * @file: configuration file.
+ *
+ * Removes @file from conf_job_index and conf_file_index, once it has
+ * been taken out of the files of its source.
+ **/
+static void
+conf_file_unindex (ConfFile *file)
+{
+	nih_assert (file != NULL);
+
+	conf_index_remove (&file->job_entry);
+	conf_index_remove (&file->name_entry);
 }
 
 
@@ -472,9 +781,11 @@ conf_file_new (ConfSource *source,
  * changes will be automatically detected with inotify.  Then for both
  * new and existing sources, the current state is parsed.
  *
- * All ConfFiles are recreated as part of the reload. If the JobClass
- * associated with a ConfSource has no Job instances, the JobClass is
- * recreated and added to the job_classes hash.
+ * Job configuration files that, along with their override files, have not
+ * changed since they were last parsed keep their existing ConfFile and
+ * JobClass.  All other ConfFiles are recreated as part of the reload. If
+ * the JobClass associated with a ConfSource has no Job instances, the
+ * JobClass is recreated and added to the job_classes hash.
  *
  * However, if a JobClass has running instances at reload time, although
  * a new ConfSource *and* a new JobClass are created, the new JobClass
@@ -491,8 +802,12 @@ conf_file_new (ConfSource *source,
 void
 conf_reload (void)
 {
+	uint64_t start;
+
 	conf_init ();
 
+	start = stats_now ();
+
 	NIH_LIST_FOREACH (conf_sources, iter) {
 		ConfSource *source = (ConfSource *)iter;
 
@@ -507,6 +822,10 @@ conf_reload (void)
 			nih_free (err);
 		}
 	}
+
+	job_process_cache_groups ();
+
+	stats_record (STATS_CONF_RELOAD, start);
 }
 
 /**
@@ -566,8 +885,10 @@ conf_source_reload (ConfSource *source)
 	NIH_HASH_FOREACH_SAFE (source->files, iter) {
 		ConfFile *file = (ConfFile *)iter;
 
-		if (file->flag != source->flag)
+		if (file->flag != source->flag) {
 			nih_list_add (&deleted, &file->entry);
+			conf_file_unindex (file);
+		}
 	}
 	NIH_LIST_FOREACH_SAFE (&deleted, iter) {
 		ConfFile *file = (ConfFile *)iter;
@@ -686,9 +1007,10 @@ conf_source_reload_file (ConfSource *source)
  * automatically parsed.  This has the side-effect of parsing the current
  * tree.
  *
- * Otherwise we walk the tree ourselves and parse all files that we find,
- * propagating the value of the flag member to all files so that deletion
- * can be detected by the calling function.
+ * Otherwise we walk the tree ourselves and parse all files that have
+ * changed since they were last parsed, propagating the value of the flag
+ * member to all files so that deletion can be detected by the calling
+ * function.
  *
  * Returns: zero on success, negative value on raised error.
  **/
@@ -1017,7 +1339,9 @@ conf_delete_handler (ConfSource *source,
  * This function is called when walking a directory tree for each file
  * found within it.
  *
- * After checking that it's a regular file, we reload it.
+ * After checking that it's a regular file, we reload it unless neither
+ * it nor its override file have changed since they were last parsed, in
+ * which case we simply mark it as still present.
  *
  * Returns: always zero.
  **/
@@ -1027,6 +1351,8 @@ conf_file_visitor (ConfSource  *source,
 		   const char  *path,
 		   struct stat *statbuf)
 {
+	ConfFile *file;
+
 	nih_assert (source != NULL);
 	nih_assert (dirname != NULL);
 	nih_assert (path != NULL);
@@ -1035,10 +1361,19 @@ conf_file_visitor (ConfSource  *source,
 	if (! S_ISREG (statbuf->st_mode))
 		return 0;
 
-	if (is_conf_file_std (path))
-		conf_load_path_with_override (source, path);
-	
-	return 0;      
+	if (! is_conf_file_std (path))
+		return 0;
+
+	file = (ConfFile *)nih_hash_lookup (source->files, path);
+	if (file && conf_file_unchanged (file)) {
+		nih_debug ("Configuration file %s unchanged", path);
+		file->flag = source->flag;
+		return 0;
+	}
+
+	conf_load_path_with_override (source, path);
+
+	return 0;
 }
 
 
@@ -1076,6 +1411,8 @@ conf_reload_path (ConfSource *source,
 	size_t          len, pos, lineno;
 	NihError       *err = NULL;
 	const char     *path_to_load;
+	struct stat     statbuf;
+	int             have_stat;
 
 	nih_assert (source != NULL);
 	nih_assert (path != NULL);
@@ -1122,12 +1459,15 @@ conf_reload_path (ConfSource *source,
 		 * destroyed.
 		 */
 		nih_list_remove (&orig->entry);
+		conf_file_unindex (orig);
 	}
 
 	/* Read the file into memory for parsing, if this fails we don't
 	 * bother creating a new ConfFile structure for it and bail out
-	 * now.
+	 * now.  Stat it first so that the fingerprint can only ever be
+	 * older than what we parse, never newer.
 	 */
+	have_stat = (stat (path_to_load, &statbuf) == 0);
 	buf = nih_file_read (NULL, path_to_load, &len);
 	if (! buf) {
 		if (! override_path && orig) {
@@ -1150,6 +1490,27 @@ conf_reload_path (ConfSource *source,
 	if (! file)
 		file = NIH_MUST (conf_file_new (source, path));
 
+	/* Record what we are about to parse so that a later mandatory
+	 * reload can tell whether it needs to be parsed again.
+	 */
+	if (override_path) {
+		if (file->override_path)
+			nih_free (file->override_path);
+		file->override_path = NIH_MUST (nih_strdup (file, override_path));
+
+		conf_fingerprint_set (&file->override_fingerprint,
+				      have_stat ? &statbuf : NULL, buf, len);
+	} else {
+		if (file->override_path)
+			nih_free (file->override_path);
+		file->override_path = NULL;
+		memset (&file->override_fingerprint, 0,
+			sizeof (ConfFingerprint));
+
+		conf_fingerprint_set (&file->fingerprint,
+				      have_stat ? &statbuf : NULL, buf, len);
+	}
+
 	pos = 0;
 	lineno = 1;
 
@@ -1245,6 +1606,165 @@ conf_reload_path (ConfSource *source,
 	return 0;
 }
 
+/**
+ * conf_file_unchanged:
+ * @file: configuration file to check.
+ *
+ * Determine whether the job configuration file @file, and the override
+ * file that would be applied to it, are the same as when @file was last
+ * parsed so that its existing JobClass can be kept by a reload.
+ *
+ * Files that failed to parse are never considered unchanged so that
+ * their errors are reported again.
+ *
+ * Returns: TRUE if @file need not be parsed again, FALSE otherwise.
+ **/
+static int
+conf_file_unchanged (ConfFile *file)
+{
+	nih_local char *name = NULL;
+	nih_local char *override_path = NULL;
+
+	nih_assert (file != NULL);
+
+	if (file->source->type != CONF_JOB_DIR || ! file->job)
+		return FALSE;
+
+	if (! conf_fingerprint_check (&file->fingerprint, file->path))
+		return FALSE;
+
+	name = conf_to_job_name (file->source->path, file->path);
+	override_path = conf_get_best_override (name, file->source);
+
+	if (! override_path)
+		return (file->override_path == NULL);
+
+	if ((! file->override_path)
+	    || strcmp (file->override_path, override_path))
+		return FALSE;
+
+	return conf_fingerprint_check (&file->override_fingerprint,
+				       override_path);
+}
+
+/**
+ * conf_fingerprint_set:
+ * @fp: fingerprint to set,
+ * @statbuf: stat of file taken before reading it,
+ * @buf: contents of file,
+ * @len: length of @buf.
+ *
+ * Set @fp to describe the file read into @buf.  If @statbuf is NULL, or
+ * the file changed size between being stat'd and read, @fp is cleared
+ * so that the file will always be parsed again.
+ **/
+static void
+conf_fingerprint_set (ConfFingerprint   *fp,
+		      const struct stat *statbuf,
+		      const char        *buf,
+		      size_t             len)
+{
+	nih_assert (fp != NULL);
+	nih_assert (buf != NULL);
+
+	if ((! statbuf) || (statbuf->st_size != (off_t)len)) {
+		memset (fp, 0, sizeof (ConfFingerprint));
+		return;
+	}
+
+	fp->dev = statbuf->st_dev;
+	fp->ino = statbuf->st_ino;
+	fp->mtime = statbuf->st_mtim;
+	fp->size = statbuf->st_size;
+	fp->hash = conf_fingerprint_hash (buf, len);
+	fp->racy = (statbuf->st_mtim.tv_sec >= time (NULL));
+}
+
+/**
+ * conf_fingerprint_check:
+ * @fp: fingerprint to check,
+ * @path: path to file.
+ *
+ * Compare the file at @path against @fp.  When the device, inode,
+ * modification time and size all match and @fp is not racy, the file is
+ * unchanged without being read.  Otherwise, when only the size matches,
+ * the contents are read and compared against the hash in @fp; a file that
+ * was merely touched or replaced by an identical copy is then unchanged,
+ * and @fp is updated to describe it.
+ *
+ * Returns: TRUE if @path is unchanged, FALSE otherwise.
+ **/
+static int
+conf_fingerprint_check (ConfFingerprint *fp,
+			const char      *path)
+{
+	struct stat     statbuf;
+	nih_local char *buf = NULL;
+	size_t          len;
+
+	nih_assert (fp != NULL);
+	nih_assert (path != NULL);
+
+	if (! fp->ino)
+		return FALSE;
+
+	if (stat (path, &statbuf) < 0)
+		return FALSE;
+
+	if (statbuf.st_size != fp->size)
+		return FALSE;
+
+	if ((! fp->racy)
+	    && (statbuf.st_dev == fp->dev)
+	    && (statbuf.st_ino == fp->ino)
+	    && (statbuf.st_mtim.tv_sec == fp->mtime.tv_sec)
+	    && (statbuf.st_mtim.tv_nsec == fp->mtime.tv_nsec))
+		return TRUE;
+
+	buf = nih_file_read (NULL, path, &len);
+	if (! buf) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_free (err);
+
+		return FALSE;
+	}
+
+	if ((len != (size_t)fp->size)
+	    || (conf_fingerprint_hash (buf, len) != fp->hash))
+		return FALSE;
+
+	conf_fingerprint_set (fp, &statbuf, buf, len);
+
+	return TRUE;
+}
+
+/**
+ * conf_fingerprint_hash:
+ * @buf: data to hash,
+ * @len: length of @buf.
+ *
+ * Hash the contents of a configuration file using 64-bit FNV-1a.
+ *
+ * Returns: hash of @buf.
+ **/
+static uint64_t
+conf_fingerprint_hash (const char *buf,
+		       size_t      len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	nih_assert (buf != NULL);
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)buf[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
 
 /**
  * conf_file_destroy:
@@ -1265,6 +1785,7 @@ conf_file_destroy (ConfFile *file)
 	nih_assert (file != NULL);
 
 	nih_list_destroy (&file->entry);
+	conf_file_unindex (file);
 
 	switch (file->source->type) {
 	case CONF_FILE:
@@ -1310,28 +1831,28 @@ conf_file_destroy (ConfFile *file)
 JobClass *
 conf_select_job (const char *name, const Session *session)
 {
+	ConfIndex *index;
+
 	nih_assert (name != NULL);
 
 	conf_init ();
 
-	NIH_LIST_FOREACH (conf_sources, iter) {
-		ConfSource *source = (ConfSource *)iter;
+	index = (ConfIndex *)nih_hash_lookup (conf_job_index, name);
+	if (! index)
+		return NULL;
 
-		if (source->type != CONF_JOB_DIR)
-			continue;
+	/* Files are listed in order of the priority of their sources */
+	NIH_LIST_FOREACH (&index->files, iter) {
+		ConfFile *file = ((ConfIndexEntry *)iter)->file;
 
-		if (source->session != session)
+		if (file->source->session != session)
 			continue;
 
-		NIH_HASH_FOREACH (source->files, file_iter) {
-			ConfFile *file = (ConfFile *)file_iter;
-
-			if (! file->job)
-				continue;
+		if (! file->job)
+			continue;
 
-			if (! strcmp (file->job->name, name))
-				return file->job;
-		}
+		if (! strcmp (file->job->name, name))
+			return file->job;
 	}
 
 	return NULL;
@@ -1842,6 +2363,7 @@ ConfFile *
 conf_file_find (const char *name, const Session *session)
 {
 	nih_local char  *basename = NULL;
+	ConfIndex       *index;
 
 	nih_assert (name);
 
@@ -1850,26 +2372,18 @@ conf_file_find (const char *name, const Session *session)
 	/* There can only be one ConfFile per session with the same
 	 * basename.
 	 */
-	basename = NIH_MUST (nih_sprintf (NULL, "/%s%s",
+	basename = NIH_MUST (nih_sprintf (NULL, "%s%s",
 				name, CONF_EXT_STD));
 
-	NIH_LIST_FOREACH (conf_sources, iter) {
-		ConfSource *source = (ConfSource *)iter;
-
-		if (source->session != session)
-			continue;
-
-		NIH_HASH_FOREACH (source->files, file_iter) {
-			ConfFile *file = (ConfFile *)file_iter;
-			char     *match;
-			char     *slash;
+	index = (ConfIndex *)nih_hash_lookup (conf_file_index, basename);
+	if (! index)
+		return NULL;
 
-			match = strstr (file->path, basename);
-			slash = strrchr (file->path, '/');
+	NIH_LIST_FOREACH (&index->files, iter) {
+		ConfFile *file = ((ConfIndexEntry *)iter)->file;
 
-			if (match && match == slash)
-				return file;
-		}
+		if (file->source->session == session)
+			return file;
 	}
 
 	return NULL;
@@ -20,6 +20,11 @@
 #ifndef INIT_CONF_H
 #define INIT_CONF_H
 
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <time.h>
+
 #include <nih/macros.h>
 
 #include <nih/hash.h>
@@ -76,12 +81,73 @@ typedef struct conf_source {
 	NihHash            *files;
 } ConfSource;
 
+/**
+ * ConfFingerprint:
+ * @dev: device containing the file,
+ * @ino: inode number of the file,
+ * @mtime: modification time of the file,
+ * @size: size of the file,
+ * @hash: hash of the contents of the file,
+ * @racy: TRUE if @mtime cannot be trusted.
+ *
+ * This structure records the state of a file at the time it was last
+ * parsed, so that a mandatory reload can tell whether it needs to be
+ * parsed again.  An @ino of zero means no fingerprint was taken.
+ *
+ * @racy is set when the file was modified in the same second that it
+ * was read, since a further modification in that second might not
+ * change @mtime; the contents are always compared for such files.
+ **/
+typedef struct conf_fingerprint {
+	dev_t           dev;
+	ino_t           ino;
+	struct timespec mtime;
+	off_t           size;
+	uint64_t        hash;
+	int             racy;
+} ConfFingerprint;
+
+/**
+ * ConfIndex:
+ * @entry: list header,
+ * @name: name files are indexed by,
+ * @files: list of ConfIndexEntry structures.
+ *
+ * This structure lists the files known by @name in conf_job_index or
+ * conf_file_index, in order of the priority of their sources.
+ **/
+typedef struct conf_index {
+	NihList  entry;
+	char    *name;
+	NihList  files;
+} ConfIndex;
+
+/**
+ * ConfIndexEntry:
+ * @entry: list header,
+ * @index: index listing @file, or NULL once that has been freed,
+ * @file: configuration file.
+ *
+ * This structure places @file in the list of an index; it is freed
+ * along with @file.
+ **/
+typedef struct conf_index_entry {
+	NihList            entry;
+	ConfIndex         *index;
+	struct conf_file  *file;
+} ConfIndexEntry;
+
 /**
  * ConfFile:
  * @entry: list header,
  * @path: path to file,
  * @source: configuration source,
  * @flag: reload flag,
+ * @fingerprint: state of @path when last parsed,
+ * @override_path: path of override file applied, or NULL,
+ * @override_fingerprint: state of @override_path when last parsed,
+ * @job_entry: entry in conf_job_index, or NULL,
+ * @name_entry: entry in conf_file_index, or NULL,
  * @data: pointer to actual item.
  *
  * This structure represents a file within @source and links to the item
@@ -91,13 +157,24 @@ typedef struct conf_source {
  * created and parsed, it is set to the same value as the source's.  Then
  * the source can trivially see which files have been lost, since they have
  * the wrong flag value.
+ *
+ * The @fingerprint and @override_fingerprint members allow a mandatory
+ * reload to keep the item for a file whose contents, and those of its
+ * override file, have not changed rather than parsing it again.
  **/
 typedef struct conf_file {
-	NihList     entry;
-	char       *path;
+	NihList          entry;
+	char            *path;
+
+	ConfSource      *source;
+	int              flag;
+
+	ConfFingerprint  fingerprint;
+	char            *override_path;
+	ConfFingerprint  override_fingerprint;
 
-	ConfSource *source;
-	int         flag;
+	ConfIndexEntry  *job_entry;
+	ConfIndexEntry  *name_entry;
 
 	union {
 		void     *data;
@@ -109,6 +186,8 @@ typedef struct conf_file {
 NIH_BEGIN_EXTERN
 
 extern NihList *conf_sources;
+extern NihHash *conf_job_index;
+extern NihHash *conf_file_index;
 
 
 void        conf_init          (void);
@@ -60,6 +60,8 @@
 #include "events.h"
 #include "paths.h"
 #include "xdg.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "com.ubuntu.Upstart.h"
 #include "org.freedesktop.DBus.h"
@@ -81,6 +83,20 @@ static int   control_check_permission    (NihDBusMessage *message)
 static void  control_session_file_create (void);
 static void  control_session_file_remove (void);
 
+static JobClass *control_job_class_lookup  (Session *session,
+					    const char *name);
+static int       control_job_class_visible (Session *session,
+					    JobClass *class);
+static size_t    control_job_class_states  (const void *parent,
+					    JobClass *class,
+					    ControlGetJobStatesJobsElement **elements)
+	__attribute__ ((warn_unused_result));
+static ControlGetJobStatesJobsElement *
+		 control_job_state_new     (const void *parent,
+					    JobClass *class, Job *job,
+					    ProcessType process)
+	__attribute__ ((warn_unused_result));
+
 /**
  * use_session_bus:
  *
@@ -135,6 +151,34 @@ DBusConnection *control_bus = NULL;
  **/
 NihList *control_conns = NULL;
 
+/**
+ * coalesce_signals:
+ *
+ * If TRUE, goal and state changes of job instances and emitted events
+ * are also batched into a single JobStatesChanged and EventsEmitted
+ * signal for each pass of the event queue.
+ **/
+int coalesce_signals = FALSE;
+
+/**
+ * control_pending_states:
+ *
+ * Goal and state changes recorded by control_queue_job_state() since
+ * the last call to control_flush_signals(), NULL terminated;
+ * control_pending_states_len is the number of changes.
+ **/
+static ControlJobStatesChangedChangesElement **control_pending_states = NULL;
+static size_t control_pending_states_len = 0;
+
+/**
+ * control_pending_events:
+ *
+ * Events emitted since the last call to control_flush_signals(), NULL
+ * terminated; control_pending_events_len is the number of events.
+ **/
+static ControlEventsEmittedEventsElement **control_pending_events = NULL;
+static size_t control_pending_events_len = 0;
+
 /* External definitions */
 extern int      user_mode;
 extern int      disable_respawn;
@@ -497,7 +541,6 @@ control_get_job_by_name (void            *data,
 {
 	Session  *session;
 	JobClass *class = NULL;
-	JobClass *global_class = NULL;
 
 	nih_assert (message != NULL);
 	nih_assert (name != NULL);
@@ -516,26 +559,7 @@ control_get_job_by_name (void            *data,
 	session = session_from_dbus (NULL, message);
 
 	/* Lookup the job */
-	class = (JobClass *)nih_hash_search (job_classes, name, NULL);
-
-	while (class && (class->session != session)) {
-
-		/* Found a match in the global session which may be used
-		 * later if no matching user session job exists.
-		 */
-		if ((! class->session) && (session && ! session->chroot))
-			global_class = class;
-
-		class = (JobClass *)nih_hash_search (job_classes, name,
-				&class->entry);
-	}
-
-	/* If no job with the given name exists in the appropriate
-	 * session, look in the global namespace (aka the NULL session).
-	 */ 
-	if (! class)
-		class = global_class;
-
+	class = control_job_class_lookup (session, name);
 	if (! class) {
 		nih_dbus_error_raise_printf (
 			DBUS_INTERFACE_UPSTART ".Error.UnknownJob",
@@ -590,8 +614,7 @@ control_get_all_jobs (void             *data,
 	NIH_HASH_FOREACH (job_classes, iter) {
 		JobClass *class = (JobClass *)iter;
 
-		if ((class->session || (session && session->chroot))
-		    && (class->session != session))
+		if (! control_job_class_visible (session, class))
 			continue;
 
 		if (! nih_str_array_add (&list, message, &len,
@@ -607,6 +630,280 @@ control_get_all_jobs (void             *data,
 	return 0;
 }
 
+/**
+ * control_get_job_states:
+ * @data: not used,
+ * @message: D-Bus connection and message received,
+ * @name: name of job to get states of, or empty string for all jobs,
+ * @jobs: pointer for array of job states reply.
+ *
+ * Implements the GetJobStates method of the com.ubuntu.Upstart
+ * interface.
+ *
+ * Called to obtain the goal, state and processes of every instance of
+ * every known job, or of the job named @name, which will be stored in
+ * @jobs.  This provides in a single call what would otherwise need
+ * calls to GetAllJobs, GetAllInstances and the properties of each
+ * instance.
+ *
+ * Each element gives the job name, instance name, goal, state and a
+ * process name and pid.  An instance with several processes has one
+ * element for each, in the same order as the processes property of the
+ * instance; an instance with no processes has a single element with an
+ * empty process name, and a job with no instances a single element with
+ * an empty goal and state.
+ *
+ * If @name is not empty and no job class with that name exists, the
+ * com.ubuntu.Upstart.Error.UnknownJob D-Bus error will be raised.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_get_job_states (void                              *data,
+			NihDBusMessage                    *message,
+			const char                        *name,
+			ControlGetJobStatesJobsElement  ***jobs)
+{
+	Session                         *session;
+	JobClass                        *class = NULL;
+	ControlGetJobStatesJobsElement **list;
+	size_t                           len;
+
+	nih_assert (message != NULL);
+	nih_assert (name != NULL);
+	nih_assert (jobs != NULL);
+
+	job_class_init ();
+
+	/* Get the relevant session */
+	session = session_from_dbus (NULL, message);
+
+	if (*name) {
+		class = control_job_class_lookup (session, name);
+		if (! class) {
+			nih_dbus_error_raise_printf (
+				DBUS_INTERFACE_UPSTART ".Error.UnknownJob",
+				_("Unknown job: %s"), name);
+			return -1;
+		}
+	}
+
+	/* Count the elements first so the reply array need only be
+	 * allocated once however many jobs there are.
+	 */
+	len = 0;
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *job_class = (JobClass *)iter;
+
+		if (class ? (job_class != class)
+		    : ! control_job_class_visible (session, job_class))
+			continue;
+
+		len += control_job_class_states (NULL, job_class, NULL);
+	}
+
+	list = nih_alloc (message, sizeof (ControlGetJobStatesJobsElement *)
+			  * (len + 1));
+	if (! list)
+		nih_return_no_memory_error (-1);
+
+	len = 0;
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *job_class = (JobClass *)iter;
+		size_t    ret;
+
+		if (class ? (job_class != class)
+		    : ! control_job_class_visible (session, job_class))
+			continue;
+
+		ret = control_job_class_states (list, job_class, &list[len]);
+		if (! ret) {
+			nih_free (list);
+			nih_return_no_memory_error (-1);
+		}
+
+		len += ret;
+	}
+
+	list[len] = NULL;
+
+	*jobs = list;
+
+	return 0;
+}
+
+/**
+ * control_job_class_lookup:
+ * @session: session of caller,
+ * @name: name of job class.
+ *
+ * Look up the job class named @name that is visible to a caller in
+ * @session, preferring one in @session itself to one in the global
+ * namespace.
+ *
+ * Returns: job class or NULL if there is no such job class.
+ **/
+static JobClass *
+control_job_class_lookup (Session     *session,
+			  const char  *name)
+{
+	JobClass *class = NULL;
+	JobClass *global_class = NULL;
+
+	nih_assert (name != NULL);
+
+	class = (JobClass *)nih_hash_search (job_classes, name, NULL);
+
+	while (class && (class->session != session)) {
+
+		/* Found a match in the global session which may be used
+		 * later if no matching user session job exists.
+		 */
+		if ((! class->session) && (session && ! session->chroot))
+			global_class = class;
+
+		class = (JobClass *)nih_hash_search (job_classes, name,
+				&class->entry);
+	}
+
+	/* If no job with the given name exists in the appropriate
+	 * session, look in the global namespace (aka the NULL session).
+	 */ 
+	if (! class)
+		class = global_class;
+
+	return class;
+}
+
+/**
+ * control_job_class_visible:
+ * @session: session of caller,
+ * @class: job class.
+ *
+ * Returns: TRUE if @class should be listed to a caller in @session,
+ * else FALSE.
+ **/
+static int
+control_job_class_visible (Session   *session,
+			   JobClass  *class)
+{
+	nih_assert (class != NULL);
+
+	if ((class->session || (session && session->chroot))
+	    && (class->session != session))
+		return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * control_job_class_states:
+ * @parent: parent of new elements,
+ * @class: job class,
+ * @elements: array to store elements in, or NULL.
+ *
+ * Fill @elements with the GetJobStates reply elements for @class and
+ * its instances; if @elements is NULL, the elements are only counted.
+ *
+ * Returns: number of elements, or zero on allocation failure.
+ **/
+static size_t
+control_job_class_states (const void                       *parent,
+			  JobClass                         *class,
+			  ControlGetJobStatesJobsElement  **elements)
+{
+	size_t len = 0;
+
+	nih_assert (class != NULL);
+
+	NIH_HASH_FOREACH (class->instances, iter) {
+		Job *job = (Job *)iter;
+		int  found = FALSE;
+
+		for (int i = 0; i < PROCESS_LAST; i++) {
+			if (job->pid[i] <= 0)
+				continue;
+
+			if (elements
+			    && ! (elements[len] = control_job_state_new (parent,
+									 class, job, i)))
+				return 0;
+
+			len++;
+			found = TRUE;
+		}
+
+		if (found)
+			continue;
+
+		if (elements
+		    && ! (elements[len] = control_job_state_new (parent,
+							 class, job,
+							 PROCESS_INVALID)))
+			return 0;
+
+		len++;
+	}
+
+	/* Jobs without instances are listed as such */
+	if (! len) {
+		if (elements
+		    && ! (elements[len] = control_job_state_new (parent,
+								 class, NULL,
+								 PROCESS_INVALID)))
+			return 0;
+
+		len++;
+	}
+
+	return len;
+}
+
+/**
+ * control_job_state_new:
+ * @parent: parent of new element,
+ * @class: job class,
+ * @job: instance of @class or NULL,
+ * @process: process of @job or PROCESS_INVALID.
+ *
+ * Allocate a GetJobStates reply element for @process of @job.
+ *
+ * Returns: new element or NULL on allocation failure.
+ **/
+static ControlGetJobStatesJobsElement *
+control_job_state_new (const void   *parent,
+		       JobClass     *class,
+		       Job          *job,
+		       ProcessType   process)
+{
+	ControlGetJobStatesJobsElement *element;
+
+	nih_assert (class != NULL);
+
+	element = nih_new (parent, ControlGetJobStatesJobsElement);
+	if (! element)
+		return NULL;
+
+	element->item0 = nih_strdup (element, class->name);
+	element->item1 = nih_strdup (element, job ? job->name : "");
+	element->item2 = nih_strdup (element,
+				     job ? job_goal_name (job->goal) : "");
+	element->item3 = nih_strdup (element,
+				     job ? job_state_name (job->state) : "");
+	element->item4 = nih_strdup (element,
+				     process != PROCESS_INVALID
+				     ? process_name (process) : "");
+	element->item5 = process != PROCESS_INVALID ? job->pid[process] : 0;
+
+	if (! (element->item0 && element->item1 && element->item2
+	       && element->item3 && element->item4)) {
+		nih_free (element);
+		return NULL;
+	}
+
+	return element;
+}
+
 
 int
 control_emit_event (void            *data,
@@ -1071,6 +1368,7 @@ control_prepare_reexec (void)
 	if (control_server)
 		control_server_close ();
 
+	control_flush_signals ();
 	control_bus_flush ();
 
 }
@@ -1274,6 +1572,209 @@ control_restart (void           *data,
 	return 0;
 }
 
+/**
+ * control_get_stats:
+ * @data: not used,
+ * @message: D-Bus connection and message received,
+ * @stats: pointer for array of histograms reply.
+ *
+ * Implements the GetStats method of the com.ubuntu.Upstart
+ * interface.
+ *
+ * Called to obtain the distribution of the durations of each of the
+ * phases of init timed by stats_record(), which will be stored in
+ * @stats.  Each element gives the name of the phase, the number of
+ * durations recorded, their sum and the longest in nanoseconds, and
+ * the number recorded in each of the STATS_BUCKETS buckets.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_get_stats (void                         *data,
+		   NihDBusMessage               *message,
+		   ControlGetStatsStatsElement ***stats)
+{
+	ControlGetStatsStatsElement **list;
+
+	nih_assert (message != NULL);
+	nih_assert (stats != NULL);
+
+	list = nih_alloc (message, sizeof (ControlGetStatsStatsElement *)
+			  * (STATS_LAST + 1));
+	if (! list)
+		nih_return_no_memory_error (-1);
+
+	for (int i = 0; i < STATS_LAST; i++) {
+		StatsHistogram *histogram = &stats_histograms[i];
+
+		list[i] = nih_new (list, ControlGetStatsStatsElement);
+		if (! list[i])
+			goto error;
+
+		list[i]->item0 = nih_strdup (list[i], stats_phase_name (i));
+		if (! list[i]->item0)
+			goto error;
+
+		list[i]->item1 = histogram->count;
+		list[i]->item2 = histogram->total;
+		list[i]->item3 = histogram->max;
+
+		list[i]->item4 = nih_alloc (list[i],
+					    sizeof (histogram->buckets));
+		if (! list[i]->item4)
+			goto error;
+
+		memcpy (list[i]->item4, histogram->buckets,
+			sizeof (histogram->buckets));
+		list[i]->item4_len = STATS_BUCKETS;
+	}
+
+	list[STATS_LAST] = NULL;
+
+	*stats = list;
+
+	return 0;
+
+error:
+	nih_free (list);
+	nih_return_no_memory_error (-1);
+}
+
+/**
+ * control_reset_stats:
+ * @data: not used,
+ * @message: D-Bus connection and message received.
+ *
+ * Implements the ResetStats method of the com.ubuntu.Upstart
+ * interface.
+ *
+ * Called to discard all of the durations recorded so far, so that
+ * those of a particular period may be examined.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_reset_stats (void           *data,
+		     NihDBusMessage *message)
+{
+	nih_assert (message != NULL);
+
+	if (! control_check_permission (message)) {
+		nih_dbus_error_raise_printf (
+			DBUS_INTERFACE_UPSTART ".Error.PermissionDenied",
+			_("You do not have permission to reset statistics"));
+		return -1;
+	}
+
+	stats_reset ();
+
+	return 0;
+}
+
+/**
+ * control_get_log_stats:
+ * @data: not used,
+ * @message: D-Bus connection and message received,
+ * @unflushed: pointer for number of bytes of unflushed output reply,
+ * @dropped: pointer for number of bytes of dropped output reply.
+ *
+ * Implements the GetLogStats method of the com.ubuntu.Upstart
+ * interface.
+ *
+ * Called to obtain the number of bytes of job output held in memory
+ * until log files can be written, which will be stored in @unflushed,
+ * and the number of bytes dropped to stay within the limits on that
+ * since init started, which will be stored in @dropped.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_get_log_stats (void           *data,
+		       NihDBusMessage *message,
+		       uint64_t       *unflushed,
+		       uint64_t       *dropped)
+{
+	nih_assert (message != NULL);
+	nih_assert (unflushed != NULL);
+	nih_assert (dropped != NULL);
+
+	*unflushed = log_unflushed_bytes;
+	*dropped = log_unflushed_dropped;
+
+	return 0;
+}
+
+/**
+ * control_get_trace:
+ * @data: not used,
+ * @message: D-Bus connection and message received,
+ * @trace: pointer for array of trace records reply.
+ *
+ * Implements the GetTrace method of the com.ubuntu.Upstart
+ * interface.
+ *
+ * Called to obtain the job state changes and event handling recorded
+ * by the tracer, oldest first, which will be stored in @trace.  Each
+ * element gives the monotonic time in nanoseconds, the kind of record,
+ * the name of the job or event and the state the job entered.
+ *
+ * The array is empty if tracing was not enabled with the trace-buffer
+ * option.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_get_trace (void                         *data,
+		   NihDBusMessage               *message,
+		   ControlGetTraceTraceElement ***trace)
+{
+	ControlGetTraceTraceElement **list;
+	size_t                        len;
+
+	nih_assert (message != NULL);
+	nih_assert (trace != NULL);
+
+	len = trace_count ();
+
+	list = nih_alloc (message, sizeof (ControlGetTraceTraceElement *)
+			  * (len + 1));
+	if (! list)
+		nih_return_no_memory_error (-1);
+
+	for (size_t i = 0; i < len; i++) {
+		const TraceRecord *record = trace_get (i);
+
+		list[i] = nih_new (list, ControlGetTraceTraceElement);
+		if (! list[i])
+			goto error;
+
+		list[i]->item0 = record->time;
+
+		list[i]->item1 = nih_strdup (list[i],
+					     trace_type_name (record->type));
+		if (! list[i]->item1)
+			goto error;
+
+		list[i]->item2 = nih_strdup (list[i], record->name);
+		if (! list[i]->item2)
+			goto error;
+
+		list[i]->item3 = nih_strdup (list[i], record->detail);
+		if (! list[i]->item3)
+			goto error;
+	}
+
+	list[len] = NULL;
+
+	*trace = list;
+
+	return 0;
+
+error:
+	nih_free (list);
+	nih_return_no_memory_error (-1);
+}
+
 /**
  * control_notify_event_emitted
  *
@@ -1284,6 +1785,8 @@ control_restart (void           *data,
 void
 control_notify_event_emitted (Event *event)
 {
+	ControlEventsEmittedEventsElement *element;
+
 	nih_assert (event != NULL);
 
 	control_init ();
@@ -1295,6 +1798,27 @@ control_notify_event_emitted (Event *event)
 		NIH_ZERO (control_emit_event_emitted (conn, DBUS_PATH_UPSTART,
 							    event->name, event->env));
 	}
+
+	if ((! coalesce_signals) || NIH_LIST_EMPTY (control_conns))
+		return;
+
+	control_pending_events = NIH_MUST (nih_realloc (
+			control_pending_events, NULL,
+			sizeof (ControlEventsEmittedEventsElement *)
+			* (control_pending_events_len + 2)));
+
+	element = NIH_MUST (nih_new (control_pending_events,
+				     ControlEventsEmittedEventsElement));
+	element->item0 = NIH_MUST (nih_strdup (element, event->name));
+	if (event->env) {
+		element->item1 = NIH_MUST (nih_str_array_copy (element, NULL,
+								event->env));
+	} else {
+		element->item1 = NIH_MUST (nih_str_array_new (element));
+	}
+
+	control_pending_events[control_pending_events_len++] = element;
+	control_pending_events[control_pending_events_len] = NULL;
 }
 
 /**
@@ -1315,6 +1839,90 @@ control_notify_restarted (void)
 	}
 }
 
+/**
+ * control_queue_job_state:
+ * @job: job instance that changed.
+ *
+ * Records the current goal and state of @job to be sent in the
+ * JobStatesChanged signal by the next call to control_flush_signals(),
+ * if signals are being coalesced and there is anyone to send it to.
+ *
+ * This is called in addition to emitting the GoalChanged or
+ * StateChanged signal for the instance itself.
+ **/
+void
+control_queue_job_state (Job *job)
+{
+	ControlJobStatesChangedChangesElement *change;
+
+	nih_assert (job != NULL);
+
+	control_init ();
+
+	if ((! coalesce_signals) || NIH_LIST_EMPTY (control_conns))
+		return;
+
+	control_pending_states = NIH_MUST (nih_realloc (
+			control_pending_states, NULL,
+			sizeof (ControlJobStatesChangedChangesElement *)
+			* (control_pending_states_len + 2)));
+
+	change = NIH_MUST (nih_new (control_pending_states,
+				    ControlJobStatesChangedChangesElement));
+	change->item0 = NIH_MUST (nih_strdup (change, job->path));
+	change->item1 = NIH_MUST (nih_strdup (change,
+					      job_goal_name (job->goal)));
+	change->item2 = NIH_MUST (nih_strdup (change,
+					      job_state_name (job->state)));
+
+	control_pending_states[control_pending_states_len++] = change;
+	control_pending_states[control_pending_states_len] = NULL;
+}
+
+/**
+ * control_flush_signals:
+ *
+ * Sends the JobStatesChanged and EventsEmitted signals containing all of
+ * the changes and events recorded since the last call, so that
+ * subscribers are woken once rather than for every transition.
+ *
+ * This is called at the end of each pass of the event queue by
+ * event_poll() and before re-exec; nothing is sent when nothing has
+ * been recorded.
+ **/
+void
+control_flush_signals (void)
+{
+	nih_local ControlJobStatesChangedChangesElement **changes = NULL;
+	nih_local ControlEventsEmittedEventsElement     **events = NULL;
+
+	changes = control_pending_states;
+	control_pending_states = NULL;
+	control_pending_states_len = 0;
+
+	events = control_pending_events;
+	control_pending_events = NULL;
+	control_pending_events_len = 0;
+
+	if ((! changes) && (! events))
+		return;
+
+	control_init ();
+
+	NIH_LIST_FOREACH (control_conns, iter) {
+		NihListEntry   *entry = (NihListEntry *)iter;
+		DBusConnection *conn = (DBusConnection *)entry->data;
+
+		if (changes)
+			NIH_ZERO (control_emit_job_states_changed (
+					  conn, DBUS_PATH_UPSTART, changes));
+
+		if (events)
+			NIH_ZERO (control_emit_events_emitted (
+					  conn, DBUS_PATH_UPSTART, events));
+	}
+}
+
 /**
  * control_set_env_list:
  *
@@ -1916,6 +2524,60 @@ control_reset_env (void           *data,
 	return 0;
 }
 
+/**
+ * control_get_origin_pid:
+ * @message: D-Bus connection and message received,
+ * @pid: returned process id.
+ *
+ * Determines the process that sent @message, asking the bus daemon if it
+ * arrived over the bus; this blocks until the bus daemon replies.
+ *
+ * Returns TRUE: if @pid now contains the process id corresponding to
+ * @message, else FALSE.
+ **/
+int
+control_get_origin_pid (NihDBusMessage *message, pid_t *pid)
+{
+	nih_local NihDBusProxy *proxy = NULL;
+	unsigned long           unix_pid = 0;
+	uint32_t                bus_pid = 0;
+	const char             *sender;
+
+	nih_assert (message);
+	nih_assert (pid);
+
+	if (! message->message || ! message->connection)
+		return FALSE;
+
+	sender = dbus_message_get_sender (message->message);
+	if (sender) {
+		proxy = nih_dbus_proxy_new (NULL, message->connection,
+					    "org.freedesktop.DBus",
+					    "/org/freedesktop/DBus",
+					    NULL, NULL);
+		if ((! proxy)
+		    || (control_dbus_get_connection_unix_process_id_sync (
+				NULL, proxy, sender, &bus_pid) < 0)) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_free (err);
+			return FALSE;
+		}
+
+		unix_pid = bus_pid;
+	} else {
+		if (! dbus_connection_get_unix_process_id (message->connection,
+							   &unix_pid)) {
+			return FALSE;
+		}
+	}
+
+	*pid = (pid_t)unix_pid;
+
+	return (*pid > 0);
+}
+
 /**
  * control_get_origin_uid:
  * @message: D-Bus connection and message received,
@@ -31,8 +31,11 @@
 #include <json.h>
 
 #include "event.h"
+#include "job.h"
 #include "quiesce.h"
 
+#include "com.ubuntu.Upstart.h"
+
 /**
  * USE_SESSION_BUS_ENV:
  *
@@ -114,6 +117,10 @@ int  control_get_job_by_name      (void *data, NihDBusMessage *message,
 int  control_get_all_jobs         (void *data, NihDBusMessage *message,
 				   char ***jobs)
 	__attribute__ ((warn_unused_result));
+int  control_get_job_states       (void *data, NihDBusMessage *message,
+				   const char *name,
+				   ControlGetJobStatesJobsElement ***jobs)
+	__attribute__ ((warn_unused_result));
 
 int  control_emit_event           (void *data, NihDBusMessage *message,
 				   const char *name, char * const *env,
@@ -157,10 +164,28 @@ int control_get_state (void           *data,
 int  control_restart (void *data, NihDBusMessage *message)
 	__attribute__ ((warn_unused_result));
 
+int  control_get_stats   (void *data, NihDBusMessage *message,
+			  ControlGetStatsStatsElement ***stats)
+	__attribute__ ((warn_unused_result));
+int  control_reset_stats (void *data, NihDBusMessage *message)
+	__attribute__ ((warn_unused_result));
+
+int  control_get_log_stats (void *data, NihDBusMessage *message,
+			    uint64_t *unflushed, uint64_t *dropped)
+	__attribute__ ((warn_unused_result));
+
+int  control_get_trace   (void *data, NihDBusMessage *message,
+			  ControlGetTraceTraceElement ***trace)
+	__attribute__ ((warn_unused_result));
+
 void control_notify_event_emitted (Event *event);
 
 void control_notify_restarted (void);
 
+void control_queue_job_state (Job *job);
+
+void control_flush_signals (void);
+
 int control_notify_disk_writeable (void   *data,
 		     NihDBusMessage *message)
 	__attribute__ ((warn_unused_result));
@@ -220,6 +245,9 @@ json_object *control_serialise_bus_address (void)
 int control_deserialise_bus_address (json_object *json)
 	__attribute__ ((warn_unused_result));
 
+int control_get_origin_pid (NihDBusMessage *message, pid_t *pid)
+	__attribute__ ((warn_unused_result));
+
 NIH_END_EXTERN
 
 #endif /* INIT_CONTROL_H */
@@ -31,6 +31,8 @@
 #include <nih/macros.h>
 #include <nih/alloc.h>
 #include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
 #include <nih/logging.h>
 #include <nih/error.h>
 
@@ -38,10 +40,69 @@
 #include "errors.h"
 
 
+/**
+ * ENVIRON_APPEND_INDEX_MIN:
+ *
+ * Combined number of entries in the tables passed to environ_append() at
+ * which it is worth building an index of the existing table rather than
+ * searching it for each new entry.
+ **/
+#define ENVIRON_APPEND_INDEX_MIN 32
+
+
+/**
+ * EnvironKey:
+ * @name: start of variable name,
+ * @len: length of @name.
+ *
+ * Key of the hash tables used to index environment arrays; @name is not
+ * nul-terminated, since it points to the start of an array entry or to
+ * a variable reference within a string being expanded.
+ **/
+typedef struct environ_key {
+	const char *name;
+	size_t      len;
+} EnvironKey;
+
+/**
+ * EnvironEntry:
+ * @entry: list header,
+ * @key: name of variable,
+ * @pos: index of variable within the environment array.
+ *
+ * Entry in the hash table used to index an environment array by name.
+ **/
+typedef struct environ_entry {
+	NihList    entry;
+	EnvironKey key;
+	size_t     pos;
+} EnvironEntry;
+
+
 /* Prototypes for static functions */
-static char *environ_expand_until (char **str, const void *parent,
-				   size_t *len, size_t *pos, char * const *env,
-				   const char *until);
+static char *        environ_expand_until (char **str, const void *parent,
+					   size_t *len, size_t *pos,
+					   char * const *env,
+					   const char *until);
+
+static char **       environ_update       (NihHash *index, char ***env,
+					   const void *parent, size_t *len,
+					   int replace, const char *str)
+	__attribute__ ((warn_unused_result));
+
+static NihHash *     environ_index_new    (const void *parent,
+					   char * const *env)
+	__attribute__ ((warn_unused_result));
+static EnvironEntry *environ_index_insert (NihHash *index,
+					   char * const *env, size_t pos)
+	__attribute__ ((warn_unused_result));
+static EnvironEntry *environ_index_find   (NihHash *index, const char *key,
+					   size_t len);
+
+static const void *  environ_index_key    (NihList *entry);
+static uint32_t      environ_index_hash   (const EnvironKey *key);
+static int           environ_index_cmp    (const EnvironKey *key1,
+					   const EnvironKey *key2);
 
 
 /**
@@ -83,9 +144,40 @@ environ_add (char       ***env,
 	     size_t       *len,
 	     int           replace,
 	     const char   *str)
+{
+	nih_assert (env != NULL);
+	nih_assert (str != NULL);
+
+	return environ_update (NULL, env, parent, len, replace, str);
+}
+
+/**
+ * environ_update:
+ * @index: index of @env or NULL,
+ * @env: pointer to environment table,
+ * @parent: parent object for new array,
+ * @len: length of @env,
+ * @replace: TRUE if existing entry should be replaced,
+ * @str: string to add.
+ *
+ * Implements environ_add(), with the addition of the optional @index of
+ * @env as built by environ_index_new() which is used to find an existing
+ * entry for @str instead of searching @env, and kept up to date with any
+ * change made to @env.
+ *
+ * Returns: new array pointer or NULL if insufficient memory.
+ **/
+static char **
+environ_update (NihHash      *index,
+		char       ***env,
+		const void   *parent,
+		size_t       *len,
+		int           replace,
+		const char   *str)
 {
 	size_t           key, _len;
 	char           **old_str;
+	EnvironEntry    *entry = NULL;
 	nih_local char  *new_str = NULL;
 
 	nih_assert (env != NULL);
@@ -126,17 +218,48 @@ environ_add (char       ***env,
 	 * if we find one we either finish or overwrite it instead of
 	 * extending the table.
 	 */
-	old_str = (char **)environ_lookup (*env, str, key);
+	if (index) {
+		entry = environ_index_find (index, str, key);
+		old_str = entry ? *env + entry->pos : NULL;
+	} else {
+		old_str = (char **)environ_lookup (*env, str, key);
+	}
+
 	if (old_str && replace) {
 		nih_unref (*old_str, *env);
 
 		if (new_str) {
 			*old_str = new_str;
 			nih_ref (new_str, *env);
+
+			if (entry)
+				entry->key.name = new_str;
 		} else {
 			memmove (old_str, old_str + 1,
 				 (char *)(*env + *len) - (char *)old_str);
 			(*len)--;
+
+			/* Entries following the removed one have moved, and
+			 * a later duplicate of it may now be found instead.
+			 */
+			if (entry) {
+				size_t pos = entry->pos;
+
+				nih_free (entry);
+
+				NIH_HASH_FOREACH (index, iter) {
+					EnvironEntry *other = (EnvironEntry *)iter;
+
+					if (other->pos > pos)
+						other->pos--;
+				}
+
+				old_str = (char **)environ_lookup (*env, str, key);
+				if (old_str && (! environ_index_insert (
+							index, *env,
+							old_str - *env)))
+					return NULL;
+			}
 		}
 
 		return *env;
@@ -149,6 +272,12 @@ environ_add (char       ***env,
 	if (new_str) {
 		if (! nih_str_array_addp (env, parent, len, new_str))
 			return NULL;
+
+		if (index && (! environ_index_insert (index, *env, *len - 1))) {
+			nih_unref ((*env)[*len - 1], *env);
+			(*env)[--(*len)] = NULL;
+			return NULL;
+		}
 	}
 
 	return *env;
@@ -259,12 +388,34 @@ environ_append (char       ***env,
 		int           replace,
 		char * const *new_env)
 {
-	char * const *e;
+	nih_local NihHash *index = NULL;
+	char * const      *e;
+	size_t             _len, new_len = 0;
 
 	nih_assert (env != NULL);
 
+	if (! len) {
+		len = &_len;
+
+		_len = 0;
+		for (e = *env; e && *e; e++)
+			_len++;
+	}
+
 	for (e = new_env; e && *e; e++)
-		if (! environ_add (env, parent, len, replace, *e))
+		new_len++;
+
+	/* Searching the existing table for each new entry would take
+	 * quadratic time, so index it first unless both are small.
+	 */
+	if (*env && (*len + new_len >= ENVIRON_APPEND_INDEX_MIN)) {
+		index = environ_index_new (NULL, *env);
+		if (! index)
+			return NULL;
+	}
+
+	for (e = new_env; e && *e; e++)
+		if (! environ_update (index, env, parent, len, replace, *e))
 			return NULL;
 
 	return *env;
@@ -448,6 +599,422 @@ environ_all_valid (char * const *env)
 }
 
 
+/**
+ * environ_table_new:
+ * @parent: parent object for new table,
+ * @env: NULL-terminated array of environment variables.
+ *
+ * Allocates and returns a new EnvironTable structure indexing the
+ * variables in @env.  If @env contains more than one entry for a variable,
+ * only the first is indexed in the same way that only the first is found
+ * by environ_lookup().
+ *
+ * @env is not referenced by the new table, so it's usual to pass it as
+ * @parent; when it is not, the table must be freed before @env is.  The
+ * array should afterwards be accessed through the env member of the table
+ * since adding to the table may reallocate it.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned table.  When all parents
+ * of the returned table are freed, the returned table will also be
+ * freed.
+ *
+ * Returns: newly allocated EnvironTable structure, or NULL if
+ * insufficient memory.
+ **/
+EnvironTable *
+environ_table_new (const void  *parent,
+		   char       **env)
+{
+	EnvironTable *table;
+
+	nih_assert (env != NULL);
+
+	table = nih_new (parent, EnvironTable);
+	if (! table)
+		return NULL;
+
+	table->index = environ_index_new (table, env);
+	if (! table->index) {
+		nih_free (table);
+		return NULL;
+	}
+
+	table->env = env;
+
+	table->len = 0;
+	for (char **e = table->env; *e; e++)
+		table->len++;
+
+	return table;
+}
+
+/**
+ * environ_table_add:
+ * @table: environment table,
+ * @replace: TRUE if existing entry should be replaced,
+ * @str: string to add.
+ *
+ * Add the new environment variable @str to @table, either replacing an
+ * existing entry or appended to the end; this behaves in exactly the same
+ * way as environ_add() except that the existing entry is found without
+ * searching the array.
+ *
+ * The env member of @table may be changed by this function.
+ *
+ * Returns: new array pointer or NULL if insufficient memory.
+ **/
+char **
+environ_table_add (EnvironTable *table,
+		   int           replace,
+		   const char   *str)
+{
+	nih_assert (table != NULL);
+	nih_assert (str != NULL);
+
+	return environ_update (table->index, &table->env, NULL, &table->len,
+			       replace, str);
+}
+
+/**
+ * environ_table_append:
+ * @table: environment table,
+ * @replace: TRUE if existing entries should be replaced,
+ * @new_env: environment table to append to @table.
+ *
+ * Appends the entries in the environment table @new_env to @table, either
+ * replacing an existing entry or appended to the end as with
+ * environ_append().
+ *
+ * Note that if this fails, some of the entries may have been appended
+ * to the table already.  It's perfectly safe to call it again.
+ *
+ * Returns: new array pointer or NULL if insufficient memory.
+ **/
+char **
+environ_table_append (EnvironTable *table,
+		      int           replace,
+		      char * const *new_env)
+{
+	char * const *e;
+
+	nih_assert (table != NULL);
+
+	for (e = new_env; e && *e; e++)
+		if (! environ_table_add (table, replace, *e))
+			return NULL;
+
+	return table->env;
+}
+
+/**
+ * environ_table_remove:
+ * @table: environment table,
+ * @key: name of variable to remove.
+ *
+ * Remove every entry for the variable named @key from @table, leaving
+ * the remaining entries in their existing order.
+ *
+ * The array is not shrunk, so this cannot fail.
+ **/
+void
+environ_table_remove (EnvironTable *table,
+		      const char   *key)
+{
+	EnvironEntry *entry;
+	size_t        len;
+
+	nih_assert (table != NULL);
+	nih_assert (key != NULL);
+
+	len = strlen (key);
+
+	entry = environ_index_find (table->index, key, len);
+	if (! entry)
+		return;
+
+	nih_free (entry);
+
+	/* Work backwards so that each removal only moves the positions
+	 * of entries we've already passed; since every entry for the
+	 * variable goes, none needs to be indexed in place of it.
+	 */
+	for (size_t pos = table->len; pos-- > 0; ) {
+		char *str = table->env[pos];
+
+		if (strncmp (str, key, len) || (str[len] != '='))
+			continue;
+
+		nih_unref (str, table->env);
+		memmove (table->env + pos, table->env + pos + 1,
+			 sizeof (char *) * (table->len - pos));
+		table->len--;
+
+		NIH_HASH_FOREACH (table->index, iter) {
+			EnvironEntry *other = (EnvironEntry *)iter;
+
+			if (other->pos > pos)
+				other->pos--;
+		}
+	}
+}
+
+/**
+ * environ_table_lookup:
+ * @table: environment table,
+ * @key: key to lookup,
+ * @len: length of @key.
+ *
+ * Lookup the environment variable named @key, which is @len characters long,
+ * in @table.
+ *
+ * Since the entry returned is within the env member of @table, subsequent
+ * entries may be examined positionally.
+ *
+ * Returns: pointer to entry in @table's array or NULL if not found.
+ **/
+char * const *
+environ_table_lookup (EnvironTable *table,
+		      const char   *key,
+		      size_t        len)
+{
+	EnvironEntry *entry;
+
+	nih_assert (table != NULL);
+	nih_assert (key != NULL);
+
+	entry = environ_index_find (table->index, key, len);
+	if (! entry)
+		return NULL;
+
+	return table->env + entry->pos;
+}
+
+/**
+ * environ_table_get:
+ * @table: environment table,
+ * @key: key to lookup.
+ *
+ * Lookup the environment variable named @key in @table and return a
+ * pointer to the value.
+ *
+ * Returns: string from @table or NULL if not found.
+ **/
+const char *
+environ_table_get (EnvironTable *table,
+		   const char   *key)
+{
+	nih_assert (key != NULL);
+
+	return environ_table_getn (table, key, strlen (key));
+}
+
+/**
+ * environ_table_getn:
+ * @table: environment table,
+ * @key: key to lookup,
+ * @len: length of @key.
+ *
+ * Lookup the environment variable named @key, which is @len characters long,
+ * in @table and return a pointer to the value.
+ *
+ * Returns: string from @table or NULL if not found.
+ **/
+const char *
+environ_table_getn (EnvironTable *table,
+		    const char   *key,
+		    size_t        len)
+{
+	char * const *e;
+
+	nih_assert (table != NULL);
+	nih_assert (key != NULL);
+
+	e = environ_table_lookup (table, key, len);
+	if (e) {
+		const char *ret;
+
+		ret = strchr (*e, '=');
+		nih_assert (ret != NULL);
+
+		return ret + 1;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * environ_index_new:
+ * @parent: parent object for new index,
+ * @env: NULL-terminated array of environment variables.
+ *
+ * Creates a hash table indexing the KEY=VALUE entries of @env by name,
+ * for use by environ_update() and environment tables.  Only the first
+ * entry for each name is indexed.  @env may be NULL to create an empty
+ * index.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned index.  When all parents
+ * of the returned index are freed, the returned index will also be
+ * freed.
+ *
+ * Returns: newly allocated hash table or NULL if insufficient memory.
+ **/
+static NihHash *
+environ_index_new (const void   *parent,
+		   char * const *env)
+{
+	NihHash *index;
+
+	index = nih_hash_new (parent, 0, environ_index_key,
+			      (NihHashFunction)environ_index_hash,
+			      (NihCmpFunction)environ_index_cmp);
+	if (! index)
+		return NULL;
+
+	for (size_t pos = 0; env && env[pos]; pos++) {
+		size_t key;
+
+		key = strcspn (env[pos], "=");
+		if (env[pos][key] != '=')
+			continue;
+
+		if (environ_index_find (index, env[pos], key))
+			continue;
+
+		if (! environ_index_insert (index, env, pos)) {
+			nih_free (index);
+			return NULL;
+		}
+	}
+
+	return index;
+}
+
+/**
+ * environ_index_insert:
+ * @index: index to add to,
+ * @env: NULL-terminated array of environment variables,
+ * @pos: position of entry in @env.
+ *
+ * Adds the KEY=VALUE entry at @pos in @env to @index.
+ *
+ * Returns: new index entry or NULL if insufficient memory.
+ **/
+static EnvironEntry *
+environ_index_insert (NihHash      *index,
+		      char * const *env,
+		      size_t        pos)
+{
+	EnvironEntry *entry;
+
+	nih_assert (index != NULL);
+	nih_assert (env != NULL);
+	nih_assert (env[pos] != NULL);
+
+	entry = nih_new (index, EnvironEntry);
+	if (! entry)
+		return NULL;
+
+	nih_list_init (&entry->entry);
+	nih_alloc_set_destructor (entry, nih_list_destroy);
+
+	entry->key.name = env[pos];
+	entry->key.len = strcspn (env[pos], "=");
+	entry->pos = pos;
+
+	nih_hash_add (index, &entry->entry);
+
+	return entry;
+}
+
+/**
+ * environ_index_find:
+ * @index: index to search,
+ * @key: key to lookup,
+ * @len: length of @key.
+ *
+ * Lookup the environment variable named @key, which is @len characters long,
+ * in @index.
+ *
+ * Returns: index entry or NULL if not found.
+ **/
+static EnvironEntry *
+environ_index_find (NihHash    *index,
+		    const char *key,
+		    size_t      len)
+{
+	EnvironKey search;
+
+	nih_assert (index != NULL);
+	nih_assert (key != NULL);
+
+	search.name = key;
+	search.len = len;
+
+	return (EnvironEntry *)nih_hash_lookup (index, &search);
+}
+
+/**
+ * environ_index_key:
+ * @entry: EnvironEntry entry.
+ *
+ * Key function for environment indexes.
+ *
+ * Returns: pointer to the key of @entry.
+ **/
+static const void *
+environ_index_key (NihList *entry)
+{
+	nih_assert (entry != NULL);
+
+	return &((EnvironEntry *)entry)->key;
+}
+
+/**
+ * environ_index_hash:
+ * @key: key to hash.
+ *
+ * Hash function for environment indexes.
+ *
+ * Returns: hash of @key.
+ **/
+static uint32_t
+environ_index_hash (const EnvironKey *key)
+{
+	uint32_t hash = 5381;
+
+	nih_assert (key != NULL);
+
+	for (size_t i = 0; i < key->len; i++)
+		hash = (hash << 5) + hash + (unsigned char)key->name[i];
+
+	return hash;
+}
+
+/**
+ * environ_index_cmp:
+ * @key1: first key,
+ * @key2: second key.
+ *
+ * Comparison function for environment indexes.
+ *
+ * Returns: zero if @key1 and @key2 name the same variable.
+ **/
+static int
+environ_index_cmp (const EnvironKey *key1,
+		   const EnvironKey *key2)
+{
+	nih_assert (key1 != NULL);
+	nih_assert (key2 != NULL);
+
+	if (key1->len != key2->len)
+		return 1;
+
+	return strncmp (key1->name, key2->name, key1->len);
+}
+
 /**
  * environ_expand:
  * @parent: parent object for new string,
@@ -21,6 +21,36 @@
 #define INIT_ENVIRON_H
 
 #include <nih/macros.h>
+#include <nih/hash.h>
+
+
+/**
+ * EnvironTable:
+ * @env: NULL-terminated array of environment variables,
+ * @len: number of entries in @env,
+ * @index: hash table indexing @env by variable name.
+ *
+ * This structure indexes an environment array of the same form as those
+ * used by the other environ_*() functions, allowing variables to be found
+ * by name without searching it while @env may still be passed directly to
+ * them or to execvp().
+ *
+ * The table does not hold a reference to @env, which remains owned by
+ * whoever allocated it; it is usual to allocate the table as a child of
+ * the array so that both are freed together.
+ *
+ * Entries in @env remain in the order they were added, with replaced
+ * values keeping their original position, so positional matching of
+ * the array is unaffected.
+ *
+ * While indexed, @env must only be modified using the environ_table_*()
+ * functions, which may change the array pointer.
+ **/
+typedef struct environ_table {
+	char    **env;
+	size_t    len;
+	NihHash  *index;
+} EnvironTable;
 
 
 NIH_BEGIN_EXTERN
@@ -52,6 +82,23 @@ char *        environ_expand    (const void *parent, const char *string,
 				 char * const *env)
 	__attribute__ ((warn_unused_result));
 
+EnvironTable *environ_table_new    (const void *parent, char **env)
+	__attribute__ ((warn_unused_result));
+char **       environ_table_add    (EnvironTable *table, int replace,
+				    const char *str)
+	__attribute__ ((warn_unused_result));
+char **       environ_table_append (EnvironTable *table, int replace,
+				    char * const *new_env)
+	__attribute__ ((warn_unused_result));
+void          environ_table_remove (EnvironTable *table, const char *key);
+
+char * const *environ_table_lookup (EnvironTable *table, const char *key,
+				    size_t len);
+
+const char *  environ_table_get    (EnvironTable *table, const char *key);
+const char *  environ_table_getn   (EnvironTable *table, const char *key,
+				    size_t len);
+
 NIH_END_EXTERN
 
 #endif /* INIT_ENVIRON_H */
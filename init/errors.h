@@ -47,6 +47,9 @@ enum {
 	PARSE_ILLEGAL_NICE,
 	PARSE_ILLEGAL_OOM,
 	PARSE_ILLEGAL_LIMIT,
+	PARSE_ILLEGAL_PRIORITY,
+	PARSE_ILLEGAL_ADDRESS,
+	PARSE_TOO_MANY_SOCKETS,
 	PARSE_EXPECTED_EVENT,
 	PARSE_EXPECTED_OPERATOR,
 	PARSE_EXPECTED_VARIABLE,
@@ -75,6 +78,9 @@ enum {
 #define PARSE_ILLEGAL_OOM_STR		N_("Illegal oom adjustment, expected -16 to 15 or 'never'")
 #define PARSE_ILLEGAL_OOM_SCORE_STR	N_("Illegal oom score adjustment, expected -999 to 1000 or 'never'")
 #define PARSE_ILLEGAL_LIMIT_STR		N_("Illegal limit, expected 'unlimited' or integer")
+#define PARSE_ILLEGAL_PRIORITY_STR	N_("Illegal priority, expected integer")
+#define PARSE_ILLEGAL_ADDRESS_STR	N_("Illegal socket address")
+#define PARSE_TOO_MANY_SOCKETS_STR	N_("Too many listen stanzas")
 #define PARSE_EXPECTED_EVENT_STR	N_("Expected event")
 #define PARSE_EXPECTED_OPERATOR_STR	N_("Expected operator")
 #define PARSE_EXPECTED_VARIABLE_STR	N_("Expected variable name before value")
@@ -45,6 +45,8 @@
 #include "control.h"
 #include "errors.h"
 #include "quiesce.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "com.ubuntu.Upstart.h"
 
@@ -138,6 +140,7 @@ event_new (const void  *parent,
 	nih_list_init (&event->entry);
 
 	event->session = NULL;
+	event->table = NULL;
 	event->fd = -1;
 
 	event->progress = EVENT_PENDING;
@@ -227,10 +230,17 @@ event_unblock (Event *event)
 void
 event_poll (void)
 {
-	int poll_again;
+	int      poll_again;
+	uint64_t start = 0;
 
 	event_init ();
 
+	/* Only time passes with something to do, otherwise every trip
+	 * around the main loop would be counted.
+	 */
+	if (! NIH_LIST_EMPTY (events))
+		start = stats_now ();
+
 	do {
 		poll_again = FALSE;
 
@@ -267,6 +277,14 @@ event_poll (void)
 			}
 		}
 	} while (poll_again);
+
+	/* Send the signals batching everything that happened since the
+	 * last pass in one go.
+	 */
+	control_flush_signals ();
+
+	if (start)
+		stats_record (STATS_EVENT_POLL, start);
 }
 
 
@@ -284,13 +302,31 @@ event_poll (void)
 static void
 event_pending (Event *event)
 {
+	uint64_t start;
+
 	nih_assert (event != NULL);
 	nih_assert (event->progress == EVENT_PENDING);
 
 	nih_info (_("Handling %s event"), event->name);
 	event->progress = EVENT_HANDLING;
 
+	trace_record (TRACE_EVENT_HANDLING, event->name, NULL, NULL);
+
+	/* Each class's conditions look up the event's variables by name,
+	 * so index them once rather than searching for every condition.
+	 */
+	start = stats_now ();
+	if (event->env)
+		event->table = NIH_MUST (environ_table_new (event->env,
+							    event->env));
+
 	event_pending_handle_jobs (event);
+
+	if (event->table) {
+		nih_free (event->table);
+		event->table = NULL;
+	}
+	stats_record (STATS_EVENT_HANDLE, start);
 }
 
 /**
@@ -298,23 +334,34 @@ event_pending (Event *event)
  * @event: event to be handled.
  *
  * This function is called whenever an event reaches the handling state.
- * It iterates the list of jobs and stops or starts any necessary.
+ * It iterates the list of jobs whose start on or stop on conditions refer
+ * to @event and stops or starts any necessary.
  **/
 static void
 event_pending_handle_jobs (Event *event)
 {
-	int  empty = TRUE;
+	NihList *classes;
+	int      empty = TRUE;
 
 #ifdef ENABLE_CGROUPS
-	int  warn = FALSE;
+	int      warn = FALSE;
 #endif /* ENABLE_CGROUPS */
 
 	nih_assert (event != NULL);
 
 	job_class_init ();
 
-	NIH_HASH_FOREACH_SAFE (job_classes, iter) {
-		JobClass *class = (JobClass *)iter;
+	/* Only classes that name the event in one of their conditions can
+	 * possibly match it, so rather than iterating every known class we
+	 * consult the index maintained as classes are registered.
+	 */
+	classes = job_class_event_classes (event->name);
+	if (! classes)
+		goto handled;
+
+	NIH_LIST_FOREACH_SAFE (classes, iter) {
+		NihListEntry *entry = (NihListEntry *)iter;
+		JobClass     *class = (JobClass *)entry->data;
 
 		/* Only affect jobs within the same session as the event
 		 * unless the event has no session, in which case do them
@@ -420,6 +467,7 @@ event_pending_handle_jobs (Event *event)
 		}
 	}
 
+handled:
 #ifdef ENABLE_CGROUPS
 	if (warn)
 		nih_debug ("Cannot start some jobs until cgroup manager available");
@@ -464,6 +512,8 @@ event_finished (Event *event)
 
 	nih_debug ("Finished %s event", event->name);
 
+	trace_record (TRACE_EVENT_FINISHED, event->name, NULL, NULL);
+
 	NIH_LIST_FOREACH_SAFE (&event->blocking, iter) {
 		Blocked *blocked = (Blocked *)iter;
 
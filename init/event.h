@@ -23,6 +23,7 @@
 #include <nih/macros.h>
 #include <nih/list.h>
 
+#include "environ.h"
 #include "session.h"
 #include "state.h"
 
@@ -47,6 +48,7 @@ typedef enum event_progress {
  * @session: session the event is attached to,
  * @name: string name of the event,
  * @env: NULL-terminated array of environment variables,
+ * @table: index of @env while the event is being handled,
  * @fd: open file descriptor associated with a particular
  *      socket-bridge socket (see socket-event(8)),
  * @progress: progress of event,
@@ -64,6 +66,9 @@ typedef enum event_progress {
  * that event through the queue.
  *
  * Events remain in the handling state while @blockers is non-zero.
+ *
+ * @table is only present while each class's conditions are matched
+ * against the event, during which @env must not be changed.
  **/
 typedef struct event {
 	NihList          entry;
@@ -71,6 +76,7 @@ typedef struct event {
 	Session *        session;
  	char            *name;
 	char           **env;
+	EnvironTable    *table;
 	int              fd;
 
 	EventProgress    progress;
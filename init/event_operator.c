@@ -98,11 +98,22 @@ event_operator_new (const void         *parent,
 		}
 
 		oper->env = env;
+		oper->matches = NULL;
+		oper->num_matches = 0;
+
+		if (event_operator_compile (oper) < 0) {
+			oper->env = NULL;
+			nih_free (oper);
+			return NULL;
+		}
+
 		if (oper->env)
 			nih_ref (oper->env, oper);
 	} else {
 		oper->name = NULL;
 		oper->env = NULL;
+		oper->matches = NULL;
+		oper->num_matches = 0;
 	}
 
 	oper->event = NULL;
@@ -156,6 +167,11 @@ event_operator_copy (const void          *parent,
 			nih_free (oper);
 			return NULL;
 		}
+
+		if (event_operator_compile (oper) < 0) {
+			nih_free (oper);
+			return NULL;
+		}
 	}
 
 	if (old_oper->event) {
@@ -215,6 +231,123 @@ event_operator_destroy (EventOperator *oper)
 }
 
 
+/**
+ * event_operator_compile:
+ * @oper: operator to compile.
+ *
+ * Parses each entry in the environment of @oper into an EventMatch,
+ * recording the variable name or, for positional entries, the index of
+ * the event environment entry to match, whether the match is negated
+ * and whether the value needs expansion or glob matching, so that
+ * event_operator_match() need not repeat this work for every event.
+ *
+ * This must be called again whenever the env member of @oper is changed,
+ * though event_operator_match() will do so itself if it finds the
+ * compiled form out of date.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+int
+event_operator_compile (EventOperator *oper)
+{
+	EventMatch *matches;
+	size_t      len = 0;
+	size_t      position = 0;
+
+	nih_assert (oper != NULL);
+
+	if (oper->env)
+		for (char * const *e = oper->env; *e; e++)
+			len++;
+
+	if (len) {
+		matches = nih_alloc (oper, sizeof (EventMatch) * len);
+		if (! matches)
+			return -1;
+	} else {
+		matches = NULL;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		EventMatch *match = &matches[i];
+		const char *oval;
+
+		match->source = oper->env[i];
+		match->negate = FALSE;
+
+		oval = strstr (match->source, "!=");
+		if (! oval)
+			oval = strchr (match->source, '=');
+
+		if (oval) {
+			match->key = match->source;
+			match->keylen = oval - match->source;
+			match->position = 0;
+
+			/* != means we negate the result (and skip the !) */
+			if (*oval == '!') {
+				match->negate = TRUE;
+				oval++;
+			}
+
+			/* Value to match against follows the equals. */
+			match->value = oval + 1;
+		} else {
+			/* Value to match against is the whole string. */
+			match->key = NULL;
+			match->keylen = 0;
+			match->position = position++;
+			match->value = match->source;
+		}
+
+		if (strchr (match->value, '$')) {
+			match->type = EVENT_MATCH_EXPAND;
+		} else if (strpbrk (match->value, "*?[\\")) {
+			match->type = EVENT_MATCH_GLOB;
+		} else {
+			match->type = EVENT_MATCH_LITERAL;
+		}
+	}
+
+	if (oper->matches)
+		nih_free (oper->matches);
+
+	oper->matches = matches;
+	oper->num_matches = len;
+
+	return 0;
+}
+
+/**
+ * event_operator_compiled:
+ * @oper: operator to check.
+ *
+ * Checks whether the compiled matches of @oper still describe its
+ * environment, which will not be the case if the env member has been
+ * replaced or modified since event_operator_compile() was last called.
+ *
+ * Returns: TRUE if the compiled form is current, FALSE otherwise.
+ **/
+static int
+event_operator_compiled (const EventOperator *oper)
+{
+	size_t i = 0;
+
+	nih_assert (oper != NULL);
+
+	if (oper->env) {
+		for (; oper->env[i]; i++) {
+			if (i >= oper->num_matches)
+				return FALSE;
+			if (oper->matches[i].source != oper->env[i])
+				return FALSE;
+		}
+	}
+
+	return (i == oper->num_matches);
+}
+
+
 /**
  * event_operator_update:
  * @oper: operator to update.
@@ -262,9 +395,12 @@ event_operator_update (EventOperator *oper)
  * array of environment variables in KEY=VALUE form.
  *
  * Matching of environment is done first by position until the first variable
- * in @oper with a name specified is found, and subsequently by name.  Each
+ * in @oper with a name specified is found, and subsequently by name; the
+ * position of each unnamed variable is resolved by event_operator_compile()
+ * so only named variables need to be looked up in @event.  Each
  * value is matched against the equivalent in @event as a glob, undergoing
- * expansion against @env first.
+ * expansion against @env first; values found by event_operator_compile()
+ * to need neither are simply compared.
  *
  * This may only be called if the type of @oper is EVENT_MATCH.
  *
@@ -275,9 +411,6 @@ event_operator_match (EventOperator *oper,
 		      Event         *event,
 		      char * const  *env)
 {
-	char * const *oenv;
-	char * const *eenv;
-
 	nih_assert (oper != NULL);
 	nih_assert (oper->type == EVENT_MATCH);
 	nih_assert (oper->node.left == NULL);
@@ -288,37 +421,38 @@ event_operator_match (EventOperator *oper,
 	if (strcmp (oper->name, event->name))
 		return FALSE;
 
-	/* Match operator environment variables against those from the event,
-	 * starting both from the beginning.
+	/* Recompile the environment if it has changed since we last saw
+	 * it; memory is the only reason this can fail.
 	 */
-	for (oenv = oper->env, eenv = event->env; oenv && *oenv;
-	     oenv++, eenv++) {
-		nih_local char *expoval = NULL;
-		char           *oval, *eval;
-		int             negate = FALSE;
-		int             ret;
-
-		oval = strstr (*oenv, "!=");
-		if (! oval)
-			oval = strchr (*oenv, '=');
+	if (! event_operator_compiled (oper))
+		NIH_ZERO (event_operator_compile (oper));
 
-		if (oval) {
-			/* Hunt through the event environment to find the
-			 * equivalent entry */
-			eenv = environ_lookup (event->env, *oenv,
-					       oval - *oenv);
-
-			/* != means we negate the result (and skip the !) */
-			if (*oval == '!') {
-				negate = TRUE;
-				oval++;
-			}
-
-			/* Value to match against follows the equals. */
-			oval++;
+	/* Match operator environment variables against those from the
+	 * event.
+	 */
+	for (size_t i = 0; i < oper->num_matches; i++) {
+		const EventMatch *match = &oper->matches[i];
+		nih_local char   *expoval = NULL;
+		char * const     *eenv;
+		char             *eval;
+		int               ret;
+
+		/* Find the equivalent entry in the event environment for
+		 * named matches, using its index while it's being handled;
+		 * positional matches are checked in order, so the entry
+		 * before this one was present and indexing can go no
+		 * further than the terminating NULL.
+		 */
+		if (match->key && event->table) {
+			eenv = environ_table_lookup (event->table, match->key,
+						     match->keylen);
+		} else if (match->key) {
+			eenv = environ_lookup (event->env, match->key,
+					       match->keylen);
+		} else if (event->env) {
+			eenv = &event->env[match->position];
 		} else {
-			/* Value to match against is the whole string. */
-			oval = *oenv;
+			eenv = NULL;
 		}
 
 		/* Make sure we haven't gone off the end of the event
@@ -336,24 +470,37 @@ event_operator_match (EventOperator *oper,
 		nih_assert (eval != NULL);
 		eval++;
 
-		/* Expand operator value against given environment before
-		 * matching; silently discard errors, since otherwise we'd
-		 * be excessively noisy on every event.
-		 */
-		while (! (expoval = environ_expand (NULL, oval, env))) {
-			NihError *err;
-
-			err = nih_error_get ();
-			if (err->number != ENOMEM) {
+		switch (match->type) {
+		case EVENT_MATCH_LITERAL:
+			ret = strcmp (match->value, eval);
+			break;
+		case EVENT_MATCH_GLOB:
+			ret = fnmatch (match->value, eval, 0);
+			break;
+		case EVENT_MATCH_EXPAND:
+			/* Expand operator value against given environment
+			 * before matching; silently discard errors, since
+			 * otherwise we'd be excessively noisy on every event.
+			 */
+			while (! (expoval = environ_expand (NULL, match->value,
+							    env))) {
+				NihError *err;
+
+				err = nih_error_get ();
+				if (err->number != ENOMEM) {
+					nih_free (err);
+					return FALSE;
+				}
 				nih_free (err);
-				return FALSE;
 			}
-			nih_free (err);
-		}
 
-		ret = fnmatch (expoval, eval, 0);
+			ret = fnmatch (expoval, eval, 0);
+			break;
+		default:
+			nih_assert_not_reached ();
+		}
 
-		if (negate ? (! ret) : ret)
+		if (match->negate ? (! ret) : ret)
 			return FALSE;
 	}
 
@@ -38,6 +38,51 @@ typedef enum event_operator_type {
 	EVENT_MATCH
 } EventOperatorType;
 
+/**
+ * EventMatchType:
+ *
+ * This is used to record how the value of a compiled EventMatch is
+ * compared with the value from the event: EVENT_MATCH_LITERAL values
+ * contain no glob or expansion characters and are compared directly,
+ * EVENT_MATCH_GLOB values are matched as a glob and EVENT_MATCH_EXPAND
+ * values must be expanded against the job environment before being
+ * matched as a glob.
+ **/
+typedef enum event_match_type {
+	EVENT_MATCH_LITERAL,
+	EVENT_MATCH_GLOB,
+	EVENT_MATCH_EXPAND
+} EventMatchType;
+
+/**
+ * EventMatch:
+ * @source: environment entry this was compiled from,
+ * @key: start of variable name within @source, or NULL if positional,
+ * @keylen: length of @key,
+ * @position: index of event environment entry matched if positional,
+ * @negate: TRUE if the match should be negated,
+ * @type: how @value should be compared,
+ * @value: value to match within @source.
+ *
+ * This structure holds a single entry from the environment of an
+ * EVENT_MATCH operator parsed into the parts needed for matching, so
+ * that this need not be repeated for every event.  @key and @value point
+ * into @source rather than being copied.
+ *
+ * Positional matches are resolved to the index of the event environment
+ * entry they are compared with, counting only positional matches, so
+ * only named matches need to search the event environment.
+ **/
+typedef struct event_match {
+	const char     *source;
+	const char     *key;
+	size_t          keylen;
+	size_t          position;
+	int             negate;
+	EventMatchType  type;
+	const char     *value;
+} EventMatch;
+
 /**
  * EventOperator:
  * @node: tree node,
@@ -45,6 +90,8 @@ typedef enum event_operator_type {
  * @value: operator value,
  * @name: name of event to match (EVENT_MATCH only),
  * @env: environment variables of event to match (EVENT_MATCH only),
+ * @matches: compiled form of @env (EVENT_MATCH only),
+ * @num_matches: number of entries in @matches,
  * @event: event matched (EVENT_MATCH only).
  *
  * This structure is used to build up an event expression tree; the leaf
@@ -59,6 +106,9 @@ typedef enum event_operator_type {
  *
  * Once an event has been matched, the @event member is set and a reference
  * held until the structure is cleared.
+ *
+ * @matches is built from @env by event_operator_compile(); it is rebuilt
+ * automatically by event_operator_match() should @env be changed.
  **/
 typedef struct event_operator {
 	NihTree             node;
@@ -68,6 +118,8 @@ typedef struct event_operator {
 
 	char               *name;
 	char              **env;
+	EventMatch         *matches;
+	size_t              num_matches;
 
 	Event              *event;
 } EventOperator;
@@ -85,6 +137,9 @@ EventOperator *event_operator_copy        (const void *parent,
 
 int            event_operator_destroy     (EventOperator *oper);
 
+int            event_operator_compile     (EventOperator *oper)
+	__attribute__ ((warn_unused_result));
+
 void           event_operator_update      (EventOperator *oper);
 int            event_operator_match       (EventOperator *oper, Event *event,
 					   char * const *env);
@@ -27,6 +27,7 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <nih/macros.h>
 #include <nih/alloc.h>
@@ -57,6 +58,10 @@
 #include "parse_job.h"
 #include "state.h"
 #include "apparmor.h"
+#include "trace.h"
+#include "schedule.h"
+#include "listen.h"
+#include "notify.h"
 
 #ifdef ENABLE_CGROUPS
 #include "cgroup.h"
@@ -120,6 +125,20 @@ job_destroy (Job *job)
 			}
 		}
 	}
+
+	for (i = 0; i < PROCESS_LAST; i++)
+		nih_list_destroy (&job->pid_index[i].entry);
+
+	schedule_job_destroy (job);
+
+	if (job->respawn_timer)
+		nih_free (job->respawn_timer);
+
+	if (job->listen_fd >= 0)
+		close (job->listen_fd);
+
+	notify_job_close (job);
+
 	nih_list_destroy (&job->entry);
 
 	return 0;
@@ -160,6 +179,21 @@ job_new (JobClass   *class,
 
 	/* Ensure unset before destructor could possibly be called */
 	job->process_data = NULL;
+	job->queued = NULL;
+	job->scheduled = FALSE;
+	job->listen_fd = -1;
+	job->listen_socket = -1;
+	job->notify_fd = -1;
+	job->notify_watch = NULL;
+	job->notify_ready = FALSE;
+	job->notify_uid = (uid_t)-1;
+
+	for (i = 0; i < PROCESS_LAST; i++) {
+		nih_list_init (&job->pid_index[i].entry);
+		job->pid_index[i].pid = 0;
+		job->pid_index[i].job = job;
+		job->pid_index[i].process = i;
+	}
 
 	nih_alloc_set_destructor (job, job_destroy);
 
@@ -230,6 +264,8 @@ job_new (JobClass   *class,
 
 	job->respawn_time = 0;
 	job->respawn_count = 0;
+	job->respawn_backoff = 0;
+	job->respawn_timer = NULL;
 
 	job->trace_forks = 0;
 	job->trace_state = TRACE_NONE;
@@ -345,6 +381,8 @@ job_change_goal (Job     *job,
 				job_goal_name (job->goal)));
 	}
 
+	control_queue_job_state (job);
+
 
 	/* Normally whatever process or event is associated with the state
 	 * will finish naturally, so all we need do is change the goal and
@@ -363,6 +401,13 @@ job_change_goal (Job     *job,
 		if (job->state == JOB_RUNNING)
 			job_change_state (job, job_next_state (job));
 
+		/* Don't wait out the respawn delay of a job that will
+		 * no longer be respawned; we can't finish stopping it
+		 * here since our caller expects it to remain.
+		 */
+		if ((job->state == JOB_POST_STOP) && job->respawn_timer)
+			job_process_set_respawn_timer (job, 0);
+
 		break;
 	case JOB_RESPAWN:
 		break;
@@ -398,7 +443,7 @@ job_change_state (Job      *job,
 
 	while (job->state != state) {
 		JobState old_state;
-		int      unused;
+		int      admit;
 
 		/* If we got blocked during async spawns, stop
 		 * transitions.
@@ -406,12 +451,24 @@ job_change_state (Job      *job,
 		if (job->blocker)
 		    return;
 
+		/* Once its starting event has finished, a job may be
+		 * held back by the start scheduler until fewer jobs are
+		 * starting; schedule_admit() moves it on.
+		 */
+		if ((job->state == JOB_STARTING)
+		    && (state == JOB_SECURITY_SPAWNING)
+		    && (! schedule_job_admit (job)))
+			return;
+
 		nih_info (_("%s state changed from %s to %s"), job_name (job),
 			  job_state_name (job->state), job_state_name (state));
 
 		old_state = job->state;
 		job->state = state;
 
+		trace_record (TRACE_JOB_STATE, job->class->name, job->name,
+			      job_state_name (job->state));
+
 		NIH_LIST_FOREACH (control_conns, iter) {
 			NihListEntry   *entry = (NihListEntry *)iter;
 			DBusConnection *conn = (DBusConnection *)entry->data;
@@ -421,6 +478,13 @@ job_change_state (Job      *job,
 					job_state_name (job->state)));
 		}
 
+		control_queue_job_state (job);
+
+		/* Leaving the starting states frees a place for a job
+		 * held back by the start scheduler.
+		 */
+		admit = schedule_job_state (job);
+
 		/* Perform whatever action is necessary to enter the new
 		 * state, such as executing a process or emitting an event.
 		 */
@@ -513,6 +577,12 @@ job_change_state (Job      *job,
 
 			if (! job->class->process[PROCESS_MAIN]) {
 				state = job_next_state (job);
+			} else if (job->notify_ready) {
+				/* Main process said it was ready before we
+				 * got here, so don't wait for it to again.
+				 */
+				notify_job_close (job);
+				state = job_next_state (job);
 			}
 
 			break;
@@ -610,7 +680,12 @@ job_change_state (Job      *job,
 		case JOB_POST_STOP:
 			nih_assert (old_state == JOB_POST_STOPPING);
 
-			if (! job->class->process[PROCESS_POST_STOP]) {
+			/* A respawn is held here until the respawn
+			 * timer expires.
+			 */
+			if ((! job->class->process[PROCESS_POST_STOP])
+			    && ! (job->respawn_timer
+				  && (job->goal == JOB_START))) {
 				state = job_next_state (job);
 			}
 			break;
@@ -623,42 +698,63 @@ job_change_state (Job      *job,
 
 			job_finished (job, FALSE);
 
-			/* Remove the job from the list of instances and
-			 * then allow a better class to replace us
-			 * in the hash table if we have no other instances
-			 * and there is one.
-			 */
-			nih_list_remove (&job->entry);
-			unused = job_class_reconsider (job->class);
+			job_discard (job);
 
-			/* If the class is due to be deleted, free it
-			 * taking the job with it; otherwise free the
-			 * job.
-			 */
-			if (job->class->deleted && unused) {
-				nih_debug ("Destroyed unused job %s",
-					   job->class->name);
-				nih_free (job->class);
-			} else {
-				nih_debug ("Destroyed inactive instance %s",
-					   job_name (job));
+			if (admit)
+				schedule_admit ();
 
-				NIH_LIST_FOREACH (control_conns, iter) {
-					NihListEntry   *entry = (NihListEntry *)iter;
-					DBusConnection *conn = (DBusConnection *)entry->data;
+			return;
+		}
 
-					NIH_ZERO (job_class_emit_instance_removed (
-							  conn,
-							  job->class->path,
-							  job->path));
-				}
+		if (admit)
+			schedule_admit ();
+	}
+}
 
-				/* Destroy the instance */
-				nih_free (job);
-			}
+/**
+ * job_discard:
+ * @job: waiting job to be freed.
+ *
+ * Removes @job from the list of instances of its class, allowing a
+ * better class to replace it in the hash table if there are no other
+ * instances and there is one, and then frees it; or if the class is due
+ * to be deleted and has no other instances, frees the class taking the
+ * job with it.
+ *
+ * This is called once a job has reached the waiting state with a goal
+ * of stop, or was stopped while held back by the start scheduler.
+ **/
+void
+job_discard (Job *job)
+{
+	int unused;
 
-			return;
+	nih_assert (job != NULL);
+	nih_assert (job->state == JOB_WAITING);
+
+	nih_list_remove (&job->entry);
+	listen_class_resume (job->class);
+
+	unused = job_class_reconsider (job->class);
+
+	if (job->class->deleted && unused) {
+		nih_debug ("Destroyed unused job %s", job->class->name);
+		nih_free (job->class);
+	} else {
+		nih_debug ("Destroyed inactive instance %s", job_name (job));
+
+		NIH_LIST_FOREACH (control_conns, iter) {
+			NihListEntry   *entry = (NihListEntry *)iter;
+			DBusConnection *conn = (DBusConnection *)entry->data;
+
+			NIH_ZERO (job_class_emit_instance_removed (
+					  conn,
+					  job->class->path,
+					  job->path));
 		}
+
+		/* Destroy the instance */
+		nih_free (job);
 	}
 }
 
@@ -1856,6 +1952,34 @@ job_serialise (const Job *job)
 
 	json_object_object_add (json, "pid", json_pid);
 
+#ifdef ENABLE_CGROUPS
+	/* Note which processes are waiting on the cgroup manager; the
+	 * request itself doesn't survive the re-exec so is simply made
+	 * again by the new instance.
+	 */
+	{
+		json_object *json_cgroup_wait;
+		int          cgroup_wait[PROCESS_LAST];
+		int          waiting = FALSE;
+
+		for (int process = 0; process < PROCESS_LAST; process++) {
+			cgroup_wait[process] = job_process_cgroups_pending (job, process);
+			if (cgroup_wait[process])
+				waiting = TRUE;
+		}
+
+		if (waiting) {
+			json_cgroup_wait = state_serialise_int_array (int,
+					cgroup_wait, PROCESS_LAST);
+			if (! json_cgroup_wait)
+				goto error;
+
+			json_object_object_add (json, "cgroup_wait",
+					json_cgroup_wait);
+		}
+	}
+#endif /* ENABLE_CGROUPS */
+
 	/* Encode the blocking event as an index number which represents
 	 * the event's position in the JSON events array.
 	 */
@@ -1920,6 +2044,48 @@ job_serialise (const Job *job)
 	if (! state_set_json_int_var_from_obj (json, job, respawn_count))
 		goto error;
 
+	if (! state_set_json_int_var_from_obj (json, job, respawn_backoff))
+		goto error;
+
+	/* conditionally encode respawn timer */
+	if (job->respawn_timer) {
+		json_object *respawn_timer;
+
+		respawn_timer = job_serialise_kill_timer (job->respawn_timer);
+
+		if (! respawn_timer)
+			goto error;
+
+		json_object_object_add (json, "respawn_timer", respawn_timer);
+	}
+
+	/* Clear the cloexec flag to ensure the connection remains
+	 * open across the re-exec.
+	 */
+	if ((job->listen_fd >= 0)
+	    && (state_modify_cloexec (job->listen_fd, FALSE) < 0))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, job, listen_fd))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, job, listen_socket))
+		goto error;
+
+	/* Likewise for the socket the main process reports readiness on */
+	if ((job->notify_fd >= 0)
+	    && (state_modify_cloexec (job->notify_fd, FALSE) < 0))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, job, notify_fd))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, job, notify_ready))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, job, notify_uid))
+		goto error;
+
 	if (! state_set_json_int_var_from_obj (json, job, trace_forks))
 		goto error;
 
@@ -2033,11 +2199,17 @@ job_deserialise (JobClass *parent, json_object *json)
 	nih_local char *name = NULL;
 	Job            *job = NULL;
 	json_object    *json_kill_timer;
+	json_object    *json_respawn_timer;
 	json_object    *json_fds;
 	json_object    *json_pid;
 	json_object    *json_logs;
 	json_object    *json_process_data;
 	json_object    *json_stop_on = NULL;
+#ifdef ENABLE_CGROUPS
+	json_object    *json_cgroup_wait;
+	nih_local int  *cgroup_wait = NULL;
+	size_t          cgroup_wait_len = 0;
+#endif /* ENABLE_CGROUPS */
 	size_t          len;
 	int             ret;
 
@@ -2196,6 +2368,61 @@ job_deserialise (JobClass *parent, json_object *json)
 	if (! state_get_json_int_var_to_obj (json, job, respawn_count))
 		goto error;
 
+	/* Versions without respawn backoff never delay a respawn */
+	if (json_object_object_get_ex (json, "respawn_backoff", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, job, respawn_backoff))
+			goto error;
+	}
+
+	/* The respawn timer is encoded the same way as the kill timer */
+	if (json_object_object_get_ex (json, "respawn_timer", &json_respawn_timer)) {
+		nih_local NihTimer *respawn_timer = job_deserialise_kill_timer (json_respawn_timer);
+		if (! respawn_timer)
+			goto error;
+
+		job_process_set_respawn_timer (job, respawn_timer->timeout);
+		job_process_adj_respawn_timer (job, respawn_timer->due);
+	}
+
+	/* Versions without socket activation never accept connections */
+	if (json_object_object_get_ex (json, "listen_fd", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, job, listen_fd))
+			goto error;
+
+		if ((job->listen_fd >= 0)
+		    && (state_modify_cloexec (job->listen_fd, TRUE) < 0))
+			goto error;
+	}
+
+	/* Versions without instance limits don't record the socket */
+	if (json_object_object_get_ex (json, "listen_socket", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, job, listen_socket))
+			goto error;
+	}
+
+	/* Versions without readiness notification have no notify socket */
+	if (json_object_object_get_ex (json, "notify_fd", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, job, notify_fd))
+			goto error;
+
+		if (job->notify_fd >= 0) {
+			if (state_modify_cloexec (job->notify_fd, TRUE) < 0)
+				goto error;
+
+			notify_job_watch (job);
+		}
+	}
+
+	if (json_object_object_get_ex (json, "notify_ready", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, job, notify_ready))
+			goto error;
+	}
+
+	if (json_object_object_get_ex (json, "notify_uid", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, job, notify_uid))
+			goto error;
+	}
+
 	if (! json_object_object_get_ex (json, "fds", &json_fds))
 		goto error;
 
@@ -2228,6 +2455,17 @@ job_deserialise (JobClass *parent, json_object *json)
 		goto error;
 	}
 
+	/* Make the restored processes known so they can be reaped */
+	for (int i = 0; i < PROCESS_LAST; i++) {
+		if (job->pid[i] > 0)
+			job_process_set_pid (job, i, job->pid[i]);
+	}
+
+	/* Count the job against the start limits, and hold it back
+	 * again if it was queued.
+	 */
+	schedule_job_restore (job);
+
 	if (! state_get_json_int_var_to_obj (json, job, trace_forks))
 			goto error;
 
@@ -2296,6 +2534,21 @@ job_deserialise (JobClass *parent, json_object *json)
 		}
 	}
 
+#ifdef ENABLE_CGROUPS
+	if (json_object_object_get_ex (json, "cgroup_wait", &json_cgroup_wait)) {
+		ret = state_deserialise_int_array (NULL, json_cgroup_wait,
+				int, &cgroup_wait, &cgroup_wait_len);
+		if (ret < 0)
+			goto error;
+
+		for (size_t process = 0; process < cgroup_wait_len
+				&& process < PROCESS_LAST; process++) {
+			if (cgroup_wait[process])
+				job_process_cgroups_resume (job, process);
+		}
+	}
+#endif /* ENABLE_CGROUPS */
+
 	return job;
 
 error:
@@ -2645,7 +2898,7 @@ job_child_error_handler (Job *job, ProcessType process)
 	nih_assert (process > PROCESS_INVALID);
 	nih_assert (process < PROCESS_LAST);
 
-	job->pid[process] = 0;
+	job_process_set_pid (job, process, 0);
 
 	switch (process) {
 	case PROCESS_SECURITY:
@@ -29,6 +29,7 @@
 #include <nih/macros.h>
 #include <nih/list.h>
 #include <nih/timer.h>
+#include <nih/io.h>
 
 #include <nih-dbus/dbus_message.h>
 
@@ -99,6 +100,25 @@ typedef enum trace_state {
 
 typedef struct job_process_data JobProcessData;
 
+/**
+ * JobPid:
+ * @entry: list header,
+ * @pid: process id,
+ * @job: job @pid belongs to,
+ * @process: which of @job's processes is running as @pid.
+ *
+ * This structure is embedded in the Job structure once for each process
+ * type and placed in the job_process_pids hash table while that process
+ * is running, allowing the job to be found from a process id without
+ * iterating every job.
+ **/
+typedef struct job_pid {
+	NihList       entry;
+	pid_t         pid;
+	struct job   *job;
+	ProcessType   process;
+} JobPid;
+
 /**
  * Job:
  * @entry: list header,
@@ -115,6 +135,7 @@ typedef struct job_process_data JobProcessData;
  *       JobClasses @start_on condition,
  * @num_fds: number of elements in @fds,
  * @pid: current process ids,
+ * @pid_index: entries for @pid in the job_process_pids hash table,
  * @blocker: emitted event we're waiting to finish,
  * @blocking: list of events we're blocking from finishing,
  * @kill_timer: timer to kill process,
@@ -122,12 +143,26 @@ typedef struct job_process_data JobProcessData;
  * @failed: whether the last process ran failed,
  * @failed_process: the last process that failed,
  * @exit_status: exit status of the last failed process,
- * @respawn_time: time job was first respawned,
+ * @respawn_time: time job was first respawned, or with a respawn delay,
+ * last respawned,
  * @respawn_count: number of respawns since @respawn_time,
+ * @respawn_backoff: current respawn delay,
+ * @respawn_timer: timer to respawn job once @respawn_backoff has passed,
  * @trace_forks: number of forks traced,
  * @trace_state: state of trace,
  * @log: pointer to array of log objects for handling job output,
- * @process_data: transitory async job process metadata.
+ * @process_data: transitory async job process metadata,
+ * @queued: entry in schedule_queue while held back by the start scheduler,
+ * @scheduled: TRUE while counted as starting by the start scheduler,
+ * @listen_fd: connection accepted for the job until its main process is
+ * spawned, or -1,
+ * @listen_socket: position within the sockets of its class of the one
+ * its connection was accepted from, or -1,
+ * @notify_fd: socket the main process reports readiness on, or -1,
+ * @notify_watch: watch on @notify_fd,
+ * @notify_ready: TRUE if the main process reported readiness before the
+ * job was spawned,
+ * @notify_uid: user the main process runs as once spawned, or -1.
  *
  * This structure holds the state of an active job instance being tracked
  * by the init daemon, the configuration details of the job are available
@@ -152,6 +187,7 @@ typedef struct job {
 	size_t           num_fds;
 
 	pid_t           *pid;
+	JobPid           pid_index[PROCESS_LAST];
 	Event           *blocker;
 	NihList          blocking;
 
@@ -164,12 +200,24 @@ typedef struct job {
 
 	time_t           respawn_time;
 	int              respawn_count;
+	time_t           respawn_backoff;
+	NihTimer        *respawn_timer;
 
 	int              trace_forks;
 	TraceState       trace_state;
 	Log            **log;
 	JobProcessData **process_data;
 
+	NihListEntry    *queued;
+	int              scheduled;
+
+	int              listen_fd;
+	int              listen_socket;
+
+	int              notify_fd;
+	NihIoWatch      *notify_watch;
+	int              notify_ready;
+	uid_t            notify_uid;
 } Job;
 
 /**
@@ -233,6 +281,7 @@ void        job_change_goal     (Job *job, JobGoal goal);
 
 void        job_change_state    (Job *job, JobState state);
 JobState    job_next_state      (Job *job);
+void        job_discard         (Job *job);
 
 void        job_failed          (Job *job, ProcessType process, int status);
 void        job_finished        (Job *job, int failed);
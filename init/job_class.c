@@ -55,6 +55,7 @@
 #include "conf.h"
 #include "control.h"
 #include "parse_job.h"
+#include "listen.h"
 
 #ifdef ENABLE_CGROUPS
 #include "cgroup.h"
@@ -71,8 +72,12 @@ extern int no_inherit_env;
 extern char **environ;
 
 /* Prototypes for static functions */
-static void  job_class_add (JobClass *class);
+static void  job_class_add (JobClass *class, JobClass *replaced);
 static int   job_class_remove (JobClass *class, const Session *session);
+static void  job_class_index_events (JobClass *class);
+static void  job_class_unindex_events (JobClass *class);
+static char **job_class_event_names (const void *parent, JobClass *class)
+	__attribute__ ((warn_unused_result));
 
 /**
  * default_console:
@@ -92,13 +97,24 @@ int default_console = -1;
  **/
 NihHash *job_classes = NULL;
 
+/**
+ * job_class_events:
+ *
+ * This hash table indexes the registered job classes by the names of the
+ * events their start on and stop on conditions refer to, so that an
+ * event need only be matched against the classes that could react to it.
+ * Each entry is a JobClassEvents structure; it is maintained by
+ * job_class_add() and job_class_remove().
+ **/
+NihHash *job_class_events = NULL;
+
 /**
  * job_environ:
  *
- * Array of environment variables that will be set in the jobs
- * environment.
+ * Table of environment variables that will be set in the jobs
+ * environment, allocated as a child of its array.
  **/
-static char **job_environ = NULL;
+static EnvironTable *job_environ = NULL;
 
 /**
  * initial_umask:
@@ -110,13 +126,16 @@ mode_t initial_umask;
 /**
  * job_class_init:
  *
- * Initialise the job classes hash table.
+ * Initialise the job classes and job class events hash tables.
  **/
 void
 job_class_init (void)
 {
 	if (! job_classes)
 		job_classes = NIH_MUST (nih_hash_string_new (NULL, 0));
+
+	if (! job_class_events)
+		job_class_events = NIH_MUST (nih_hash_string_new (NULL, 0));
 }
 
 /**
@@ -128,15 +147,17 @@ void
 job_class_environment_init (void)
 {
 	char * const default_environ[] = { JOB_DEFAULT_ENVIRONMENT, NULL };
+	char       **env;
 
 	if (job_environ)
 		return;
 
-	job_environ = NIH_MUST (nih_str_array_new (NULL));
-	NIH_MUST (environ_append (&job_environ, NULL, 0, TRUE, default_environ));
+	env = NIH_MUST (nih_str_array_new (NULL));
+	job_environ = NIH_MUST (environ_table_new (env, env));
+	NIH_MUST (environ_table_append (job_environ, TRUE, default_environ));
 
 	if (user_mode && ! no_inherit_env)
-		NIH_MUST(environ_append (&job_environ, NULL, 0, TRUE, environ));
+		NIH_MUST (environ_table_append (job_environ, TRUE, environ));
 }
 
 /**
@@ -162,7 +183,7 @@ void
 job_class_environment_clear (void)
 {
 	if (job_environ) {
-		nih_free (job_environ);
+		nih_free (job_environ->env);
 		job_environ = NULL;
 	}
 }
@@ -184,7 +205,7 @@ job_class_environment_set (const char *var, int replace)
 	nih_assert (var);
 	nih_assert (job_environ);
 
-	if (! environ_add (&job_environ, NULL, NULL, replace, var))
+	if (! environ_table_add (job_environ, replace, var))
 		return -1;
 
 	/* Update all running jobs */
@@ -217,8 +238,7 @@ job_class_environment_unset (const char *name)
 	nih_assert (name);
 	nih_assert (job_environ);
 
-	if (! environ_remove (&job_environ, NULL, NULL, name))
-		return -1;
+	environ_table_remove (job_environ, name);
 
 	/* Update all running jobs */
 	NIH_HASH_FOREACH (job_classes, iter) {
@@ -250,7 +270,7 @@ job_class_environment_get_all (const void *parent)
 {
 	nih_assert (job_environ);
 
-	return nih_str_array_copy (parent, NULL, job_environ);
+	return nih_str_array_copy (parent, NULL, job_environ->env);
 }
 
 /**
@@ -271,7 +291,7 @@ job_class_environment_get (const char *name)
 	nih_assert (name);
 	nih_assert (job_environ);
 
-	return environ_get (job_environ, name);
+	return environ_table_get (job_environ, name);
 }
 
 /**
@@ -368,6 +388,9 @@ job_class_new (const void *parent,
 	class->respawn = FALSE;
 	class->respawn_limit = JOB_DEFAULT_RESPAWN_LIMIT;
 	class->respawn_interval = JOB_DEFAULT_RESPAWN_INTERVAL;
+	class->respawn_delay = 0;
+	class->respawn_delay_max = JOB_DEFAULT_RESPAWN_DELAY_MAX;
+	class->respawn_stable = JOB_DEFAULT_RESPAWN_DELAY_MAX;
 
 	class->normalexit = NULL;
 	class->normalexit_len = 0;
@@ -396,6 +419,16 @@ job_class_new (const void *parent,
 
 	class->cgmanager_wait = FALSE;
 
+	class->event_index = NULL;
+
+	class->concurrency_group = NULL;
+	class->concurrency_limit = 0;
+	class->priority = 0;
+
+	nih_list_init (&class->listen);
+	class->listen_accept = FALSE;
+	class->listen_serial = 0;
+
 	nih_list_init (&class->cgroups);
 
 	return class;
@@ -473,7 +506,7 @@ job_class_consider (JobClass *class)
 			}
 		}
 
-		job_class_add (best);
+		job_class_add (best, registered);
 	}
 
 	return (class == best ? TRUE : FALSE);
@@ -511,7 +544,7 @@ job_class_reconsider (JobClass *class)
 			if (! job_class_remove (class, class->session))
 				return FALSE;
 
-			job_class_add (best);
+			job_class_add (best, class);
 
 			return TRUE;
 		} else {
@@ -598,20 +631,30 @@ job_class_event_block (void *parent, JobClass *old, JobClass *new)
 
 /**
  * job_class_add:
- * @class: new class to select.
+ * @class: new class to select,
+ * @replaced: class just removed by job_class_remove().
  *
  * Adds @class to the hash table and registers it with all current D-Bus
  * connections.  @class may be NULL.
+ *
+ * If @replaced is not NULL, its listening sockets are passed on to
+ * @class rather than being closed and opened again.
  **/
 static void
-job_class_add (JobClass *class)
+job_class_add (JobClass *class,
+	       JobClass *replaced)
 {
 	control_init ();
 
+	if (replaced)
+		listen_class_handover (replaced, class);
+
 	if (! class)
 		return;
 
 	nih_hash_add (job_classes, &class->entry);
+	job_class_index_events (class);
+	listen_class_open (class);
 
 	NIH_LIST_FOREACH (control_conns, iter) {
 		NihListEntry   *entry = (NihListEntry *)iter;
@@ -642,7 +685,7 @@ job_class_add_safe (JobClass *class)
 
 	nih_assert (! registered);
 
-	job_class_add (class);
+	job_class_add (class, NULL);
 }
 
 
@@ -652,7 +695,8 @@ job_class_add_safe (JobClass *class)
  * @session: Session of @class.
  *
  * Removes @class from the hash table and unregisters it from all current
- * D-Bus connections.
+ * D-Bus connections.  Its listening sockets are left open for
+ * job_class_add() to pass on to the class that replaces it.
  *
  * Returns: TRUE if class could be unregistered, FALSE if there are
  * active instances that prevent unregistration, or if @session
@@ -673,6 +717,7 @@ job_class_remove (JobClass *class, const Session *session)
 		return FALSE;
 
 	nih_list_remove (&class->entry);
+	job_class_unindex_events (class);
 
 	NIH_LIST_FOREACH (control_conns, iter) {
 		NihListEntry   *entry = (NihListEntry *)iter;
@@ -684,6 +729,186 @@ job_class_remove (JobClass *class, const Session *session)
 	return TRUE;
 }
 
+/**
+ * job_class_event_names:
+ * @parent: parent object for new array,
+ * @class: class to examine.
+ *
+ * Builds a list of the distinct event names referred to by EVENT_MATCH
+ * nodes in the start on and stop on conditions of @class.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: newly allocated NULL-terminated array of event names, or NULL
+ * if insufficient memory.
+ **/
+static char **
+job_class_event_names (const void *parent,
+		       JobClass   *class)
+{
+	EventOperator  *roots[2];
+	char          **names;
+	size_t          len = 0;
+
+	nih_assert (class != NULL);
+
+	names = nih_str_array_new (parent);
+	if (! names)
+		return NULL;
+
+	roots[0] = class->start_on;
+	roots[1] = class->stop_on;
+
+	for (int i = 0; i < 2; i++) {
+		if (! roots[i])
+			continue;
+
+		NIH_TREE_FOREACH_POST (&roots[i]->node, iter) {
+			EventOperator *oper = (EventOperator *)iter;
+			int            found = FALSE;
+
+			if (oper->type != EVENT_MATCH)
+				continue;
+
+			for (char **name = names; name && *name; name++) {
+				if (! strcmp (*name, oper->name)) {
+					found = TRUE;
+					break;
+				}
+			}
+
+			if (found)
+				continue;
+
+			if (! nih_str_array_add (&names, parent, &len,
+						 oper->name)) {
+				nih_free (names);
+				return NULL;
+			}
+		}
+	}
+
+	return names;
+}
+
+/**
+ * job_class_index_events:
+ * @class: newly registered class.
+ *
+ * Adds @class to the job_class_events index under the name of every event
+ * its start on and stop on conditions refer to.  The index entries are
+ * allocated beneath @class so they are automatically discarded should it
+ * be freed while still registered.
+ **/
+static void
+job_class_index_events (JobClass *class)
+{
+	nih_local char **names = NULL;
+
+	nih_assert (class != NULL);
+	nih_assert (class->event_index == NULL);
+
+	job_class_init ();
+
+	names = NIH_MUST (job_class_event_names (NULL, class));
+	if (! *names)
+		return;
+
+	class->event_index = NIH_MUST (nih_alloc (class, 1));
+
+	for (char **name = names; *name; name++) {
+		JobClassEvents *index;
+		NihListEntry   *entry;
+
+		index = (JobClassEvents *)nih_hash_lookup (job_class_events,
+							   *name);
+		if (! index) {
+			index = NIH_MUST (nih_new (NULL, JobClassEvents));
+
+			nih_list_init (&index->entry);
+			nih_list_init (&index->classes);
+			nih_alloc_set_destructor (index, nih_list_destroy);
+
+			index->name = NIH_MUST (nih_strdup (index, *name));
+
+			nih_hash_add (job_class_events, &index->entry);
+		}
+
+		entry = NIH_MUST (nih_list_entry_new (class->event_index));
+		entry->data = class;
+
+		nih_list_add (&index->classes, &entry->entry);
+	}
+}
+
+/**
+ * job_class_unindex_events:
+ * @class: class being deregistered.
+ *
+ * Removes @class from the job_class_events index, discarding any index
+ * entries that no longer refer to a registered class.
+ **/
+static void
+job_class_unindex_events (JobClass *class)
+{
+	nih_local char **names = NULL;
+
+	nih_assert (class != NULL);
+
+	if (! class->event_index)
+		return;
+
+	job_class_init ();
+
+	/* Freeing the parent unlinks each of our entries from the
+	 * per-event lists.
+	 */
+	nih_free (class->event_index);
+	class->event_index = NULL;
+
+	names = NIH_MUST (job_class_event_names (NULL, class));
+
+	for (char **name = names; *name; name++) {
+		JobClassEvents *index;
+
+		index = (JobClassEvents *)nih_hash_lookup (job_class_events,
+							   *name);
+		if (index && NIH_LIST_EMPTY (&index->classes))
+			nih_free (index);
+	}
+}
+
+/**
+ * job_class_event_classes:
+ * @name: name of event.
+ *
+ * Look up the registered job classes whose start on or stop on conditions
+ * refer to the event @name.
+ *
+ * Returns: list of NihListEntry structures whose data members are the
+ * matching JobClass structures, or NULL if no registered class refers to
+ * @name.  The list may be safely iterated with NIH_LIST_FOREACH_SAFE()
+ * while classes are added and removed.
+ **/
+NihList *
+job_class_event_classes (const char *name)
+{
+	JobClassEvents *index;
+
+	nih_assert (name != NULL);
+
+	job_class_init ();
+
+	index = (JobClassEvents *)nih_hash_lookup (job_class_events, name);
+	if (! index)
+		return NULL;
+
+	return &index->classes;
+}
+
 /**
  * job_class_register:
  * @class: class to register,
@@ -772,35 +997,42 @@ job_class_environment (const void *parent,
 		       JobClass   *class,
 		       size_t     *len)
 {
-	char  **env;
+	char         **env;
+	EnvironTable  *table;
 
 	nih_assert (class != NULL);
 	nih_assert (job_environ);
 
-	env = nih_str_array_new (parent);
+	/* Copy the set of environment variables, usually these just
+	 * pick up the values from init's own environment; the table
+	 * holds no duplicates so it can be copied as it stands.
+	 */
+	env = nih_str_array_copy (parent, NULL, job_environ->env);
 	if (! env)
 		return NULL;
-	if (len)
-		*len = 0;
 
-	/* Copy the set of environment variables, usually these just
-	 * pick up the values from init's own environment.
-	 */
-	if (! environ_append (&env, parent, len, TRUE, job_environ))
-		goto error;
+	table = environ_table_new (env, env);
+	if (! table) {
+		nih_free (env);
+		return NULL;
+	}
 
 	/* Copy the set of environment variables from the job configuration,
 	 * these often have values but also often don't and we want them to
 	 * override the builtins.
 	 */
-	if (! environ_append (&env, parent, len, TRUE, class->env))
-		goto error;
+	if (! environ_table_append (table, TRUE, class->env)) {
+		nih_free (table->env);
+		return NULL;
+	}
 
-	return env;
+	env = table->env;
+	if (len)
+		*len = table->len;
 
-error:
-	nih_free (env);
-	return NULL;
+	nih_free (table);
+
+	return env;
 }
 
 
@@ -1855,7 +2087,7 @@ job_class_serialise_job_environ (void)
 
 	job_class_environment_init ();
 
-	json = state_serialise_str_array (job_environ);
+	json = state_serialise_str_array (job_environ->env);
 	if (! json)
 		goto error;
 
@@ -1877,6 +2109,8 @@ error:
 int
 job_class_deserialise_job_environ (json_object *json)
 {
+	char **env = NULL;
+
 	nih_assert (json);
 
 	nih_assert (! job_environ);
@@ -1884,9 +2118,15 @@ job_class_deserialise_job_environ (json_object *json)
 	if (! state_check_json_type (json, array))
 		goto error;
 
-	if (! state_deserialise_str_array (NULL, json, &job_environ))
+	if (! state_deserialise_str_array (NULL, json, &env))
 		goto error;
 
+	job_environ = environ_table_new (env, env);
+	if (! job_environ) {
+		nih_free (env);
+		goto error;
+	}
+
 	return 0;
 
 error:
@@ -1915,6 +2155,7 @@ job_class_serialise (JobClass *class)
 	json_object      *json_jobs;
 	json_object      *json_start_on;
 	json_object      *json_stop_on;
+	json_object      *json_listen;
 	int               session_index;
 
 #ifdef ENABLE_CGROUPS
@@ -2027,6 +2268,15 @@ job_class_serialise (JobClass *class)
 	if (! state_set_json_int_var_from_obj (json, class, respawn_interval))
 		goto error;
 
+	if (! state_set_json_int_var_from_obj (json, class, respawn_delay))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, class, respawn_delay_max))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, class, respawn_stable))
+		goto error;
+
 	json_normalexit = state_serialise_int_array (int, class->normalexit,
 					     class->normalexit_len);
 	if (! json_normalexit)
@@ -2080,6 +2330,27 @@ job_class_serialise (JobClass *class)
 	if (! state_set_json_int_var_from_obj (json, class, cgmanager_wait))
 		goto error;
 
+	if (! state_set_json_string_var_from_obj (json, class, concurrency_group))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, class, concurrency_limit))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, class, priority))
+		goto error;
+
+	json_listen = listen_serialise_all (&class->listen);
+	if (! json_listen)
+		goto error;
+
+	json_object_object_add (json, "listen", json_listen);
+
+	if (! state_set_json_int_var_from_obj (json, class, listen_accept))
+		goto error;
+
+	if (! state_set_json_int_var_from_obj (json, class, listen_serial))
+		goto error;
+
 #ifdef ENABLE_CGROUPS
 	json_cgroups = cgroup_serialise_all (&class->cgroups);
 	if (! json_cgroups)
@@ -2344,6 +2615,18 @@ job_class_deserialise (json_object *json)
 	if (! state_get_json_int_var_to_obj (json, class, respawn_interval))
 		goto error;
 
+	/* Versions without respawn backoff never delay a respawn */
+	if (json_object_object_get_ex (json, "respawn_delay", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, class, respawn_delay))
+			goto error;
+
+		if (! state_get_json_int_var_to_obj (json, class, respawn_delay_max))
+			goto error;
+
+		if (! state_get_json_int_var_to_obj (json, class, respawn_stable))
+			goto error;
+	}
+
 	if (! state_get_json_enum_var (json,
 				job_class_console_type_str_to_enum,
 				"console", class->console))
@@ -2387,6 +2670,30 @@ job_class_deserialise (json_object *json)
 			goto error;
 	}
 
+	/* Likewise for versions without the start scheduler */
+	if (json_object_object_get_ex (json, "concurrency_group", NULL)) {
+		if (! state_get_json_string_var_to_obj (json, class, concurrency_group))
+			goto error;
+
+		if (! state_get_json_int_var_to_obj (json, class, concurrency_limit))
+			goto error;
+
+		if (! state_get_json_int_var_to_obj (json, class, priority))
+			goto error;
+	}
+
+	/* And for versions without socket activation */
+	if (json_object_object_get_ex (json, "listen", NULL)) {
+		if (listen_deserialise_all (class, json) < 0)
+			goto error;
+
+		if (! state_get_json_int_var_to_obj (json, class, listen_accept))
+			goto error;
+
+		if (! state_get_json_int_var_to_obj (json, class, listen_serial))
+			goto error;
+	}
+
 	if (! json_object_object_get_ex (json, "normalexit", &json_normalexit))
 		goto error;
 
@@ -2524,6 +2831,7 @@ job_class_expect_type_enum_to_str (ExpectType expect)
 	state_enum_to_str (EXPECT_STOP, expect);
 	state_enum_to_str (EXPECT_DAEMON, expect);
 	state_enum_to_str (EXPECT_FORK, expect);
+	state_enum_to_str (EXPECT_NOTIFY, expect);
 
 	return NULL;
 }
@@ -2546,6 +2854,7 @@ job_class_expect_type_str_to_enum (const char *expect)
 	state_str_to_enum (EXPECT_STOP, expect);
 	state_str_to_enum (EXPECT_DAEMON, expect);
 	state_str_to_enum (EXPECT_FORK, expect);
+	state_str_to_enum (EXPECT_NOTIFY, expect);
 
 	return -1;
 }
@@ -44,12 +44,15 @@
  * This is used to determine what to expect to happen before moving the job
  * from the spawned state.  EXPECT_NONE means that we don't expect anything
  * so the job will move directly out of the spawned state without waiting.
+ * EXPECT_NOTIFY waits for the main process to send READY=1 to the socket
+ * named in its NOTIFY_SOCKET variable rather than tracing it.
  **/
 typedef enum expect_type {
 	EXPECT_NONE,
 	EXPECT_STOP,
 	EXPECT_DAEMON,
-	EXPECT_FORK
+	EXPECT_FORK,
+	EXPECT_NOTIFY
 } ExpectType;
 
 /**
@@ -94,6 +97,14 @@ typedef enum console_type {
  **/
 #define JOB_DEFAULT_RESPAWN_INTERVAL 5
 
+/**
+ * JOB_DEFAULT_RESPAWN_DELAY_MAX:
+ *
+ * The default maximum number of seconds to wait before respawning a job
+ * with a respawn delay.
+ **/
+#define JOB_DEFAULT_RESPAWN_DELAY_MAX 300
+
 /**
  * JOB_DEFAULT_UMASK:
  *
@@ -152,6 +163,11 @@ typedef enum console_type {
  * @respawn: instances should be restarted if main process fails,
  * @respawn_limit: number of respawns in @respawn_interval that we permit,
  * @respawn_interval: barrier for @respawn_limit,
+ * @respawn_delay: initial time to wait before respawning, or zero to
+ * respawn at once,
+ * @respawn_delay_max: maximum time to wait before respawning,
+ * @respawn_stable: time the main process must run for before the delay
+ * is reset to @respawn_delay,
  * @normalexit: array of exit codes that prevent a respawn,
  * @normalexit_len: length of @normalexit array,
  * @console: how to arrange processes' stdin/out/err file descriptors,
@@ -169,7 +185,18 @@ typedef enum console_type {
  * @cgroups: list of CGroup objects representing the cgroups the
  *  job is required to run in,
  * @cgmanager_wait: TRUE if job waiting for cgroup manager to be
- * available.
+ * available,
+ * @event_index: parent of this class's entries in the job_class_events
+ * index while it is registered,
+ * @concurrency_group: name of group whose jobs share @concurrency_limit,
+ * @concurrency_limit: maximum number of jobs of @concurrency_group that
+ * may be starting at once, or zero for no limit,
+ * @priority: order in which jobs held back by the start scheduler are
+ * started, highest first,
+ * @listen: list of ListenSocket structures init listens on for the job,
+ * @listen_accept: TRUE to accept each connection and start an instance
+ * to handle it, FALSE to start a single instance with the sockets,
+ * @listen_serial: number of the last connection accepted.
  *
  * This structure holds the configuration of a known task or service that
  * should be tracked by the init daemon; as tasks and services are
@@ -209,6 +236,9 @@ typedef struct job_class {
 	int             respawn;
 	int             respawn_limit;
 	time_t          respawn_interval;
+	time_t          respawn_delay;
+	time_t          respawn_delay_max;
+	time_t          respawn_stable;
 
 	int            *normalexit;
 	size_t          normalexit_len;
@@ -232,12 +262,41 @@ typedef struct job_class {
 	char	       *apparmor_switch;
 	NihList         cgroups;
 	int             cgmanager_wait;
+
+	void           *event_index;
+
+	char           *concurrency_group;
+	int             concurrency_limit;
+	int             priority;
+
+	NihList         listen;
+	int             listen_accept;
+	unsigned int    listen_serial;
 } JobClass;
 
+/**
+ * JobClassEvents:
+ * @entry: list header,
+ * @name: name of event,
+ * @classes: registered classes whose conditions name the event.
+ *
+ * This structure is an entry in the job_class_events hash table; @classes
+ * is a list of NihListEntry structures whose data member points at each
+ * registered JobClass with an EVENT_MATCH node for @name in either its
+ * start on or stop on condition.  A class appears at most once in the
+ * list of any given event.
+ **/
+typedef struct job_class_events {
+	NihList   entry;
+	char     *name;
+	NihList   classes;
+} JobClassEvents;
+
 
 NIH_BEGIN_EXTERN
 
 extern NihHash  *job_classes;
+extern NihHash  *job_class_events;
 
 void        job_class_init                 (void);
 
@@ -379,6 +438,9 @@ void job_class_prepare_reexec (void);
 time_t     job_class_max_kill_timeout (void)
 	__attribute__ ((warn_unused_result));
 
+NihList   *job_class_event_classes (const char *name)
+	__attribute__ ((warn_unused_result));
+
 JobClass  *job_class_get_registered (const char *name, const Session *session)
 	__attribute__ ((warn_unused_result));
 
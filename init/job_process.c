@@ -34,6 +34,8 @@
 #include <sys/ioctl.h>
 
 #include <time.h>
+#include <sched.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
 #include <limits.h>
@@ -53,6 +55,7 @@
 #include <nih/string.h>
 #include <nih/signal.h>
 #include <nih/io.h>
+#include <nih/hash.h>
 #include <nih/logging.h>
 #include <nih/error.h>
 #include <nih-dbus/dbus_util.h>
@@ -68,11 +71,32 @@
 #include "control.h"
 #include "xdg.h"
 #include "apparmor.h"
+#include "stats.h"
+#include "listen.h"
+#include "notify.h"
 
 #ifdef ENABLE_CGROUPS
 #include "cgroup.h"
 #endif /* ENABLE_CGROUPS */
 
+/**
+ * JOB_PROCESS_PIDS_SIZE:
+ *
+ * Number of bins in the job_process_pids hash table; since it is sized
+ * once and never grows, this allows for several thousand processes
+ * before chains become long.
+ **/
+#define JOB_PROCESS_PIDS_SIZE 1024
+
+/**
+ * JOB_PROCESS_CLONE_STACK_SIZE:
+ *
+ * Size of the stack used by a child spawned with clone(); the child only
+ * runs until it calls exec(), so this need only be large enough for
+ * the setup code in job_process_child().
+ **/
+#define JOB_PROCESS_CLONE_STACK_SIZE (256 * 1024)
+
 /**
  * SHELL_CHARS:
  *
@@ -95,6 +119,69 @@ typedef struct job_process_wire_error {
 	int                 errnum;
 } JobProcessWireError;
 
+/**
+ * JobProcessChild:
+ * @job: job of process to be spawned,
+ * @argv: NULL-terminated list of arguments for the process,
+ * @env: NULL-terminated list of environment variables for the process,
+ * @trace: whether to trace this process,
+ * @script_fd: script file descriptor,
+ * @process: job process to spawn,
+ * @fds: pipe to report errors to parent,
+ * @pty_master: master side of pty for CONSOLE_LOG jobs,
+ * @log_pipe: writing end of pipe for CONSOLE_LOG jobs when output is
+ * collected through a pipe rather than a pty, otherwise -1,
+ * @orig_set: signal mask to restore before exec(),
+ * @cgroups_needed: whether process must be placed into cgroups,
+ * @cgroups: cgroups already created by init for the process, or NULL
+ * if the process must create them itself,
+ * @groups: supplementary groups to set or NULL to call initgroups(),
+ * @ngroups: number of entries in @groups,
+ * @listen_fds: sockets to pass to the process,
+ * @num_listen_fds: number of entries in @listen_fds.
+ *
+ * This structure carries the details needed by the child process between
+ * job_process_spawn_with_fd() and job_process_child().
+ **/
+typedef struct job_process_child {
+	Job           *job;
+	char * const  *argv;
+	char * const  *env;
+	int            trace;
+	int            script_fd;
+	ProcessType    process;
+	int            fds[2];
+	int            pty_master;
+	int            log_pipe;
+	sigset_t       orig_set;
+	int            cgroups_needed;
+	NihList       *cgroups;
+	gid_t         *groups;
+	int            ngroups;
+	int            listen_fds[LISTEN_MAX_SOCKETS];
+	int            num_listen_fds;
+} JobProcessChild;
+
+#ifdef ENABLE_CGROUPS
+/**
+ * JobProcessCGroups:
+ * @entry: list header,
+ * @job: job of process waiting to be spawned,
+ * @process: process waiting to be spawned,
+ * @request: outstanding cgroup manager request, or NULL if none has
+ * been made yet.
+ *
+ * This structure tracks a job process whose spawning is deferred until
+ * the cgroup manager has created and configured its cgroups.
+ **/
+typedef struct job_process_cgroups {
+	NihList        entry;
+	Job           *job;
+	ProcessType    process;
+	CGroupRequest *request;
+} JobProcessCGroups;
+#endif /* ENABLE_CGROUPS */
+
 /**
  * log_dir:
  *
@@ -110,6 +197,26 @@ char *log_dir = NULL;
  **/
 int disable_respawn = FALSE;
 
+/**
+ * job_process_pids:
+ *
+ * This hash table holds the JobPid entries of every running job process
+ * indexed by process id, so that job_process_find() does not need to
+ * iterate every job; entries are added and removed by
+ * job_process_set_pid().
+ **/
+NihHash *job_process_pids = NULL;
+
+#ifdef ENABLE_CGROUPS
+/**
+ * job_process_cgroups_waiting:
+ *
+ * List of JobProcessCGroups entries for job processes waiting on the
+ * cgroup manager before they can be spawned.
+ **/
+static NihList *job_process_cgroups_waiting = NULL;
+#endif /* ENABLE_CGROUPS */
+
 /* Prototypes for static functions */
 static void job_process_remap_fd        (int *fd, int reserved_fd, int error_fd);
 
@@ -129,8 +236,51 @@ int disable_job_logging = 0;
  **/
 int no_inherit_env = FALSE;
 
+/**
+ * disable_clone_spawn:
+ *
+ * If TRUE, always spawn job processes with fork() rather than clone().
+ **/
+int disable_clone_spawn = FALSE;
+
+/**
+ * job_process_cloned:
+ *
+ * TRUE while a child spawned with clone() is running in our memory, used
+ * by job_process_child() to restrict itself to async-signal-safe calls
+ * and by job_process_child_abort() to avoid calling exit() in that child.
+ **/
+static int job_process_cloned = FALSE;
+
+/**
+ * job_process_clone_stack:
+ *
+ * Stack for children spawned with clone(); since we are suspended until
+ * the child calls exec() or exits, only one is ever in use.
+ **/
+static char job_process_clone_stack[JOB_PROCESS_CLONE_STACK_SIZE]
+	__attribute__ ((aligned (16)));
+
+/**
+ * job_process_groups:
+ *
+ * Supplementary group list set by processes of jobs running as root that
+ * are spawned with clone(), looked up by job_process_cache_groups(), or
+ * NULL if not known.
+ **/
+static gid_t *job_process_groups = NULL;
+
+/**
+ * job_process_ngroups:
+ *
+ * Number of entries in job_process_groups.
+ **/
+static int job_process_ngroups = 0;
+
 /* Prototypes for static functions */
 static void job_process_kill_timer      (Job *job, NihTimer *timer);
+static void job_process_respawn_timer   (Job *job, NihTimer *timer);
+static time_t job_process_respawn_delay (Job *job);
 static void job_process_terminated      (Job *job, ProcessType process,
 					 int status, int state_only);
 static int  job_process_catch_runaway   (Job *job);
@@ -142,6 +292,36 @@ static void job_process_trace_signal    (Job *job, ProcessType process,
 static void job_process_trace_fork      (Job *job, ProcessType process);
 static void job_process_trace_exec      (Job *job, ProcessType process);
 
+static void   job_process_child          (JobProcessChild *child)
+	__attribute__ ((noreturn));
+static void   job_process_child_abort    (int fd, JobProcessErrorType type,
+					  int arg)
+	__attribute__ ((noreturn));
+static void   job_process_format_pid     (char *str, pid_t pid);
+static int    job_process_clone_child    (void *arg);
+static int    job_process_clone_eligible (Job *job, ProcessType process,
+					  char * const argv[], int trace,
+					  int cgroups_needed, int log_pipe);
+static gid_t *job_process_root_groups    (const void *parent, int *ngroups)
+	__attribute__ ((warn_unused_result));
+
+#ifdef ENABLE_CGROUPS
+static JobProcessCGroups *job_process_cgroups_find    (const Job *job,
+						       ProcessType process);
+static JobProcessCGroups *job_process_cgroups_new     (Job *job,
+						       ProcessType process,
+						       char * const *env)
+	__attribute__ ((warn_unused_result));
+static void               job_process_cgroups_handler (JobProcessCGroups *cgroups,
+						       CGroupRequest *request);
+static JobState           job_process_cgroups_state   (ProcessType process);
+#endif /* ENABLE_CGROUPS */
+
+static const void *job_process_pid_key  (NihList *entry);
+static uint32_t    job_process_pid_hash (const pid_t *pid);
+static int         job_process_pid_cmp  (const pid_t *key1,
+					 const pid_t *key2);
+
 extern char         *control_server_address;
 extern int           user_mode;
 extern int           session_end;
@@ -196,7 +376,13 @@ job_process_start (Job                    *job,
 	int                 fds[2] = { -1, -1 };
 	int                 trace = FALSE, shell = FALSE;
 	int                 job_process_fd = -1;
+	int                 listen_fds[LISTEN_MAX_SOCKETS];
+	pid_t               pid;
+	uint64_t            start;
 	JobProcessData     *process_data = NULL;
+#ifdef ENABLE_CGROUPS
+	JobProcessCGroups  *cgroups = NULL;
+#endif /* ENABLE_CGROUPS */
 
 	nih_assert (job);
 	nih_assert (process > PROCESS_INVALID);
@@ -300,6 +486,40 @@ job_process_start (Job                    *job,
 		NIH_MUST (environ_set (&env, NULL, &envc, TRUE,
 			       "UPSTART_SESSION=%s", control_server_address));
 
+	/* Tell the process how many sockets it is passed; the child
+	 * fills in LISTEN_PID since only it knows its process id.
+	 */
+	if (listen_job_fds (job, process, listen_fds)) {
+		NIH_MUST (environ_set (&env, NULL, &envc, TRUE,
+			       "LISTEN_FDS=%zu",
+			       listen_job_fds (job, process, listen_fds)));
+		NIH_MUST (environ_set (&env, NULL, &envc, TRUE,
+			       "LISTEN_PID=%*s", 10, ""));
+	}
+
+	/* If the main process is to tell us when it is ready, give it a
+	 * socket to do so; should we be unable to, we don't wait for it.
+	 */
+	if ((process == PROCESS_MAIN)
+	    && (job->class->expect == EXPECT_NOTIFY)) {
+		nih_local char *address = NULL;
+
+		if ((notify_job_open (job) < 0)
+		    || (! (address = notify_job_address (NULL, job)))) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_warn (_("Failed to create notify socket for %s: %s"),
+				  job_name (job), err->message);
+			nih_free (err);
+
+			notify_job_close (job);
+		} else {
+			NIH_MUST (environ_set (&env, NULL, &envc, TRUE,
+				       "NOTIFY_SOCKET=%s", address));
+		}
+	}
+
 	/* If we're about to spawn the main job and we expect it to become
 	 * a daemon or fork before we can move out of spawned, we need to
 	 * set a trace on it.
@@ -309,8 +529,51 @@ job_process_start (Job                    *job,
 		|| (job->class->expect == EXPECT_FORK)))
 		trace = TRUE;
 
+#ifdef ENABLE_CGROUPS
+	/* Rather than have every job process connect to the cgroup manager
+	 * and wait on it to create its cgroups, ask it ourselves without
+	 * blocking and only spawn the process once it has replied; we're
+	 * called again from job_process_cgroups_handler() when it has.
+	 */
+	if (job_needs_cgroups (job)
+	    && cgroup_support_enabled ()
+	    && cgroup_manager_available ()) {
+		cgroups = job_process_cgroups_find (job, process);
+		if (cgroups
+		    && ((! cgroups->request) || cgroups->request->calls)) {
+			/* Superseded by a new attempt to start the process */
+			nih_free (cgroups);
+			cgroups = NULL;
+		}
+
+		if (! cgroups) {
+			cgroups = job_process_cgroups_new (job, process, env);
+			if (! cgroups) {
+				NihError *err;
+
+				/* Leave the process to set up its cgroups
+				 * itself.
+				 */
+				err = nih_error_get ();
+				nih_warn (_("Unable to request cgroups for %s %s process: %s"),
+					  job_name (job), process_name (process),
+					  err->message);
+				nih_free (err);
+			} else if (cgroups->request->calls) {
+				if (shell) {
+					close (fds[0]);
+					close (fds[1]);
+				}
+
+				return;
+			}
+		}
+	}
+#endif /* ENABLE_CGROUPS */
+
 	/* Spawn the process, repeat until fork() works */
-	while ((job->pid[process] = job_process_spawn_with_fd (job, argv, env,
+	start = stats_now ();
+	while ((pid = job_process_spawn_with_fd (job, argv, env,
 					trace, fds[0], process, &job_process_fd)) < 0) {
 		NihError *err;
 
@@ -319,10 +582,24 @@ job_process_start (Job                    *job,
 				err->message);
 		nih_free (err);
 	}
+	stats_record (STATS_SPAWN, start);
+
+#ifdef ENABLE_CGROUPS
+	if (cgroups)
+		nih_free (cgroups);
+#endif /* ENABLE_CGROUPS */
+
+	job_process_set_pid (job, process, pid);
 
 	nih_info (_("%s %s process (%d)"),
 		  job_name (job), process_name (process), job->pid[process]);
 
+	/* The main process now holds any connection accepted for it */
+	if ((process == PROCESS_MAIN) && (job->listen_fd >= 0)) {
+		close (job->listen_fd);
+		job->listen_fd = -1;
+	}
+
 	job->trace_forks = 0;
 	job->trace_state = trace ? TRACE_NEW : TRACE_NONE;
 
@@ -397,8 +674,13 @@ job_process_start (Job                    *job,
  * closed setup was successful and the caller can then mark the job
  * process as started.
  *
+ * Where the child needs no user or group lookups, root directory change
+ * or cgroup setup, it is created with clone() sharing our memory rather
+ * than with fork(), avoiding the cost of copying the page tables of init;
+ * the error pipe protocol is the same either way.
+ *
  * Spawning a process may fail for temporary reasons, usually due to a failure
- * of the fork() syscall.
+ * of the fork() or clone() syscall.
  *
  * Returns: process id of new process on success, -1 on raised error
  **/
@@ -411,24 +693,17 @@ job_process_spawn_with_fd (Job          *job,
 		   ProcessType   process,
 		   int          *job_process_fd)
 {
-	sigset_t        child_set, orig_set;
-	pid_t           pid;
-	int             i, fds[2] = { -1, -1 };
-	int             pty_master = -1;
-	int             pty_slave = -1;
-	char            pts_name[PATH_MAX];
-	char            filename[PATH_MAX];
-	FILE           *fd;
-	nih_local char *log_path = NULL;
-	JobClass       *class;
-	uid_t           job_setuid = -1;
-	gid_t           job_setgid = -1;
-	struct passwd   *pwd = NULL;
-	struct group    *grp = NULL;
-
-#ifdef ENABLE_CGROUPS
+	sigset_t         child_set;
+	pid_t            pid;
+	int              fds[2] = { -1, -1 };
+	int              pty_master = -1;
+	int              log_pipe[2] = { -1, -1 };
+	nih_local char  *log_path = NULL;
+	JobClass        *class;
+	JobProcessChild  child;
+	int              use_clone;
 	int              cgroups_needed = FALSE;
-#endif /* ENABLE_CGROUPS */
+	NihList         *cgroups = NULL;
 
 	nih_assert (job != NULL);
 	nih_assert (job->class != NULL);
@@ -450,6 +725,15 @@ job_process_spawn_with_fd (Job          *job,
 		/* Should never happen */
 		if (! cgroup_manager_available ())
 			nih_return_error (-1, CGROUP_ERROR, _("cgroup manager not available"));
+
+		/* Use the cgroups init has already had created, if any */
+		if (job_process_cgroups_waiting) {
+			JobProcessCGroups *wait;
+
+			wait = job_process_cgroups_find (job, process);
+			if (wait && wait->request && ! wait->request->calls)
+				cgroups = &wait->request->cgroups;
+		}
 	}
 
 #endif /* ENABLE_CGROUPS */
@@ -487,7 +771,15 @@ job_process_spawn_with_fd (Job          *job,
 			nih_return_no_memory_error (-1);
 		}
 
-		pty_master = posix_openpt (O_RDWR | O_NOCTTY);
+		/* Output collected through a pipe can be spliced into the
+		 * log file, but the job loses its terminal.
+		 */
+		if (log_splice) {
+			if (pipe2 (log_pipe, O_CLOEXEC) == 0)
+				pty_master = log_pipe[0];
+		} else {
+			pty_master = posix_openpt (O_RDWR | O_NOCTTY);
+		}
 
 		if (pty_master < 0) {
 			nih_error (_("Failed to create pty - disabling logging for job"));
@@ -511,18 +803,53 @@ job_process_spawn_with_fd (Job          *job,
 		job->log[process] = log_new (job->log, log_path, pty_master, 0);
 		if (! job->log[process]) {
 			close (pty_master);
+			if (log_pipe[1] >= 0)
+				close (log_pipe[1]);
 			close (fds[0]);
 			close (fds[1]);
 			nih_return_system_error (-1);
 		}
 	}
 
+	child.job = job;
+	child.argv = argv;
+	child.env = env;
+	child.trace = trace;
+	child.script_fd = script_fd;
+	child.process = process;
+	child.fds[0] = fds[0];
+	child.fds[1] = fds[1];
+	child.pty_master = pty_master;
+	child.log_pipe = log_pipe[1];
+	child.cgroups_needed = cgroups_needed;
+	child.cgroups = cgroups;
+	child.groups = NULL;
+	child.ngroups = 0;
+	child.num_listen_fds = listen_job_fds (job, process, child.listen_fds);
+
+	/* Jobs that need no lookups or privilege changes in the child can
+	 * be spawned without copying our address space; the child can't
+	 * call into NSS for the supplementary group list, so that must
+	 * have been looked up when the configuration was loaded, otherwise
+	 * we simply fork as usual and let the child do it.
+	 */
+	use_clone = job_process_clone_eligible (job, process, argv, trace,
+						cgroups_needed, log_pipe[1]);
+	if (use_clone && process != PROCESS_SECURITY && geteuid () == 0) {
+		if (job_process_groups) {
+			child.groups = job_process_groups;
+			child.ngroups = job_process_ngroups;
+		} else {
+			use_clone = FALSE;
+		}
+	}
+
 	/* Block all signals while we fork to avoid the child process running
 	 * our own signal handlers before we've reset them all back to the
 	 * default.
 	 */
 	sigfillset (&child_set);
-	sigprocmask (SIG_BLOCK, &child_set, &orig_set);
+	sigprocmask (SIG_BLOCK, &child_set, &child.orig_set);
 
 	/* Ensure that any lingering data in stdio buffers is flushed
 	 * to avoid the child getting a copy of it.
@@ -533,17 +860,39 @@ job_process_spawn_with_fd (Job          *job,
 
 	/* Fork the child process, handling success and failure by resetting
 	 * the signal mask and returning the new process id or a raised error.
+	 *
+	 * A cloned child shares our memory and we are suspended until it
+	 * calls exec() or exits, so it runs on a stack of its own and we
+	 * restore the environ pointer it replaces.
 	 */
-	pid = fork ();
+	if (use_clone) {
+		char **saved_environ = environ;
+
+		job_process_cloned = TRUE;
+		pid = clone (job_process_clone_child,
+			     job_process_clone_stack + JOB_PROCESS_CLONE_STACK_SIZE,
+			     CLONE_VM | CLONE_VFORK | SIGCHLD, &child);
+		job_process_cloned = FALSE;
+
+		environ = saved_environ;
+	} else {
+		pid = fork ();
+		if (pid == 0)
+			job_process_child (&child);
+	}
+
 	if (pid > 0) {
 		if (class->debug) {
 			nih_info (_("Pausing %s (%d) [pre-exec] for debug"),
 			  class->name, pid);
 		}
 
-		sigprocmask (SIG_SETMASK, &orig_set, NULL);
+		sigprocmask (SIG_SETMASK, &child.orig_set, NULL);
 		close (fds[1]);
 
+		if (log_pipe[1] >= 0)
+			close (log_pipe[1]);
+
 		*job_process_fd = fds[0];
 
 		nih_io_set_cloexec (*job_process_fd);
@@ -552,9 +901,11 @@ job_process_spawn_with_fd (Job          *job,
 	} else if (pid < 0) {
 		nih_error_raise_system ();
 
-		sigprocmask (SIG_SETMASK, &orig_set, NULL);
+		sigprocmask (SIG_SETMASK, &child.orig_set, NULL);
 		close (fds[0]);
 		close (fds[1]);
+		if (log_pipe[1] >= 0)
+			close (log_pipe[1]);
 		if (class->console == CONSOLE_LOG) {
 			nih_free (job->log[process]);
 			job->log[process] = NULL;
@@ -562,9 +913,70 @@ job_process_spawn_with_fd (Job          *job,
 		return -1;
 	}
 
-	/* We're now in the child process.
-	 *
-	 * The rest of this function sets the child up and ends by executing
+	nih_assert_not_reached ();
+}
+
+
+/**
+ * job_process_child:
+ * @child: details of process to set up.
+ *
+ * Called in the child process created by job_process_spawn_with_fd()
+ * to set up the process according to the class details of the job in
+ * @child and execute the new binary.
+ *
+ * When called from a child spawned by clone() this shares the memory of
+ * init, which is suspended until it returns, so anything it modifies
+ * must be a local copy.
+ *
+ * This function never returns; errors are written to the pipe given in
+ * @child and the process exits.
+ **/
+static void
+job_process_child (JobProcessChild *child)
+{
+	Job                *job;
+	JobClass           *class;
+	char * const       *argv;
+	char * const       *env;
+	int                 trace;
+	int                 script_fd;
+	ProcessType         process;
+	int                 i, fds[2];
+	int                 pty_master;
+	int                 pty_slave = -1;
+	int                 listen_fds[LISTEN_MAX_SOCKETS];
+	int                 num_listen_fds;
+	char                pts_name[PATH_MAX];
+	char                filename[PATH_MAX];
+	FILE               *fd;
+	uid_t               job_setuid = -1;
+	gid_t               job_setgid = -1;
+	struct passwd      *pwd = NULL;
+	struct group       *grp = NULL;
+#ifdef ENABLE_CGROUPS
+	int                 cgroups_needed;
+	NihList            *cgroups;
+#endif /* ENABLE_CGROUPS */
+
+	nih_assert (child != NULL);
+
+	job = child->job;
+	class = job->class;
+	argv = child->argv;
+	env = child->env;
+	trace = child->trace;
+	script_fd = child->script_fd;
+	process = child->process;
+	fds[0] = child->fds[0];
+	fds[1] = child->fds[1];
+	pty_master = child->pty_master;
+#ifdef ENABLE_CGROUPS
+	cgroups_needed = child->cgroups_needed;
+	cgroups = child->cgroups ? child->cgroups : &class->cgroups;
+#endif /* ENABLE_CGROUPS */
+
+	/* The rest of this function sets the child up and ends by executing
 	 * the new binary.  Failures are handled by terminating the child
 	 * and writing an error back to the parent.
 	 */
@@ -576,16 +988,28 @@ job_process_spawn_with_fd (Job          *job,
 	close (fds[0]);
 
 	job_process_remap_fd (&fds[1], JOB_PROCESS_SCRIPT_FD, fds[1]);
-	nih_io_set_cloexec (fds[1]);
+	fcntl (fds[1], F_SETFD, FD_CLOEXEC);
 
-	if (class->console == CONSOLE_LOG) {
+	/* Keep the sockets we pass on clear of the script fd too */
+	num_listen_fds = child->num_listen_fds;
+	for (i = 0; i < num_listen_fds; i++) {
+		listen_fds[i] = child->listen_fds[i];
+		job_process_remap_fd (&listen_fds[i], JOB_PROCESS_SCRIPT_FD, fds[1]);
+	}
+
+	if ((class->console == CONSOLE_LOG) && (child->log_pipe >= 0)) {
+		/* Output goes to a pipe rather than a pty */
+		pty_slave = child->log_pipe;
+
+		job_process_remap_fd (&pty_slave, JOB_PROCESS_SCRIPT_FD, fds[1]);
+	} else if (class->console == CONSOLE_LOG) {
 		struct sigaction act;
 		struct sigaction ignore;
 
 		job_process_remap_fd (&pty_master, JOB_PROCESS_SCRIPT_FD, fds[1]);
 
 		/* Child is the slave, so won't need this */
-		nih_io_set_cloexec (pty_master);
+		fcntl (pty_master, F_SETFD, FD_CLOEXEC);
 
 		/* Temporarily disable child handler as grantpt(3) disallows one
 		 * being in effect when called.
@@ -595,36 +1019,30 @@ job_process_spawn_with_fd (Job          *job,
 		sigemptyset (&ignore.sa_mask);
 
 		if (sigaction (SIGCHLD, &ignore, &act) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_SIGNAL, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_SIGNAL, 0);
 		}
 
 		if (grantpt (pty_master) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_GRANTPT, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_GRANTPT, 0);
 		}
 
 		/* Restore child handler */
 		if (sigaction (SIGCHLD, &act, NULL) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_SIGNAL, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_SIGNAL, 0);
 		}
 
 		if (unlockpt (pty_master) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_UNLOCKPT, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_UNLOCKPT, 0);
 		}
 
 		if (ptsname_r (pty_master, pts_name, sizeof(pts_name)) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_PTSNAME, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_PTSNAME, 0);
 		}
 
 		pty_slave = open (pts_name, O_RDWR | O_NOCTTY);
 
 		if (pty_slave < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_OPENPT_SLAVE, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_OPENPT_SLAVE, 0);
 		}
 
 		job_process_remap_fd (&pty_slave, JOB_PROCESS_SCRIPT_FD, fds[1]);
@@ -636,8 +1054,7 @@ job_process_spawn_with_fd (Job          *job,
 	if ((script_fd != -1) && (script_fd != JOB_PROCESS_SCRIPT_FD)) {
 		int tmp = dup2 (script_fd, JOB_PROCESS_SCRIPT_FD);
 		if (tmp < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
 		}
 		close (script_fd);
 		script_fd = tmp;
@@ -655,8 +1072,20 @@ job_process_spawn_with_fd (Job          *job,
 	 * any other open descriptor must be intended for the child, or have
 	 * the FD_CLOEXEC flag so it's automatically closed when we exec()
 	 * later.
+	 *
+	 * A cloned child may only report errors through errno, and is only
+	 * used for jobs whose console is /dev/null, so opens that itself.
 	 */
-	if (system_setup_console (class->console, FALSE) < 0) {
+	if (job_process_cloned) {
+		for (i = 0; i < 3; i++)
+			close (i);
+
+		if (open (DEV_NULL, O_RDWR | O_NOCTTY) < 0)
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_CONSOLE, 0);
+
+		while (dup (STDIN_FILENO) < 2)
+			;
+	} else if (system_setup_console (class->console, FALSE) < 0) {
 		if (class->console == CONSOLE_OUTPUT) {
 			NihError *err;
 
@@ -674,18 +1103,57 @@ job_process_spawn_with_fd (Job          *job,
 	if (class->console == CONSOLE_LOG) {
 		/* Redirect stdout and stderr to the logger fd */
 		if (dup2 (pty_slave, STDOUT_FILENO) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
 		}
 
 		if (dup2 (pty_slave, STDERR_FILENO) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
 		}
 
 		close (pty_slave);
 	}
 
+	/* Pass the sockets init listens on for the job as consecutive
+	 * descriptors from LISTEN_FDS_START, first moving our error pipe
+	 * and the sockets themselves clear of that range, and record our
+	 * process id in the space left for it in the environment.
+	 */
+	if (num_listen_fds) {
+		int           last = LISTEN_FDS_START + num_listen_fds;
+		int           moved[LISTEN_MAX_SOCKETS];
+		char * const *e;
+
+		if (fds[1] < last) {
+			int tmp = fcntl (fds[1], F_DUPFD_CLOEXEC, last);
+			if (tmp < 0) {
+				job_process_child_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			}
+			close (fds[1]);
+			fds[1] = tmp;
+		}
+
+		for (i = 0; i < num_listen_fds; i++) {
+			moved[i] = fcntl (listen_fds[i], F_DUPFD, last);
+			if (moved[i] < 0) {
+				job_process_child_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			}
+		}
+
+		for (i = 0; i < num_listen_fds; i++) {
+			if (dup2 (moved[i], LISTEN_FDS_START + i) < 0) {
+				job_process_child_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			}
+			close (moved[i]);
+		}
+
+		for (e = env; e && *e; e++) {
+			if (! strncmp (*e, "LISTEN_PID=", 11)) {
+				job_process_format_pid (*e + 11, getpid ());
+				break;
+			}
+		}
+	}
+
 	/* Switch to the specified AppArmor profile, but only for the main
 	   process, so we don't confine the pre- and post- processes.
 	 */
@@ -703,8 +1171,7 @@ job_process_spawn_with_fd (Job          *job,
 		}
 
 		if (apparmor_switch (profile) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_SECURITY, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_SECURITY, 0);
 		}
 	}
 
@@ -718,8 +1185,7 @@ job_process_spawn_with_fd (Job          *job,
 				continue;
 
 			if (setrlimit (i, class->limits[i]) < 0) {
-				nih_error_raise_system ();
-				job_process_error_abort (fds[1],
+				job_process_child_abort (fds[1],
 							 JOB_PROCESS_ERROR_RLIMIT, i);
 			}
 		}
@@ -733,8 +1199,7 @@ job_process_spawn_with_fd (Job          *job,
 		 */
 		if (class->nice != JOB_NICE_INVALID &&
 		    setpriority (PRIO_PROCESS, 0, class->nice) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1],
+			job_process_child_abort (fds[1],
 						 JOB_PROCESS_ERROR_PRIORITY, 0);
 		}
 
@@ -754,14 +1219,12 @@ job_process_spawn_with_fd (Job          *job,
 				fd = fopen (filename, "w");
 			}
 			if (! fd) {
-				nih_error_raise_system ();
-				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_OOM_ADJ, 0);
+				job_process_child_abort (fds[1], JOB_PROCESS_ERROR_OOM_ADJ, 0);
 			} else {
 				fprintf (fd, "%d\n", oom_value);
 
 				if (fclose (fd)) {
-					nih_error_raise_system ();
-					job_process_error_abort (fds[1], JOB_PROCESS_ERROR_OOM_ADJ, 0);
+					job_process_child_abort (fds[1], JOB_PROCESS_ERROR_OOM_ADJ, 0);
 				}
 			}
 		}
@@ -771,8 +1234,7 @@ job_process_spawn_with_fd (Job          *job,
 		 */
 		if (class->session && class->session->chroot) {
 			if (chroot (class->session->chroot) < 0) {
-				nih_error_raise_system ();
-				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_CHROOT, 0);
+				job_process_child_abort (fds[1], JOB_PROCESS_ERROR_CHROOT, 0);
 			}
 		}
 
@@ -782,8 +1244,7 @@ job_process_spawn_with_fd (Job          *job,
 		 */
 		if (class->chroot) {
 			if (chroot (class->chroot) < 0) {
-				nih_error_raise_system ();
-				job_process_error_abort (fds[1],
+				job_process_child_abort (fds[1],
 							 JOB_PROCESS_ERROR_CHROOT, 0);
 			}
 		}
@@ -794,8 +1255,7 @@ job_process_spawn_with_fd (Job          *job,
 		 */
 		if (class->chdir || user_mode == FALSE) {
 			if (chdir (class->chdir ? class->chdir : "/") < 0) {
-				nih_error_raise_system ();
-				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_CHDIR, 0);
+				job_process_child_abort (fds[1], JOB_PROCESS_ERROR_CHDIR, 0);
 			}
 		}
 
@@ -812,8 +1272,7 @@ job_process_spawn_with_fd (Job          *job,
 			pwd = getpwnam (class->setuid);
 			if (! pwd) {
 				if (errno != 0) {
-					nih_error_raise_system ();
-					job_process_error_abort (fds[1], JOB_PROCESS_ERROR_GETPWNAM, 0);
+					job_process_child_abort (fds[1], JOB_PROCESS_ERROR_GETPWNAM, 0);
 				} else {
 					nih_error_raise (JOB_PROCESS_INVALID_SETUID,
 							 JOB_PROCESS_INVALID_SETUID_STR);
@@ -831,8 +1290,7 @@ job_process_spawn_with_fd (Job          *job,
 			grp = getgrnam (class->setgid);
 			if (! grp) {
 				if (errno != 0) {
-					nih_error_raise_system ();
-					job_process_error_abort (fds[1], JOB_PROCESS_ERROR_GETGRNAM, 0);
+					job_process_child_abort (fds[1], JOB_PROCESS_ERROR_GETGRNAM, 0);
 				} else {
 					nih_error_raise (JOB_PROCESS_INVALID_SETGID,
 							 JOB_PROCESS_INVALID_SETGID_STR);
@@ -846,34 +1304,34 @@ job_process_spawn_with_fd (Job          *job,
 		if (script_fd != -1 &&
 		    (job_setuid != (uid_t) -1 || job_setgid != (gid_t) -1) &&
 		    fchown (script_fd, job_setuid, job_setgid) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_CHOWN, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_CHOWN, 0);
 		}
 
 		/* Make sure we always have the needed pwd and grp structs.
 		 * Then pass those to initgroups() to setup the user's group list.
 		 * Only do that if we're root as initgroups() won't work when non-root. */
-		if (geteuid () == 0) {
+		if (geteuid () == 0 && child->groups) {
+			if (setgroups (child->ngroups, child->groups) < 0) {
+				job_process_child_abort (fds[1], JOB_PROCESS_ERROR_INITGROUPS, 0);
+			}
+		} else if (geteuid () == 0) {
 			if (! pwd) {
 				pwd = getpwuid (geteuid ());
 				if (! pwd) {
-					nih_error_raise_system ();
-					job_process_error_abort (fds[1], JOB_PROCESS_ERROR_GETPWUID, 0);
+					job_process_child_abort (fds[1], JOB_PROCESS_ERROR_GETPWUID, 0);
 				}
 			}
 
 			if (! grp) {
 				grp = getgrgid (getegid ());
 				if (! grp) {
-					nih_error_raise_system ();
-					job_process_error_abort (fds[1], JOB_PROCESS_ERROR_GETGRGID, 0);
+					job_process_child_abort (fds[1], JOB_PROCESS_ERROR_GETGRGID, 0);
 				}
 			}
 
 			if (pwd && grp) {
 				if (initgroups (pwd->pw_name, grp->gr_gid) < 0) {
-					nih_error_raise_system ();
-					job_process_error_abort (fds[1], JOB_PROCESS_ERROR_INITGROUPS, 0);
+					job_process_child_abort (fds[1], JOB_PROCESS_ERROR_INITGROUPS, 0);
 				}
 			}
 		}
@@ -882,7 +1340,19 @@ job_process_spawn_with_fd (Job          *job,
 		if (cgroups_needed) {
 			if (cgroup_manager_connect () < 0)
 				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_CGROUP_MGR_CONNECT, 0);
+		}
 
+		if (cgroups_needed && child->cgroups) {
+			/* init has already created the cgroups and applied
+			 * their settings, leaving only the change of
+			 * ownership which may need user and group lookups.
+			 */
+			if (! cgroup_chown_groups (cgroups,
+						class->setuid ? job_setuid : geteuid (),
+						class->setgid ? job_setgid : getegid ())) {
+				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_CGROUP_SETUP, 0);
+			}
+		} else if (cgroups_needed) {
 			if (! cgroup_setup (&job->class->cgroups,
 						env,
 						class->setuid ? job_setuid : geteuid (),
@@ -905,13 +1375,11 @@ job_process_spawn_with_fd (Job          *job,
 
 		/* Start dropping privileges */
 		if (job_setgid != (gid_t) -1 && setgid (job_setgid) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_SETGID, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_SETGID, 0);
 		}
 
 		if (job_setuid != (uid_t)-1 && setuid (job_setuid) < 0) {
-			nih_error_raise_system ();
-			job_process_error_abort (fds[1], JOB_PROCESS_ERROR_SETUID, 0);
+			job_process_child_abort (fds[1], JOB_PROCESS_ERROR_SETUID, 0);
 		}
 	}
 
@@ -919,8 +1387,19 @@ job_process_spawn_with_fd (Job          *job,
 	 * the child isn't unexpectedly ignoring any, and so we won't
 	 * surprisingly handle them before we've exec()d the new process.
 	 */
-	nih_signal_reset ();
-	sigprocmask (SIG_SETMASK, &orig_set, NULL);
+	if (job_process_cloned) {
+		struct sigaction act;
+
+		act.sa_handler = SIG_DFL;
+		act.sa_flags = 0;
+		sigemptyset (&act.sa_mask);
+
+		for (i = 1; i < NSIG; i++)
+			sigaction (i, &act, NULL);
+	} else {
+		nih_signal_reset ();
+	}
+	sigprocmask (SIG_SETMASK, &child->orig_set, NULL);
 
 	/* Notes:
 	 *
@@ -954,27 +1433,263 @@ job_process_spawn_with_fd (Job          *job,
 	 * the process is running with the correct group and user
 	 * ownership.
 	 */
-	if (cgroups_needed && cgroup_enter_groups (&job->class->cgroups) != TRUE)
+	if (cgroups_needed && cgroup_enter_groups (cgroups) != TRUE)
 		job_process_error_abort (fds[1], JOB_PROCESS_ERROR_CGROUP_ENTER, 0);
 
-#endif /* ENABLE_CGROUPS */
+#endif /* ENABLE_CGROUPS */
+
+	/* Set up a process trace if we need to trace forks */
+	if (trace) {
+		if (ptrace (PTRACE_TRACEME, 0, NULL, 0) < 0) {
+			job_process_child_abort (fds[1],
+						 JOB_PROCESS_ERROR_PTRACE, 0);
+		}
+	}
+
+	/* Execute the process, if we escape from here it failed; a cloned
+	 * child is always given a path, so has no need to search PATH.
+	 */
+	if (job_process_cloned) {
+		execv (argv[0], argv);
+		job_process_child_abort (fds[1], JOB_PROCESS_ERROR_EXEC, 0);
+	} else if (execvp (argv[0], argv) < 0) {
+		job_process_child_abort (fds[1], JOB_PROCESS_ERROR_EXEC, 0);
+	}
+
+	nih_assert_not_reached ();
+}
+
+/**
+ * job_process_child_abort:
+ * @fd: writing end of pipe,
+ * @type: step that failed,
+ * @arg: argument to @type.
+ *
+ * Abort the child process, first writing the error details in @type, @arg
+ * and errno to the writing end of the pipe specified by @fd.
+ *
+ * Unlike job_process_error_abort() this does not use the raised NihError,
+ * so is async-signal-safe and may be called from a child spawned with
+ * clone().
+ *
+ * This function calls the exit() system call, or _exit() for a child
+ * spawned with clone(), so never returns.
+ **/
+static void
+job_process_child_abort (int                 fd,
+			 JobProcessErrorType type,
+			 int                 arg)
+{
+	JobProcessWireError wire_err;
+
+	wire_err.type = type;
+	wire_err.arg = arg;
+	wire_err.errnum = errno;
+
+	while (write (fd, &wire_err, sizeof (wire_err)) < 0)
+		;
+
+	if (job_process_cloned)
+		_exit (255);
+
+	exit (255);
+}
+
+/**
+ * job_process_format_pid:
+ * @str: string to write to,
+ * @pid: process id.
+ *
+ * Write @pid in decimal to @str, which must have room for it and a
+ * terminating nul; unlike sprintf() this is async-signal-safe.
+ **/
+static void
+job_process_format_pid (char  *str,
+			pid_t  pid)
+{
+	char buf[32];
+	int  len = 0;
+
+	nih_assert (str != NULL);
+	nih_assert (pid > 0);
+
+	do {
+		buf[len++] = '0' + (pid % 10);
+		pid /= 10;
+	} while (pid);
+
+	while (len)
+		*str++ = buf[--len];
+	*str = '\0';
+}
+
+/**
+ * job_process_clone_child:
+ * @arg: JobProcessChild describing process.
+ *
+ * Entry point for a child spawned by clone(), which runs on
+ * job_process_clone_stack.
+ *
+ * Returns: never.
+ **/
+static int
+job_process_clone_child (void *arg)
+{
+	job_process_child ((JobProcessChild *)arg);
+}
+
+/**
+ * job_process_clone_eligible:
+ * @job: job of process to be spawned,
+ * @process: job process to spawn,
+ * @argv: NULL-terminated list of arguments for the process,
+ * @trace: whether process will be traced,
+ * @cgroups_needed: whether process must be placed into cgroups,
+ * @log_pipe: writing end of pipe for output or -1.
+ *
+ * Determine whether the process may be spawned with clone() sharing our
+ * memory rather than with fork().  This is only the case when the child
+ * has no need to stop before exec(), look up users or groups, change its
+ * root directory or talk to other daemons, since all of these would run
+ * while init is suspended or could leave state behind in our memory.
+ *
+ * The child must also only make async-signal-safe calls, so its output
+ * must go to /dev/null or a pipe rather than a pty or the console, and
+ * it must be given a path rather than needing to search PATH.
+ *
+ * Returns: TRUE if clone() may be used, FALSE otherwise.
+ **/
+static int
+job_process_clone_eligible (Job          *job,
+			    ProcessType   process,
+			    char * const  argv[],
+			    int           trace,
+			    int           cgroups_needed,
+			    int           log_pipe)
+{
+	JobClass *class;
+
+	nih_assert (job != NULL);
+	nih_assert (job->class != NULL);
+
+	class = job->class;
+
+	if (disable_clone_spawn)
+		return FALSE;
+
+	if (trace || class->debug || cgroups_needed)
+		return FALSE;
+
+	if (class->setuid || class->setgid)
+		return FALSE;
+
+	if (class->chroot || (class->session && class->session->chroot))
+		return FALSE;
+
+	if (class->apparmor_switch && process == PROCESS_MAIN)
+		return FALSE;
+
+	if (class->oom_score_adj != JOB_DEFAULT_OOM_SCORE_ADJ)
+		return FALSE;
+
+	if ((class->console == CONSOLE_LOG) && (log_pipe < 0))
+		return FALSE;
+
+	if ((class->console != CONSOLE_LOG) && (class->console != CONSOLE_NONE))
+		return FALSE;
+
+	if (! argv || ! argv[0] || ! strchr (argv[0], '/'))
+		return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * job_process_cache_groups:
+ *
+ * Looks up the supplementary group list that initgroups() would set for
+ * our effective user, so that processes of jobs running as root may be
+ * spawned with clone() without the child calling into NSS.
+ *
+ * This is called when the configuration is loaded rather than for each
+ * process spawned, so that a slow name service only delays loading; if
+ * the lookup fails, processes are spawned with fork() until it succeeds.
+ **/
+void
+job_process_cache_groups (void)
+{
+	if (job_process_groups) {
+		nih_free (job_process_groups);
+		job_process_groups = NULL;
+		job_process_ngroups = 0;
+	}
+
+	if (disable_clone_spawn || (geteuid () != 0))
+		return;
+
+	job_process_groups = job_process_root_groups (NULL,
+						      &job_process_ngroups);
+	if (! job_process_groups)
+		nih_debug ("Unable to look up supplementary groups, "
+			   "spawning with fork()");
+}
+
+/**
+ * job_process_root_groups:
+ * @parent: parent object for new array,
+ * @ngroups: number of groups returned.
+ *
+ * Look up the supplementary group list that initgroups() would set for
+ * our effective user and group, storing the number of entries in
+ * @ngroups.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: newly allocated array of groups or NULL if the user or group
+ * could not be found or insufficient memory.
+ **/
+static gid_t *
+job_process_root_groups (const void *parent,
+			 int        *ngroups)
+{
+	struct passwd *pwd;
+	struct group  *grp;
+	gid_t         *groups;
+	int            size = 32;
+
+	nih_assert (ngroups != NULL);
+
+	pwd = getpwuid (geteuid ());
+	if (! pwd)
+		return NULL;
 
-	/* Set up a process trace if we need to trace forks */
-	if (trace) {
-		if (ptrace (PTRACE_TRACEME, 0, NULL, 0) < 0) {
-			nih_error_raise_system();
-			job_process_error_abort (fds[1],
-						 JOB_PROCESS_ERROR_PTRACE, 0);
+	grp = getgrgid (getegid ());
+	if (! grp)
+		return NULL;
+
+	for (;;) {
+		int count = size;
+
+		groups = nih_alloc (parent, sizeof (gid_t) * size);
+		if (! groups)
+			return NULL;
+
+		if (getgrouplist (pwd->pw_name, grp->gr_gid,
+				  groups, &count) >= 0) {
+			*ngroups = count;
+			return groups;
 		}
-	}
 
-	/* Execute the process, if we escape from here it failed */
-	if (execvp (argv[0], argv) < 0) {
-		nih_error_raise_system ();
-		job_process_error_abort (fds[1], JOB_PROCESS_ERROR_EXEC, 0);
-	}
+		nih_free (groups);
 
-	nih_assert_not_reached ();
+		if (count <= size)
+			return NULL;
+
+		size = count;
+	}
 }
 
 
@@ -988,7 +1703,8 @@ job_process_spawn_with_fd (Job          *job,
  * and the currently raised NihError to the writing end of the pipe specified
  * by @fd.
  *
- * This function calls the exit() system call, so never returns.
+ * This function calls the exit() system call, or _exit() for a child
+ * spawned with clone(), so never returns.
  **/
 void
 job_process_error_abort (int                 fd,
@@ -1014,6 +1730,12 @@ job_process_error_abort (int                 fd,
 
 	nih_free (err);
 
+	/* A cloned child shares our memory, so must not run atexit()
+	 * handlers or flush stdio buffers belonging to init.
+	 */
+	if (job_process_cloned)
+		_exit (255);
+
 	exit (255);
 }
 
@@ -1451,6 +2173,125 @@ job_process_kill_timer (Job      *job,
 	}
 }
 
+/**
+ * job_process_respawn_delay:
+ * @job: job to be respawned.
+ *
+ * Calculates how long to wait before respawning @job, doubling the
+ * delay used for its previous respawn up to the maximum given in its
+ * respawn stanza, or starting again from the initial delay if the job
+ * has run for at least the stable time since it was last respawned.
+ *
+ * Up to a quarter of the delay is taken off at random so that jobs that
+ * failed together, for example because of a service they all depend on,
+ * don't all respawn at the same moment; rand() is seeded by main().
+ *
+ * Returns: number of seconds to wait, always at least one.
+ **/
+static time_t
+job_process_respawn_delay (Job *job)
+{
+	struct timespec now;
+	time_t          delay;
+
+	nih_assert (job != NULL);
+	nih_assert (job->class->respawn_delay > 0);
+
+	nih_assert (clock_gettime (CLOCK_MONOTONIC, &now) == 0);
+
+	if ((now.tv_sec - job->respawn_time) >= job->class->respawn_stable)
+		job->respawn_backoff = 0;
+
+	if (! job->respawn_backoff) {
+		delay = job->class->respawn_delay;
+	} else if (job->respawn_backoff > job->class->respawn_delay_max / 2) {
+		delay = job->class->respawn_delay_max;
+	} else {
+		delay = job->respawn_backoff * 2;
+	}
+
+	if (delay > job->class->respawn_delay_max)
+		delay = job->class->respawn_delay_max;
+
+	job->respawn_backoff = delay;
+
+	return delay - (rand () % (delay / 4 + 1));
+}
+
+/**
+ * job_process_set_respawn_timer:
+ * @job: job to set respawn timer for,
+ * @timeout: timeout to apply for timer.
+ *
+ * Set respawn timer for @job with timeout @timeout, replacing any
+ * existing timer.  A job in the post-stop state is held there until the
+ * timer expires.
+ *
+ * The timer is not a child of @job since expiring may free the job.
+ **/
+void
+job_process_set_respawn_timer (Job    *job,
+			       time_t  timeout)
+{
+	nih_assert (job);
+
+	if (job->respawn_timer)
+		nih_free (job->respawn_timer);
+
+	job->respawn_timer = NIH_MUST (nih_timer_add_timeout (
+			  NULL, timeout,
+			  (NihTimerCb)job_process_respawn_timer, job));
+}
+
+/**
+ * job_process_adj_respawn_timer:
+ *
+ * @job: job whose respawn timer is to be modified,
+ * @due: new due time to set for job respawn timer.
+ *
+ * Adjust due time for @job's respawn timer to @due.
+ **/
+void
+job_process_adj_respawn_timer (Job *job, time_t due)
+{
+	nih_assert (job);
+	nih_assert (job->respawn_timer);
+
+	job->respawn_timer->due = due;
+}
+
+/**
+ * job_process_respawn_timer:
+ * @job: job to respawn,
+ * @timer: timer that caused us to be called.
+ *
+ * This callback is called once the respawn delay of @job has passed.  If
+ * the job is waiting in the post-stop state, with no post-stop process
+ * still running, it is moved on; this either starts it again or, if it
+ * was stopped in the meantime, finishes stopping it.
+ **/
+static void
+job_process_respawn_timer (Job      *job,
+			   NihTimer *timer)
+{
+	struct timespec now;
+
+	nih_assert (job != NULL);
+	nih_assert (timer != NULL);
+	nih_assert (job->respawn_timer == timer);
+
+	job->respawn_timer = NULL;
+
+	nih_assert (clock_gettime (CLOCK_MONOTONIC, &now) == 0);
+	job->respawn_time = now.tv_sec;
+
+	if ((job->state == JOB_POST_STOP)
+	    && (job->pid[PROCESS_POST_STOP] <= 0)
+	    && ! (job->process_data
+		  && job->process_data[PROCESS_POST_STOP]))
+		job_change_state (job, job_next_state (job));
+}
+
 
 /**
  * job_process_handler:
@@ -1672,6 +2513,9 @@ job_process_terminated (Job         *job,
 			    || (job->state == JOB_POST_START)
 			    || (job->state == JOB_PRE_STOP));
 
+		/* Nothing is left to report readiness */
+		notify_job_close (job);
+
 		/* We don't change the state if we're in post-start and there's
 		 * a post-start process running, or if we're in pre-stop and
 		 * there's a pre-stop process running; we wait for those to
@@ -1727,15 +2571,37 @@ job_process_terminated (Job         *job,
 
 			/* We might be able to respawn the failed job;
 			 * that's a simple matter of doing nothing.  Check
-			 * the job isn't running away first though.
+			 * the job isn't running away first though, unless
+			 * it has a respawn delay which bounds the rate
+			 * instead.
 			 */
 			if (failed && job->class->respawn && ! disable_respawn) {
-				if (job_process_catch_runaway (job)) {
+				if ((! job->class->respawn_delay)
+				    && job_process_catch_runaway (job)) {
 					nih_warn (_("%s respawning too fast, stopped"),
 						  job_name (job));
 
 					failed = FALSE;
 					job_failed (job, PROCESS_INVALID, 0);
+				} else if (job->class->respawn_delay) {
+					time_t delay;
+
+					delay = job_process_respawn_delay (job);
+
+					nih_warn (_("%s %s process ended, respawning in %ld seconds"),
+						  job_name (job),
+						  process_name (process),
+						  (long)delay);
+					failed = FALSE;
+
+					/* The job is held in the post-stop
+					 * state until the timer expires.
+					 */
+					job_process_set_respawn_timer (job, delay);
+
+					if (! state)
+						job_change_goal (job, JOB_RESPAWN);
+					break;
 				} else {
 					nih_warn (_("%s %s process ended, respawning"),
 						  job_name (job),
@@ -1816,6 +2682,12 @@ job_process_terminated (Job         *job,
 			failed = TRUE;
 			stop = TRUE;
 		}
+
+		/* A respawn still waiting out its delay is started by
+		 * the respawn timer instead.
+		 */
+		if (job->respawn_timer && (job->goal == JOB_START))
+			state = FALSE;
 		break;
 	default:
 		nih_assert_not_reached ();
@@ -1886,7 +2758,7 @@ job_process_terminated (Job         *job,
 		endutxent();
 
 		/* Clear the process pid field */
-		job->pid[process] = 0;
+		job_process_set_pid (job, process, 0);
 	}
 
 	/* Mark the job as failed */
@@ -2176,7 +3048,7 @@ job_process_trace_fork (Job         *job,
 	/* Update the process we're supervising which is about to get SIGSTOP
 	 * so set the trace options to capture it.
 	 */
-	job->pid[process] = (pid_t)data;
+	job_process_set_pid (job, process, (pid_t)data);
 	job->trace_state = TRACE_NEW_CHILD;
 
 	/* We may have already had the wait notification for the new child
@@ -2240,14 +3112,322 @@ job_process_trace_exec (Job         *job,
 }
 
 
+/**
+ * job_process_init:
+ *
+ * Initialise the job process pids hash table.
+ **/
+void
+job_process_init (void)
+{
+	if (! job_process_pids)
+		job_process_pids = NIH_MUST (nih_hash_new (NULL,
+						JOB_PROCESS_PIDS_SIZE,
+						job_process_pid_key,
+						(NihHashFunction)job_process_pid_hash,
+						(NihCmpFunction)job_process_pid_cmp));
+
+#ifdef ENABLE_CGROUPS
+	if (! job_process_cgroups_waiting)
+		job_process_cgroups_waiting = NIH_MUST (nih_list_new (NULL));
+#endif /* ENABLE_CGROUPS */
+}
+
+#ifdef ENABLE_CGROUPS
+/**
+ * job_process_cgroups_pending:
+ * @job: job,
+ * @process: process.
+ *
+ * Determine whether @process of @job is waiting on the cgroup manager
+ * before it can be spawned.
+ *
+ * Returns: TRUE if @process is waiting, else FALSE.
+ **/
+int
+job_process_cgroups_pending (const Job    *job,
+			     ProcessType   process)
+{
+	nih_assert (job != NULL);
+	nih_assert (process < PROCESS_LAST);
+
+	return job_process_cgroups_find (job, process) ? TRUE : FALSE;
+}
+
+/**
+ * job_process_cgroups_find:
+ * @job: job,
+ * @process: process.
+ *
+ * Look up the entry for @process of @job in the list of processes
+ * waiting on the cgroup manager.
+ *
+ * Returns: JobProcessCGroups entry or NULL if not waiting.
+ **/
+static JobProcessCGroups *
+job_process_cgroups_find (const Job    *job,
+			  ProcessType   process)
+{
+	nih_assert (job != NULL);
+
+	if (! job_process_cgroups_waiting)
+		return NULL;
+
+	NIH_LIST_FOREACH (job_process_cgroups_waiting, iter) {
+		JobProcessCGroups *cgroups = (JobProcessCGroups *)iter;
+
+		if ((cgroups->job == job) && (cgroups->process == process))
+			return cgroups;
+	}
+
+	return NULL;
+}
+
+/**
+ * job_process_cgroups_new:
+ * @job: job,
+ * @process: process to spawn,
+ * @env: environment table for @process.
+ *
+ * Ask the cgroup manager to create and configure the cgroups of @job
+ * for @process, adding an entry for it to the list of processes
+ * waiting on the cgroup manager.  The entry is freed along with @job.
+ *
+ * Returns: new JobProcessCGroups entry, or NULL on raised error.
+ **/
+static JobProcessCGroups *
+job_process_cgroups_new (Job          *job,
+			 ProcessType   process,
+			 char * const *env)
+{
+	JobProcessCGroups *cgroups;
+
+	nih_assert (job != NULL);
+	nih_assert (env != NULL);
+
+	job_process_init ();
+
+	cgroups = nih_new (job, JobProcessCGroups);
+	if (! cgroups)
+		nih_return_no_memory_error (NULL);
+
+	nih_list_init (&cgroups->entry);
+
+	cgroups->job = job;
+	cgroups->process = process;
+
+	/* If spawning the last process for the job, arrange for the
+	 * cgroup manager to destroy all job cgroups relating to this
+	 * job once all job processes have completed.
+	 */
+	cgroups->request = cgroup_request_new (cgroups,
+				&job->class->cgroups, env,
+				job_last_process (job, process),
+				(CGroupRequestHandler)job_process_cgroups_handler,
+				cgroups);
+	if (! cgroups->request) {
+		nih_free (cgroups);
+		return NULL;
+	}
+
+	nih_alloc_set_destructor (cgroups, nih_list_destroy);
+	nih_list_add (job_process_cgroups_waiting, &cgroups->entry);
+
+	return cgroups;
+}
+
+/**
+ * job_process_cgroups_resume:
+ * @job: job,
+ * @process: process.
+ *
+ * Restart @process of @job after it was left waiting on the cgroup
+ * manager by the previous instance of init before it re-exec'd, whose
+ * request did not survive.
+ **/
+void
+job_process_cgroups_resume (Job          *job,
+			    ProcessType   process)
+{
+	nih_assert (job != NULL);
+	nih_assert (process > PROCESS_INVALID);
+	nih_assert (process < PROCESS_LAST);
+
+	if (job->state != job_process_cgroups_state (process))
+		return;
+
+	if (! job->class->process[process])
+		return;
+
+	job_process_start (job, process);
+}
+
+/**
+ * job_process_cgroups_handler:
+ * @cgroups: entry of waiting process,
+ * @request: completed request.
+ *
+ * Called once the cgroup manager has replied to every call made for
+ * the process in @cgroups.  On success the process is spawned, unless
+ * the job has since moved on to a state that no longer runs it; on
+ * failure the process is treated as having failed to spawn.
+ **/
+static void
+job_process_cgroups_handler (JobProcessCGroups *cgroups,
+			     CGroupRequest     *request)
+{
+	Job         *job;
+	ProcessType  process;
+
+	nih_assert (cgroups != NULL);
+	nih_assert (request != NULL);
+
+	job = cgroups->job;
+	process = cgroups->process;
+
+	if (request->error) {
+		nih_warn (_("Failed to spawn %s %s process: unable to setup cgroup: %s"),
+			  job_name (job), process_name (process),
+			  request->error->message);
+
+		nih_free (cgroups);
+		job_child_error_handler (job, process);
+		return;
+	}
+
+	if (job->state != job_process_cgroups_state (process)) {
+		nih_free (cgroups);
+		return;
+	}
+
+	job_process_start (job, process);
+}
+
+/**
+ * job_process_cgroups_state:
+ * @process: process.
+ *
+ * Returns: state a job rests in while @process runs.
+ **/
+static JobState
+job_process_cgroups_state (ProcessType process)
+{
+	switch (process) {
+	case PROCESS_MAIN:
+		return JOB_SPAWNED;
+	case PROCESS_PRE_START:
+		return JOB_PRE_START;
+	case PROCESS_POST_START:
+		return JOB_POST_START;
+	case PROCESS_PRE_STOP:
+		return JOB_PRE_STOP;
+	case PROCESS_POST_STOP:
+		return JOB_POST_STOP;
+	case PROCESS_SECURITY:
+		return JOB_SECURITY;
+	default:
+		nih_assert_not_reached ();
+	}
+}
+#endif /* ENABLE_CGROUPS */
+
+/**
+ * job_process_pid_key:
+ * @entry: JobPid entry.
+ *
+ * Key function for the job_process_pids hash table.
+ *
+ * Returns: pointer to the process id of @entry.
+ **/
+static const void *
+job_process_pid_key (NihList *entry)
+{
+	nih_assert (entry != NULL);
+
+	return &((JobPid *)entry)->pid;
+}
+
+/**
+ * job_process_pid_hash:
+ * @pid: process id to hash.
+ *
+ * Hash function for the job_process_pids hash table; process ids are
+ * allocated sequentially so are already well distributed.
+ *
+ * Returns: hash of @pid.
+ **/
+static uint32_t
+job_process_pid_hash (const pid_t *pid)
+{
+	nih_assert (pid != NULL);
+
+	return (uint32_t)*pid;
+}
+
+/**
+ * job_process_pid_cmp:
+ * @key1: first process id,
+ * @key2: second process id.
+ *
+ * Comparison function for the job_process_pids hash table.
+ *
+ * Returns: zero if @key1 and @key2 are the same process id.
+ **/
+static int
+job_process_pid_cmp (const pid_t *key1,
+		     const pid_t *key2)
+{
+	nih_assert (key1 != NULL);
+	nih_assert (key2 != NULL);
+
+	return *key1 != *key2;
+}
+
+/**
+ * job_process_set_pid:
+ * @job: job to update,
+ * @process: process to update,
+ * @pid: new process id.
+ *
+ * Records @pid as the process id of @job's @process, updating the
+ * job_process_pids hash table so that job_process_find() is able to
+ * find @job by @pid.  A @pid of zero indicates that the process is no
+ * longer running.
+ *
+ * This should be used instead of assigning to @job's pid array directly.
+ **/
+void
+job_process_set_pid (Job         *job,
+		     ProcessType  process,
+		     pid_t        pid)
+{
+	JobPid *entry;
+
+	nih_assert (job != NULL);
+	nih_assert (process > PROCESS_INVALID);
+	nih_assert (process < PROCESS_LAST);
+	nih_assert (pid >= 0);
+
+	job_process_init ();
+
+	entry = &job->pid_index[process];
+	nih_list_remove (&entry->entry);
+
+	job->pid[process] = pid;
+	entry->pid = pid;
+
+	if (pid > 0)
+		nih_hash_add (job_process_pids, &entry->entry);
+}
+
 /**
  * job_process_find:
  * @pid: process id to find,
  * @process: pointer to place process which is running @pid.
  *
- * Finds the job with a process of the given @pid in the jobs hash table.
- * If @process is not NULL, the @process variable is set to point at the
- * process entry in the table which has @pid.
+ * Finds the job with a process of the given @pid in the job process pids
+ * hash table.  If @process is not NULL, the @process variable is set to
+ * point at the process entry in the table which has @pid.
  *
  * Returns: job found or NULL if not known.
  **/
@@ -2255,25 +3435,25 @@ Job *
 job_process_find (pid_t        pid,
 		  ProcessType *process)
 {
+	JobPid *entry = NULL;
+
 	nih_assert (pid > 0);
 
-	job_class_init ();
+	job_process_init ();
 
-	NIH_HASH_FOREACH (job_classes, iter) {
-		JobClass *class = (JobClass *)iter;
+	while ((entry = (JobPid *)nih_hash_search (job_process_pids, &pid,
+						   entry ? &entry->entry : NULL))) {
+		/* Ignore any entry whose job has since been given a
+		 * different process id without going through
+		 * job_process_set_pid().
+		 */
+		if (entry->job->pid[entry->process] != pid)
+			continue;
 
-		NIH_HASH_FOREACH (class->instances, job_iter) {
-			Job *job = (Job *)job_iter;
-			int  i;
+		if (process)
+			*process = entry->process;
 
-			for (i = 0; i < PROCESS_LAST; i++) {
-				if (job->pid[i] == pid) {
-					if (process)
-						*process = i;
-					return job;
-				}
-			}
-		}
+		return entry->job;
 	}
 
 	return NULL;
@@ -2417,8 +3597,7 @@ job_process_remap_fd (int *fd, int reserved_fd, int error_fd)
 
 	new = dup (*fd);
 	if (new < 0) {
-		nih_error_raise_system ();
-		job_process_error_abort (error_fd, JOB_PROCESS_ERROR_DUP, 0);
+		job_process_child_abort (error_fd, JOB_PROCESS_ERROR_DUP, 0);
 	}
 
 	close (*fd);
@@ -2558,8 +3737,16 @@ job_process_close_handler (JobProcessData  *process_data,
 
 	job_process_run_bottom (process_data);
 
+	/* The main process has now exec'd as the user it runs as, which
+	 * is who we accept readiness notifications from.
+	 */
+	if (job && (process == PROCESS_MAIN) && (job->notify_fd >= 0))
+		notify_job_spawned (job);
+
 	if (job && job->state == JOB_SPAWNED) {
-		if (job->class->expect == EXPECT_NONE) {
+		if ((job->class->expect == EXPECT_NONE)
+		    || ((job->class->expect == EXPECT_NOTIFY)
+			&& (job->notify_fd < 0))) {
 			if (process == PROCESS_MAIN) {
 				/* Job has not specified expect stanza so will
 				 * not have its state automatically progressed
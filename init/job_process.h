@@ -23,6 +23,7 @@
 #include <sys/types.h>
 
 #include <nih/macros.h>
+#include <nih/hash.h>
 #include <nih/child.h>
 #include <nih/error.h>
 
@@ -142,6 +143,12 @@ typedef void (*JobProcessErrorHandler) (Job *job, JobState state, ProcessType pr
 
 NIH_BEGIN_EXTERN
 
+extern NihHash *job_process_pids;
+
+void   job_process_init       (void);
+
+void   job_process_cache_groups (void);
+
 void   job_process_start      (Job *job, ProcessType process);
 void   job_process_run_bottom (JobProcessData *handler_data);
 
@@ -166,6 +173,8 @@ void   job_process_kill    (Job *job, ProcessType process);
 void   job_process_handler (void *ptr, pid_t pid,
 			    NihChildEvents event, int status);
 
+void   job_process_set_pid  (Job *job, ProcessType process, pid_t pid);
+
 Job   *job_process_find     (pid_t pid, ProcessType *process);
 
 char  *job_process_log_path (Job *job, int user_job)
@@ -177,6 +186,10 @@ void   job_process_set_kill_timer (Job          *job,
 
 void   job_process_adj_kill_timer  (Job *job, time_t due);
 
+void   job_process_set_respawn_timer (Job *job, time_t timeout);
+
+void   job_process_adj_respawn_timer (Job *job, time_t due);
+
 int    job_process_jobs_running (void);
 
 void   job_process_stop_all (void);
@@ -199,6 +212,11 @@ void job_process_error_abort     (int fd, JobProcessErrorType type,
 					 int arg)
 	__attribute__ ((noreturn));
 
+#ifdef ENABLE_CGROUPS
+int  job_process_cgroups_pending (const Job *job, ProcessType process);
+void job_process_cgroups_resume  (Job *job, ProcessType process);
+#endif /* ENABLE_CGROUPS */
+
 NIH_END_EXTERN
 
 #endif /* INIT_JOB_PROCESS_H */
@@ -0,0 +1,859 @@
+/* upstart
+ *
+ * listen.c - sockets listened on by init on behalf of jobs
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/io.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include "environ.h"
+#include "job_class.h"
+#include "job.h"
+#include "state.h"
+#include "listen.h"
+
+
+/* Prototypes for static functions */
+static int  listen_socket_destroy (ListenSocket *sock);
+static void listen_watcher        (ListenSocket *sock, NihIoWatch *watch,
+				   NihIoEvents events);
+static void listen_class_enable   (JobClass *class, int enable);
+static int  listen_socket_position (ListenSocket *sock);
+static int  listen_socket_full    (ListenSocket *sock);
+static void listen_start_job      (ListenSocket *sock, int fd,
+				   const struct sockaddr_in *addr);
+
+static const char *listen_type_enum_to_str (ListenType type)
+	__attribute__ ((warn_unused_result));
+static ListenType  listen_type_str_to_enum (const char *type)
+	__attribute__ ((warn_unused_result));
+
+
+/**
+ * listen_socket_new:
+ * @class: job class socket belongs to,
+ * @type: kind of socket,
+ * @address: IPv4 address or path of socket,
+ * @port: TCP port for LISTEN_INET.
+ *
+ * Allocates a new ListenSocket beneath @class and appends it to the
+ * list of sockets of @class; the socket is not opened until the class
+ * is registered.  Its maximum number of instances is initially
+ * LISTEN_DEFAULT_MAX_INSTANCES.
+ *
+ * Returns: newly allocated ListenSocket or NULL if insufficient memory.
+ **/
+ListenSocket *
+listen_socket_new (JobClass   *class,
+		   ListenType  type,
+		   const char *address,
+		   int         port)
+{
+	ListenSocket *sock;
+
+	nih_assert (class != NULL);
+	nih_assert (address != NULL);
+
+	sock = nih_new (class, ListenSocket);
+	if (! sock)
+		return NULL;
+
+	nih_list_init (&sock->entry);
+
+	sock->class = class;
+	sock->type = type;
+	sock->port = port;
+	sock->max_instances = LISTEN_DEFAULT_MAX_INSTANCES;
+	sock->fd = -1;
+	sock->watch = NULL;
+
+	sock->address = nih_strdup (sock, address);
+	if (! sock->address) {
+		nih_free (sock);
+		return NULL;
+	}
+
+	nih_alloc_set_destructor (sock, listen_socket_destroy);
+
+	nih_list_add (&class->listen, &sock->entry);
+
+	return sock;
+}
+
+/**
+ * listen_socket_destroy:
+ * @sock: socket being freed.
+ *
+ * Closes @sock, if open, when it is freed.
+ *
+ * Returns: zero.
+ **/
+static int
+listen_socket_destroy (ListenSocket *sock)
+{
+	nih_assert (sock != NULL);
+
+	nih_list_destroy (&sock->entry);
+
+	if (sock->fd >= 0)
+		close (sock->fd);
+
+	return 0;
+}
+
+/**
+ * listen_socket_open:
+ * @sock: socket to open.
+ *
+ * Creates, binds and listens on the socket described by @sock.  Any
+ * existing file at the path of a unix socket is removed first, since it
+ * can only be a socket left behind by an earlier init or daemon.
+ *
+ * The socket is non-blocking and close-on-exec, and is only passed to a
+ * job's main process by job_process_spawn_with_fd().
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+listen_socket_open (ListenSocket *sock)
+{
+	union {
+		struct sockaddr    sa;
+		struct sockaddr_in in;
+		struct sockaddr_un un;
+	}         addr;
+	socklen_t addrlen;
+	int       fd;
+	int       opt = 1;
+
+	nih_assert (sock != NULL);
+	nih_assert (sock->fd < 0);
+
+	memset (&addr, 0, sizeof (addr));
+
+	switch (sock->type) {
+	case LISTEN_INET:
+		addr.in.sin_family = AF_INET;
+		addr.in.sin_port = htons (sock->port);
+		if (inet_pton (AF_INET, sock->address, &addr.in.sin_addr) != 1)
+			nih_return_error (-1, EINVAL, strerror (EINVAL));
+
+		addrlen = sizeof (addr.in);
+		break;
+	case LISTEN_UNIX:
+		addr.un.sun_family = AF_UNIX;
+		if (strlen (sock->address) >= sizeof (addr.un.sun_path))
+			nih_return_error (-1, ENAMETOOLONG,
+					  strerror (ENAMETOOLONG));
+
+		strcpy (addr.un.sun_path, sock->address);
+		addrlen = offsetof (struct sockaddr_un, sun_path)
+			+ strlen (sock->address);
+
+		if (addr.un.sun_path[0] == '@') {
+			addr.un.sun_path[0] = '\0';
+		} else {
+			addrlen++;
+			if ((unlink (sock->address) < 0) && (errno != ENOENT))
+				nih_return_system_error (-1);
+		}
+		break;
+	default:
+		nih_assert_not_reached ();
+	}
+
+	fd = socket (addr.sa.sa_family,
+		     SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		nih_return_system_error (-1);
+
+	if ((sock->type == LISTEN_INET)
+	    && (setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+			    &opt, sizeof (opt)) < 0))
+		goto error;
+
+	if (bind (fd, &addr.sa, addrlen) < 0)
+		goto error;
+
+	if (listen (fd, SOMAXCONN) < 0)
+		goto error;
+
+	sock->fd = fd;
+
+	return 0;
+
+error:
+	nih_error_raise_system ();
+	close (fd);
+	return -1;
+}
+
+
+/**
+ * listen_class_open:
+ * @class: class being registered.
+ *
+ * Called when @class becomes the registered class of its name to open
+ * each of its sockets that isn't already open, and watch them for
+ * connections.  A socket that cannot be opened is skipped with a
+ * warning; the job can still be started by other means.
+ *
+ * Sockets are not watched while a single daemon is running, or in
+ * accept mode while they have their maximum number of instances.
+ **/
+void
+listen_class_open (JobClass *class)
+{
+	nih_assert (class != NULL);
+
+	NIH_LIST_FOREACH (&class->listen, iter) {
+		ListenSocket *sock = (ListenSocket *)iter;
+
+		if ((sock->fd < 0) && (listen_socket_open (sock) < 0)) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_warn (_("Failed to listen on %s socket %s for %s: %s"),
+				  listen_type_enum_to_str (sock->type),
+				  sock->address, class->name, err->message);
+			nih_free (err);
+
+			continue;
+		}
+
+		if (! sock->watch)
+			sock->watch = NIH_MUST (nih_io_add_watch (
+					sock, sock->fd, NIH_IO_READ,
+					(NihIoWatcher)listen_watcher, sock));
+	}
+
+	if (class->listen_accept) {
+		NIH_LIST_FOREACH (&class->listen, iter) {
+			ListenSocket *sock = (ListenSocket *)iter;
+
+			if (sock->watch && listen_socket_full (sock))
+				sock->watch->events = 0;
+		}
+
+		return;
+	}
+
+	/* A single daemon already running holds the sockets */
+	NIH_HASH_FOREACH (class->instances, iter) {
+		listen_class_enable (class, FALSE);
+		break;
+	}
+}
+
+/**
+ * listen_class_close:
+ * @class: class being unregistered.
+ *
+ * Stop watching and close the sockets of @class.
+ **/
+void
+listen_class_close (JobClass *class)
+{
+	nih_assert (class != NULL);
+
+	listen_class_handover (class, NULL);
+}
+
+/**
+ * listen_class_handover:
+ * @from: class no longer registered,
+ * @to: class replacing @from or NULL.
+ *
+ * Called when @from is no longer the registered class of its name, and
+ * so has no instances, to stop watching its sockets and pass each open
+ * one to the socket of @to with the same type and address, before @to
+ * is opened.  Sockets that @to does not listen on are closed.
+ *
+ * Passing the sockets on means that connections queued on them are not
+ * lost, that an inet socket is not refused its address while the old
+ * one is still bound, and that a unix socket is not unlinked and bound
+ * again under a daemon still holding the old one.
+ **/
+void
+listen_class_handover (JobClass *from,
+		       JobClass *to)
+{
+	nih_assert (from != NULL);
+
+	NIH_LIST_FOREACH (&from->listen, iter) {
+		ListenSocket *sock = (ListenSocket *)iter;
+
+		if (sock->watch) {
+			nih_free (sock->watch);
+			sock->watch = NULL;
+		}
+
+		if (sock->fd < 0)
+			continue;
+
+		if (to) {
+			NIH_LIST_FOREACH (&to->listen, to_iter) {
+				ListenSocket *to_sock = (ListenSocket *)to_iter;
+
+				if ((to_sock->fd >= 0)
+				    || (to_sock->type != sock->type)
+				    || (to_sock->port != sock->port)
+				    || strcmp (to_sock->address, sock->address))
+					continue;
+
+				to_sock->fd = sock->fd;
+				sock->fd = -1;
+				break;
+			}
+		}
+
+		if (sock->fd >= 0) {
+			close (sock->fd);
+			sock->fd = -1;
+		}
+	}
+}
+
+/**
+ * listen_class_resume:
+ * @class: class whose instance has stopped.
+ *
+ * Called when an instance of @class is discarded to watch its sockets
+ * for connections again once it has no other instances or, in accept
+ * mode, to watch each socket again that now has fewer than its maximum
+ * number of instances.
+ **/
+void
+listen_class_resume (JobClass *class)
+{
+	nih_assert (class != NULL);
+
+	if (NIH_LIST_EMPTY (&class->listen))
+		return;
+
+	if (class->listen_accept) {
+		NIH_LIST_FOREACH (&class->listen, iter) {
+			ListenSocket *sock = (ListenSocket *)iter;
+
+			if (sock->watch && (! sock->watch->events)
+			    && (! listen_socket_full (sock)))
+				sock->watch->events = NIH_IO_READ;
+		}
+
+		return;
+	}
+
+	NIH_HASH_FOREACH (class->instances, iter)
+		return;
+
+	listen_class_enable (class, TRUE);
+}
+
+/**
+ * listen_class_enable:
+ * @class: job class,
+ * @enable: TRUE to watch for connections, FALSE to stop.
+ *
+ * Starts or stops watching the open sockets of @class for connections.
+ * While a single daemon is running it accepts connections itself, so we
+ * must stop watching or we would be woken for each one.
+ **/
+static void
+listen_class_enable (JobClass *class,
+		     int       enable)
+{
+	nih_assert (class != NULL);
+
+	NIH_LIST_FOREACH (&class->listen, iter) {
+		ListenSocket *sock = (ListenSocket *)iter;
+
+		if (sock->watch)
+			sock->watch->events = enable ? NIH_IO_READ : 0;
+	}
+}
+
+/**
+ * listen_socket_position:
+ * @sock: socket.
+ *
+ * Returns: position of @sock within the sockets of its class.
+ **/
+static int
+listen_socket_position (ListenSocket *sock)
+{
+	int pos = 0;
+
+	nih_assert (sock != NULL);
+
+	NIH_LIST_FOREACH (&sock->class->listen, iter) {
+		if (iter == &sock->entry)
+			break;
+
+		pos++;
+	}
+
+	return pos;
+}
+
+/**
+ * listen_socket_full:
+ * @sock: socket in accept mode.
+ *
+ * Counts the instances of the class of @sock started by connections
+ * accepted from it.
+ *
+ * Returns: TRUE if @sock has its maximum number of instances, FALSE
+ * otherwise.
+ **/
+static int
+listen_socket_full (ListenSocket *sock)
+{
+	int pos;
+	int count = 0;
+
+	nih_assert (sock != NULL);
+
+	if (! sock->max_instances)
+		return FALSE;
+
+	pos = listen_socket_position (sock);
+
+	NIH_HASH_FOREACH (sock->class->instances, iter) {
+		Job *job = (Job *)iter;
+
+		if ((job->listen_socket == pos)
+		    && (++count >= sock->max_instances))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/**
+ * listen_watcher:
+ * @sock: socket with a pending connection,
+ * @watch: watch on socket,
+ * @events: events that occurred.
+ *
+ * Called when a connection arrives on @sock.  In accept mode the
+ * connection is accepted and a new instance of the job started to handle
+ * it, after which we stop watching @sock if that gives it its maximum
+ * number of instances; otherwise the job is started with the listening
+ * sockets, unless it is already running.
+ **/
+static void
+listen_watcher (ListenSocket *sock,
+		NihIoWatch   *watch,
+		NihIoEvents   events)
+{
+	JobClass           *class;
+	struct sockaddr_in  addr;
+	socklen_t           addrlen = sizeof (addr);
+	int                 fd;
+
+	nih_assert (sock != NULL);
+	nih_assert (watch != NULL);
+
+	class = sock->class;
+
+	if (! class->listen_accept) {
+		listen_class_enable (class, FALSE);
+
+		NIH_HASH_FOREACH (class->instances, iter)
+			return;
+
+		nih_info (_("Connection on %s socket %s, starting %s"),
+			  listen_type_enum_to_str (sock->type),
+			  sock->address, class->name);
+
+		listen_start_job (sock, -1, NULL);
+		return;
+	}
+
+	memset (&addr, 0, sizeof (addr));
+
+	fd = accept4 (sock->fd, (struct sockaddr *)&addr, &addrlen,
+		      SOCK_CLOEXEC);
+	if (fd < 0) {
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK)
+		    && (errno != EINTR) && (errno != ECONNABORTED))
+			nih_warn (_("Failed to accept connection on %s socket %s for %s: %s"),
+				  listen_type_enum_to_str (sock->type),
+				  sock->address, class->name,
+				  strerror (errno));
+		return;
+	}
+
+	listen_start_job (sock, fd,
+			  (sock->type == LISTEN_INET) ? &addr : NULL);
+
+	/* Leave further connections in the backlog until an instance
+	 * finishes; listen_class_resume() watches the socket again.
+	 */
+	if (listen_socket_full (sock)) {
+		nih_info (_("%s socket %s for %s has %d instances, "
+			    "not accepting connections"),
+			  listen_type_enum_to_str (sock->type),
+			  sock->address, class->name, sock->max_instances);
+
+		watch->events = 0;
+	}
+}
+
+/**
+ * listen_start_job:
+ * @sock: socket with a pending connection,
+ * @fd: connection accepted from @sock or -1,
+ * @addr: address of remote end of @fd for LISTEN_INET.
+ *
+ * Starts an instance of the class of @sock, passing it @fd if given.  Each accepted
+ * connection is numbered, with the number given in the CONNECTION
+ * variable and used as the instance name unless the class has an instance
+ * stanza; the remote address and port are given in the REMOTE_ADDR and
+ * REMOTE_PORT variables.  An instance that already exists is never
+ * handed a connection, which is closed instead.
+ **/
+static void
+listen_start_job (ListenSocket             *sock,
+		  int                       fd,
+		  const struct sockaddr_in *addr)
+{
+	nih_local char **env = NULL;
+	nih_local char  *name = NULL;
+	size_t           len;
+	JobClass        *class;
+	Job             *job;
+
+	nih_assert (sock != NULL);
+
+	class = sock->class;
+
+	env = NIH_MUST (job_class_environment (NULL, class, &len));
+
+	if (fd >= 0) {
+		class->listen_serial++;
+
+		NIH_MUST (environ_set (&env, NULL, &len, TRUE,
+				       "CONNECTION=%u", class->listen_serial));
+
+		if (addr) {
+			char buf[INET_ADDRSTRLEN];
+
+			NIH_MUST (environ_set (&env, NULL, &len, TRUE,
+					       "REMOTE_ADDR=%s",
+					       inet_ntop (AF_INET,
+							  &addr->sin_addr,
+							  buf, sizeof (buf))));
+			NIH_MUST (environ_set (&env, NULL, &len, TRUE,
+					       "REMOTE_PORT=%d",
+					       ntohs (addr->sin_port)));
+		}
+	}
+
+	if ((fd >= 0) && (! *class->instance)) {
+		name = NIH_MUST (nih_sprintf (NULL, "%u", class->listen_serial));
+	} else {
+		name = NIH_SHOULD (environ_expand (NULL, class->instance, env));
+		if (! name) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_warn (_("Failed to obtain %s instance: %s"),
+				  class->name, err->message);
+			nih_free (err);
+
+			if (fd >= 0)
+				close (fd);
+			return;
+		}
+	}
+
+	if (nih_hash_lookup (class->instances, name)) {
+		if (fd >= 0) {
+			nih_warn (_("%s (%s) already running, closing connection"),
+				  class->name, name);
+			close (fd);
+		}
+		return;
+	}
+
+	job = NIH_MUST (job_new (class, name));
+	job->listen_fd = fd;
+	if (fd >= 0)
+		job->listen_socket = listen_socket_position (sock);
+
+	nih_debug ("New instance %s", job_name (job));
+
+	job->start_env = env;
+	nih_ref (job->start_env, job);
+
+	nih_discard (env);
+	env = NULL;
+
+	job_change_goal (job, JOB_START);
+}
+
+
+/**
+ * listen_job_fds:
+ * @job: job being spawned,
+ * @process: process being spawned,
+ * @fds: array of at least LISTEN_MAX_SOCKETS to fill.
+ *
+ * Fills @fds with the sockets to pass to @process of @job: for the main
+ * process, the accepted connection in accept mode, otherwise each open
+ * listening socket of its class; other processes are passed none.
+ *
+ * Returns: number of sockets in @fds.
+ **/
+size_t
+listen_job_fds (Job         *job,
+		ProcessType  process,
+		int         *fds)
+{
+	size_t len = 0;
+
+	nih_assert (job != NULL);
+	nih_assert (fds != NULL);
+
+	if (process != PROCESS_MAIN)
+		return 0;
+
+	if (job->class->listen_accept) {
+		if (job->listen_fd >= 0)
+			fds[len++] = job->listen_fd;
+
+		return len;
+	}
+
+	NIH_LIST_FOREACH (&job->class->listen, iter) {
+		ListenSocket *sock = (ListenSocket *)iter;
+
+		nih_assert (len < LISTEN_MAX_SOCKETS);
+
+		if (sock->fd >= 0)
+			fds[len++] = sock->fd;
+	}
+
+	return len;
+}
+
+
+/**
+ * listen_type_enum_to_str:
+ * @type: ListenType.
+ *
+ * Convert ListenType to a string representation.
+ *
+ * Returns: string representation of @type, or NULL if not known.
+ **/
+static const char *
+listen_type_enum_to_str (ListenType type)
+{
+	if (type == LISTEN_INET)
+		return "inet";
+	if (type == LISTEN_UNIX)
+		return "unix";
+
+	return NULL;
+}
+
+/**
+ * listen_type_str_to_enum:
+ * @type: string ListenType value.
+ *
+ * Convert @type back into enum value.
+ *
+ * Returns: ListenType representation of @type, or -1 if not known.
+ **/
+static ListenType
+listen_type_str_to_enum (const char *type)
+{
+	nih_assert (type != NULL);
+
+	if (! strcmp (type, "inet"))
+		return LISTEN_INET;
+	if (! strcmp (type, "unix"))
+		return LISTEN_UNIX;
+
+	return -1;
+}
+
+/**
+ * listen_serialise_all:
+ * @sockets: list of ListenSocket objects.
+ *
+ * Convert @sockets to JSON representation, clearing the close-on-exec
+ * flag of each open socket so that it remains open across the re-exec.
+ *
+ * Returns: JSON object containing array of ListenSocket objects in JSON
+ * form, or NULL on error.
+ **/
+json_object *
+listen_serialise_all (NihList *sockets)
+{
+	json_object *json;
+
+	nih_assert (sockets != NULL);
+
+	json = json_object_new_array ();
+	if (! json)
+		return NULL;
+
+	NIH_LIST_FOREACH (sockets, iter) {
+		ListenSocket *sock = (ListenSocket *)iter;
+		json_object  *json_sock;
+
+		json_sock = json_object_new_object ();
+		if (! json_sock)
+			goto error;
+
+		json_object_array_add (json, json_sock);
+
+		if (! state_set_json_enum_var (json_sock,
+					listen_type_enum_to_str,
+					"type", sock->type))
+			goto error;
+
+		if (! state_set_json_string_var_from_obj (json_sock, sock, address))
+			goto error;
+
+		if (! state_set_json_int_var_from_obj (json_sock, sock, port))
+			goto error;
+
+		if (! state_set_json_int_var_from_obj (json_sock, sock,
+						       max_instances))
+			goto error;
+
+		if ((sock->fd >= 0) && (state_modify_cloexec (sock->fd, FALSE) < 0))
+			goto error;
+
+		if (! state_set_json_int_var_from_obj (json_sock, sock, fd))
+			goto error;
+	}
+
+	return json;
+
+error:
+	json_object_put (json);
+	return NULL;
+}
+
+/**
+ * listen_deserialise_all:
+ * @class: job class to add sockets to,
+ * @json: root of JSON-serialised JobClass.
+ *
+ * Convert JSON representation of ListenSocket objects back into sockets
+ * of @class, taking ownership of any that were open.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+int
+listen_deserialise_all (JobClass    *class,
+			json_object *json)
+{
+	json_object *json_sockets;
+
+	nih_assert (class != NULL);
+	nih_assert (json != NULL);
+
+	/* Versions without socket activation have no sockets */
+	if (! json_object_object_get_ex (json, "listen", &json_sockets))
+		return 0;
+
+	if (! state_check_json_type (json_sockets, array))
+		return -1;
+
+	for (int i = 0; i < json_object_array_length (json_sockets); i++) {
+		nih_local char *address = NULL;
+		json_object    *json_sock;
+		ListenSocket   *sock;
+		ListenType      type;
+		int             port;
+		int             fd;
+
+		json_sock = json_object_array_get_idx (json_sockets, i);
+		if (! json_sock)
+			return -1;
+
+		if (! state_check_json_type (json_sock, object))
+			return -1;
+
+		if (! state_get_json_enum_var (json_sock,
+					listen_type_str_to_enum,
+					"type", type))
+			return -1;
+
+		if (! state_get_json_string_var_strict (json_sock, "address",
+							NULL, address))
+			return -1;
+
+		if (! state_get_json_int_var (json_sock, "port", port))
+			return -1;
+
+		if (! state_get_json_int_var (json_sock, "fd", fd))
+			return -1;
+
+		sock = listen_socket_new (class, type, address, port);
+		if (! sock)
+			return -1;
+
+		/* Versions without instance limits have none */
+		if (json_object_object_get_ex (json_sock, "max_instances", NULL)) {
+			if (! state_get_json_int_var_to_obj (json_sock, sock,
+							     max_instances))
+				return -1;
+		} else {
+			sock->max_instances = 0;
+		}
+
+		if (fd >= 0) {
+			sock->fd = fd;
+
+			if (state_modify_cloexec (fd, TRUE) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+/* upstart
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_LISTEN_H
+#define INIT_LISTEN_H
+
+#include <nih/macros.h>
+#include <nih/list.h>
+#include <nih/io.h>
+
+#include <json.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "job_process.h"
+
+
+/**
+ * LISTEN_FDS_START:
+ *
+ * First file descriptor the listening sockets are passed to the main
+ * process of a job as; the rest follow in the order of the listen
+ * stanzas, and their number is given in the LISTEN_FDS variable.
+ **/
+#define LISTEN_FDS_START 3
+
+/**
+ * LISTEN_MAX_SOCKETS:
+ *
+ * Maximum number of listen stanzas in a job, so that the descriptors
+ * passed never reach the script descriptor.
+ **/
+#define LISTEN_MAX_SOCKETS (JOB_PROCESS_SCRIPT_FD - LISTEN_FDS_START)
+
+/**
+ * LISTEN_DEFAULT_MAX_INSTANCES:
+ *
+ * Number of instances that connections accepted from a socket may have
+ * at once, unless its listen stanza gives another; once reached, further
+ * connections wait in the socket's backlog until one of them finishes.
+ **/
+#define LISTEN_DEFAULT_MAX_INSTANCES 64
+
+
+/**
+ * ListenType:
+ *
+ * Kind of socket described by a listen stanza.
+ **/
+typedef enum listen_type {
+	LISTEN_INET,
+	LISTEN_UNIX,
+} ListenType;
+
+/**
+ * ListenSocket:
+ * @entry: list header,
+ * @class: job class the socket belongs to,
+ * @type: kind of socket,
+ * @address: IPv4 address for LISTEN_INET, or path for LISTEN_UNIX
+ * with a leading '@' for the abstract namespace,
+ * @port: TCP port for LISTEN_INET,
+ * @max_instances: number of instances connections accepted from the
+ * socket may have at once, or zero for no limit,
+ * @fd: listening socket, or -1 when not open,
+ * @watch: watch on @fd while the class is registered.
+ *
+ * This structure represents a listen stanza of a job class; init binds
+ * the socket itself while the class is registered and starts the job
+ * when a connection arrives, passing it the socket or, in accept mode,
+ * the connection.
+ *
+ * In accept mode @watch is disabled while @max_instances instances
+ * started from the socket are running.
+ **/
+typedef struct listen_socket {
+	NihList     entry;
+	JobClass   *class;
+	ListenType  type;
+	char       *address;
+	int         port;
+	int         max_instances;
+	int         fd;
+	NihIoWatch *watch;
+} ListenSocket;
+
+
+NIH_BEGIN_EXTERN
+
+ListenSocket *listen_socket_new  (JobClass *class, ListenType type,
+				  const char *address, int port)
+	__attribute__ ((warn_unused_result));
+
+int           listen_socket_open (ListenSocket *sock)
+	__attribute__ ((warn_unused_result));
+
+void          listen_class_open   (JobClass *class);
+void          listen_class_close  (JobClass *class);
+void          listen_class_handover (JobClass *from, JobClass *to);
+void          listen_class_resume (JobClass *class);
+
+size_t        listen_job_fds      (Job *job, ProcessType process, int *fds);
+
+json_object  *listen_serialise_all   (NihList *sockets)
+	__attribute__ ((warn_unused_result));
+int           listen_deserialise_all (JobClass *class, json_object *json)
+	__attribute__ ((warn_unused_result));
+
+NIH_END_EXTERN
+
+#endif /* INIT_LISTEN_H */
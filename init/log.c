@@ -20,22 +20,50 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */    
 
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <fcntl.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <limits.h>
 #include <signal.h>
 #include <poll.h>
+#include <time.h>
+#include <sys/uio.h>
 #include <nih/signal.h>
+#include <nih/child.h>
 #include <nih/main.h>
 #include "log.h"
 #include "job_process.h"
 #include "session.h"
 #include "conf.h"
 #include "paths.h"
+#include "stats.h"
 
 static int  log_file_open   (Log *log);
 static int  log_file_write  (Log *log, const char *buf, size_t len);
 static void log_read_watch  (Log *log);
 static void log_flush       (Log *log);
+static void log_io_write    (Log *log, NihIo *io, const char *buf,
+			     size_t len);
+static void log_batch_flush (Log *log);
+static void log_batch_timer (Log *log, NihTimer *timer);
+static int  log_rotate_due  (Log *log, const struct stat *statbuf);
+static int  log_rotate      (Log *log);
+static void log_rotate_time (Log *log);
+static void log_compress    (Log *log, const char *path);
+static int  log_compressing (const char *path);
+static void log_compress_reaped (NihListEntry *entry, pid_t pid,
+				 NihChildEvents event, int status);
+static void log_splice_watcher (Log *log, NihIoWatch *watch,
+				NihIoEvents events);
+static int  log_splice_data (Log *log, int fd);
+static int  log_unflushed_push   (Log *log, const char *buf, size_t len);
+static void log_unflushed_shrink (Log *log, size_t len);
+static void log_unflushed_drop   (Log *log, size_t len);
+static void log_write_dropped    (Log *log);
 
 /**
  * log_flushed:
@@ -57,6 +85,108 @@ int log_flushed = 0;
  **/
 NihList *log_unflushed_files = NULL;
 
+/**
+ * log_batch_size:
+ *
+ * Number of bytes of job output to accumulate before writing it to the
+ * log file, or zero to write output as soon as it is read.
+ *
+ * Batching reduces the number of writes made by init for jobs that
+ * produce a lot of output in small pieces.
+ **/
+int log_batch_size = 0;
+
+/**
+ * log_batch_timeout:
+ *
+ * Maximum number of seconds that job output is held back for when
+ * log_batch_size is set.
+ **/
+int log_batch_timeout = LOG_BATCH_DEFAULT_TIMEOUT;
+
+/**
+ * log_rotate_size:
+ *
+ * Size in bytes at which log files are rotated, or zero to never rotate
+ * log files because of their size.
+ **/
+int log_rotate_size = 0;
+
+/**
+ * log_rotate_interval:
+ *
+ * Number of seconds after which log files are rotated, or zero to never
+ * rotate log files because of their age.
+ **/
+int log_rotate_interval = 0;
+
+/**
+ * log_rotate_count:
+ *
+ * Number of rotated log files to keep for each job.
+ **/
+int log_rotate_count = LOG_ROTATE_DEFAULT_COUNT;
+
+/**
+ * log_rotate_compress:
+ *
+ * If TRUE, rotated log files are compressed by running
+ * LOG_COMPRESS_COMMAND.
+ **/
+int log_rotate_compress = FALSE;
+
+/**
+ * log_compressions:
+ *
+ * List of NihListEntry objects containing the paths of log files whose
+ * rotated file is being compressed by a child process.  These are not
+ * rotated again until the child has exited, since that would rename the
+ * file from under it.
+ **/
+static NihList *log_compressions = NULL;
+
+/**
+ * log_splice:
+ *
+ * If TRUE, the output of jobs is collected through a pipe rather than a
+ * pty so that it can be moved into log files with splice(2) without
+ * being copied through init.
+ **/
+int log_splice = FALSE;
+
+/**
+ * log_unflushed_limit:
+ *
+ * Maximum number of bytes of unflushed output kept for each log while
+ * its log file cannot be written, or zero for no limit.  Once reached,
+ * the oldest output is dropped to make room for the newest.
+ **/
+int log_unflushed_limit = LOG_UNFLUSHED_DEFAULT_LIMIT;
+
+/**
+ * log_unflushed_total_limit:
+ *
+ * Maximum number of bytes of unflushed output kept for all logs
+ * together, or zero for no limit.  Once reached, output is dropped from
+ * whichever log is being written to.
+ **/
+int log_unflushed_total_limit = LOG_UNFLUSHED_DEFAULT_TOTAL_LIMIT;
+
+/**
+ * log_unflushed_bytes:
+ *
+ * Number of bytes of unflushed output currently held for all logs.
+ **/
+uint64_t log_unflushed_bytes = 0;
+
+/**
+ * log_unflushed_dropped:
+ *
+ * Number of bytes of unflushed output dropped to stay within
+ * log_unflushed_limit and log_unflushed_total_limit since init started.
+ **/
+uint64_t log_unflushed_dropped = 0;
+
 /**
  * log_new:
  *
@@ -75,7 +205,8 @@ NihList *log_unflushed_files = NULL;
  * freed.
  *
  * Note that @fd must refer to a valid and open pty(7) file
- * descriptor.
+ * descriptor, or to the read end of a pipe(7), in which case output is
+ * spliced directly into the log file whenever it can be.
  *
  * Returns: newly allocated Log structure or NULL on error.
  **/
@@ -85,8 +216,9 @@ log_new (const void *parent,
 	 int fd,
 	 uid_t uid)
 {
-	Log    *log;
-	size_t  len;
+	Log         *log;
+	size_t       len;
+	struct stat  statbuf;
 
 	nih_assert (path);
 	nih_assert (fd > 0);
@@ -129,6 +261,9 @@ log_new (const void *parent,
 	log->detached      = 0;
 	log->remote_closed = 0;
 	log->open_errno    = 0;
+	log->batch_timer   = NULL;
+	log->rotate_time   = 0;
+	log->dropped       = 0;
 
 	log->path = nih_strndup (log, path, len);
 	if (! log->path)
@@ -140,7 +275,7 @@ log_new (const void *parent,
 
 	log->io = nih_io_reopen (log, fd, NIH_IO_STREAM,
 			(NihIoReader)log_io_reader,
-			NULL,
+			(NihIoCloseHandler)log_io_close_handler,
 			(NihIoErrorHandler)log_io_error_handler,
 			log);
 
@@ -151,6 +286,14 @@ log_new (const void *parent,
 		goto error;
 	}
 
+	/* Output from a pipe can be spliced, so take over its watch and
+	 * only hand it back to NihIo when that isn't possible.
+	 */
+	if (! fstat (fd, &statbuf) && S_ISFIFO (statbuf.st_mode)) {
+		log->io->watch->watcher = (NihIoWatcher)log_splice_watcher;
+		log->io->watch->data = log;
+	}
+
 	nih_alloc_set_destructor (log, log_destroy);
 
 	return log;
@@ -191,6 +334,10 @@ log_destroy (Log *log)
 
 	log->fd = -1;
 
+	/* Whatever could not be flushed is lost */
+	if (log->unflushed)
+		log_unflushed_shrink (log, log->unflushed->len);
+
 	return 0;
 }
 
@@ -220,6 +367,9 @@ log_flush (Log *log)
 	/* User job logging not currently available */
 	nih_assert (log->uid == 0);
 
+	/* Write any output held back for batching */
+	log_batch_flush (log);
+
 	/* Job probably attempted to write data _only_ before the logger
 	 * could access the disk. Last ditch attempt to persist the
 	 * data.
@@ -288,6 +438,11 @@ out:
  * Called automatically when data is available to read on the fd
  * encapsulated in @io.
  *
+ * If log_batch_size is set, the data is left in the receive buffer of
+ * @io until at least that much has accumulated, or until
+ * log_batch_timeout seconds have passed or the job has ended, so that
+ * chatty jobs do not cause a write for every read.
+ *
  * Notes for user jobs:
  *
  * User jobs by necessity are handled differently to system jobs. Since
@@ -314,8 +469,6 @@ out:
 void
 log_io_reader (Log *log, NihIo *io, const char *buf, size_t len)
 {
-	int          ret;
-
 	nih_assert (log);
 	nih_assert (log->path);
 	nih_assert (io);
@@ -326,6 +479,47 @@ log_io_reader (Log *log, NihIo *io, const char *buf, size_t len)
 	/* User job logging not currently available */
 	nih_assert (log->uid == 0);
 
+	/* When batching, leave the data in the receive buffer, to which
+	 * NihIo will append any further output, until enough has
+	 * accumulated to be worth writing or the timer expires.
+	 */
+	if (log_batch_size > 0 && len < (size_t)log_batch_size) {
+		if (! log->batch_timer)
+			log->batch_timer = nih_timer_add_timeout (
+				log, log_batch_timeout,
+				(NihTimerCb)log_batch_timer, log);
+
+		/* Write immediately if we can't arrange to do so later */
+		if (log->batch_timer)
+			return;
+	}
+
+	log_io_write (log, io, buf, len);
+}
+
+/**
+ * log_io_write:
+ *
+ * @log: Log associated with this @io,
+ * @io: NihIo with data to be written,
+ * @buf: buffer data is available in,
+ * @len: bytes in @buf available for writing.
+ *
+ * Writes the data read from the job to the log file, or saves it as
+ * unflushed data if the log file cannot be opened, removing it from
+ * the receive buffer of @io.
+ **/
+static void
+log_io_write (Log *log, NihIo *io, const char *buf, size_t len)
+{
+	int          ret;
+	uint64_t     start;
+
+	nih_assert (log);
+	nih_assert (io);
+	nih_assert (buf);
+	nih_assert (len);
+
 	/* Just in case we try to write more than read can inform us
 	 * about (this should really be a build-time assertion).
 	 */
@@ -336,7 +530,7 @@ log_io_reader (Log *log, NihIo *io, const char *buf, size_t len)
 	if (ret < 0) {
 		if (log->open_errno != ENOSPC) {
 			/* Add new data to unflushed buffer */
-			if (nih_io_buffer_push (log->unflushed, buf, len) < 0)
+			if (log_unflushed_push (log, buf, len) < 0)
 				return;
 		}
 
@@ -349,11 +543,62 @@ log_io_reader (Log *log, NihIo *io, const char *buf, size_t len)
 		return;
 	}
 
+	start = stats_now ();
 	ret = log_file_write (log, buf, len);
+	stats_record (STATS_LOG_WRITE, start);
+
 	if (ret < 0)
 		nih_warn ("%s %s", _("Failed to write to log file"), log->path);
 }
 
+/**
+ * log_batch_flush:
+ *
+ * @log: Log.
+ *
+ * Writes any job output held back in the receive buffer of @log's
+ * NihIo for batching, and cancels the batch timer.
+ **/
+static void
+log_batch_flush (Log *log)
+{
+	NihIo *io;
+
+	nih_assert (log);
+
+	if (log->batch_timer) {
+		nih_free (log->batch_timer);
+		log->batch_timer = NULL;
+	}
+
+	io = log->io;
+
+	if (io && io->recv_buf->len)
+		log_io_write (log, io, io->recv_buf->buf, io->recv_buf->len);
+}
+
+/**
+ * log_batch_timer:
+ *
+ * @log: Log,
+ * @timer: timer that expired.
+ *
+ * Called when job output has been held back for batching for
+ * log_batch_timeout seconds, to write it to the log file.
+ **/
+static void
+log_batch_timer (Log *log, NihTimer *timer)
+{
+	nih_assert (log);
+	nih_assert (timer);
+	nih_assert (log->batch_timer == timer);
+
+	/* Timer is freed once we return */
+	log->batch_timer = NULL;
+
+	log_batch_flush (log);
+}
+
 /**
  * log_io_error_handler:
  *
@@ -384,6 +629,28 @@ log_io_error_handler (Log *log, NihIo *io)
 
 	nih_free (err);
 
+	log_io_close_handler (log, io);
+}
+
+/**
+ * log_io_close_handler:
+ *
+ * @log: Log associated with this @io,
+ * @io: NihIo.
+ *
+ * Called automatically when the job closes its end of a pipe, which
+ * unlike a pty reads as end of file rather than an error.
+ */
+void
+log_io_close_handler (Log *log, NihIo *io)
+{
+	nih_assert (log);
+	nih_assert (io);
+	nih_assert (log->io == io);
+
+	/* Write any output held back for batching before it is lost */
+	log_batch_flush (log);
+
 	/* Ensure the NihIo is closed */
 	nih_free (log->io);
 	log->io = NULL;
@@ -391,6 +658,124 @@ log_io_error_handler (Log *log, NihIo *io)
 	log->remote_closed = 1;
 }
 
+/**
+ * log_splice_watcher:
+ *
+ * @log: Log,
+ * @watch: watch on the pipe the job writes its output to,
+ * @events: events that occurred.
+ *
+ * Called in place of the usual NihIo watcher when job output arrives on
+ * a pipe.  If the log file can be written and no earlier output is still
+ * waiting to be, the output is spliced straight from the pipe into the
+ * log file; otherwise it is read into the NihIo as usual, to be saved as
+ * unflushed data or batched.
+ **/
+static void
+log_splice_watcher (Log          *log,
+		    NihIoWatch   *watch,
+		    NihIoEvents   events)
+{
+	NihIo *io;
+	int    ret;
+
+	nih_assert (log);
+	nih_assert (watch);
+
+	io = log->io;
+
+	nih_assert (io);
+	nih_assert (io->watch == watch);
+
+	if ((events & NIH_IO_READ)
+	    && (log_batch_size <= 0)
+	    && (! log->unflushed->len)
+	    && (! io->recv_buf->len)
+	    && (log_file_open (log) == 0)) {
+		ret = log_splice_data (log, watch->fd);
+
+		if (ret > 0)
+			return;
+
+		if (! ret) {
+			/* Frees the NihIo, and with it the watch */
+			log_io_close_handler (log, io);
+			return;
+		}
+	}
+
+	nih_io_watcher (io, watch, events);
+}
+
+/**
+ * log_splice_data:
+ *
+ * @log: Log with open log file,
+ * @fd: pipe to read job output from.
+ *
+ * Moves up to LOG_SPLICE_SIZE bytes of the output waiting in @fd into
+ * the log file of @log with splice(2), so that it is never copied into
+ * our own memory.  Any more is left for the next iteration of the main
+ * loop, so that a job writing continuously cannot keep us from other
+ * work, and the log file is checked for rotation before it is written.
+ *
+ * splice(2) refuses to write to a file opened for appending, so the log
+ * file is written from its end with O_APPEND cleared, which is safe since
+ * we are its only writer, and the flag is restored afterwards.
+ *
+ * Returns: 1 if output was moved or @fd is empty, 0 if the job has closed
+ * its end of @fd, or -1 if the output must be read instead.
+ **/
+static int
+log_splice_data (Log *log, int fd)
+{
+	ssize_t   len;
+	uint64_t  start;
+	int       flags;
+	int       ret;
+
+	nih_assert (log);
+	nih_assert (log->fd >= 0);
+	nih_assert (fd >= 0);
+
+	flags = fcntl (log->fd, F_GETFL);
+	if (flags < 0)
+		return -1;
+
+	if (fcntl (log->fd, F_SETFL, flags & ~O_APPEND) < 0)
+		return -1;
+
+	if (lseek (log->fd, 0, SEEK_END) < 0) {
+		ret = -1;
+		goto out;
+	}
+
+	do {
+		start = stats_now ();
+		len = splice (fd, NULL, log->fd, NULL, LOG_SPLICE_SIZE,
+			      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		stats_record (STATS_LOG_WRITE, start);
+	} while ((len < 0) && (errno == EINTR));
+
+	if (len > 0) {
+		ret = 1;
+	} else if (! len) {
+		ret = 0;
+	} else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+		ret = 1;
+	} else {
+		/* Whatever else went wrong, the output is still in
+		 * the pipe to be read.
+		 */
+		ret = -1;
+	}
+
+out:
+	fcntl (log->fd, F_SETFL, flags);
+
+	return ret;
+}
+
 /**
  * log_file_open:
  * @log: Log.
@@ -419,6 +804,14 @@ log_file_open (Log *log)
 
 	ret = fstat (log->fd, &statbuf);
 
+	/* Already open, but now needs to be rotated */
+	if (log->fd > -1 && (! ret && statbuf.st_nlink)
+			&& log_rotate_due (log, &statbuf)) {
+		if (log_rotate (log) < 0)
+			nih_warn ("%s %s", _("Failed to rotate log file"),
+				  log->path);
+	}
+
 	/* Already open */
 	if (log->fd > -1 && (! ret && statbuf.st_nlink))
 		return 0;
@@ -459,9 +852,259 @@ log_file_open (Log *log)
 	if (log->fd < 0)
 		return -1;
 
+	if (log_rotate_interval && ! log->rotate_time)
+		log_rotate_time (log);
+
 	return 0;
 }
 
+/**
+ * log_rotate_due:
+ * @log: Log,
+ * @statbuf: status of open log file.
+ *
+ * Determine whether the log file of @log, whose status is given by
+ * @statbuf, has grown larger than log_rotate_size or is older than
+ * log_rotate_interval.
+ *
+ * Returns: TRUE if the log file should now be rotated, FALSE otherwise.
+ **/
+static int
+log_rotate_due (Log *log, const struct stat *statbuf)
+{
+	nih_assert (log);
+	nih_assert (statbuf);
+
+	if (! statbuf->st_size)
+		return FALSE;
+
+	if (log_compressing (log->path))
+		return FALSE;
+
+	if (log_rotate_size > 0 && statbuf->st_size >= log_rotate_size)
+		return TRUE;
+
+	if (log_rotate_interval > 0 && log->rotate_time
+			&& time (NULL) - log->rotate_time >= log_rotate_interval)
+		return TRUE;
+
+	return FALSE;
+}
+
+/**
+ * log_rotate:
+ * @log: Log.
+ *
+ * Closes the log file of @log and renames it with a ".1" suffix, first
+ * renaming any existing rotated files to the next number up and removing
+ * those beyond log_rotate_count.  The newly rotated file is compressed if
+ * log_rotate_compress is TRUE.
+ *
+ * The caller should then open the log file again to create a new file.
+ *
+ * Returns: 0 on success, -1 on failure.
+ **/
+static int
+log_rotate (Log *log)
+{
+	const char     *suffixes[] = { "", LOG_COMPRESS_SUFFIX, NULL };
+	nih_local char *rotated = NULL;
+
+	nih_assert (log);
+	nih_assert (log->path);
+	nih_assert (log->fd != -1);
+
+	close (log->fd);
+	log->fd = -1;
+
+	log->rotate_time = time (NULL);
+
+	if (log_rotate_count <= 0)
+		return unlink (log->path);
+
+	/* Make space for the new file, removing the oldest */
+	for (int i = log_rotate_count; i > 0; i--) {
+		for (const char **suffix = suffixes; *suffix; suffix++) {
+			nih_local char *from = NULL;
+			nih_local char *to = NULL;
+
+			from = nih_sprintf (NULL, "%s.%d%s",
+					    log->path, i, *suffix);
+			if (! from)
+				return -1;
+
+			if (i == log_rotate_count) {
+				if (unlink (from) < 0 && errno != ENOENT)
+					return -1;
+				continue;
+			}
+
+			to = nih_sprintf (NULL, "%s.%d%s",
+					  log->path, i + 1, *suffix);
+			if (! to)
+				return -1;
+
+			if (rename (from, to) < 0 && errno != ENOENT)
+				return -1;
+		}
+	}
+
+	rotated = nih_sprintf (NULL, "%s.1", log->path);
+	if (! rotated)
+		return -1;
+
+	if (rename (log->path, rotated) < 0)
+		return -1;
+
+	if (log_rotate_compress)
+		log_compress (log, rotated);
+
+	return 0;
+}
+
+/**
+ * log_rotate_time:
+ * @log: Log.
+ *
+ * Determine when the log file of @log was last rotated, from the
+ * modification time of the most recently rotated file, so that the age
+ * of log files written by successive instances of a job is considered
+ * rather than just the lifetime of @log.
+ *
+ * If there is no rotated file, the current time is used.
+ **/
+static void
+log_rotate_time (Log *log)
+{
+	const char *suffixes[] = { "", LOG_COMPRESS_SUFFIX, NULL };
+
+	nih_assert (log);
+	nih_assert (log->path);
+
+	log->rotate_time = time (NULL);
+
+	for (const char **suffix = suffixes; *suffix; suffix++) {
+		nih_local char *rotated = NULL;
+		struct stat     statbuf;
+
+		rotated = nih_sprintf (NULL, "%s.1%s", log->path, *suffix);
+		if (! rotated)
+			return;
+
+		if (! stat (rotated, &statbuf)) {
+			log->rotate_time = statbuf.st_mtime;
+			return;
+		}
+	}
+}
+
+/**
+ * log_compress:
+ * @log: Log,
+ * @path: rotated log file.
+ *
+ * Compress @path, the file the log file of @log was just rotated to, in
+ * the background by running LOG_COMPRESS_COMMAND in a child process.
+ * The log file is not rotated again until the child has exited.
+ **/
+static void
+log_compress (Log        *log,
+	      const char *path)
+{
+	NihListEntry *entry;
+	pid_t         pid;
+
+	nih_assert (log);
+	nih_assert (log->path);
+	nih_assert (path);
+
+	if (! log_compressions)
+		log_compressions = NIH_MUST (nih_list_new (NULL));
+
+	entry = NIH_MUST (nih_list_entry_new (log_compressions));
+	entry->str = NIH_MUST (nih_strdup (entry, log->path));
+
+	pid = fork ();
+	if (pid < 0) {
+		nih_warn ("%s %s: %s", _("Failed to compress log file"),
+			  path, strerror (errno));
+		nih_free (entry);
+		return;
+	} else if (pid > 0) {
+		NIH_MUST (nih_child_add_watch (NULL, pid,
+					       (NIH_CHILD_EXITED
+						| NIH_CHILD_KILLED
+						| NIH_CHILD_DUMPED),
+					       (NihChildHandler)log_compress_reaped,
+					       entry));
+
+		nih_list_add (log_compressions, &entry->entry);
+		return;
+	}
+
+	/* Child: restore default signal handling so that the
+	 * compression command behaves normally, and don't leave it
+	 * holding our log files, sockets and pipes.
+	 */
+	nih_signal_reset ();
+
+	for (int fd = sysconf (_SC_OPEN_MAX) - 1; fd > STDERR_FILENO; fd--)
+		close (fd);
+
+	execlp (LOG_COMPRESS_COMMAND, LOG_COMPRESS_COMMAND, "-f", path,
+		(char *)NULL);
+	_exit (255);
+}
+
+/**
+ * log_compressing:
+ * @path: path of log file.
+ *
+ * Determine whether the file the log file at @path was last rotated to
+ * is still being compressed.
+ *
+ * Returns: TRUE if a compression child for @path is running, FALSE
+ * otherwise.
+ **/
+static int
+log_compressing (const char *path)
+{
+	nih_assert (path);
+
+	if (! log_compressions)
+		return FALSE;
+
+	NIH_LIST_FOREACH (log_compressions, iter) {
+		NihListEntry *entry = (NihListEntry *)iter;
+
+		if (! strcmp (entry->str, path))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * log_compress_reaped:
+ * @entry: entry in log_compressions,
+ * @pid: process id of compression child,
+ * @event: event that occurred,
+ * @status: exit status or signal.
+ *
+ * Called when the child process started by log_compress() has exited,
+ * allowing the log file to be rotated again.
+ **/
+static void
+log_compress_reaped (NihListEntry   *entry,
+		     pid_t           pid,
+		     NihChildEvents  event,
+		     int             status)
+{
+	nih_assert (entry);
+
+	nih_free (entry);
+}
+
 
 /**
  * log_file_write:
@@ -532,6 +1175,62 @@ log_file_write (Log *log, const char *buf, size_t len)
 
 	io = log->io;
 
+	/* Mark where output was dropped before writing what followed */
+	if (log->dropped)
+		log_write_dropped (log);
+
+	/* Write both any data we previously failed to write and the new
+	 * data with a single call where possible.
+	 */
+	if (log->unflushed->len && buf && len) {
+		struct iovec iov[2];
+
+		iov[0].iov_base = log->unflushed->buf;
+		iov[0].iov_len = log->unflushed->len;
+		iov[1].iov_base = (void *)buf;
+		iov[1].iov_len = len;
+
+		wlen = writev (log->fd, iov, 2);
+		saved = errno;
+
+		if (wlen < 0) {
+			/* As below, add the new data to the unflushed
+			 * buffer unless out of space.
+			 */
+			if (saved != ENOSPC
+					&& log_unflushed_push (log, buf, len) < 0)
+				goto error;
+
+			nih_io_buffer_shrink (io->recv_buf, len);
+
+			goto error;
+		}
+
+		if ((size_t)wlen < log->unflushed->len) {
+			/* Partial write of the unflushed data, so store
+			 * the new data for next time to avoid a gap.
+			 */
+			log_unflushed_shrink (log, (size_t)wlen);
+
+			if (log_unflushed_push (log, buf, len) < 0)
+				goto error;
+
+			nih_io_buffer_shrink (io->recv_buf, len);
+
+			goto error;
+		}
+
+		wlen -= log->unflushed->len;
+		log_unflushed_shrink (log, log->unflushed->len);
+
+		/* Shrink buffer by amount of new data written (which
+		 * handles partial writes)
+		 */
+		nih_io_buffer_shrink (io->recv_buf, (size_t)wlen);
+
+		return 0;
+	}
+
 	/* Flush any data we previously failed to write */
 	if (log->unflushed->len) {
 		wlen = write (log->fd, log->unflushed->buf, log->unflushed->len);
@@ -549,7 +1248,7 @@ log_file_write (Log *log, const char *buf, size_t len)
 			 * space.
 			 */
 			if (saved != ENOSPC && len
-					&& nih_io_buffer_push (log->unflushed, buf, len) < 0)
+					&& log_unflushed_push (log, buf, len) < 0)
 				goto error;
 
 			if (len)
@@ -559,7 +1258,7 @@ log_file_write (Log *log, const char *buf, size_t len)
 			goto error;
 		}
 
-		nih_io_buffer_shrink (log->unflushed, (size_t)wlen);
+		log_unflushed_shrink (log, (size_t)wlen);
 	}
 
 	/* Only managed a partial write for the unflushed data,
@@ -572,7 +1271,7 @@ log_file_write (Log *log, const char *buf, size_t len)
 			goto error;
 
 		/* Save new data */
-		if (nih_io_buffer_push (log->unflushed, buf, len) < 0)
+		if (log_unflushed_push (log, buf, len) < 0)
 			goto error;
 
 		nih_io_buffer_shrink (io->recv_buf, len);
@@ -588,7 +1287,7 @@ log_file_write (Log *log, const char *buf, size_t len)
 	saved = errno;
 
 	if (wlen < 0) {
-		if (saved != ENOSPC && nih_io_buffer_push (log->unflushed, buf, len) < 0)
+		if (saved != ENOSPC && log_unflushed_push (log, buf, len) < 0)
 			goto error;
 
 		nih_io_buffer_shrink (io->recv_buf, len);
@@ -702,9 +1401,14 @@ log_read_watch (Log *log)
 			 * In this scenario the error handler is never called.
 			 *
 			 */
-			if (saved && saved != EAGAIN && saved != EWOULDBLOCK)
+			if (! len || (saved && saved != EAGAIN && saved != EWOULDBLOCK))
 				log->remote_closed = 1;
 
+			/* Don't hold back any output now the job has
+			 * ended.
+			 */
+			log_batch_flush (log);
+
 			close (log->fd);
 			log->fd = -1;
 			break;
@@ -712,6 +1416,149 @@ log_read_watch (Log *log)
 	}
 }
 
+/**
+ * log_unflushed_push:
+ *
+ * @log: Log,
+ * @buf: job output,
+ * @len: length of @buf.
+ *
+ * Adds @buf to the unflushed output of @log, first dropping its oldest
+ * output, or the start of @buf itself, as needed to keep within
+ * log_unflushed_limit and log_unflushed_total_limit so that only the
+ * newest output is kept.
+ *
+ * Returns: 0 on success, -1 on failure.
+ **/
+static int
+log_unflushed_push (Log *log, const char *buf, size_t len)
+{
+	uint64_t limit = UINT64_MAX;
+	uint64_t others;
+
+	nih_assert (log);
+	nih_assert (log->unflushed);
+	nih_assert (buf);
+
+	if (log_unflushed_limit > 0)
+		limit = (uint64_t)log_unflushed_limit;
+
+	/* Output held for other logs leaves less room for this one */
+	if (log_unflushed_total_limit > 0) {
+		others = log_unflushed_bytes - log->unflushed->len;
+
+		if (others >= (uint64_t)log_unflushed_total_limit) {
+			limit = 0;
+		} else if ((uint64_t)log_unflushed_total_limit - others < limit) {
+			limit = (uint64_t)log_unflushed_total_limit - others;
+		}
+	}
+
+	if (len > limit) {
+		log_unflushed_drop (log, len - limit);
+		buf += len - limit;
+		len = limit;
+	}
+
+	if (log->unflushed->len + len > limit) {
+		size_t excess = log->unflushed->len + len - limit;
+
+		log_unflushed_shrink (log, excess);
+		log_unflushed_drop (log, excess);
+	}
+
+	if (! len)
+		return 0;
+
+	if (nih_io_buffer_push (log->unflushed, buf, len) < 0)
+		return -1;
+
+	log_unflushed_bytes += len;
+
+	return 0;
+}
+
+/**
+ * log_unflushed_shrink:
+ *
+ * @log: Log,
+ * @len: number of bytes.
+ *
+ * Removes the first @len bytes of unflushed output from @log, once
+ * written or dropped.
+ **/
+static void
+log_unflushed_shrink (Log *log, size_t len)
+{
+	nih_assert (log);
+	nih_assert (log->unflushed);
+	nih_assert (len <= log->unflushed->len);
+	nih_assert (len <= log_unflushed_bytes);
+
+	if (! len)
+		return;
+
+	nih_io_buffer_shrink (log->unflushed, len);
+	log_unflushed_bytes -= len;
+}
+
+/**
+ * log_unflushed_drop:
+ *
+ * @log: Log,
+ * @len: number of bytes.
+ *
+ * Counts @len bytes of output of @log dropped rather than kept, so that
+ * a marker can be written in their place.
+ **/
+static void
+log_unflushed_drop (Log *log, size_t len)
+{
+	nih_assert (log);
+
+	if (! len)
+		return;
+
+	if (! log->dropped)
+		nih_warn ("%s %s", _("Dropping unflushed output for log file"),
+			  log->path);
+
+	log->dropped += len;
+	log_unflushed_dropped += len;
+}
+
+/**
+ * log_write_dropped:
+ *
+ * @log: Log with open log file.
+ *
+ * Writes a line to the log file of @log saying how much output was
+ * dropped at that point, ahead of the output that was kept.  If the line
+ * cannot be written, it is attempted again with the next write.
+ **/
+static void
+log_write_dropped (Log *log)
+{
+	char    marker[LOG_DROPPED_MARKER_MAX];
+	int     len;
+	ssize_t wlen;
+
+	nih_assert (log);
+	nih_assert (log->fd != -1);
+	nih_assert (log->dropped);
+
+	len = snprintf (marker, sizeof (marker), LOG_DROPPED_MARKER,
+			log->dropped);
+	if ((len < 0) || ((size_t)len >= sizeof (marker)))
+		return;
+
+	wlen = write (log->fd, marker, (size_t)len);
+	if (wlen != len)
+		return;
+
+	log->dropped = 0;
+}
+
 /**
  * log_unflushed_init:
  *
@@ -907,6 +1754,11 @@ log_serialise (Log *log)
 	if (! log || (! log->io && log->unflushed && ! log->unflushed->len))
 		goto placeholder;
 
+	/* Output held back for batching is not encoded, so write it now
+	 * (or move it to the unflushed buffer if that isn't possible).
+	 */
+	log_batch_flush (log);
+
 	/* Attempt to flush any cached data */
 	if (log->unflushed && log->unflushed->len) {
 		/* Don't check return values since if this fails and
@@ -965,6 +1817,9 @@ log_serialise (Log *log)
 	if (! state_set_json_int_var_from_obj (json, log, open_errno))
 		goto error;
 
+	if (! state_set_json_int_var_from_obj (json, log, dropped))
+		goto error;
+
 	return json;
 
 placeholder:
@@ -1060,7 +1915,12 @@ log_deserialise (const void *parent,
 		if (ret < 0)
 			goto error;
 
-		if (nih_io_buffer_push (log->unflushed, unflushed, len) < 0)
+		if (log_unflushed_push (log, unflushed, len) < 0)
+			goto error;
+	}
+
+	if (json_object_object_get_ex (json, "dropped", NULL)) {
+		if (! state_get_json_int_var_to_obj (json, log, dropped))
 			goto error;
 	}
 
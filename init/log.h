@@ -21,9 +21,12 @@
 #ifndef INIT_LOG_H
 #define INIT_LOG_H
 
+#include <stdint.h>
+
 #include <nih/alloc.h>
 #include <nih/list.h>
 #include <nih/io.h>
+#include <nih/timer.h>
 #include <nih/file.h>
 #include <nih/string.h>
 #include <nih/logging.h>
@@ -49,6 +52,68 @@
  **/
 #define LOG_READ_SIZE            1024
 
+/** LOG_SPLICE_SIZE:
+ *
+ * Maximum number of bytes to move from a job pipe to its log file each
+ * time the pipe becomes readable.
+ **/
+#define LOG_SPLICE_SIZE          65536
+
+/** LOG_BATCH_DEFAULT_TIMEOUT:
+ *
+ * Default number of seconds job output may be held back before being
+ * written when batching is enabled with the --log-batch-size option.
+ **/
+#define LOG_BATCH_DEFAULT_TIMEOUT 1
+
+/** LOG_ROTATE_DEFAULT_COUNT:
+ *
+ * Default number of rotated log files to keep for each job when log
+ * rotation is enabled.
+ **/
+#define LOG_ROTATE_DEFAULT_COUNT 4
+
+/** LOG_UNFLUSHED_DEFAULT_LIMIT:
+ *
+ * Default maximum number of bytes of unflushed output kept for each log
+ * until its log file can be written.
+ **/
+#define LOG_UNFLUSHED_DEFAULT_LIMIT       (1024 * 1024)
+
+/** LOG_UNFLUSHED_DEFAULT_TOTAL_LIMIT:
+ *
+ * Default maximum number of bytes of unflushed output kept for all logs
+ * together.
+ **/
+#define LOG_UNFLUSHED_DEFAULT_TOTAL_LIMIT (8 * 1024 * 1024)
+
+/** LOG_DROPPED_MARKER:
+ *
+ * Format of the line written to a log file in place of unflushed output
+ * that was dropped, given the number of bytes dropped.
+ **/
+#define LOG_DROPPED_MARKER       "[%zu bytes of output dropped while log was not writeable]\n"
+
+/** LOG_DROPPED_MARKER_MAX:
+ *
+ * Size of buffer large enough for LOG_DROPPED_MARKER.
+ **/
+#define LOG_DROPPED_MARKER_MAX   128
+
+/** LOG_COMPRESS_COMMAND:
+ *
+ * Command run to compress a rotated log file, which is given as its only
+ * argument and should be replaced by a file of the same name with a
+ * LOG_COMPRESS_SUFFIX suffix.
+ **/
+#define LOG_COMPRESS_COMMAND     "gzip"
+
+/** LOG_COMPRESS_SUFFIX:
+ *
+ * Suffix of rotated log files compressed by LOG_COMPRESS_COMMAND.
+ **/
+#define LOG_COMPRESS_SUFFIX      ".gz"
+
 /**
  * Log:
  *
@@ -58,8 +123,12 @@
  * @uid: User ID of caller,
  * @unflushed: Unflushed data,
  * @detached: TRUE if log is no longer associated with a parent (job),
- * @remote_closed: TRUE if remote end of pty has been closed,
- * @open_errno: value of errno immediately after last attempt to open @path.
+ * @remote_closed: TRUE if remote end of pty or pipe has been closed,
+ * @open_errno: value of errno immediately after last attempt to open @path,
+ * @batch_timer: timer to write batched output held in @io,
+ * @rotate_time: time @path was last rotated (or first opened),
+ * @dropped: number of bytes of unflushed output dropped since a marker
+ * was last written to @path.
  **/
 typedef struct log {
 	int          fd;
@@ -70,17 +139,32 @@ typedef struct log {
 	int          detached;
 	int          remote_closed;
 	int          open_errno;
+	NihTimer    *batch_timer;
+	time_t       rotate_time;
+	size_t       dropped;
 } Log;
 
 NIH_BEGIN_EXTERN
 
 extern NihList *log_unflushed_files;
+extern int      log_batch_size;
+extern int      log_batch_timeout;
+extern int      log_rotate_size;
+extern int      log_rotate_interval;
+extern int      log_rotate_count;
+extern int      log_rotate_compress;
+extern int      log_splice;
+extern int      log_unflushed_limit;
+extern int      log_unflushed_total_limit;
+extern uint64_t log_unflushed_bytes;
+extern uint64_t log_unflushed_dropped;
 
 Log  *log_new                (const void *parent, const char *path,
 			      int fd, uid_t uid)
 	__attribute__ ((warn_unused_result));
 void  log_io_reader          (Log *log, NihIo *io, const char *buf, size_t len);
 void  log_io_error_handler   (Log *log, NihIo *io);
+void  log_io_close_handler   (Log *log, NihIo *io);
 int   log_destroy            (Log *log)
 	__attribute__ ((warn_unused_result));
 int   log_handle_unflushed   (void *parent, Log *log)
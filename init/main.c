@@ -69,6 +69,7 @@
 #include "control.h"
 #include "state.h"
 #include "xdg.h"
+#include "schedule.h"
 
 
 /* Prototypes for static functions */
@@ -101,6 +102,15 @@ static int  append_conf_dir_setter  (NihOption *option, const char *arg);
  **/
 static int state_fd = -1;
 
+/**
+ * state_memfd:
+ *
+ * Memfd holding a binary snapshot left by the previous instance during
+ * stateful re-exec, which we have told it we will read instead of JSON
+ * from state_fd; or -1.
+ **/
+static int state_memfd = -1;
+
 /**
  * conf_dirs:
  *
@@ -147,13 +157,26 @@ static int disable_startup_event = FALSE;
 static int disable_dbus = FALSE;
 
 extern int          no_inherit_env;
+extern int          coalesce_signals;
 extern int          user_mode;
 extern int          chroot_sessions;
 extern int          disable_job_logging;
+extern int          disable_clone_spawn;
 extern int          use_session_bus;
 extern int          default_console;
 extern int          write_state_file;
+extern int          disable_binary_state;
 extern char        *log_dir;
+extern int          log_batch_size;
+extern int          log_batch_timeout;
+extern int          log_rotate_size;
+extern int          log_rotate_interval;
+extern int          log_rotate_count;
+extern int          log_rotate_compress;
+extern int          log_splice;
+extern int          log_unflushed_limit;
+extern int          log_unflushed_total_limit;
+extern int          trace_size;
 extern DBusBusType  dbus_bus_type;
 extern mode_t       initial_umask;
 extern int          debug_stanza_enabled;
@@ -174,20 +197,56 @@ static NihOption options[] = {
 	{ 0, "chroot-sessions", N_("enable chroot sessions"),
 		NULL, NULL, &chroot_sessions, NULL },
 
+	{ 0, "coalesce-signals", N_("also send job state changes and events as one D-Bus signal per main loop iteration"),
+		NULL, NULL, &coalesce_signals, NULL },
+
 	{ 0, "confdir", N_("specify alternative directory to load configuration files from"),
 		NULL, "DIR", NULL, conf_dir_setter },
 
 	{ 0, "default-console", N_("default value for console stanza"),
 		NULL, "VALUE", NULL, console_type_setter },
 
+	{ 0, "log-batch-size", N_("accumulate up to BYTES of job output before writing to log files"),
+		NULL, "BYTES", &log_batch_size, nih_option_int },
+
+	{ 0, "log-batch-timeout", N_("maximum number of seconds to hold back job output for when batching"),
+		NULL, "SECONDS", &log_batch_timeout, nih_option_int },
+
+	{ 0, "log-rotate-compress", N_("compress rotated log files"),
+		NULL, NULL, &log_rotate_compress, NULL },
+
+	{ 0, "log-rotate-count", N_("number of rotated log files to keep for each job"),
+		NULL, "COUNT", &log_rotate_count, nih_option_int },
+
+	{ 0, "log-rotate-interval", N_("rotate log files older than SECONDS"),
+		NULL, "SECONDS", &log_rotate_interval, nih_option_int },
+
+	{ 0, "log-rotate-size", N_("rotate log files larger than BYTES"),
+		NULL, "BYTES", &log_rotate_size, nih_option_int },
+
+	{ 0, "log-splice", N_("collect job output through pipes and splice it into log files"),
+		NULL, NULL, &log_splice, NULL },
+
+	{ 0, "log-unflushed-limit", N_("keep at most BYTES of output for each job until its log file can be written"),
+		NULL, "BYTES", &log_unflushed_limit, nih_option_int },
+
+	{ 0, "log-unflushed-total-limit", N_("keep at most BYTES of output for all jobs until their log files can be written"),
+		NULL, "BYTES", &log_unflushed_total_limit, nih_option_int },
+
 	{ 0, "logdir", N_("specify alternative directory to store job output logs in"),
 		NULL, "DIR", &log_dir, NULL },
 
+	{ 0, "no-binary-state", N_("pass state as JSON on re-exec"),
+		NULL, NULL, &disable_binary_state, NULL },
+
 #ifdef ENABLE_CGROUPS
 	{ 0, "no-cgroups", N_("do not support cgroups"),
 		NULL, NULL, &disable_cgroups, NULL },
 #endif /* ENABLE_CGROUPS */
 
+	{ 0, "no-clone-spawn", N_("always spawn job processes with fork"),
+		NULL, NULL, &disable_clone_spawn, NULL },
+
 	{ 0, "no-dbus", N_("do not connect to a D-Bus bus"),
 		NULL, NULL, &disable_dbus, NULL },
 
@@ -214,9 +273,15 @@ static NihOption options[] = {
 	{ 0, "session", N_("use D-Bus session bus rather than system bus (for testing)"),
 		NULL, NULL, &use_session_bus, NULL },
 
+	{ 0, "start-concurrency", N_("maximum number of jobs to be starting at once"),
+		NULL, "COUNT", &schedule_limit, nih_option_int },
+
 	{ 0, "startup-event", N_("specify an alternative initial event (for testing)"),
 		NULL, "NAME", &initial_event, NULL },
 
+	{ 0, "trace-buffer", N_("record the last COUNT job state changes and events for initctl trace"),
+		NULL, "COUNT", &trace_size, nih_option_int },
+
 	{ 0, "user", N_("start in user mode (as used for user sessions)"),
 		NULL, NULL, &user_mode, NULL },
 
@@ -234,8 +299,9 @@ int
 main (int   argc,
       char *argv[])
 {
-	char **args = NULL;
-	int    ret;
+	char           **args = NULL;
+	int              ret;
+	struct timeval   tv;
 
 	conf_dirs = NIH_MUST (nih_str_array_new (NULL));
 	append_conf_dirs = NIH_MUST (nih_str_array_new (NULL));
@@ -245,6 +311,12 @@ main (int   argc,
 
 	nih_main_init (args_copy[0]);
 
+	/* Seed the jitter taken off respawn delays; our pid is usually
+	 * 1, so the time has to provide the difference between boots.
+	 */
+	gettimeofday (&tv, NULL);
+	srand ((unsigned int)(tv.tv_sec ^ tv.tv_usec ^ getpid ()));
+
 	nih_option_set_synopsis (_("Process management daemon."));
 	nih_option_set_help (
 		_("This daemon is normally executed by the kernel and given "
@@ -255,6 +327,12 @@ main (int   argc,
 	if (! args)
 		exit (1);
 
+	/* Tell the previous instance straight away whether we will read
+	 * a binary snapshot, so that it need not generate JSON.
+	 */
+	if (restart && (state_fd != -1))
+		state_memfd = state_ack_memfd (state_fd);
+
 	if (nih_log_priority == NIH_LOG_DEBUG)
 		debug_stanza_enabled = TRUE;
 
@@ -527,6 +605,10 @@ main (int   argc,
 	NIH_MUST (nih_main_loop_add_func (NULL, (NihMainLoopCb)event_poll,
 					  NULL));
 
+	/* Start jobs held back by the start scheduler as room allows */
+	NIH_MUST (nih_main_loop_add_func (NULL, (NihMainLoopCb)schedule_poll,
+					  NULL));
+
 
 	/* Adjust our OOM priority to the default, which will be inherited
 	 * by all jobs.
@@ -561,6 +643,20 @@ main (int   argc,
 
 
 	if (restart) {
+		/* A snapshot in a memfd may be read at once, but only once
+		 * the child of the previous instance has released the
+		 * D-Bus name, and so closed its end of state_fd, may we
+		 * restore the bus connection.
+		 */
+		if (state_memfd != -1) {
+			if (state_read_sync (state_fd) < 0)
+				nih_warn ("%s",
+					_("Timed out waiting for D-Bus name to be released"));
+
+			close (state_fd);
+			state_fd = state_memfd;
+		}
+
 		if (state_fd == -1) {
 			nih_warn ("%s",
 				_("Stateful re-exec supported but stateless re-exec requested"));
@@ -0,0 +1,497 @@
+/* upstart
+ *
+ * notify.c - readiness notification of job main processes
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/io.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include "process.h"
+#include "system.h"
+#include "job_class.h"
+#include "job.h"
+#include "job_process.h"
+#include "notify.h"
+
+
+/* Prototypes for static functions */
+static void notify_watcher     (Job *job, NihIoWatch *watch,
+				NihIoEvents events);
+static int  notify_sender_ok   (Job *job, uid_t uid)
+	__attribute__ ((warn_unused_result));
+static uid_t notify_job_uid    (Job *job)
+	__attribute__ ((warn_unused_result));
+static int  notify_mainpid_ok  (Job *job, pid_t pid)
+	__attribute__ ((warn_unused_result));
+
+
+/**
+ * notify_job_open:
+ * @job: job whose main process is about to be spawned.
+ *
+ * Creates the datagram socket on which the main process of @job, which
+ * has "expect notify", tells us it is ready, unless it already has one.
+ * The socket is bound to a unique name in the abstract namespace chosen
+ * by the kernel, so nothing is left behind in the filesystem and no name
+ * can clash with that of a socket restored after a re-exec.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+notify_job_open (Job *job)
+{
+	sa_family_t family = AF_UNIX;
+	int         fd;
+	int         opt = 1;
+
+	nih_assert (job != NULL);
+
+	if (job->notify_fd >= 0)
+		return 0;
+
+	fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		nih_return_system_error (-1);
+
+	/* Binding just the family autobinds an abstract name */
+	if (bind (fd, (struct sockaddr *)&family, sizeof (family)) < 0)
+		goto error;
+
+	if (setsockopt (fd, SOL_SOCKET, SO_PASSCRED, &opt, sizeof (opt)) < 0)
+		goto error;
+
+	job->notify_fd = fd;
+	notify_job_watch (job);
+
+	return 0;
+
+error:
+	nih_error_raise_system ();
+	close (fd);
+	return -1;
+}
+
+/**
+ * notify_job_address:
+ * @parent: parent object for new string,
+ * @job: job with notify socket.
+ *
+ * Returns the name of the notify socket of @job in the form given in the
+ * NOTIFY_SOCKET variable, with a leading '@' for the abstract namespace.
+ *
+ * Returns: newly allocated string or NULL on raised error.
+ **/
+char *
+notify_job_address (const void *parent,
+		    Job        *job)
+{
+	struct sockaddr_un addr;
+	socklen_t          addrlen = sizeof (addr);
+	size_t             len;
+	char              *str;
+
+	nih_assert (job != NULL);
+	nih_assert (job->notify_fd >= 0);
+
+	memset (&addr, 0, sizeof (addr));
+	if (getsockname (job->notify_fd, (struct sockaddr *)&addr,
+			 &addrlen) < 0)
+		nih_return_system_error (NULL);
+
+	len = addrlen - offsetof (struct sockaddr_un, sun_path);
+	if ((len < 1) || addr.sun_path[0])
+		nih_return_error (NULL, EINVAL, strerror (EINVAL));
+
+	str = nih_strndup (parent, addr.sun_path, len);
+	if (! str)
+		nih_return_no_memory_error (NULL);
+
+	str[0] = '@';
+
+	return str;
+}
+
+/**
+ * notify_job_close:
+ * @job: job.
+ *
+ * Stops watching and closes the notify socket of @job, if it has one,
+ * forgetting any readiness reported on it; called once it has become
+ * ready, when its main process dies and when it is freed.
+ **/
+void
+notify_job_close (Job *job)
+{
+	nih_assert (job != NULL);
+
+	if (job->notify_watch) {
+		nih_free (job->notify_watch);
+		job->notify_watch = NULL;
+	}
+
+	if (job->notify_fd >= 0) {
+		close (job->notify_fd);
+		job->notify_fd = -1;
+	}
+
+	job->notify_ready = FALSE;
+	job->notify_uid = (uid_t)-1;
+}
+
+/**
+ * notify_job_watch:
+ * @job: job with notify socket.
+ *
+ * Watches the notify socket of @job for messages, unless it already is;
+ * also called for a socket restored after a re-exec.
+ **/
+void
+notify_job_watch (Job *job)
+{
+	nih_assert (job != NULL);
+	nih_assert (job->notify_fd >= 0);
+
+	if (job->notify_watch)
+		return;
+
+	job->notify_watch = NIH_MUST (nih_io_add_watch (
+			job, job->notify_fd, NIH_IO_READ,
+			(NihIoWatcher)notify_watcher, job));
+}
+
+
+/**
+ * notify_job_spawned:
+ * @job: job whose main process has been spawned.
+ *
+ * Records the user the main process of @job runs as, now that it has
+ * changed to it and exec'd, so that notifications from processes of that
+ * user are accepted without looking the user up by name in init.
+ **/
+void
+notify_job_spawned (Job *job)
+{
+	nih_assert (job != NULL);
+
+	job->notify_uid = (uid_t)-1;
+	job->notify_uid = notify_job_uid (job);
+}
+
+
+/**
+ * notify_watcher:
+ * @job: job with pending messages,
+ * @watch: watch on notify socket,
+ * @events: events that occurred.
+ *
+ * Called when messages arrive on the notify socket of @job, reads each
+ * along with the credentials of its sender and handles it.
+ **/
+static void
+notify_watcher (Job         *job,
+		NihIoWatch  *watch,
+		NihIoEvents  events)
+{
+	nih_assert (job != NULL);
+	nih_assert (watch != NULL);
+
+	while (job->notify_fd >= 0) {
+		char            buf[NOTIFY_MESSAGE_MAX];
+		char            control[CMSG_SPACE (sizeof (struct ucred))];
+		struct iovec    iov;
+		struct msghdr   msg;
+		struct cmsghdr *cmsg;
+		struct ucred   *cred = NULL;
+		ssize_t         len;
+
+		iov.iov_base = buf;
+		iov.iov_len = sizeof (buf);
+
+		memset (&msg, 0, sizeof (msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof (control);
+
+		len = recvmsg (job->notify_fd, &msg,
+			       MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+		if (len < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)
+			    && (errno != EINTR))
+				nih_warn (_("Failed to receive notification for %s: %s"),
+					  job_name (job), strerror (errno));
+			return;
+		}
+
+		for (cmsg = CMSG_FIRSTHDR (&msg); cmsg;
+		     cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+			if ((cmsg->cmsg_level == SOL_SOCKET)
+			    && (cmsg->cmsg_type == SCM_CREDENTIALS)
+			    && (cmsg->cmsg_len == CMSG_LEN (sizeof (struct ucred))))
+				cred = (struct ucred *)CMSG_DATA (cmsg);
+		}
+
+		if (! cred) {
+			nih_debug ("Ignored notification for %s without credentials",
+				   job_name (job));
+			continue;
+		}
+
+		/* Handling the message may close the socket, or free the
+		 * job along with the watch, in which case stop reading.
+		 */
+		if (notify_job_message (job, cred->pid, cred->uid,
+					buf, (size_t)len) > 0)
+			return;
+	}
+}
+
+/**
+ * notify_sender_ok:
+ * @job: job,
+ * @uid: user id of sender.
+ *
+ * Only processes running as root, as ourselves, or as the user the job
+ * runs as may tell us about the job, since any process may send to an
+ * abstract socket.
+ *
+ * Returns: TRUE if a message from @uid is accepted, FALSE otherwise.
+ **/
+static int
+notify_sender_ok (Job   *job,
+		  uid_t  uid)
+{
+	nih_assert (job != NULL);
+
+	if ((uid == 0) || (uid == geteuid ()))
+		return TRUE;
+
+	if (! job->class->setuid)
+		return FALSE;
+
+	return (uid == notify_job_uid (job));
+}
+
+/**
+ * notify_job_uid:
+ * @job: job.
+ *
+ * Returns the user the main process of @job runs as, recorded by
+ * notify_job_spawned().  Should a notification arrive before that, the
+ * user is taken from the main process, once it has changed from root.
+ *
+ * Returns: user id, or -1 if not known.
+ **/
+static uid_t
+notify_job_uid (Job *job)
+{
+	uid_t uid;
+	pid_t ppid;
+
+	nih_assert (job != NULL);
+
+	if (job->notify_uid != (uid_t)-1)
+		return job->notify_uid;
+
+	if (! job->class->setuid)
+		return geteuid ();
+
+	if ((job->pid[PROCESS_MAIN] <= 0)
+	    || (system_process_status (job->pid[PROCESS_MAIN],
+				       &uid, &ppid) < 0)
+	    || (uid == 0))
+		return (uid_t)-1;
+
+	job->notify_uid = uid;
+
+	return uid;
+}
+
+/**
+ * notify_mainpid_ok:
+ * @job: job,
+ * @pid: process named as the new main process of @job.
+ *
+ * A process may only be made the main process of @job, which we then
+ * signal and reap, if it was started by the main process we spawned or
+ * runs as the user that @job runs as, so that a process of the job's user
+ * can't have us supervise a process of another.
+ *
+ * Returns: TRUE if @pid is accepted, FALSE otherwise.
+ **/
+static int
+notify_mainpid_ok (Job   *job,
+		   pid_t  pid)
+{
+	uid_t uid, job_uid;
+	pid_t ppid;
+	int   depth;
+
+	nih_assert (job != NULL);
+	nih_assert (pid > 0);
+
+	if (system_process_status (pid, &uid, &ppid) < 0)
+		return FALSE;
+
+	job_uid = notify_job_uid (job);
+	if ((job_uid != (uid_t)-1) && (uid == job_uid))
+		return TRUE;
+
+	/* Daemons that fork only once remain descendants of the main
+	 * process until it exits; don't follow absurdly deep trees.
+	 */
+	for (depth = 0; (ppid > 1) && (depth < NOTIFY_ANCESTRY_MAX); depth++) {
+		if (ppid == job->pid[PROCESS_MAIN])
+			return TRUE;
+
+		if (system_process_status (ppid, &uid, &ppid) < 0)
+			break;
+	}
+
+	return FALSE;
+}
+
+/**
+ * notify_job_message:
+ * @job: job message is for,
+ * @pid: process id of sender,
+ * @uid: user id of sender,
+ * @msg: message,
+ * @len: length of @msg.
+ *
+ * Handles a readiness message of newline-separated assignments sent to the
+ * notify socket of @job.  "MAINPID=" names the process to supervise as the
+ * main process in place of the one we spawned, for daemons that fork, and
+ * "READY=1" moves @job out of the spawned state; others are ignored.
+ * The process named must have been started by the main process or run as
+ * the user @job runs as.
+ *
+ * Readiness reported while @job is still spawning is remembered in the
+ * notify_ready member, and acted on by job_change_state() once @job has
+ * been spawned.
+ *
+ * Returns: positive value if @job became ready, zero otherwise.
+ **/
+int
+notify_job_message (Job        *job,
+		    pid_t       pid,
+		    uid_t       uid,
+		    const char *msg,
+		    size_t      len)
+{
+	nih_local char *copy = NULL;
+	char           *line, *next;
+	pid_t           mainpid = 0;
+	int             ready = FALSE;
+
+	nih_assert (job != NULL);
+	nih_assert (msg != NULL);
+
+	if (! notify_sender_ok (job, uid)) {
+		nih_warn (_("Ignored notification for %s from process (%d) "
+			    "of user %d"),
+			  job_name (job), pid, (int)uid);
+		return 0;
+	}
+
+	copy = NIH_MUST (nih_strndup (NULL, msg, len));
+
+	for (line = copy; line && *line; line = next) {
+		next = strchr (line, '\n');
+		if (next)
+			*(next++) = '\0';
+
+		if (! strcmp (line, "READY=1")) {
+			ready = TRUE;
+		} else if (! strncmp (line, "MAINPID=", 8)) {
+			char *endptr;
+			long  value;
+
+			errno = 0;
+			value = strtol (line + 8, &endptr, 10);
+			if (errno || *endptr || (value <= 1) || (value > INT_MAX)) {
+				nih_warn (_("Ignored invalid main process "
+					    "for %s: %s"),
+					  job_name (job), line + 8);
+				continue;
+			}
+
+			mainpid = (pid_t)value;
+		}
+	}
+
+	/* Only the main process being started may be replaced */
+	if ((job->state != JOB_SPAWNING) && (job->state != JOB_SPAWNED))
+		return 0;
+
+	if (mainpid && (mainpid != job->pid[PROCESS_MAIN])) {
+		if (! notify_mainpid_ok (job, mainpid)) {
+			nih_warn (_("Ignored main process (%d) for %s: %s"),
+				  mainpid, job_name (job),
+				  _("not started by the job"));
+		} else {
+			nih_info (_("%s %s process (%d) became new process (%d)"),
+				  job_name (job), process_name (PROCESS_MAIN),
+				  job->pid[PROCESS_MAIN], mainpid);
+
+			job_process_set_pid (job, PROCESS_MAIN, mainpid);
+		}
+	}
+
+	if (! ready)
+		return 0;
+
+	if (job->state == JOB_SPAWNING) {
+		nih_debug ("%s %s process (%d) is ready before being spawned",
+			   job_name (job), process_name (PROCESS_MAIN),
+			   job->pid[PROCESS_MAIN]);
+
+		job->notify_ready = TRUE;
+		return 0;
+	}
+
+	nih_info (_("%s %s process (%d) is ready"),
+		  job_name (job), process_name (PROCESS_MAIN),
+		  job->pid[PROCESS_MAIN]);
+
+	notify_job_close (job);
+	job_change_state (job, job_next_state (job));
+
+	return 1;
+}
@@ -0,0 +1,60 @@
+/* upstart
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_NOTIFY_H
+#define INIT_NOTIFY_H
+
+#include <sys/types.h>
+
+#include <nih/macros.h>
+
+#include "job.h"
+
+
+/**
+ * NOTIFY_MESSAGE_MAX:
+ *
+ * Largest readiness message we accept; longer datagrams are truncated.
+ **/
+#define NOTIFY_MESSAGE_MAX 4096
+
+/**
+ * NOTIFY_ANCESTRY_MAX:
+ *
+ * Most parents followed from a process named by "MAINPID=" looking for
+ * the main process of the job.
+ **/
+#define NOTIFY_ANCESTRY_MAX 32
+
+
+NIH_BEGIN_EXTERN
+
+int   notify_job_open    (Job *job)
+	__attribute__ ((warn_unused_result));
+char *notify_job_address (const void *parent, Job *job)
+	__attribute__ ((warn_unused_result, malloc));
+void  notify_job_close   (Job *job);
+void  notify_job_watch   (Job *job);
+void  notify_job_spawned (Job *job);
+
+int   notify_job_message (Job *job, pid_t pid, uid_t uid,
+			  const char *msg, size_t len);
+
+NIH_END_EXTERN
+
+#endif /* INIT_NOTIFY_H */
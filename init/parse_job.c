@@ -26,6 +26,8 @@
 
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
 
 #include <errno.h>
 #include <limits.h>
@@ -46,6 +48,7 @@
 #include "parse_job.h"
 #include "errors.h"
 #include "apparmor.h"
+#include "listen.h"
 
 #ifdef ENABLE_CGROUPS
 #include "cgroup.h"
@@ -242,6 +245,18 @@ static int stanza_usage       (JobClass *class, NihConfigStanza *stanza,
 			       const char *file, size_t len,
 			       size_t *pos, size_t *lineno)
 	__attribute__ ((warn_unused_result));
+static int stanza_concurrency (JobClass *class, NihConfigStanza *stanza,
+			       const char *file, size_t len,
+			       size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result));
+static int stanza_priority    (JobClass *class, NihConfigStanza *stanza,
+			       const char *file, size_t len,
+			       size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result));
+static int stanza_listen      (JobClass *class, NihConfigStanza *stanza,
+			       const char *file, size_t len,
+			       size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result));
 
 static int stanza_cgroup      (JobClass *class, NihConfigStanza *stanza,
 			       const char *file, size_t len,
@@ -304,6 +319,9 @@ static NihConfigStanza stanzas[] = {
 	{ "usage",       (NihConfigHandler)stanza_usage       },
 	{ "apparmor",    (NihConfigHandler)stanza_apparmor    },
 	{ "cgroup",      (NihConfigHandler)stanza_cgroup      },
+	{ "concurrency", (NihConfigHandler)stanza_concurrency },
+	{ "priority",    (NihConfigHandler)stanza_priority    },
+	{ "listen",      (NihConfigHandler)stanza_listen      },
 
 	NIH_CONFIG_LAST
 };
@@ -1004,6 +1022,12 @@ parse_on_operand (JobClass         *class,
 				return -1;
 			}
 		}
+
+		/* Compile the environment now so that it is not parsed
+		 * again every time an event is matched.
+		 */
+		if (event_operator_compile (oper) < 0)
+			nih_return_system_error (-1);
 	}
 
 	return 0;
@@ -1911,6 +1935,8 @@ stanza_expect (JobClass        *class,
 		class->expect = EXPECT_DAEMON;
 	} else if (! strcmp (arg, "fork")) {
 		class->expect = EXPECT_FORK;
+	} else if (! strcmp (arg, "notify")) {
+		class->expect = EXPECT_NOTIFY;
 	} else if (! strcmp (arg, "none")) {
 		class->expect = EXPECT_NONE;
 	} else {
@@ -2263,7 +2289,9 @@ finish:
  *
  * Parse a daemon stanza from @file.  This either has no arguments, in
  * which case it sets the respawn flag for the job, or it has the "limit"
- * argument and sets the respawn rate limit.
+ * argument and sets the respawn rate limit, or it has the "delay" argument
+ * and sets the initial and maximum respawn delay and, optionally, how long
+ * the job must run for before the delay is reset.
  *
  * Returns: zero on success, negative value on error.
  **/
@@ -2348,6 +2376,58 @@ stanza_respawn (JobClass        *class,
 
 		ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
 
+	} else if (! strcmp (arg, "delay")) {
+		time_t values[3];
+		int    count;
+
+		/* Parse the initial delay and the optional maximum and
+		 * stable time values.
+		 */
+		for (count = 0; count < 3; count++) {
+			nih_local char *delayarg = NULL;
+			char           *endptr;
+
+			if ((count > 0)
+			    && ! nih_config_has_token (file, len,
+						       &a_pos, &a_lineno))
+				break;
+
+			/* Update error position to the value */
+			*pos = a_pos;
+			if (lineno)
+				*lineno = a_lineno;
+
+			delayarg = nih_config_next_arg (NULL, file, len,
+							&a_pos, &a_lineno);
+			if (! delayarg)
+				goto finish;
+
+			errno = 0;
+			values[count] = strtol (delayarg, &endptr, 10);
+			if (errno || *endptr || (values[count] < 0))
+				nih_return_error (-1, PARSE_ILLEGAL_INTERVAL,
+						  _(PARSE_ILLEGAL_INTERVAL_STR));
+
+			if ((count == 1) && (values[1] < values[0]))
+				nih_return_error (-1, PARSE_ILLEGAL_INTERVAL,
+						  _(PARSE_ILLEGAL_INTERVAL_STR));
+		}
+
+		class->respawn_delay = values[0];
+
+		if (count > 1) {
+			class->respawn_delay_max = values[1];
+		} else {
+			class->respawn_delay_max = JOB_DEFAULT_RESPAWN_DELAY_MAX;
+			if (class->respawn_delay_max < class->respawn_delay)
+				class->respawn_delay_max = class->respawn_delay;
+		}
+
+		class->respawn_stable = (count > 2 ? values[2]
+					 : class->respawn_delay_max);
+
+		ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
+
 	} else {
 		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
 				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
@@ -3025,6 +3105,302 @@ stanza_usage (JobClass        *class,
 	return nih_config_skip_comment (file, len, pos, lineno);
 }
 
+/**
+ * stanza_concurrency:
+ * @class: job class being parsed,
+ * @stanza: stanza found,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * Parse a concurrency stanza from @file, extracting an argument naming
+ * the group the job belongs to and an optional second argument giving
+ * the maximum number of jobs of the group that may be starting at once,
+ * or "unlimited".
+ *
+ * Returns: zero on success, negative value on error.
+ **/
+static int
+stanza_concurrency (JobClass        *class,
+		    NihConfigStanza *stanza,
+		    const char      *file,
+		    size_t           len,
+		    size_t          *pos,
+		    size_t          *lineno)
+{
+	nih_local char *arg = NULL;
+	char           *endptr;
+	size_t          a_pos, a_lineno;
+	int             ret = -1;
+
+	nih_assert (class != NULL);
+	nih_assert (stanza != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	a_pos = *pos;
+	a_lineno = (lineno ? *lineno : 1);
+
+	if (class->concurrency_group)
+		nih_unref (class->concurrency_group, class);
+
+	class->concurrency_group = nih_config_next_arg (class, file, len,
+							&a_pos, &a_lineno);
+	if (! class->concurrency_group)
+		goto finish;
+
+	class->concurrency_limit = 0;
+
+	if (nih_config_has_token (file, len, &a_pos, &a_lineno)) {
+		/* Update error position to the limit value */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		arg = nih_config_next_arg (NULL, file, len, &a_pos, &a_lineno);
+		if (! arg)
+			goto finish;
+
+		if (strcmp (arg, "unlimited")) {
+			errno = 0;
+			class->concurrency_limit = (int)strtol (arg, &endptr, 10);
+			if (errno || *endptr || (class->concurrency_limit < 1))
+				nih_return_error (-1, PARSE_ILLEGAL_LIMIT,
+						  _(PARSE_ILLEGAL_LIMIT_STR));
+		}
+	}
+
+	ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
+
+finish:
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	return ret;
+}
+
+/**
+ * stanza_priority:
+ * @class: job class being parsed,
+ * @stanza: stanza found,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * Parse a priority stanza from @file, extracting a single argument
+ * containing the order in which jobs held back by the start scheduler
+ * are started.
+ *
+ * Returns: zero on success, negative value on error.
+ **/
+static int
+stanza_priority (JobClass        *class,
+		 NihConfigStanza *stanza,
+		 const char      *file,
+		 size_t           len,
+		 size_t          *pos,
+		 size_t          *lineno)
+{
+	nih_local char *arg = NULL;
+	char           *endptr;
+	long            priority;
+	size_t          a_pos, a_lineno;
+	int             ret = -1;
+
+	nih_assert (class != NULL);
+	nih_assert (stanza != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	a_pos = *pos;
+	a_lineno = (lineno ? *lineno : 1);
+
+	arg = nih_config_next_arg (NULL, file, len, &a_pos, &a_lineno);
+	if (! arg)
+		goto finish;
+
+	errno = 0;
+	priority = strtol (arg, &endptr, 10);
+	if (errno || *endptr || (priority < INT_MIN) || (priority > INT_MAX))
+		nih_return_error (-1, PARSE_ILLEGAL_PRIORITY,
+				  _(PARSE_ILLEGAL_PRIORITY_STR));
+
+	class->priority = (int)priority;
+
+	ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
+
+finish:
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	return ret;
+}
+
+/**
+ * stanza_listen:
+ * @class: job class being parsed,
+ * @stanza: stanza found,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * Parse a listen stanza from @file.  This either has the "accept"
+ * argument, in which case the job is started for each connection to its
+ * sockets, or it has the "inet" argument followed by an IPv4 address and
+ * port, or the "unix" argument followed by an absolute or abstract path,
+ * and adds a socket for init to listen on for the job.  An optional final
+ * argument gives the maximum number of instances connections accepted
+ * from the socket may have at once, or "unlimited".
+ *
+ * Returns: zero on success, negative value on error.
+ **/
+static int
+stanza_listen (JobClass        *class,
+	       NihConfigStanza *stanza,
+	       const char      *file,
+	       size_t           len,
+	       size_t          *pos,
+	       size_t          *lineno)
+{
+	nih_local char *arg = NULL;
+	nih_local char *address = NULL;
+	ListenSocket   *sock;
+	ListenType      type;
+	int             port = 0;
+	int             max_instances = LISTEN_DEFAULT_MAX_INSTANCES;
+	int             count = 0;
+	size_t          a_pos, a_lineno;
+	int             ret = -1;
+
+	nih_assert (class != NULL);
+	nih_assert (stanza != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	a_pos = *pos;
+	a_lineno = (lineno ? *lineno : 1);
+
+	arg = nih_config_next_token (NULL, file, len, &a_pos, &a_lineno,
+				     NIH_CONFIG_CNLWS, FALSE);
+	if (! arg)
+		goto finish;
+
+	if (! strcmp (arg, "accept")) {
+		class->listen_accept = TRUE;
+
+		ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
+		goto finish;
+	} else if (! strcmp (arg, "inet")) {
+		type = LISTEN_INET;
+	} else if (! strcmp (arg, "unix")) {
+		type = LISTEN_UNIX;
+	} else {
+		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
+				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
+	}
+
+	NIH_LIST_FOREACH (&class->listen, iter)
+		count++;
+
+	if (count >= LISTEN_MAX_SOCKETS)
+		nih_return_error (-1, PARSE_TOO_MANY_SOCKETS,
+				  _(PARSE_TOO_MANY_SOCKETS_STR));
+
+	/* Update error position to the address */
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	address = nih_config_next_arg (NULL, file, len, &a_pos, &a_lineno);
+	if (! address)
+		goto finish;
+
+	if (type == LISTEN_INET) {
+		nih_local char *portarg = NULL;
+		struct in_addr  addr;
+		char           *endptr;
+		long            value;
+
+		if (inet_pton (AF_INET, address, &addr) != 1)
+			nih_return_error (-1, PARSE_ILLEGAL_ADDRESS,
+					  _(PARSE_ILLEGAL_ADDRESS_STR));
+
+		/* Update error position to the port */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		portarg = nih_config_next_arg (NULL, file, len,
+					       &a_pos, &a_lineno);
+		if (! portarg)
+			goto finish;
+
+		errno = 0;
+		value = strtol (portarg, &endptr, 10);
+		if (errno || *endptr || (value < 1) || (value > 65535))
+			nih_return_error (-1, PARSE_ILLEGAL_ADDRESS,
+					  _(PARSE_ILLEGAL_ADDRESS_STR));
+
+		port = (int)value;
+	} else {
+		struct sockaddr_un addr;
+
+		if (((address[0] != '/') && (address[0] != '@'))
+		    || (strlen (address) >= sizeof (addr.sun_path)))
+			nih_return_error (-1, PARSE_ILLEGAL_ADDRESS,
+					  _(PARSE_ILLEGAL_ADDRESS_STR));
+	}
+
+	if (nih_config_has_token (file, len, &a_pos, &a_lineno)) {
+		nih_local char *limit = NULL;
+		char           *endptr;
+		long            value;
+
+		/* Update error position to the limit value */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		limit = nih_config_next_arg (NULL, file, len,
+					     &a_pos, &a_lineno);
+		if (! limit)
+			goto finish;
+
+		if (strcmp (limit, "unlimited")) {
+			errno = 0;
+			value = strtol (limit, &endptr, 10);
+			if (errno || *endptr || (value < 1)
+			    || (value > INT_MAX))
+				nih_return_error (-1, PARSE_ILLEGAL_LIMIT,
+						  _(PARSE_ILLEGAL_LIMIT_STR));
+
+			max_instances = (int)value;
+		} else {
+			max_instances = 0;
+		}
+	}
+
+	sock = listen_socket_new (class, type, address, port);
+	if (! sock)
+		nih_return_system_error (-1);
+
+	sock->max_instances = max_instances;
+
+	ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
+
+finish:
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	return ret;
+}
+
 /**
  * stanza_cgroup:
  * @class: job class being parsed,
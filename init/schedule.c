@@ -0,0 +1,517 @@
+/* upstart
+ *
+ * schedule.c - limiting the number of jobs starting at once
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <sys/types.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/logging.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "job_process.h"
+#include "event.h"
+#include "blocked.h"
+#include "control.h"
+#include "system.h"
+#include "schedule.h"
+
+
+/* Prototypes for static functions */
+static void schedule_adjust (JobClass *class, int delta);
+static int  schedule_fits   (JobClass *class, int starting)
+	__attribute__ ((warn_unused_result));
+static void schedule_queue_job (Job *job);
+static int  schedule_awaited   (NihList *blocking, int depth)
+	__attribute__ ((warn_unused_result));
+static int  schedule_counted_pid (pid_t pid)
+	__attribute__ ((warn_unused_result));
+
+
+/**
+ * schedule_limit:
+ *
+ * Maximum number of jobs that may be starting at once, set from the
+ * command-line; zero, the default, means no limit.
+ **/
+int schedule_limit = 0;
+
+/**
+ * schedule_starting:
+ *
+ * Number of jobs whose starting event has finished that are not yet
+ * running.
+ **/
+int schedule_starting = 0;
+
+/**
+ * schedule_groups:
+ *
+ * This hash table holds the ScheduleGroup for each group named by the
+ * concurrency stanza of a job that has started, indexed by name.
+ **/
+NihHash *schedule_groups = NULL;
+
+/**
+ * schedule_queue:
+ *
+ * This list holds an NihListEntry for each job that has been held back
+ * in the starting state, once its starting event has finished, because
+ * starting it would exceed a limit; the data member points at the job.  It is ordered by the priority of the
+ * job's class, highest first, and then by the order jobs were queued.
+ **/
+NihList *schedule_queue = NULL;
+
+
+/**
+ * schedule_init:
+ *
+ * Initialise the groups hash table and queue.
+ **/
+void
+schedule_init (void)
+{
+	if (! schedule_groups)
+		schedule_groups = NIH_MUST (nih_hash_string_new (NULL, 0));
+
+	if (! schedule_queue)
+		schedule_queue = NIH_MUST (nih_list_new (NULL));
+}
+
+
+/**
+ * schedule_starting_state:
+ * @state: job state.
+ *
+ * Jobs count against the concurrency limits from the moment their
+ * starting event finishes until they are running, or give up and begin
+ * stopping; this is where the forking, disk access and waiting for
+ * daemons to become ready happens.
+ *
+ * Jobs are not counted while their starting event is being handled,
+ * since that may be waiting for other jobs started by it, which would
+ * otherwise be held back for want of the place it holds.
+ *
+ * Returns: TRUE if a job in @state is starting, FALSE otherwise.
+ **/
+int
+schedule_starting_state (JobState state)
+{
+	switch (state) {
+	case JOB_SECURITY_SPAWNING:
+	case JOB_SECURITY:
+	case JOB_PRE_STARTING:
+	case JOB_PRE_START:
+	case JOB_SPAWNING:
+	case JOB_SPAWNED:
+	case JOB_POST_STARTING:
+	case JOB_POST_START:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+
+/**
+ * schedule_adjust:
+ * @class: class of job,
+ * @delta: change in number of starting jobs.
+ *
+ * Adds @delta to the number of jobs starting, both overall and in the
+ * group named by the concurrency stanza of @class if any.
+ **/
+static void
+schedule_adjust (JobClass *class,
+		 int       delta)
+{
+	ScheduleGroup *group;
+
+	nih_assert (class != NULL);
+
+	schedule_init ();
+
+	schedule_starting += delta;
+	nih_assert (schedule_starting >= 0);
+
+	if (! class->concurrency_group)
+		return;
+
+	group = (ScheduleGroup *)nih_hash_lookup (schedule_groups,
+						  class->concurrency_group);
+	if (! group) {
+		group = NIH_MUST (nih_new (schedule_groups, ScheduleGroup));
+
+		nih_list_init (&group->entry);
+		nih_alloc_set_destructor (group, nih_list_destroy);
+
+		group->name = NIH_MUST (nih_strdup (group,
+						    class->concurrency_group));
+		group->starting = 0;
+
+		nih_hash_add (schedule_groups, &group->entry);
+	}
+
+	group->starting += delta;
+	nih_assert (group->starting >= 0);
+}
+
+/**
+ * schedule_fits:
+ * @class: class of job,
+ * @starting: number of jobs starting overall.
+ *
+ * Determines whether another job of @class can be started without
+ * exceeding either the limit given on the command-line, with @starting
+ * jobs already starting, or the limit of its concurrency group.
+ *
+ * Returns: TRUE if the job may start, FALSE otherwise.
+ **/
+static int
+schedule_fits (JobClass *class,
+	       int       starting)
+{
+	ScheduleGroup *group;
+
+	nih_assert (class != NULL);
+
+	if ((schedule_limit > 0) && (starting >= schedule_limit))
+		return FALSE;
+
+	if (! class->concurrency_group || (class->concurrency_limit <= 0))
+		return TRUE;
+
+	schedule_init ();
+
+	group = (ScheduleGroup *)nih_hash_lookup (schedule_groups,
+						  class->concurrency_group);
+	if (group && (group->starting >= class->concurrency_limit))
+		return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * schedule_queue_job:
+ * @job: job to hold back.
+ *
+ * Adds @job to schedule_queue after every queued job whose class has the
+ * same or a higher priority, unless it is already queued.
+ **/
+static void
+schedule_queue_job (Job *job)
+{
+	NihListEntry *entry;
+	NihList      *before;
+
+	nih_assert (job != NULL);
+
+	schedule_init ();
+
+	if (job->queued)
+		return;
+
+	before = schedule_queue;
+	NIH_LIST_FOREACH (schedule_queue, iter) {
+		NihListEntry *queued = (NihListEntry *)iter;
+		Job          *other = (Job *)queued->data;
+
+		if (other->class->priority < job->class->priority) {
+			before = iter;
+			break;
+		}
+	}
+
+	/* Freed along with the job, which removes it from the queue */
+	entry = NIH_MUST (nih_list_entry_new (job));
+	entry->data = job;
+
+	nih_list_add (before, &entry->entry);
+	job->queued = entry;
+}
+
+
+/**
+ * schedule_counted_pid:
+ * @pid: process id.
+ *
+ * Determines whether @pid, or one of its parents, is a process of a job
+ * counted as starting.
+ *
+ * Returns: TRUE if so, FALSE otherwise.
+ **/
+static int
+schedule_counted_pid (pid_t pid)
+{
+	nih_assert (pid > 0);
+
+	for (int depth = 0; (pid > 1) && (depth < SCHEDULE_ANCESTRY_MAX);
+	     depth++) {
+		Job   *job;
+		uid_t  uid;
+
+		job = job_process_find (pid, NULL);
+		if (job && job->scheduled)
+			return TRUE;
+
+		if (system_process_status (pid, &uid, &pid) < 0)
+			break;
+	}
+
+	return FALSE;
+}
+
+/**
+ * schedule_awaited:
+ * @blocking: list of Blocked structures,
+ * @depth: number of events already followed.
+ *
+ * Determines whether anything in @blocking, which is waiting for a job
+ * to start, is a method call made by a process of a job counted as
+ * starting, such as "start" in a pre-start script; or is an event that
+ * such a method call is waiting for.  Holding back the job would then
+ * leave the place the counted job holds never freed.
+ *
+ * Returns: TRUE if so, FALSE otherwise.
+ **/
+static int
+schedule_awaited (NihList *blocking,
+		  int      depth)
+{
+	nih_assert (blocking != NULL);
+
+	NIH_LIST_FOREACH (blocking, iter) {
+		Blocked *blocked = (Blocked *)iter;
+		pid_t    pid;
+
+		switch (blocked->type) {
+		case BLOCKED_JOB:
+			break;
+		case BLOCKED_EVENT:
+			if ((depth < SCHEDULE_BLOCKING_DEPTH)
+			    && schedule_awaited (&blocked->event->blocking,
+						 depth + 1))
+				return TRUE;
+
+			break;
+		default:
+			if (control_get_origin_pid (blocked->message, &pid)
+			    && schedule_counted_pid (pid))
+				return TRUE;
+
+			break;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/**
+ * schedule_job_admit:
+ * @job: starting job whose starting event has finished.
+ *
+ * Called by job_change_state() to determine whether @job may leave the
+ * starting state now.  If starting it would exceed the limit given on
+ * the command-line or that of its concurrency group, it is instead held
+ * back in schedule_queue, to be started by schedule_admit() once enough
+ * other jobs have finished starting.
+ *
+ * Jobs that a job counted as starting is waiting for are never held
+ * back, since that job would otherwise never finish starting.
+ *
+ * Since schedule_admit() is run whenever a job finishes starting, no
+ * queued job could have started when this is called and @job may go
+ * ahead of them if its own group has room.
+ *
+ * Returns: TRUE if @job may be started, FALSE if it was queued.
+ **/
+int
+schedule_job_admit (Job *job)
+{
+	nih_assert (job != NULL);
+	nih_assert (job->state == JOB_STARTING);
+
+	if (schedule_fits (job->class, schedule_starting)
+	    || schedule_awaited (&job->blocking, 0)) {
+		if (job->queued) {
+			nih_free (job->queued);
+			job->queued = NULL;
+		}
+
+		return TRUE;
+	}
+
+	if (! job->queued)
+		nih_info (_("%s queued to start"), job_name (job));
+
+	schedule_queue_job (job);
+
+	return FALSE;
+}
+
+/**
+ * schedule_job_state:
+ * @job: job that has changed state.
+ *
+ * Called by job_change_state() whenever @job enters a new state to
+ * update the number of jobs starting.
+ *
+ * Returns: TRUE if @job has finished starting, freeing a place for
+ * another, FALSE otherwise.
+ **/
+int
+schedule_job_state (Job *job)
+{
+	int starting;
+
+	nih_assert (job != NULL);
+
+	starting = schedule_starting_state (job->state);
+	if (starting == job->scheduled)
+		return FALSE;
+
+	job->scheduled = starting;
+	schedule_adjust (job->class, starting ? 1 : -1);
+
+	return ! starting;
+}
+
+/**
+ * schedule_job_restore:
+ * @job: deserialised job.
+ *
+ * Counts @job if it was starting when init was re-executed, and queues
+ * it again if it was being held back, which is the case for a starting
+ * job no longer blocked by its starting event.  Such jobs whose goal is
+ * no longer start are queued too, so that schedule_poll() stops them.
+ * Waiting jobs are queued as well, since earlier versions held jobs
+ * back before they emitted their starting event.
+ **/
+void
+schedule_job_restore (Job *job)
+{
+	nih_assert (job != NULL);
+
+	schedule_job_state (job);
+
+	if ((job->state == JOB_WAITING)
+	    || ((job->state == JOB_STARTING) && (! job->blocker)))
+		schedule_queue_job (job);
+}
+
+/**
+ * schedule_job_destroy:
+ * @job: job being freed.
+ *
+ * Called when @job is freed to stop counting it if it was starting.
+ **/
+void
+schedule_job_destroy (Job *job)
+{
+	nih_assert (job != NULL);
+
+	if (job->scheduled) {
+		job->scheduled = FALSE;
+		schedule_adjust (job->class, -1);
+	}
+}
+
+
+/**
+ * schedule_admit:
+ *
+ * Starts queued jobs, highest priority first, for as long as the limit
+ * given on the command-line allows; jobs whose concurrency group is full
+ * are skipped over rather than holding back those of other groups.
+ **/
+void
+schedule_admit (void)
+{
+	schedule_init ();
+
+	NIH_LIST_FOREACH_SAFE (schedule_queue, iter) {
+		NihListEntry *entry = (NihListEntry *)iter;
+		Job          *job = (Job *)entry->data;
+
+		if ((schedule_limit > 0) && (schedule_starting >= schedule_limit))
+			break;
+
+		/* Left for schedule_poll() to discard */
+		if (job->goal != JOB_START)
+			continue;
+
+		if (! schedule_fits (job->class, schedule_starting))
+			continue;
+
+		nih_free (entry);
+		job->queued = NULL;
+
+		nih_info (_("%s admitted to start"), job_name (job));
+
+		job_change_state (job, job_next_state (job));
+	}
+}
+
+/**
+ * schedule_poll:
+ *
+ * Called once each time through the main loop to stop queued jobs that
+ * were stopped before they could be started, which cannot be done by
+ * job_change_goal() since its callers expect the job to remain in its
+ * current state, and then to start any queued jobs there is now room
+ * for.
+ **/
+void
+schedule_poll (void)
+{
+	schedule_init ();
+
+	NIH_LIST_FOREACH_SAFE (schedule_queue, iter) {
+		NihListEntry *entry = (NihListEntry *)iter;
+		Job          *job = (Job *)entry->data;
+
+		if (job->goal == JOB_START)
+			continue;
+
+		nih_free (entry);
+		job->queued = NULL;
+
+		if (job->state == JOB_WAITING) {
+			nih_debug ("Discarding queued instance %s",
+				   job_name (job));
+
+			job_finished (job, FALSE);
+			job_discard (job);
+		} else {
+			job_change_state (job, job_next_state (job));
+		}
+	}
+
+	schedule_admit ();
+}
@@ -0,0 +1,85 @@
+/* upstart
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_SCHEDULE_H
+#define INIT_SCHEDULE_H
+
+#include <nih/macros.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+
+#include "job.h"
+
+
+/**
+ * SCHEDULE_ANCESTRY_MAX:
+ *
+ * Maximum number of parents followed from the sender of a method call
+ * to find whether it was made by a process of a starting job.
+ **/
+#define SCHEDULE_ANCESTRY_MAX 32
+
+/**
+ * SCHEDULE_BLOCKING_DEPTH:
+ *
+ * Maximum number of events followed through their blocking lists to
+ * find whether a job is awaited by a starting job.
+ **/
+#define SCHEDULE_BLOCKING_DEPTH 8
+
+
+/**
+ * ScheduleGroup:
+ * @entry: list header,
+ * @name: name of group,
+ * @starting: number of jobs in the group that are starting.
+ *
+ * This structure is an entry in the schedule_groups hash table, counting
+ * the jobs of classes with a concurrency stanza naming the group that
+ * are between the starting and running states.
+ **/
+typedef struct schedule_group {
+	NihList  entry;
+	char    *name;
+	int      starting;
+} ScheduleGroup;
+
+
+NIH_BEGIN_EXTERN
+
+extern int      schedule_limit;
+extern int      schedule_starting;
+extern NihHash *schedule_groups;
+extern NihList *schedule_queue;
+
+void schedule_init           (void);
+
+int  schedule_starting_state (JobState state)
+	__attribute__ ((const));
+
+int  schedule_job_admit      (Job *job);
+int  schedule_job_state      (Job *job);
+void schedule_job_restore    (Job *job);
+void schedule_job_destroy    (Job *job);
+
+void schedule_admit          (void);
+void schedule_poll           (void);
+
+NIH_END_EXTERN
+
+#endif /* INIT_SCHEDULE_H */
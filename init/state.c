@@ -23,12 +23,18 @@
 # include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/select.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -88,8 +94,113 @@ int restart = FALSE;
  **/
 int write_state_file = FALSE;
 
+/**
+ * disable_binary_state:
+ *
+ * If TRUE, always pass state to the new instance as JSON text over a
+ * pipe rather than as a binary snapshot in a memfd.
+ **/
+int disable_binary_state = FALSE;
+
+/**
+ * StateSection:
+ *
+ * @name: name of section in serialisation data,
+ * @desc: description of section for error messages,
+ * @stream: TRUE if the section is an array that state_write_stream()
+ * writes one element at a time.
+ *
+ * A top-level section of the serialisation data.
+ **/
+typedef struct state_section {
+	const char  *name;
+	const char  *desc;
+	int          stream;
+} StateSection;
+
+/**
+ * state_sections:
+ *
+ * Top-level sections of the serialisation data in the order they are
+ * serialised and must be deserialised.
+ **/
+static const StateSection state_sections[] = {
+	{ "sessions",               N_("Sessions"),               FALSE },
+	{ "events",                 N_("Events"),                 TRUE  },
+	{ "control_bus_address",    N_("control bus address"),    FALSE },
+#ifdef ENABLE_CGROUPS
+	{ "cgroup_manager_address", N_("cgroup manager address"), FALSE },
+#endif /* ENABLE_CGROUPS */
+	{ "conf_sources",           N_("ConfSources"),            TRUE  },
+	{ "job_environment",        N_("global job environment"), FALSE },
+	{ "job_classes",            N_("JobClasses"),             TRUE  },
+
+	{ NULL, NULL, FALSE }
+};
+
 /* Prototypes for static functions */
-static void state_write_file (NihIoBuffer *buffer);
+static void         state_write_file     (const char *data, size_t len);
+static void         state_write_json_file (json_object *json);
+static int          state_write_memfd    (void);
+static int          state_wait_ack       (int fd);
+static int          state_write_all      (int fd, const char *data,
+					  size_t len)
+	__attribute__ ((warn_unused_result));
+static int          state_write_record   (int fd, NihIoBuffer *buffer,
+					  StateBinaryRecordType type,
+					  const char *name, json_object *json)
+	__attribute__ ((warn_unused_result));
+static int          state_write_element  (int fd, NihIoBuffer *buffer,
+					  const StateSection *section,
+					  json_object *json)
+	__attribute__ ((warn_unused_result));
+static int          state_read_stream    (int fd)
+	__attribute__ ((warn_unused_result));
+static int          state_read_all       (int fd, void *data, size_t len)
+	__attribute__ ((warn_unused_result));
+static json_object *state_serialise      (void)
+	__attribute__ ((warn_unused_result));
+static int          state_serialise_section (const StateSection *section,
+					     json_object **json)
+	__attribute__ ((warn_unused_result));
+static int          state_deserialise    (json_object *json)
+	__attribute__ ((warn_unused_result));
+static int          state_deserialise_section (json_object *json,
+					       const StateSection *section)
+	__attribute__ ((warn_unused_result));
+static int          state_prune_section  (json_object *json,
+					  const StateSection *section)
+	__attribute__ ((warn_unused_result));
+static json_object *state_prune_class    (json_object *json)
+	__attribute__ ((warn_unused_result));
+static json_object *state_prune_keys     (json_object *json,
+					  const char * const *keys)
+	__attribute__ ((warn_unused_result));
+static int          state_deserialise_sections (json_object *json,
+						const StateSection **next,
+						const StateSection *last)
+	__attribute__ ((warn_unused_result));
+static const StateSection *
+		    state_section_find   (const char *name);
+static void         state_binary_header  (StateBinaryHeader *header);
+static int          state_binary_check_header (const StateBinaryHeader *header);
+static int          state_binary_record  (NihIoBuffer *buffer,
+					  StateBinaryRecordType type,
+					  const char *name, json_object *json)
+	__attribute__ ((warn_unused_result));
+static int          state_binary_apply   (json_object *json, uint8_t type,
+					  const char *name, json_object *value)
+	__attribute__ ((warn_unused_result));
+static int          state_binary_encode  (NihIoBuffer *buffer,
+					  json_object *json)
+	__attribute__ ((warn_unused_result));
+static int          state_binary_read    (const char **data, size_t *len,
+					  void *value, size_t size)
+	__attribute__ ((warn_unused_result));
+static int          state_binary_decode  (const char **data, size_t *len,
+					  int depth, json_object **json)
+	__attribute__ ((warn_unused_result));
+static int          state_hex_value      (char c);
 
 /**
  * state_read:
@@ -202,6 +313,173 @@ state_write (int fd, const char *state_data, size_t len)
 	return 0;
 }
 
+/**
+ * state_read_sync:
+ *
+ * @fd: re-exec state socket given by --state-fd.
+ *
+ * Wait for the other end of @fd to be closed, discarding anything
+ * written to it; the child forked by stateful_reexec() closes it by
+ * exiting once it has released the D-Bus name and private control server.
+ * As for state_read(), the wait times out after STATE_WAIT_SECS seconds.
+ *
+ * Returns: 0 once @fd reaches end of file, or -1 on error or timeout.
+ **/
+int
+state_read_sync (int fd)
+{
+	ssize_t         ret;
+	char            buf[4096];
+	fd_set          readfds;
+	struct timeval  timeout;
+
+	nih_assert (fd != -1);
+
+	state_get_timeout (timeout.tv_sec);
+	timeout.tv_usec = 0;
+
+	if (! timeout.tv_sec)
+		return 0;
+
+	while (TRUE) {
+		FD_ZERO (&readfds);
+		FD_SET (fd, &readfds);
+
+		ret = select (fd + 1, &readfds, NULL, NULL,
+				timeout.tv_sec < 0 ? NULL : &timeout);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+
+		ret = read (fd, buf, sizeof (buf));
+		if (! ret)
+			return 0;
+
+		if (ret < 0 && (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+			return -1;
+	}
+}
+
+/**
+ * state_ack_memfd:
+ *
+ * @fd: re-exec state socket given by --state-fd.
+ *
+ * Called by a new instance as soon as it starts to find out whether the
+ * previous instance also left it a binary snapshot in a memfd, named by
+ * STATE_MEMFD_ENV, and tell the previous instance's child which it will
+ * read by writing STATE_ACK_BINARY or STATE_ACK_JSON to @fd.
+ *
+ * STATE_MEMFD_ENV is removed from our environment so that it is not
+ * passed on to jobs.
+ *
+ * Returns: memfd to read the snapshot from once state_read_sync() has
+ * returned, or -1 if state should be read from @fd as JSON.
+ **/
+int
+state_ack_memfd (int fd)
+{
+	const char        *value;
+	char              *end;
+	long               memfd = -1;
+	StateBinaryHeader  header;
+	char               ack = STATE_ACK_JSON;
+
+	nih_assert (fd != -1);
+
+	value = getenv (STATE_MEMFD_ENV);
+	if (! value)
+		return -1;
+
+	errno = 0;
+	memfd = strtol (value, &end, 10);
+	if (errno || (end == value) || *end || (memfd < 0) || (memfd > INT_MAX))
+		memfd = -1;
+
+	unsetenv (STATE_MEMFD_ENV);
+
+	if ((memfd != -1)
+	    && (pread ((int)memfd, &header, sizeof (header), 0)
+		== (ssize_t)sizeof (header))
+	    && state_is_binary ((const char *)&header, sizeof (header))
+	    && state_binary_check_header (&header))
+		ack = STATE_ACK_BINARY;
+
+	while ((write (fd, &ack, 1) < 0) && (errno == EINTR))
+		;
+
+	if (ack != STATE_ACK_BINARY) {
+		nih_warn ("%s - %s", _("Unable to read binary serialisation data"),
+			  _("reading JSON"));
+
+		if (memfd != -1)
+			close ((int)memfd);
+
+		return -1;
+	}
+
+	return (int)memfd;
+}
+
+/**
+ * state_wait_ack:
+ *
+ * @fd: our end of the re-exec state socket.
+ *
+ * Called by the child forked by stateful_reexec() to wait up to
+ * STATE_ACK_WAIT_MSECS milliseconds for the new instance to acknowledge
+ * which form of state it will read; as for state_read(), a timeout of
+ * zero given by STATE_WAIT_SECS_ENV means we don't wait.
+ *
+ * Returns: STATE_ACK_BINARY or STATE_ACK_JSON, or -1 if the new instance
+ * did not acknowledge either, so predates binary snapshots.
+ **/
+static int
+state_wait_ack (int fd)
+{
+	fd_set          readfds;
+	struct timeval  timeout;
+	long            wait_secs;
+	ssize_t         ret;
+	char            ack;
+
+	nih_assert (fd != -1);
+
+	state_get_timeout (wait_secs);
+
+	if (wait_secs) {
+		timeout.tv_sec = STATE_ACK_WAIT_MSECS / 1000;
+		timeout.tv_usec = (STATE_ACK_WAIT_MSECS % 1000) * 1000;
+	} else {
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 0;
+	}
+
+	while (TRUE) {
+		FD_ZERO (&readfds);
+		FD_SET (fd, &readfds);
+
+		ret = select (fd + 1, &readfds, NULL, NULL, &timeout);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+
+		ret = read (fd, &ack, 1);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret != 1)
+			return -1;
+
+		if ((ack == STATE_ACK_BINARY) || (ack == STATE_ACK_JSON))
+			return ack;
+
+		return -1;
+	}
+}
+
 
 /**
  * state_read_objects:
@@ -220,11 +498,43 @@ state_read_objects (int fd)
 	int                      initial_size = 4096;
 	nih_local NihIoBuffer   *buffer = NULL;
 	nih_local char          *buf = NULL;
+	StateBinaryHeader        header;
+	size_t                   header_len = 0;
 
 	nih_assert (fd != -1);
 
 	buffer = nih_io_buffer_new (NULL);
 
+	/* Read enough to tell a binary snapshot from JSON text; a binary
+	 * snapshot is then read and deserialised a section at a time.
+	 */
+	while (header_len < sizeof (header)) {
+		ret = read (fd, (char *)&header + header_len,
+			    sizeof (header) - header_len);
+		if (ret < 0) {
+			if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+				goto error;
+			continue;
+		} else if (! ret)
+			break;
+
+		header_len += (size_t)ret;
+	}
+
+	if (state_is_binary ((const char *)&header, header_len)) {
+		if (header_len < sizeof (header)
+		    || ! state_binary_check_header (&header)) {
+			nih_error ("%s", _("Detected invalid serialisation data"));
+			return -1;
+		}
+
+		return state_read_stream (fd);
+	}
+
+	if (header_len && nih_io_buffer_push (buffer, (const char *)&header,
+					      header_len) < 0)
+		goto error;
+
 	buf = nih_alloc (NULL, initial_size);
 	if (! buf)
 		goto error;
@@ -251,7 +561,7 @@ state_read_objects (int fd)
 		goto error;
 
 	if (write_state_file || getenv (STATE_FILE_ENV))
-		state_write_file (buffer);
+		state_write_file (buffer->buf, buffer->len);
 
 	return 0;
 
@@ -261,7 +571,7 @@ error:
 	 * re-exec analysis.
 	 */
 	if (buffer->len && log_dir)
-		state_write_file (buffer);
+		state_write_file (buffer->buf, buffer->len);
 
 	return -1;
 }
@@ -269,21 +579,22 @@ error:
 /**
  * state_write_file:
  *
- * @buffer: NihIoBuffer containing JSON data.
+ * @data: JSON data,
+ * @len: length of @data.
  *
- * Write JSON data contained in @buffer to STATE_FILE below log_dir.
+ * Write JSON data @data to STATE_FILE below log_dir.
  *
  * Failures are ignored since this is designed to be called in an error
  * scenario anyway.
  **/
 void
-state_write_file (NihIoBuffer *buffer)
+state_write_file (const char *data, size_t len)
 {
 	int              fd;
 	ssize_t          bytes;
 	nih_local char  *state_file = NULL;
 
-	nih_assert (buffer);
+	nih_assert (data);
 
 	state_file = nih_sprintf (NULL, "%s/%s", log_dir, STATE_FILE);
 	if (! state_file)
@@ -294,290 +605,1649 @@ state_write_file (NihIoBuffer *buffer)
 	if (fd < 0)
 		return;
 
-	while (TRUE) {
-		bytes = write (fd, buffer->buf, buffer->len);
+	while (len) {
+		bytes = write (fd, data, len);
+
+		if (! bytes)
+			break;
+		else if (bytes > 0) {
+			data += bytes;
+			len -= (size_t)bytes;
+		} else if (bytes < 0 && errno != EINTR)
+			break;
+	}
+
+	close (fd);
+}
+
+/**
+ * state_write_json_file:
+ *
+ * @json: JSON object tree.
+ *
+ * Write @json, for example as decoded from a binary snapshot, to
+ * STATE_FILE below log_dir so that it can be inspected.
+ **/
+static void
+state_write_json_file (json_object *json)
+{
+	const char *value;
+
+	nih_assert (json);
+
+	value = json_object_to_json_string (json);
+	if (value)
+		state_write_file (value, strlen (value));
+}
+
+/**
+ * state_write_objects:
+ *
+ * @fd: file descriptor to write serialisation data on,
+ * @state_data: JSON string representing internal object state,
+ * @len: length of @state_data.
+ *
+ * Write serialisation data to specified file descriptor.
+ * @fd is assumed to be open and valid to write to.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+int
+state_write_objects (int fd, const char *state_data, size_t len)
+{
+	ssize_t   ret;
+
+	nih_assert (fd != -1);
+	nih_assert (state_data);
+	nih_assert (len);
+
+	ret = write (fd, state_data, len);
+
+	return (ret < 0 ? -1 : 0);
+}
+
+/**
+ * state_serialise_section:
+ *
+ * @section: section to serialise,
+ * @json: location to store serialised section.
+ *
+ * Serialise the internal data structures making up @section. For the
+ * control bus and cgroup manager addresses, @json is set to NULL if
+ * no address has been set yet.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_serialise_section (const StateSection *section, json_object **json)
+{
+	nih_assert (section);
+	nih_assert (json);
+
+	*json = NULL;
+
+	if (! strcmp (section->name, "sessions")) {
+		*json = json_sessions = session_serialise_all ();
+	} else if (! strcmp (section->name, "events")) {
+		*json = json_events = event_serialise_all ();
+	} else if (! strcmp (section->name, "control_bus_address")) {
+		*json = control_serialise_bus_address ();
+
+		/* Take care to distinguish between memory failure and an
+		 * as-yet-not-set control bus address.
+		 */
+		if (! *json && ! control_bus_address)
+			return 0;
+#ifdef ENABLE_CGROUPS
+	} else if (! strcmp (section->name, "cgroup_manager_address")) {
+		*json = cgroup_manager_serialise ();
+
+		/* Take care to distinguish between memory failure and an
+		 * as-yet-not-set cgroup manager address.
+		 */
+		if (! *json && ! cgroup_manager_address)
+			return 0;
+#endif /* ENABLE_CGROUPS */
+	} else if (! strcmp (section->name, "conf_sources")) {
+		*json = json_conf_sources = conf_source_serialise_all ();
+	} else if (! strcmp (section->name, "job_environment")) {
+		*json = job_class_serialise_job_environ ();
+	} else if (! strcmp (section->name, "job_classes")) {
+		*json = json_classes = job_class_serialise_all ();
+	} else {
+		nih_assert_not_reached ();
+	}
+
+	if (! *json) {
+		nih_error ("%s %s", _("Failed to serialise"),
+			   _(section->desc));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * state_serialise:
+ *
+ * Serialise internal data structures to a JSON object tree.
+ *
+ * Returns: new JSON object on success, NULL on error.
+ **/
+static json_object *
+state_serialise (void)
+{
+	json_object  *json;
+
+	json = json_object_new_object ();
+
+	if (! json)
+		return NULL;
+
+	for (const StateSection *section = state_sections;
+			section->name;
+			section++) {
+		json_object *json_section;
+
+		if (state_serialise_section (section, &json_section) < 0)
+			goto error;
+
+		json_object_object_add (json, section->name, json_section);
+	}
+
+	return json;
+
+error:
+	json_object_put (json);
+	return NULL;
+}
+
+/**
+ * state_to_string:
+ *
+ * @json_string; newly-allocated string,
+ * @len: length of @json_string.
+ *
+ * Serialise internal data structures to a JSON string.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+int
+state_to_string (char **json_string, size_t *len)
+{
+	json_object  *json;
+	const char   *value;
+
+	nih_assert (json_string);
+	nih_assert (len);
+
+	json = state_serialise ();
+	if (! json)
+		return -1;
+
+	/* Note that the returned value is managed by json-c! */
+	value = json_object_to_json_string (json);
+	if (! value)
+		goto error;
+
+	*len = strlen (value);
+
+	*json_string = NIH_MUST (nih_strndup (NULL, value, *len));
+
+	json_object_put (json);
+
+	return 0;
+
+error:
+	json_object_put (json);
+	return -1;
+}
+
+/**
+ * state_write_stream:
+ *
+ * @fd: file descriptor to write to.
+ *
+ * Serialise internal data structures as a binary snapshot written
+ * directly to @fd.
+ *
+ * Rather than building the JSON object tree for all state in memory,
+ * each section is serialised and written in turn; events, job classes
+ * and ConfSources are further written one object at a time, so only the
+ * JSON for a single object, such as a job class with all of its jobs,
+ * is held in memory at once.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+int
+state_write_stream (int fd)
+{
+	nih_local NihIoBuffer  *buffer = NULL;
+	StateBinaryHeader       header;
+
+	nih_assert (fd != -1);
+
+	buffer = nih_io_buffer_new (NULL);
+	if (! buffer)
+		return -1;
+
+	state_binary_header (&header);
+
+	if (state_write_all (fd, (const char *)&header, sizeof (header)) < 0)
+		return -1;
+
+	for (const StateSection *section = state_sections;
+			section->name;
+			section++) {
+		json_object  *json;
+		int           ret;
+
+		if (! section->stream) {
+			if (state_serialise_section (section, &json) < 0)
+				return -1;
+
+			ret = state_write_record (fd, buffer,
+						  STATE_BINARY_RECORD_SECTION,
+						  section->name, json);
+			if (json)
+				json_object_put (json);
+
+			if (ret < 0)
+				return -1;
+
+			continue;
+		}
+
+		/* Write an empty array, then append each object */
+		json = json_object_new_array ();
+		if (! json)
+			return -1;
+
+		ret = state_write_record (fd, buffer,
+					  STATE_BINARY_RECORD_SECTION,
+					  section->name, json);
+		json_object_put (json);
+
+		if (ret < 0)
+			return -1;
+
+		if (! strcmp (section->name, "events")) {
+			event_init ();
+
+			NIH_LIST_FOREACH (events, iter) {
+				Event *event = (Event *)iter;
+
+				if (state_write_element (fd, buffer, section,
+						event_serialise (event)) < 0)
+					return -1;
+			}
+		} else if (! strcmp (section->name, "conf_sources")) {
+			conf_init ();
+
+			NIH_LIST_FOREACH (conf_sources, iter) {
+				ConfSource *source = (ConfSource *)iter;
+
+				if (state_write_element (fd, buffer, section,
+						conf_source_serialise (source)) < 0)
+					return -1;
+			}
+		} else if (! strcmp (section->name, "job_classes")) {
+			job_class_init ();
+
+			NIH_HASH_FOREACH (job_classes, iter) {
+				JobClass *class = (JobClass *)iter;
+
+				if (state_write_element (fd, buffer, section,
+						job_class_serialise (class)) < 0)
+					return -1;
+			}
+		} else {
+			nih_assert_not_reached ();
+		}
+	}
+
+	return state_write_record (fd, buffer, STATE_BINARY_RECORD_END,
+				   NULL, NULL);
+}
+
+/**
+ * state_write_element:
+ *
+ * @fd: file descriptor to write to,
+ * @buffer: scratch buffer,
+ * @section: section @json belongs to,
+ * @json: serialised object or NULL on error.
+ *
+ * Write @json as the next element of the array making up @section,
+ * freeing it afterwards.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_write_element (int                  fd,
+		     NihIoBuffer         *buffer,
+		     const StateSection  *section,
+		     json_object         *json)
+{
+	int ret;
+
+	nih_assert (buffer);
+	nih_assert (section);
+
+	if (! json) {
+		nih_error ("%s %s", _("Failed to serialise"),
+			   _(section->desc));
+		return -1;
+	}
+
+	ret = state_write_record (fd, buffer, STATE_BINARY_RECORD_ELEMENT,
+				  section->name, json);
+
+	json_object_put (json);
+
+	return ret;
+}
+
+/**
+ * state_write_record:
+ *
+ * @fd: file descriptor to write to,
+ * @buffer: scratch buffer,
+ * @type: type of record,
+ * @name: name of section,
+ * @json: value of record.
+ *
+ * Encode a single record into @buffer and write it to @fd; @buffer is
+ * emptied again afterwards so that it may be reused.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_write_record (int                    fd,
+		    NihIoBuffer           *buffer,
+		    StateBinaryRecordType  type,
+		    const char            *name,
+		    json_object           *json)
+{
+	int ret;
+
+	nih_assert (buffer);
+
+	ret = state_binary_record (buffer, type, name, json);
+	if (! ret)
+		ret = state_write_all (fd, buffer->buf, buffer->len);
+
+	nih_io_buffer_shrink (buffer, buffer->len);
+
+	return ret;
+}
+
+/**
+ * state_write_all:
+ *
+ * @fd: file descriptor to write to,
+ * @data: data to write,
+ * @len: length of @data.
+ *
+ * Write all of @data to @fd, retrying after partial writes.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_write_all (int fd, const char *data, size_t len)
+{
+	nih_assert (fd != -1);
+	nih_assert (data || ! len);
+
+	while (len) {
+		ssize_t ret;
+
+		ret = write (fd, data, len);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			return -1;
+		}
+
+		data += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+/**
+ * state_from_string:
+ *
+ * @state: JSON-encoded state.
+ *
+ * Convert JSON string back to an internal representation.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+int
+state_from_string (const char *state)
+{
+	int                       ret;
+	json_object              *json;
+	enum json_tokener_error   error;
+
+	nih_assert (state);
+
+	json = json_tokener_parse_verbose (state, &error);
+
+	if (! json) {
+		nih_error ("%s: %s",
+				_("Detected invalid serialisation data"),
+				json_tokener_error_desc (error));
+		return -1;
+	}
+
+	ret = state_deserialise (json);
+
+	/* Only need to free the root JSON node */
+	json_object_put (json);
+
+	return ret;
+}
+
+/**
+ * state_read_stream:
+ *
+ * @fd: file descriptor to read binary snapshot from.
+ *
+ * Read the records of a binary snapshot from @fd, whose header has
+ * already been read, recreating the internal objects of each section
+ * as soon as all of it has arrived rather than waiting for the whole
+ * snapshot.
+ *
+ * The JSON for a section is built in full before it is deserialised,
+ * so the peak is the largest section, usually the job classes with
+ * their jobs. Unless the state is to be written to a file afterwards,
+ * each section is then pruned to what resolving dependencies needs.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_read_stream (int fd)
+{
+	int                  ret = -1;
+	json_object         *json;
+	nih_local char      *data = NULL;
+	size_t               size = 0;
+	const StateSection  *next = state_sections;
+	const StateSection  *current = NULL;
+	int                  prune;
+
+	nih_assert (fd != -1);
+
+	prune = ! (write_state_file || getenv (STATE_FILE_ENV));
+
+	json = json_object_new_object ();
+	if (! json)
+		return -1;
+
+	/* This function is called before conf_source_new (), so setup
+	 * the environment.
+	 */
+	conf_init ();
+
+	while (TRUE) {
+		uint8_t              type;
+		uint32_t             name_len;
+		uint64_t             value_len;
+		nih_local char      *name = NULL;
+		json_object         *value = NULL;
+		const char          *p;
+		size_t               len;
+		const StateSection  *section;
+
+		if (state_read_all (fd, &type, sizeof (type)) < 0)
+			goto out;
+
+		if (type == STATE_BINARY_RECORD_END)
+			break;
+
+		if (state_read_all (fd, &name_len, sizeof (name_len)) < 0)
+			goto out;
+
+		name = nih_alloc (NULL, name_len + 1);
+		if (! name)
+			goto out;
+
+		if (state_read_all (fd, name, name_len) < 0)
+			goto out;
+
+		name[name_len] = '\0';
+
+		if (state_read_all (fd, &value_len, sizeof (value_len)) < 0)
+			goto out;
+
+		if (value_len > SIZE_MAX)
+			goto out;
+
+		/* Reuse a single buffer for the encoded values */
+		if (value_len > size) {
+			char *new_data;
+
+			new_data = nih_realloc (data, NULL, value_len);
+			if (! new_data)
+				goto out;
+
+			data = new_data;
+			size = value_len;
+		}
+
+		if (state_read_all (fd, data, value_len) < 0)
+			goto out;
+
+		p = data;
+		len = value_len;
+
+		if (state_binary_decode (&p, &len, 0, &value) < 0 || len) {
+			if (value)
+				json_object_put (value);
+			goto out;
+		}
+
+		/* Once a different section starts, the previous one is
+		 * complete and can be deserialised.
+		 */
+		section = state_section_find (name);
+
+		if (current && current != section) {
+			const StateSection *first = next;
+
+			if (state_deserialise_sections (json, &next, current) < 0)
+				goto out;
+
+			for (; prune && first < next; first++)
+				if (state_prune_section (json, first) < 0)
+					goto out;
+
+			current = NULL;
+		}
+
+		if (state_binary_apply (json, type, name, value) < 0)
+			goto out;
+
+		if (section) {
+			/* Sections must arrive in order */
+			if (section < next)
+				goto out;
+
+			current = section;
+		}
+	}
+
+	/* Deserialise the final section, along with any that were
+	 * missing so that their absence is handled.
+	 */
+	if (state_deserialise_sections (json, &next, NULL) < 0)
+		goto out;
+
+	if (state_deserialise_resolve_deps (json) < 0) {
+		nih_error (_("Failed to resolve deserialisation dependencies"));
+		goto out;
+	}
+
+	ret = 0;
+
+out:
+	if (ret < 0) {
+		nih_error ("%s", _("Detected invalid serialisation data"));
+
+		/* Keep whatever was read, less anything pruned, for post
+		 * re-exec analysis.
+		 */
+		if (log_dir)
+			state_write_json_file (json);
+	} else if (write_state_file || getenv (STATE_FILE_ENV)) {
+		state_write_json_file (json);
+	}
+
+	json_object_put (json);
+
+	return ret;
+}
+
+/**
+ * state_read_all:
+ *
+ * @fd: file descriptor to read from,
+ * @data: buffer to read into,
+ * @len: number of bytes to read.
+ *
+ * Read exactly @len bytes from @fd into @data.
+ *
+ * Returns: 0 on success, -1 on error or if end of file is reached first.
+ **/
+static int
+state_read_all (int fd, void *data, size_t len)
+{
+	char *p = data;
+
+	nih_assert (fd != -1);
+	nih_assert (data || ! len);
+
+	while (len) {
+		ssize_t ret;
+
+		ret = read (fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			return -1;
+		} else if (! ret) {
+			return -1;
+		}
+
+		p += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+/**
+ * state_section_find:
+ *
+ * @name: name of section.
+ *
+ * Look up the entry in state_sections for @name.
+ *
+ * Returns: section, or NULL if @name is not known.
+ **/
+static const StateSection *
+state_section_find (const char *name)
+{
+	nih_assert (name);
+
+	for (const StateSection *section = state_sections;
+			section->name;
+			section++) {
+		if (! strcmp (section->name, name))
+			return section;
+	}
+
+	return NULL;
+}
+
+/**
+ * state_deserialise_sections:
+ *
+ * @json: JSON object tree,
+ * @next: pointer to next section to deserialise,
+ * @last: last section to deserialise, or NULL for all.
+ *
+ * Deserialise each section from @next up to and including @last in
+ * turn, updating @next.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_deserialise_sections (json_object          *json,
+			    const StateSection  **next,
+			    const StateSection   *last)
+{
+	nih_assert (json);
+	nih_assert (next);
+
+	while ((*next)->name) {
+		const StateSection *section = (*next)++;
+
+		if (state_deserialise_section (json, section) < 0)
+			return -1;
+
+		if (section == last)
+			break;
+	}
+
+	return 0;
+}
+
+/**
+ * state_prune_section:
+ *
+ * @json: JSON object tree,
+ * @section: section already deserialised.
+ *
+ * Drop everything from @section of @json but what
+ * state_deserialise_resolve_deps() still needs once the section has
+ * been deserialised: the blocking entries of Events and Jobs, and the
+ * names needed to find those Jobs again. ConfSources are dropped
+ * entirely.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_prune_section (json_object *json, const StateSection *section)
+{
+	static const char * const event_keys[] = { "blocking", NULL };
+
+	nih_assert (json);
+	nih_assert (section);
+
+	if (! strcmp (section->name, "events") && json_events) {
+		for (int i = 0; i < json_object_array_length (json_events); i++) {
+			json_object *json_event;
+
+			json_event = json_object_array_get_idx (json_events, i);
+			if (! json_event
+			    || ! json_object_is_type (json_event, json_type_object))
+				continue;
+
+			json_event = state_prune_keys (json_event, event_keys);
+			if (! json_event)
+				return -1;
+
+			if (json_object_array_put_idx (json_events, i,
+						       json_event) < 0) {
+				json_object_put (json_event);
+				return -1;
+			}
+		}
+	} else if (! strcmp (section->name, "job_classes") && json_classes) {
+		for (int i = 0; i < json_object_array_length (json_classes); i++) {
+			json_object *json_class;
+
+			json_class = json_object_array_get_idx (json_classes, i);
+			if (! json_class
+			    || ! json_object_is_type (json_class, json_type_object))
+				continue;
+
+			json_class = state_prune_class (json_class);
+			if (! json_class)
+				return -1;
+
+			if (json_object_array_put_idx (json_classes, i,
+						       json_class) < 0) {
+				json_object_put (json_class);
+				return -1;
+			}
+		}
+	} else if (! strcmp (section->name, "conf_sources")) {
+		json_object_object_del (json, "conf_sources");
+		json_conf_sources = NULL;
+	}
+
+	return 0;
+}
+
+/**
+ * state_prune_class:
+ *
+ * @json: JSON-serialised JobClass.
+ *
+ * Returns: new JSON object holding the name and session of @json, and
+ * the name and blocking entries of only those of its Jobs that have
+ * blocking entries, or NULL on error.
+ **/
+static json_object *
+state_prune_class (json_object *json)
+{
+	static const char * const class_keys[] = { "name", "session", NULL };
+	static const char * const job_keys[] = { "name", "blocking", NULL };
+	json_object  *pruned;
+	json_object  *json_jobs;
+	json_object  *json_blocked_jobs;
+
+	nih_assert (json);
+
+	pruned = state_prune_keys (json, class_keys);
+	if (! pruned)
+		return NULL;
+
+	/* Leave a missing array for state_deserialise_resolve_deps()
+	 * to complain about.
+	 */
+	if (! json_object_object_get_ex (json, "jobs", &json_jobs)
+	    || ! json_object_is_type (json_jobs, json_type_array))
+		return pruned;
+
+	json_blocked_jobs = json_object_new_array ();
+	if (! json_blocked_jobs)
+		goto error;
+
+	json_object_object_add (pruned, "jobs", json_blocked_jobs);
+
+	for (int i = 0; i < json_object_array_length (json_jobs); i++) {
+		json_object *json_job;
+
+		json_job = json_object_array_get_idx (json_jobs, i);
+
+		if (json_job && json_object_is_type (json_job, json_type_object)) {
+			if (! json_object_object_get_ex (json_job, "blocking", NULL))
+				continue;
+
+			json_job = state_prune_keys (json_job, job_keys);
+			if (! json_job)
+				goto error;
+		} else if (json_job) {
+			json_object_get (json_job);
+		}
+
+		if (json_object_array_add (json_blocked_jobs, json_job) < 0) {
+			if (json_job)
+				json_object_put (json_job);
+			goto error;
+		}
+	}
+
+	return pruned;
+
+error:
+	json_object_put (pruned);
+	return NULL;
+}
+
+/**
+ * state_prune_keys:
+ *
+ * @json: JSON object,
+ * @keys: NULL-terminated array of keys to keep.
+ *
+ * Returns: new JSON object holding only the values of @json for @keys,
+ * or NULL on error.
+ **/
+static json_object *
+state_prune_keys (json_object *json, const char * const *keys)
+{
+	json_object *pruned;
+
+	nih_assert (json);
+	nih_assert (keys);
+
+	pruned = json_object_new_object ();
+	if (! pruned)
+		return NULL;
+
+	for (const char * const *key = keys; *key; key++) {
+		json_object *value;
+
+		if (! json_object_object_get_ex (json, *key, &value))
+			continue;
+
+		json_object_object_add (pruned, *key, json_object_get (value));
+	}
+
+	return pruned;
+}
+
+/**
+ * state_deserialise:
+ *
+ * @json: JSON object tree.
+ *
+ * Convert JSON object tree produced by state_serialise() back to an
+ * internal representation.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_deserialise (json_object *json)
+{
+	const StateSection  *next = state_sections;
+
+	nih_assert (json);
+
+	/* This function is called before conf_source_new (), so setup
+	 * the environment.
+	 */
+	conf_init ();
+
+	if (! state_check_json_type (json, object))
+		return -1;
+
+	if (state_deserialise_sections (json, &next, NULL) < 0)
+		return -1;
+
+	if (state_deserialise_resolve_deps (json) < 0) {
+		nih_error (_("Failed to resolve deserialisation dependencies"));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * state_deserialise_section:
+ *
+ * @json: JSON object tree,
+ * @section: section to deserialise.
+ *
+ * Convert @section of @json back to internal objects. Sections that
+ * older versions did not serialise may be missing from @json.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_deserialise_section (json_object         *json,
+			   const StateSection  *section)
+{
+	json_object  *json_section = NULL;
+	int           ret;
+
+	nih_assert (json);
+	nih_assert (section);
+
+	ret = json_object_object_get_ex (json, section->name, &json_section);
+
+	if (! strcmp (section->name, "sessions")) {
+		if (session_deserialise_all (json) < 0) {
+			nih_error ("%s Sessions", _("Failed to deserialise"));
+			return -1;
+		}
+	} else if (! strcmp (section->name, "events")) {
+		if (event_deserialise_all (json) < 0) {
+			nih_error ("%s Events", _("Failed to deserialise"));
+			return -1;
+		}
+	} else if (! strcmp (section->name, "control_bus_address")) {
+		if (json_section) {
+			if (control_deserialise_bus_address (json_section) < 0) {
+				nih_error ("%s control details", _("Failed to deserialise"));
+				return -1;
+			}
+		} else if (! ret) {
+			/* Probably deserialising from older format that doesn't
+			 * encode control details.
+			 */
+			nih_warn ("%s", _("No control details present in state data"));
+		}
+#ifdef ENABLE_CGROUPS
+	} else if (! strcmp (section->name, "cgroup_manager_address")) {
+		if (json_section) {
+			if (cgroup_manager_deserialise (json_section) < 0) {
+				nih_error ("%s %s",
+						_("Failed to deserialise"),
+						_("cgroup manager address"));
+				return -1;
+			}
+		} else if (! ret) {
+			nih_warn ("No %s in state data", _("cgroup manager address"));
+		}
+#endif /* ENABLE_CGROUPS */
+	} else if (! strcmp (section->name, "conf_sources")) {
+		/* Again, we cannot error here since older JSON state data did
+		 * not encode ConfSource or ConfFile objects.
+		 */
+		if (ret) {
+			if (conf_source_deserialise_all (json) < 0) {
+				nih_error ("%s ConfSources", _("Failed to deserialise"));
+				return -1;
+			}
+		} else {
+			nih_warn ("%s", _("No ConfSources present in state data"));
+		}
+	} else if (! strcmp (section->name, "job_environment")) {
+		if (ret) {
+			if (job_class_deserialise_job_environ (json_section) < 0) {
+				nih_error ("%s global job environment",
+						_("Failed to deserialise"));
+				return -1;
+			}
+		} else {
+			nih_warn ("%s", _("No global job environment data present in state data"));
+		}
+	} else if (! strcmp (section->name, "job_classes")) {
+		if (job_class_deserialise_all (json) < 0) {
+			nih_error ("%s JobClasses", _("Failed to deserialise"));
+			return -1;
+		}
+	} else {
+		nih_assert_not_reached ();
+	}
+
+	return 0;
+}
+
+
+/**
+ * state_binary_header:
+ *
+ * @header: header to fill in.
+ *
+ * Fill in @header for a new binary snapshot.
+ **/
+static void
+state_binary_header (StateBinaryHeader *header)
+{
+	nih_assert (header);
+
+	memset (header, 0, sizeof (StateBinaryHeader));
+	memcpy (header->magic, STATE_BINARY_MAGIC, STATE_BINARY_MAGIC_LEN);
+	header->version = STATE_BINARY_VERSION;
+}
+
+/**
+ * state_binary_check_header:
+ *
+ * @header: header to check.
+ *
+ * Check that @header begins a binary snapshot we understand.
+ *
+ * Returns: TRUE if @header is valid, FALSE otherwise.
+ **/
+static int
+state_binary_check_header (const StateBinaryHeader *header)
+{
+	nih_assert (header);
+
+	if (memcmp (header->magic, STATE_BINARY_MAGIC, STATE_BINARY_MAGIC_LEN))
+		return FALSE;
+
+	if (header->version != STATE_BINARY_VERSION || header->flags)
+		return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * state_json_to_binary:
+ *
+ * @buffer: buffer to append snapshot to,
+ * @json: JSON object tree.
+ *
+ * Encode @json as a binary snapshot, consisting of a StateBinaryHeader
+ * followed by a section record for each member of @json and an end
+ * record, appending it to @buffer.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+int
+state_json_to_binary (NihIoBuffer *buffer, json_object *json)
+{
+	StateBinaryHeader  header;
+
+	nih_assert (buffer);
+	nih_assert (json);
+	nih_assert (state_check_json_type (json, object));
+
+	state_binary_header (&header);
+
+	if (nih_io_buffer_push (buffer, (const char *)&header,
+				sizeof (header)) < 0)
+		return -1;
+
+	json_object_object_foreach (json, key, value) {
+		if (state_binary_record (buffer, STATE_BINARY_RECORD_SECTION,
+					 key, value) < 0)
+			return -1;
+	}
+
+	return state_binary_record (buffer, STATE_BINARY_RECORD_END,
+				    NULL, NULL);
+}
+
+/**
+ * state_binary_record:
+ *
+ * @buffer: buffer to append to,
+ * @type: type of record,
+ * @name: name of section,
+ * @json: value of record.
+ *
+ * Append a record of @type to @buffer. Other than for the end record,
+ * this consists of the length and bytes of @name followed by the length
+ * and encoding of @json.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_binary_record (NihIoBuffer            *buffer,
+		     StateBinaryRecordType   type,
+		     const char             *name,
+		     json_object            *json)
+{
+	uint8_t   record_type = type;
+	uint32_t  name_len;
+	uint64_t  value_len = 0;
+	size_t    offset;
+
+	nih_assert (buffer);
+
+	if (nih_io_buffer_push (buffer, (const char *)&record_type,
+				sizeof (record_type)) < 0)
+		return -1;
+
+	if (type == STATE_BINARY_RECORD_END)
+		return 0;
+
+	nih_assert (name);
+
+	name_len = strlen (name);
+
+	if (nih_io_buffer_push (buffer, (const char *)&name_len,
+				sizeof (name_len)) < 0)
+		return -1;
+
+	if (nih_io_buffer_push (buffer, name, name_len) < 0)
+		return -1;
+
+	/* Length is filled in once the value has been encoded */
+	offset = buffer->len;
+	if (nih_io_buffer_push (buffer, (const char *)&value_len,
+				sizeof (value_len)) < 0)
+		return -1;
+
+	if (state_binary_encode (buffer, json) < 0)
+		return -1;
+
+	value_len = buffer->len - offset - sizeof (value_len);
+	memcpy (buffer->buf + offset, &value_len, sizeof (value_len));
+
+	return 0;
+}
+
+/**
+ * state_binary_apply:
+ *
+ * @json: JSON object tree,
+ * @type: type of record,
+ * @name: name of section,
+ * @value: value of record.
+ *
+ * Add the section @name to @json for a section record, or append @value
+ * to the array making up @name for an element record. @value is always
+ * consumed.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_binary_apply (json_object  *json,
+		    uint8_t       type,
+		    const char   *name,
+		    json_object  *value)
+{
+	json_object *array = NULL;
+
+	nih_assert (json);
+	nih_assert (name);
+
+	switch (type) {
+	case STATE_BINARY_RECORD_SECTION:
+		json_object_object_add (json, name, value);
+		return 0;
+
+	case STATE_BINARY_RECORD_ELEMENT:
+		if (! json_object_object_get_ex (json, name, &array)
+		    || ! json_object_is_type (array, json_type_array))
+			break;
+
+		if (json_object_array_add (array, value) < 0)
+			break;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	if (value)
+		json_object_put (value);
+
+	return -1;
+}
+
+/**
+ * state_binary_encode:
+ *
+ * @buffer: buffer to append to,
+ * @json: JSON value.
+ *
+ * Append the binary encoding of @json, and any values it contains, to
+ * @buffer.
+ *
+ * Returns: 0 on success, -1 on error.
+ **/
+static int
+state_binary_encode (NihIoBuffer *buffer, json_object *json)
+{
+	uint8_t   type;
+	size_t    offset;
+	uint32_t  count = 0;
+
+	nih_assert (buffer);
+
+	switch (json_object_get_type (json)) {
+	case json_type_null:
+		type = STATE_BINARY_NULL;
+		return nih_io_buffer_push (buffer, (const char *)&type,
+					   sizeof (type));
+
+	case json_type_boolean:
+		{
+			uint8_t value = json_object_get_boolean (json) ? 1 : 0;
+
+			type = STATE_BINARY_BOOLEAN;
+			if (nih_io_buffer_push (buffer, (const char *)&type,
+						sizeof (type)) < 0)
+				return -1;
+
+			return nih_io_buffer_push (buffer, (const char *)&value,
+						   sizeof (value));
+		}
+
+	case json_type_int:
+		{
+			int64_t value = json_object_get_int64 (json);
+
+			type = STATE_BINARY_INT;
+			if (nih_io_buffer_push (buffer, (const char *)&type,
+						sizeof (type)) < 0)
+				return -1;
+
+			return nih_io_buffer_push (buffer, (const char *)&value,
+						   sizeof (value));
+		}
+
+	case json_type_double:
+		{
+			double value = json_object_get_double (json);
+
+			type = STATE_BINARY_DOUBLE;
+			if (nih_io_buffer_push (buffer, (const char *)&type,
+						sizeof (type)) < 0)
+				return -1;
+
+			return nih_io_buffer_push (buffer, (const char *)&value,
+						   sizeof (value));
+		}
+
+	case json_type_string:
+		{
+			const char *value = json_object_get_string (json);
+			uint32_t    len = json_object_get_string_len (json);
+
+			type = STATE_BINARY_STRING;
+			if (nih_io_buffer_push (buffer, (const char *)&type,
+						sizeof (type)) < 0)
+				return -1;
+
+			if (nih_io_buffer_push (buffer, (const char *)&len,
+						sizeof (len)) < 0)
+				return -1;
+
+			return nih_io_buffer_push (buffer, value, len);
+		}
+
+	case json_type_array:
+		type = STATE_BINARY_ARRAY;
+		count = json_object_array_length (json);
+
+		if (nih_io_buffer_push (buffer, (const char *)&type,
+					sizeof (type)) < 0)
+			return -1;
+
+		if (nih_io_buffer_push (buffer, (const char *)&count,
+					sizeof (count)) < 0)
+			return -1;
+
+		for (uint32_t i = 0; i < count; i++) {
+			if (state_binary_encode (buffer,
+					json_object_array_get_idx (json, i)) < 0)
+				return -1;
+		}
+
+		return 0;
+
+	case json_type_object:
+		type = STATE_BINARY_OBJECT;
+
+		if (nih_io_buffer_push (buffer, (const char *)&type,
+					sizeof (type)) < 0)
+			return -1;
+
+		/* Count is filled in once the members have been written */
+		offset = buffer->len;
+		if (nih_io_buffer_push (buffer, (const char *)&count,
+					sizeof (count)) < 0)
+			return -1;
+
+		json_object_object_foreach (json, key, value) {
+			uint32_t len = strlen (key);
+
+			if (nih_io_buffer_push (buffer, (const char *)&len,
+						sizeof (len)) < 0)
+				return -1;
+
+			if (nih_io_buffer_push (buffer, key, len) < 0)
+				return -1;
+
+			if (state_binary_encode (buffer, value) < 0)
+				return -1;
+
+			count++;
+		}
+
+		memcpy (buffer->buf + offset, &count, sizeof (count));
+
+		return 0;
+
+	default:
+		nih_assert_not_reached ();
+	}
+}
+
+/**
+ * state_binary_to_json:
+ *
+ * @data: binary snapshot,
+ * @len: length of @data.
+ *
+ * Decode binary snapshot @data back into a JSON object tree, checking
+ * the header and that every record and value lies within @data.
+ *
+ * Returns: new JSON object, or NULL if @data is not a valid binary
+ * snapshot or on insufficient memory.
+ **/
+json_object *
+state_binary_to_json (const char *data, size_t len)
+{
+	StateBinaryHeader  header;
+	json_object       *json;
+
+	nih_assert (data);
+
+	if (len < sizeof (header))
+		return NULL;
+
+	memcpy (&header, data, sizeof (header));
+
+	if (! state_binary_check_header (&header))
+		return NULL;
+
+	data += sizeof (header);
+	len -= sizeof (header);
+
+	json = json_object_new_object ();
+	if (! json)
+		return NULL;
+
+	while (TRUE) {
+		uint8_t          type;
+		uint32_t         name_len;
+		uint64_t         value_len;
+		nih_local char  *name = NULL;
+		json_object     *value = NULL;
+		const char      *value_data;
+		size_t           remaining;
+
+		if (state_binary_read (&data, &len, &type, sizeof (type)) < 0)
+			goto error;
+
+		if (type == STATE_BINARY_RECORD_END)
+			break;
+
+		if (state_binary_read (&data, &len, &name_len,
+				       sizeof (name_len)) < 0)
+			goto error;
+
+		if (len < name_len)
+			goto error;
+
+		name = nih_strndup (NULL, data, name_len);
+		if (! name)
+			goto error;
+
+		data += name_len;
+		len -= name_len;
+
+		if (state_binary_read (&data, &len, &value_len,
+				       sizeof (value_len)) < 0)
+			goto error;
+
+		if (len < value_len)
+			goto error;
+
+		value_data = data;
+		remaining = value_len;
+
+		if (state_binary_decode (&value_data, &remaining, 0, &value) < 0
+		    || remaining) {
+			if (value)
+				json_object_put (value);
+			goto error;
+		}
+
+		data += value_len;
+		len -= value_len;
 
-		if (! bytes)
-			break;
-		else if (bytes > 0)
-			nih_io_buffer_shrink (buffer, (size_t)bytes);
-		else if (bytes < 0 && errno != EINTR)
-			break;
+		if (state_binary_apply (json, type, name, value) < 0)
+			goto error;
 	}
 
-	close (fd);
+	/* Nothing may follow the end record */
+	if (len)
+		goto error;
+
+	return json;
+
+error:
+	json_object_put (json);
+	return NULL;
 }
 
 /**
- * state_write_objects:
+ * state_binary_read:
  *
- * @fd: file descriptor to write serialisation data on,
- * @state_data: JSON string representing internal object state,
- * @len: length of @state_data.
+ * @data: pointer to current position in encoded data,
+ * @len: pointer to number of bytes remaining,
+ * @value: location to copy to,
+ * @size: number of bytes to copy.
  *
- * Write serialisation data to specified file descriptor.
- * @fd is assumed to be open and valid to write to.
+ * Copy @size bytes from @data into @value, advancing @data and reducing
+ * @len.
  *
- * Returns: 0 on success, -1 on error.
+ * Returns: 0 on success, -1 if fewer than @size bytes remain.
  **/
-int
-state_write_objects (int fd, const char *state_data, size_t len)
+static int
+state_binary_read (const char **data, size_t *len, void *value, size_t size)
 {
-	ssize_t   ret;
-
-	nih_assert (fd != -1);
-	nih_assert (state_data);
+	nih_assert (data);
 	nih_assert (len);
+	nih_assert (value);
 
-	ret = write (fd, state_data, len);
+	if (*len < size)
+		return -1;
 
-	return (ret < 0 ? -1 : 0);
+	memcpy (value, *data, size);
+
+	*data += size;
+	*len -= size;
+
+	return 0;
 }
 
 /**
- * state_to_string:
+ * state_binary_decode:
  *
- * @json_string; newly-allocated string,
- * @len: length of @json_string.
+ * @data: pointer to current position in encoded data,
+ * @len: pointer to number of bytes remaining,
+ * @depth: current nesting depth,
+ * @json: location to store new value.
  *
- * Serialise internal data structures to a JSON string.
+ * Decode a single value, and any values it contains, from @data,
+ * advancing @data and reducing @len by the number of bytes consumed.
+ *
+ * A null value is stored in @json as NULL.
  *
  * Returns: 0 on success, -1 on error.
  **/
-int
-state_to_string (char **json_string, size_t *len)
+static int
+state_binary_decode (const char  **data,
+		     size_t       *len,
+		     int           depth,
+		     json_object **json)
 {
-	json_object  *json;
-	json_object  *json_job_environ;
-	json_object  *json_control_bus_address;
-	const char   *value;
-
-#ifdef ENABLE_CGROUPS
-	json_object  *json_cgroup_manager_address;
-#endif /* ENABLE_CGROUPS */
+	uint8_t       type;
+	uint32_t      count;
+	json_object  *value = NULL;
 
-	nih_assert (json_string);
+	nih_assert (data);
 	nih_assert (len);
+	nih_assert (json);
 
-	json = json_object_new_object ();
+	*json = NULL;
 
-	if (! json)
+	if (depth > STATE_BINARY_MAX_DEPTH)
 		return -1;
 
-	json_sessions = session_serialise_all ();
-	if (! json_sessions) {
-		nih_error ("%s Sessions", _("Failed to serialise"));
-		goto error;
-	}
-
-	json_object_object_add (json, "sessions", json_sessions);
-
-	json_events = event_serialise_all ();
-	if (! json_events) {
-		nih_error ("%s Events", _("Failed to serialise"));
-		goto error;
-	}
-
-	json_object_object_add (json, "events", json_events);
-
-	json_control_bus_address = control_serialise_bus_address ();
-
-	/* Take care to distinguish between memory failure and an
-	 * as-yet-not-set control bus address.
-	 */
-	if (! json_control_bus_address && control_bus_address) {
-		nih_error ("%s %s",
-				_("Failed to serialise"),
-			       _("control bus address"));
-		goto error;
-	}
-
-	json_object_object_add (json, "control_bus_address", json_control_bus_address);
+	if (state_binary_read (data, len, &type, sizeof (type)) < 0)
+		return -1;
 
-#ifdef ENABLE_CGROUPS
-	json_cgroup_manager_address = cgroup_manager_serialise ();
+	switch (type) {
+	case STATE_BINARY_NULL:
+		return 0;
 
-	/* Take care to distinguish between memory failure and an
-	 * as-yet-not-set cgroup manager address.
-	 */
-	if (! json_cgroup_manager_address && cgroup_manager_address) {
-		nih_error ("%s %s",
-				_("Failed to serialise"),
-			       _("cgroup manager address"));
-		goto error;
-	}
+	case STATE_BINARY_BOOLEAN:
+		{
+			uint8_t b;
 
-	json_object_object_add (json, "cgroup_manager_address", json_cgroup_manager_address);
-#endif /* ENABLE_CGROUPS */
+			if (state_binary_read (data, len, &b, sizeof (b)) < 0)
+				return -1;
 
-	json_job_environ = job_class_serialise_job_environ ();
+			value = json_object_new_boolean (b ? TRUE : FALSE);
+			break;
+		}
 
-	if (! json_job_environ) {
-		nih_error ("%s global job environment",
-				_("Failed to serialise"));
-		goto error;
-	}
+	case STATE_BINARY_INT:
+		{
+			int64_t i;
 
-	json_object_object_add (json, "job_environment", json_job_environ);
+			if (state_binary_read (data, len, &i, sizeof (i)) < 0)
+				return -1;
 
-	json_classes = job_class_serialise_all ();
+			value = json_object_new_int64 (i);
+			break;
+		}
 
-	if (! json_classes) {
-		nih_error ("%s JobClasses", _("Failed to serialise"));
-		goto error;
-	}
+	case STATE_BINARY_DOUBLE:
+		{
+			double d;
 
-	json_object_object_add (json, "job_classes", json_classes);
+			if (state_binary_read (data, len, &d, sizeof (d)) < 0)
+				return -1;
 
-	json_conf_sources = conf_source_serialise_all ();
+			value = json_object_new_double (d);
+			break;
+		}
 
-	if (! json_conf_sources) {
-		nih_error ("%s ConfSources", _("Failed to serialise"));
-		goto error;
-	}
+	case STATE_BINARY_STRING:
+		if (state_binary_read (data, len, &count, sizeof (count)) < 0)
+			return -1;
 
-	json_object_object_add (json, "conf_sources", json_conf_sources);
+		if (*len < count)
+			return -1;
 
-	/* Note that the returned value is managed by json-c! */
-	value = json_object_to_json_string (json);
-	if (! value)
-		goto error;
+		value = json_object_new_string_len (*data, count);
+		*data += count;
+		*len -= count;
+		break;
 
-	*len = strlen (value);
+	case STATE_BINARY_ARRAY:
+		if (state_binary_read (data, len, &count, sizeof (count)) < 0)
+			return -1;
 
-	*json_string = NIH_MUST (nih_strndup (NULL, value, *len));
+		/* Every value needs at least its type byte */
+		if (*len < count)
+			return -1;
 
-	json_object_put (json);
+		value = json_object_new_array ();
+		if (! value)
+			return -1;
 
-	return 0;
+		for (uint32_t i = 0; i < count; i++) {
+			json_object *element;
 
-error:
-	json_object_put (json);
-	return -1;
-}
+			if (state_binary_decode (data, len, depth + 1,
+						 &element) < 0)
+				goto error;
 
-/**
- * state_from_string:
- *
- * @state: JSON-encoded state.
- *
- * Convert JSON string back to an internal representation.
- *
- * Returns: 0 on success, -1 on error.
- **/
-int
-state_from_string (const char *state)
-{
-	int                       ret = -1;
-	json_object              *json;
-	json_object              *json_job_environ;
-	json_object              *json_control_bus_address;
-	enum json_tokener_error   error;
+			if (json_object_array_add (value, element) < 0) {
+				if (element)
+					json_object_put (element);
+				goto error;
+			}
+		}
+		break;
 
-#ifdef ENABLE_CGROUPS
-	json_object              *json_cgroup_manager_address;
-#endif /* ENABLE_CGROUPS */
+	case STATE_BINARY_OBJECT:
+		if (state_binary_read (data, len, &count, sizeof (count)) < 0)
+			return -1;
 
-	nih_assert (state);
+		if (*len < count)
+			return -1;
 
-	/* This function is called before conf_source_new (), so setup
-	 * the environment.
-	 */
-	conf_init ();
+		value = json_object_new_object ();
+		if (! value)
+			return -1;
 
-	json = json_tokener_parse_verbose (state, &error);
+		for (uint32_t i = 0; i < count; i++) {
+			nih_local char *key = NULL;
+			json_object    *member;
+			uint32_t        key_len;
 
-	if (! json) {
-		nih_error ("%s: %s",
-				_("Detected invalid serialisation data"),
-				json_tokener_error_desc (error));
-		return ret;
-	}
+			if (state_binary_read (data, len, &key_len,
+					       sizeof (key_len)) < 0)
+				goto error;
 
-	if (! state_check_json_type (json, object))
-		goto out;
+			if (*len < key_len)
+				goto error;
 
-	if (session_deserialise_all (json) < 0) {
-		nih_error ("%s Sessions", _("Failed to deserialise"));
-		goto out;
-	}
+			key = nih_strndup (NULL, *data, key_len);
+			if (! key)
+				goto error;
 
-	if (event_deserialise_all (json) < 0) {
-		nih_error ("%s Events", _("Failed to deserialise"));
-		goto out;
-	}
+			*data += key_len;
+			*len -= key_len;
 
-	ret = json_object_object_get_ex (json, "control_bus_address", &json_control_bus_address);
+			if (state_binary_decode (data, len, depth + 1,
+						 &member) < 0)
+				goto error;
 
-	if (json_control_bus_address) {
-		if (control_deserialise_bus_address (json_control_bus_address) < 0) {
-			nih_error ("%s control details", _("Failed to deserialise"));
-			goto out;
+			json_object_object_add (value, key, member);
 		}
-	} else if (! ret) {
-		/* Probably deserialising from older format that doesn't
-		 * encode control details.
-		 */
-		nih_warn ("%s", _("No control details present in state data"));
-	}
-
-#ifdef ENABLE_CGROUPS
-	ret = json_object_object_get_ex (json, "cgroup_manager_address", &json_cgroup_manager_address);
+		break;
 
-	if (json_cgroup_manager_address) {
-		if (cgroup_manager_deserialise (json_cgroup_manager_address) < 0) {
-			nih_error ("%s %s",
-					_("Failed to deserialise"),
-					_("cgroup manager address"));
-			goto out;
-		}
-	} else if (! ret) {
-		nih_warn ("No %s in state data", _("cgroup manager address"));
+	default:
+		return -1;
 	}
-#endif /* ENABLE_CGROUPS */
 
-	/* Again, we cannot error here since older JSON state data did
-	 * not encode ConfSource or ConfFile objects.
-	 */
-	if (json_object_object_get_ex (json, "conf_sources", NULL)) {
-		if (conf_source_deserialise_all (json) < 0) {
-			nih_error ("%s ConfSources", _("Failed to deserialise"));
-			goto out;
-		}
-	} else {
-		nih_warn ("%s", _("No ConfSources present in state data"));
-	}
+	if (! value)
+		return -1;
 
-	if (json_object_object_get_ex (json, "job_environment", &json_job_environ)) {
-		if (job_class_deserialise_job_environ (json_job_environ) < 0) {
-			nih_error ("%s global job environment",
-					_("Failed to deserialise"));
-			goto out;
-		}
-	} else {
-		nih_warn ("%s", _("No global job environment data present in state data"));
-	}
+	*json = value;
 
-	if (job_class_deserialise_all (json) < 0) {
-		nih_error ("%s JobClasses", _("Failed to deserialise"));
-		goto out;
-	}
+	return 0;
 
-	if (state_deserialise_resolve_deps (json) < 0) {
-		nih_error (_("Failed to resolve deserialisation dependencies"));
-		goto out;
-	}
+error:
+	json_object_put (value);
+	return -1;
+}
 
-	ret = 0;
+/**
+ * state_is_binary:
+ *
+ * @data: serialisation data,
+ * @len: length of @data.
+ *
+ * Determine whether @data is a binary snapshot rather than JSON text.
+ *
+ * Returns: TRUE if @data begins with STATE_BINARY_MAGIC, else FALSE.
+ **/
+int
+state_is_binary (const char *data, size_t len)
+{
+	nih_assert (data);
 
-out:
-	/* Only need to free the root JSON node */
-	json_object_put (json);
+	if (len < STATE_BINARY_MAGIC_LEN)
+		return FALSE;
 
-	return ret;
+	return memcmp (data, STATE_BINARY_MAGIC, STATE_BINARY_MAGIC_LEN) ? FALSE : TRUE;
 }
 
-
 /**
  * state_modify_cloexec:
  *
@@ -1859,27 +3529,27 @@ error:
 char *
 state_data_to_hex (void *parent, const void *data, size_t len)
 {
-	unsigned char  *p;
-	char           *encoded = NULL;
-	size_t          i;
+	static const char    digits[] = "0123456789abcdef";
+	const unsigned char *p;
+	char                *encoded;
+	char                *e;
 
 	nih_assert (data);
 	nih_assert (len);
 
-	for (i = 0, p = (unsigned char *)data;
-			i < len;
-			i++, p++) {
-		if (! nih_strcat_sprintf (&encoded, parent, "%02x", *p))
-			goto error;
-	}
+	/* Encode in a single allocation since log data can be large */
+	encoded = nih_alloc (parent, (len * 2) + 1);
+	if (! encoded)
+		return NULL;
 
-	return encoded;
+	for (p = data, e = encoded; len; len--, p++) {
+		*e++ = digits[*p >> 4];
+		*e++ = digits[*p & 0xf];
+	}
 
-error:
-	if (encoded)
-		nih_free (encoded);
+	*e = '\0';
 
-	return NULL;
+	return encoded;
 }
 
 /**
@@ -1903,10 +3573,10 @@ state_hex_to_data (void      *parent,
 		char        **data,
 		size_t       *data_len)
 {
-	char    *p;
-	char    *d;
-	char    *decoded;
-	size_t   new_len;
+	const char  *p;
+	char        *d;
+	char        *decoded;
+	size_t       new_len;
 
 	nih_assert (hex_data);
 	nih_assert (hex_len);
@@ -1923,24 +3593,19 @@ state_hex_to_data (void      *parent,
 	memset (decoded, '\0', new_len);
 
 	d = (char *)decoded;
+	p = (const char *)hex_data;
 
 	for (size_t i = 0; i < hex_len; i += 2, d++) {
-		char   byte;
-		char   str[3] = { '\0' };
-		char  *endptr;
-
-		p = ((char *)hex_data)+i;
+		int  high;
+		int  low;
 
-		str[0] = *p;
-		str[1] = *(p+1);
+		high = state_hex_value (p[i]);
+		low = state_hex_value (p[i+1]);
 
-		errno = 0;
-		byte = strtol (str, &endptr, 16);
-
-		if (errno || *endptr)
+		if (high < 0 || low < 0)
 			goto error;
 
-		*d = byte;
+		*d = (char)((high << 4) | low);
 	}
 
 	*data_len = (size_t)(d - decoded);
@@ -1954,6 +3619,28 @@ error:
 	return -1;
 }
 
+/**
+ * state_hex_value:
+ *
+ * @c: hex digit.
+ *
+ * Convert a single hex digit to its value.
+ *
+ * Returns: value of @c, or -1 if @c is not a hex digit.
+ **/
+static int
+state_hex_value (char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
 /**
  * perform_reexec:
  *
@@ -2029,16 +3716,29 @@ perform_reexec (void)
  * result in a basic re-exec being performed where all state
  * will be lost.
  *
- * The process involves the initial Upstart instance (PID 1) creating a
- * pipe and then forking. The child then writes its serialised state
- * over the pipe back to PID 1 which has now re-exec'd itself.
- *
- * Once the state has been passed, the child can exit.
+ * The initial Upstart instance (PID 1) creates a socket pair, one end of
+ * which is given to the new instance with --state-fd, and forks a child
+ * to relinquish the D-Bus name before re-exec'ing itself.
+ *
+ * Where it can, PID 1 first writes a binary snapshot of its state to a
+ * memfd which is inherited across the re-exec and named by the
+ * STATE_MEMFD_ENV environment variable. A new instance that reads it says
+ * so over the socket (see state_ack_memfd()), and the child simply exits
+ * once it has released the D-Bus name, which the new instance waits for
+ * (see state_read_sync()). Otherwise, including when the new instance is
+ * too old to acknowledge the snapshot, the child writes its serialised
+ * JSON state over the socket back to PID 1 which has now re-exec'd
+ * itself.
+ *
+ * Once the state has been passed, the child can exit; PID 1 does not
+ * wait for it, it is reaped as any other child once the new instance
+ * is running.
  **/
 void
 stateful_reexec (void)
 {
 	int             fds[2] = { -1, -1 };
+	int             memfd;
 	pid_t           pid;
 	sigset_t        mask, oldmask;
 	nih_local char *state_data = NULL;
@@ -2054,14 +3754,20 @@ stateful_reexec (void)
 	sigfillset (&mask);
 	sigprocmask (SIG_BLOCK, &mask, &oldmask);
 
-	if (state_to_string (&state_data, &len) < 0) {
+	/* Without a snapshot, JSON is generated before forking as it
+	 * always has been; otherwise the child only generates it if the
+	 * new instance turns out not to read the snapshot.
+	 */
+	memfd = state_write_memfd ();
+
+	if ((memfd < 0) && (state_to_string (&state_data, &len) < 0)) {
 		nih_error ("%s - %s",
 				_("Failed to generate serialisation data"),
 				_("reverting to stateless re-exec"));
 		goto reexec;
 	}
 
-	if (pipe (fds) < 0)
+	if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) < 0)
 		goto reexec;
 
 	nih_info (_("Performing stateful re-exec"));
@@ -2100,11 +3806,24 @@ stateful_reexec (void)
 
 		arg = NIH_MUST (nih_sprintf (NULL, "%d", fds[0]));
 		NIH_MUST (nih_str_array_add (&args_copy, NULL, NULL, arg));
+
+		/* Offer the snapshot through the environment, which an
+		 * instance that cannot read it ignores, unlike an unknown
+		 * option.
+		 */
+		if (memfd >= 0) {
+			arg = NIH_MUST (nih_sprintf (NULL, "%d", memfd));
+			if (setenv (STATE_MEMFD_ENV, arg, TRUE) < 0) {
+				close (memfd);
+				memfd = -1;
+			}
+		}
 	} else {
 		/* Child */
 		close (fds[0]);
 
-		nih_info (_("Passing state from PID %d to parent"), (int)getpid ());
+		if (memfd >= 0)
+			close (memfd);
 
 		/* D-Bus name and the private control server connection must be
 		 * relinquished now to allow parent to acquire them.
@@ -2120,6 +3839,21 @@ stateful_reexec (void)
 
 		control_server_close ();
 
+		/* If the new instance is reading the snapshot, the baton
+		 * has already been passed; otherwise it expects JSON.
+		 */
+		if ((memfd >= 0) && (state_wait_ack (fds[1]) != STATE_ACK_BINARY)) {
+			if (state_to_string (&state_data, &len) < 0) {
+				nih_error ("%s",
+					_("Failed to generate serialisation data"));
+				exit (1);
+			}
+		} else if (memfd >= 0) {
+			exit (0);
+		}
+
+		nih_info (_("Passing state from PID %d to parent"), (int)getpid ());
+
 		if (state_write (fds[1], state_data, len) < 0) {
 			nih_error ("%s",
 				_("Failed to write serialisation data"));
@@ -2143,6 +3877,56 @@ reexec:
 
 	/* Restore */
 	sigprocmask (SIG_SETMASK, &oldmask, NULL);
+
+	unsetenv (STATE_MEMFD_ENV);
+
+	if (memfd >= 0)
+		close (memfd);
+	if (fds[0] != -1)
+		close (fds[0]);
+}
+
+/**
+ * state_write_memfd:
+ *
+ * Stream a binary snapshot of our state to a new memfd, which is left
+ * without the close-on-exec flag so that it is inherited by the new
+ * instance.
+ *
+ * Returns: memfd positioned at the start of the snapshot, or -1 if
+ * binary snapshots are disabled or unsupported, or on error.
+ **/
+static int
+state_write_memfd (void)
+{
+#ifdef HAVE_MEMFD_CREATE
+	int fd;
+
+	if (disable_binary_state)
+		return -1;
+
+	fd = memfd_create ("upstart-state", 0);
+	if (fd < 0)
+		return -1;
+
+	if (state_write_stream (fd) < 0) {
+		nih_warn ("%s - %s",
+				_("Failed to generate binary serialisation data"),
+				_("reverting to JSON"));
+		goto error;
+	}
+
+	if (lseek (fd, 0, SEEK_SET) < 0)
+		goto error;
+
+	return fd;
+
+error:
+	close (fd);
+	return -1;
+#else /* HAVE_MEMFD_CREATE */
+	return -1;
+#endif /* HAVE_MEMFD_CREATE */
 }
 
 /**
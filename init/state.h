@@ -295,6 +295,38 @@
  *   - create any event->blocking links to any jobs.
  *   - create any event->blocking links to any D-Bus messages.
  *
+ * == Binary Snapshots ==
+ *
+ * The JSON object tree built by the serialisation functions is passed
+ * to the new instance in a compact binary encoding rather than as JSON
+ * text, avoiding the cost of generating and tokenising large strings.
+ *
+ * A snapshot is a StateBinaryHeader followed by a sequence of records
+ * (see StateBinaryRecordType), each naming a top-level section and
+ * carrying a length-prefixed encoded value (see StateBinaryType). Large
+ * sections are written as an empty array followed by one record per
+ * element, so that state_write_stream() need only hold one object in
+ * memory at a time, and the reader deserialises each section as soon
+ * as it is complete.
+ *
+ * The snapshot is written to a memfd which is inherited by the new
+ * instance and named by STATE_MEMFD_ENV, alongside the --state-fd socket
+ * over which JSON text is sent as before. If memfd_create(2) is
+ * unavailable or fails, or binary snapshots are disabled, only JSON is
+ * offered.
+ *
+ * As soon as it starts, the new instance writes STATE_ACK_BINARY or
+ * STATE_ACK_JSON to the socket to say which it will read. The child
+ * that releases the D-Bus name waits up to STATE_ACK_WAIT_MSECS for this
+ * and only generates and sends JSON if the snapshot is not being read;
+ * an instance that predates binary snapshots ignores STATE_MEMFD_ENV and
+ * never acknowledges, so is sent JSON. A new instance reading the snapshot
+ * waits for the child to exit and so close its end of the socket before
+ * restoring its state. PID 1 never waits for the child itself; it is
+ * reaped by the new instance like any other child.
+ * The reader detects which format it has been given from the first
+ * bytes, and STATE_FILE is always written as JSON for debugging.
+ *
  * == Ptrace handling ==
  *
  * Fortuitously, it transpires that if a process is ptrace(2)-ing one
@@ -336,6 +368,7 @@
 #include <nih/macros.h>
 #include <nih/alloc.h>
 #include <nih/list.h>
+#include <nih/io.h>
 
 #include <json.h>
 
@@ -372,6 +405,74 @@
  **/
 #define STATE_FILE "upstart.state"
 
+/**
+ * STATE_BINARY_MAGIC:
+ *
+ * Bytes that begin a binary snapshot; the leading nul ensures a binary
+ * snapshot can never be mistaken for JSON text.
+ **/
+#define STATE_BINARY_MAGIC "\0UPSTATE"
+
+/**
+ * STATE_BINARY_MAGIC_LEN:
+ *
+ * Length of STATE_BINARY_MAGIC.
+ **/
+#define STATE_BINARY_MAGIC_LEN 8
+
+/**
+ * STATE_BINARY_VERSION:
+ *
+ * Version of the binary snapshot encoding; must be incremented if the
+ * encoding (rather than the serialised data) changes.
+ **/
+#define STATE_BINARY_VERSION 2
+
+/**
+ * STATE_BINARY_MAX_DEPTH:
+ *
+ * Maximum nesting of arrays and objects accepted when decoding a binary
+ * snapshot.
+ **/
+#define STATE_BINARY_MAX_DEPTH 64
+
+/**
+ * STATE_MEMFD_ENV:
+ *
+ * Name of environment variable giving the new instance the file
+ * descriptor of a memfd holding a binary snapshot during stateful
+ * re-exec. Unlike an unknown option, it is ignored by an instance that
+ * cannot read binary snapshots.
+ **/
+#define STATE_MEMFD_ENV "UPSTART_STATE_MEMFD"
+
+/**
+ * STATE_ACK_BINARY:
+ *
+ * Byte written to the --state-fd socket by a new instance that will read
+ * the binary snapshot named by STATE_MEMFD_ENV.
+ **/
+#define STATE_ACK_BINARY 'B'
+
+/**
+ * STATE_ACK_JSON:
+ *
+ * Byte written to the --state-fd socket by a new instance that cannot
+ * read the binary snapshot named by STATE_MEMFD_ENV, and so expects JSON
+ * over the socket.
+ **/
+#define STATE_ACK_JSON 'J'
+
+/**
+ * STATE_ACK_WAIT_MSECS:
+ *
+ * Time in milliseconds to wait for the new instance to acknowledge a
+ * binary snapshot before assuming it predates them and sending JSON.
+ * This is well within STATE_WAIT_SECS, for which such an instance waits
+ * for the JSON.
+ **/
+#define STATE_ACK_WAIT_MSECS 500
+
 /**
  * state_get_timeout:
  *
@@ -1104,6 +1205,65 @@
 
 NIH_BEGIN_EXTERN
 
+/**
+ * StateBinaryType:
+ *
+ * Tag preceding each value of a binary snapshot. Values are encoded in
+ * native byte order since they are only ever read by the same machine:
+ *
+ * - STATE_BINARY_NULL: no data.
+ * - STATE_BINARY_BOOLEAN: single byte.
+ * - STATE_BINARY_INT: int64_t.
+ * - STATE_BINARY_DOUBLE: double.
+ * - STATE_BINARY_STRING: uint32_t length followed by the bytes.
+ * - STATE_BINARY_ARRAY: uint32_t count followed by the values.
+ * - STATE_BINARY_OBJECT: uint32_t count followed by pairs of
+ *   uint32_t key length, key bytes and value.
+ **/
+typedef enum state_binary_type {
+	STATE_BINARY_NULL,
+	STATE_BINARY_BOOLEAN,
+	STATE_BINARY_INT,
+	STATE_BINARY_DOUBLE,
+	STATE_BINARY_STRING,
+	STATE_BINARY_ARRAY,
+	STATE_BINARY_OBJECT,
+} StateBinaryType;
+
+/**
+ * StateBinaryRecordType:
+ *
+ * Tag beginning each record of a binary snapshot:
+ *
+ * - STATE_BINARY_RECORD_END: marks the end of the snapshot.
+ * - STATE_BINARY_RECORD_SECTION: a top-level section.
+ * - STATE_BINARY_RECORD_ELEMENT: an element to append to the array
+ *   making up the named section.
+ *
+ * Other than the end record, the tag is followed by a uint32_t length
+ * and the bytes of the section name, then by a uint64_t length and the
+ * encoded value.
+ **/
+typedef enum state_binary_record_type {
+	STATE_BINARY_RECORD_END,
+	STATE_BINARY_RECORD_SECTION,
+	STATE_BINARY_RECORD_ELEMENT,
+} StateBinaryRecordType;
+
+/**
+ * StateBinaryHeader:
+ * @magic: STATE_BINARY_MAGIC,
+ * @version: STATE_BINARY_VERSION,
+ * @flags: reserved, must be zero.
+ *
+ * Header that begins every binary snapshot.
+ **/
+typedef struct state_binary_header {
+	char      magic[STATE_BINARY_MAGIC_LEN];
+	uint32_t  version;
+	uint32_t  flags;
+} StateBinaryHeader;
+
 /**
  * EnumSerialiser:
  *
@@ -1138,12 +1298,30 @@ int  state_read_objects  (int fd)
 int  state_write_objects (int fd, const char *state_data, size_t len)
 	__attribute__ ((warn_unused_result));
 
+int  state_read_sync     (int fd)
+	__attribute__ ((warn_unused_result));
+
+int  state_ack_memfd     (int fd);
+
 int  state_to_string (char **json_string, size_t *len)
 	__attribute__ ((warn_unused_result));
 
 int    state_from_string (const char *state)
 	__attribute__ ((warn_unused_result));
 
+int    state_write_stream (int fd)
+	__attribute__ ((warn_unused_result));
+
+int    state_json_to_binary (NihIoBuffer *buffer, json_object *json)
+	__attribute__ ((warn_unused_result));
+
+json_object *
+state_binary_to_json (const char *data, size_t len)
+	__attribute__ ((warn_unused_result));
+
+int    state_is_binary (const char *data, size_t len)
+	__attribute__ ((warn_unused_result));
+
 int    state_modify_cloexec (int fd, int set);
 
 json_object *
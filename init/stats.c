@@ -0,0 +1,135 @@
+/* upstart
+ *
+ * stats.c - latency histograms of the phases of init
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <string.h>
+#include <time.h>
+
+#include <nih/macros.h>
+#include <nih/logging.h>
+
+#include "stats.h"
+
+
+/**
+ * stats_histograms:
+ *
+ * Histogram of the durations of each phase since init started, or
+ * stats_reset() was last called.
+ **/
+StatsHistogram stats_histograms[STATS_LAST];
+
+
+/**
+ * stats_now:
+ *
+ * Returns the current time to be passed to stats_record() at the end of
+ * a phase.
+ *
+ * Returns: current value of the monotonic clock in nanoseconds.
+ **/
+uint64_t
+stats_now (void)
+{
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) < 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * stats_record:
+ * @phase: phase that has completed,
+ * @start: time the phase began, as returned by stats_now().
+ *
+ * Records the time since @start in the histogram for @phase.  This
+ * never allocates so may be called from any path.
+ **/
+void
+stats_record (StatsPhase phase,
+	      uint64_t   start)
+{
+	StatsHistogram *histogram;
+	uint64_t        duration;
+	uint64_t        usec;
+	int             bucket = 0;
+
+	nih_assert (phase < STATS_LAST);
+
+	histogram = &stats_histograms[phase];
+
+	duration = stats_now ();
+	duration = (duration > start) ? duration - start : 0;
+
+	for (usec = duration / 1000; usec && (bucket < STATS_BUCKETS - 1);
+	     usec >>= 1)
+		bucket++;
+
+	histogram->count++;
+	histogram->total += duration;
+	if (duration > histogram->max)
+		histogram->max = duration;
+	histogram->buckets[bucket]++;
+}
+
+/**
+ * stats_reset:
+ *
+ * Discards all recorded durations.
+ **/
+void
+stats_reset (void)
+{
+	memset (stats_histograms, 0, sizeof (stats_histograms));
+}
+
+/**
+ * stats_phase_name:
+ * @phase: phase to convert.
+ *
+ * Converts an enumerated phase into the string used for the D-Bus
+ * interface and by initctl.
+ *
+ * Returns: static string or NULL if phase not known.
+ **/
+const char *
+stats_phase_name (StatsPhase phase)
+{
+	switch (phase) {
+	case STATS_EVENT_POLL:
+		return N_("event-poll");
+	case STATS_EVENT_HANDLE:
+		return N_("event-handle");
+	case STATS_SPAWN:
+		return N_("spawn");
+	case STATS_LOG_WRITE:
+		return N_("log-write");
+	case STATS_CONF_RELOAD:
+		return N_("conf-reload");
+	default:
+		return NULL;
+	}
+}
@@ -0,0 +1,83 @@
+/* upstart
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_STATS_H
+#define INIT_STATS_H
+
+#include <stdint.h>
+
+#include <nih/macros.h>
+
+
+/**
+ * STATS_BUCKETS:
+ *
+ * Number of buckets in each histogram.  The first bucket counts
+ * durations of less than one microsecond, each following bucket n
+ * counts durations of at least 2^(n-1) and less than 2^n microseconds,
+ * and the last also counts everything longer.
+ **/
+#define STATS_BUCKETS 32
+
+
+/**
+ * StatsPhase:
+ *
+ * Phases of init whose durations are recorded.
+ **/
+typedef enum stats_phase {
+	STATS_EVENT_POLL,
+	STATS_EVENT_HANDLE,
+	STATS_SPAWN,
+	STATS_LOG_WRITE,
+	STATS_CONF_RELOAD,
+	STATS_LAST
+} StatsPhase;
+
+/**
+ * StatsHistogram:
+ * @count: number of durations recorded,
+ * @total: sum of durations recorded in nanoseconds,
+ * @max: longest duration recorded in nanoseconds,
+ * @buckets: number of durations recorded in each bucket.
+ *
+ * This structure holds the distribution of the durations of one phase;
+ * it is fixed in size so that recording a duration never allocates.
+ **/
+typedef struct stats_histogram {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint64_t buckets[STATS_BUCKETS];
+} StatsHistogram;
+
+
+NIH_BEGIN_EXTERN
+
+extern StatsHistogram stats_histograms[STATS_LAST];
+
+uint64_t    stats_now        (void);
+void        stats_record     (StatsPhase phase, uint64_t start);
+void        stats_reset      (void);
+
+const char *stats_phase_name (StatsPhase phase)
+	__attribute__ ((const));
+
+NIH_END_EXTERN
+
+#endif /* INIT_STATS_H */
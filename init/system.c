@@ -29,7 +29,9 @@
 #include <sys/mount.h>
 
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <termios.h>
@@ -269,3 +271,50 @@ system_check_file (const char *path, mode_t type, dev_t dev)
 
 	return 0;
 }
+
+/**
+ * system_process_status:
+ * @pid: process id,
+ * @uid: pointer to store real user id of process in,
+ * @ppid: pointer to store parent process id in.
+ *
+ * Reads the real user and parent of @pid from /proc.
+ *
+ * Returns: zero on success, negative value if @pid could not be read.
+ **/
+int
+system_process_status (pid_t  pid,
+		       uid_t *uid,
+		       pid_t *ppid)
+{
+	char  path[PATH_MAX];
+	char  line[256];
+	FILE *f;
+	int   found = 0;
+
+	nih_assert (pid > 0);
+	nih_assert (uid != NULL);
+	nih_assert (ppid != NULL);
+
+	sprintf (path, "/proc/%d/status", pid);
+
+	f = fopen (path, "re");
+	if (! f)
+		return -1;
+
+	while (fgets (line, sizeof (line), f)) {
+		unsigned long value;
+
+		if (sscanf (line, "PPid: %lu", &value) == 1) {
+			*ppid = (pid_t)value;
+			found |= 1;
+		} else if (sscanf (line, "Uid: %lu", &value) == 1) {
+			*uid = (uid_t)value;
+			found |= 2;
+		}
+	}
+
+	fclose (f);
+
+	return (found == 3) ? 0 : -1;
+}
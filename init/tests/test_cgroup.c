@@ -22,12 +22,32 @@
 #include <nih/string.h>
 #include <nih/file.h>
 #include <nih/test.h>
+#include <nih-dbus/test_dbus.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <dbus/dbus.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/signal.h>
+#include <nih/timer.h>
+#include <nih/main.h>
+#include <nih/error.h>
+
+#include <nih-dbus/dbus_connection.h>
 
 #include "cgroup.h"
 
 #include "test_util_common.h"
 
 extern NihHash *cgroup_paths;
+extern char    *cgroup_manager_address;
 
 void
 test_cgroup_new (void)
@@ -243,6 +263,258 @@ test_cgroup_setting_new (void)
 	}
 }
 
+/* Address of the fake cgroup manager */
+#define TEST_CGMANAGER_ADDRESS "unix:abstract=/com/ubuntu/upstart/test-cgmanager"
+
+static int cgmanager_fd = -1;
+
+static DBusHandlerResult
+my_cgmanager_filter (DBusConnection *conn,
+		     DBusMessage    *message,
+		     void           *data)
+{
+	DBusMessage *reply;
+	const char  *controller;
+	const char  *cgroup;
+	int32_t      existed = 0;
+
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	assert (dbus_message_get_args (message, NULL,
+				       DBUS_TYPE_STRING, &controller,
+				       DBUS_TYPE_STRING, &cgroup,
+				       DBUS_TYPE_INVALID));
+
+	assert (dprintf (cgmanager_fd, "%s %s %s\n",
+			 dbus_message_get_member (message),
+			 controller, cgroup) > 0);
+
+	if (! strcmp (cgroup, "fail")) {
+		reply = dbus_message_new_error (message,
+				"org.linuxcontainers.cgmanager.Error",
+				"Invalid cgroup");
+	} else {
+		reply = dbus_message_new_method_return (message);
+		assert (reply != NULL);
+
+		if (dbus_message_is_method_call (message, NULL, "Create"))
+			dbus_message_append_args (reply,
+						  DBUS_TYPE_INT32, &existed,
+						  DBUS_TYPE_INVALID);
+	}
+	assert (reply != NULL);
+
+	assert (dbus_connection_send (conn, reply, NULL));
+	dbus_connection_flush (conn);
+
+	dbus_message_unref (reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static int
+my_cgmanager_connect (DBusServer     *server,
+		      DBusConnection *conn)
+{
+	assert (dbus_connection_add_filter (conn, my_cgmanager_filter,
+					    NULL, NULL));
+
+	return TRUE;
+}
+
+static int request_handled = 0;
+
+static void
+my_request_handler (void          *data,
+		    CGroupRequest *request)
+{
+	TEST_EQ_P (data, &request_handled);
+	TEST_EQ (request->calls, 0);
+
+	request_handled++;
+
+	nih_main_loop_exit (0);
+}
+
+static void
+my_request_timeout (void     *data,
+		    NihTimer *timer)
+{
+	nih_main_loop_exit (1);
+}
+
+void
+test_cgroup_request_new (void)
+{
+	char            *env[] = { "UPSTART_JOB=foo", "UPSTART_INSTANCE=", NULL };
+	NihList         *cgroups;
+	CGroupRequest   *request;
+	CGroup          *cgroup;
+	CGroupName      *cgname;
+	NihTimer        *timer;
+	FILE            *output;
+	pid_t            pid;
+	int              wait_fd, status, ret;
+	int              fds[2];
+
+	TEST_FUNCTION ("cgroup_request_new");
+	nih_error_init ();
+	nih_timer_init ();
+	nih_main_loop_init ();
+
+	assert0 (pipe (fds));
+
+	TEST_CHILD_WAIT (pid, wait_fd) {
+		DBusServer *server;
+
+		close (fds[0]);
+		cgmanager_fd = fds[1];
+
+		nih_signal_set_handler (SIGTERM, nih_signal_handler);
+		assert (nih_signal_add_handler (NULL, SIGTERM,
+						nih_main_term_signal, NULL));
+
+		server = nih_dbus_server (TEST_CGMANAGER_ADDRESS,
+					  my_cgmanager_connect, NULL);
+		assert (server != NULL);
+
+		TEST_CHILD_RELEASE (wait_fd);
+
+		nih_main_loop ();
+
+		dbus_server_disconnect (server);
+		dbus_server_unref (server);
+
+		dbus_shutdown ();
+
+		exit (0);
+	}
+
+	close (fds[1]);
+	output = fdopen (fds[0], "r");
+	TEST_NE_P (output, NULL);
+
+	TEST_TRUE (cgroup_manager_set_address (TEST_CGMANAGER_ADDRESS));
+
+
+	/* Check that a request sends the calls to create the cgroup,
+	 * apply its settings and have it removed once empty without
+	 * waiting for the replies, expanding the name first; the handler
+	 * should only be called once every reply has been received.
+	 */
+	TEST_FEATURE ("with settings and removal");
+	cgroups = nih_list_new (NULL);
+	TEST_NE_P (cgroups, NULL);
+	TEST_TRUE (cgroup_add (cgroups, cgroups, "memory", NULL,
+			       "limit_in_bytes", "1024"));
+
+	request_handled = 0;
+
+	request = cgroup_request_new (NULL, cgroups, env, TRUE,
+				      my_request_handler, &request_handled);
+
+	TEST_NE_P (request, NULL);
+	TEST_ALLOC_SIZE (request, sizeof (CGroupRequest));
+	TEST_EQ (request->calls, 3);
+	TEST_EQ (request_handled, 0);
+
+	TEST_LIST_NOT_EMPTY (&request->cgroups);
+	cgroup = (CGroup *)request->cgroups.next;
+	TEST_ALLOC_PARENT (cgroup, request);
+	TEST_EQ_STR (cgroup->controller, "memory");
+
+	TEST_LIST_NOT_EMPTY (&cgroup->names);
+	cgname = (CGroupName *)cgroup->names.next;
+	TEST_EQ_STR (cgname->name, "upstart/foo");
+
+	timer = nih_timer_add_timeout (NULL, 5, my_request_timeout, NULL);
+
+	ret = nih_main_loop ();
+	TEST_EQ (ret, 0);
+	TEST_EQ (request_handled, 1);
+	TEST_EQ_P (request->error, NULL);
+
+	TEST_FILE_EQ (output, "Create memory upstart/foo\n");
+	TEST_FILE_EQ (output, "SetValue memory upstart/foo\n");
+	TEST_FILE_EQ (output, "RemoveOnEmpty memory upstart/foo\n");
+
+	nih_free (timer);
+	nih_free (request);
+	nih_free (cgroups);
+
+
+	/* Check that an error from the cgroup manager is stored in the
+	 * request, which is still completed.
+	 */
+	TEST_FEATURE ("with error from cgroup manager");
+	cgroups = nih_list_new (NULL);
+	TEST_NE_P (cgroups, NULL);
+	TEST_TRUE (cgroup_add (cgroups, cgroups, "cpu", "fail", NULL, NULL));
+
+	request_handled = 0;
+
+	request = cgroup_request_new (NULL, cgroups, env, FALSE,
+				      my_request_handler, &request_handled);
+
+	TEST_NE_P (request, NULL);
+	TEST_EQ (request->calls, 1);
+
+	timer = nih_timer_add_timeout (NULL, 5, my_request_timeout, NULL);
+
+	ret = nih_main_loop ();
+	TEST_EQ (ret, 0);
+	TEST_EQ (request_handled, 1);
+	TEST_NE_P (request->error, NULL);
+	TEST_ALLOC_PARENT (request->error, request);
+
+	TEST_FILE_EQ (output, "Create cpu fail\n");
+
+	nih_free (timer);
+	nih_free (request);
+	nih_free (cgroups);
+
+
+	/* Check that freeing a request before the replies arrive
+	 * cancels it so the handler is never called.
+	 */
+	TEST_FEATURE ("with request freed before reply");
+	cgroups = nih_list_new (NULL);
+	TEST_NE_P (cgroups, NULL);
+	TEST_TRUE (cgroup_add (cgroups, cgroups, "cpu", "bar", NULL, NULL));
+
+	request_handled = 0;
+
+	request = cgroup_request_new (NULL, cgroups, env, FALSE,
+				      my_request_handler, &request_handled);
+
+	TEST_NE_P (request, NULL);
+	nih_free (request);
+
+	timer = nih_timer_add_timeout (NULL, 1, my_request_timeout, NULL);
+
+	ret = nih_main_loop ();
+	TEST_EQ (ret, 1);
+	TEST_EQ (request_handled, 0);
+
+	TEST_FILE_EQ (output, "Create cpu bar\n");
+
+	nih_free (cgroups);
+
+
+	kill (pid, SIGTERM);
+	waitpid (pid, &status, 0);
+	TEST_TRUE (WIFEXITED (status));
+	TEST_EQ (WEXITSTATUS (status), 0);
+
+	fclose (output);
+
+	nih_free (cgroup_manager_address);
+	cgroup_manager_address = NULL;
+
+	dbus_shutdown ();
+}
+
 void
 test_cgroup_job_start (void)
 {
@@ -382,6 +654,7 @@ main (int   argc,
 	test_cgroup_new ();
 	test_cgroup_name_new ();
 	test_cgroup_setting_new ();
+	test_cgroup_request_new ();
 	test_cgroup_job_start ();
 
 	return 0;
@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <limits.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <nih/macros.h>
@@ -48,6 +49,7 @@
 #include "event.h"
 #include "job_process.h"
 #include "blocked.h"
+#include "session.h"
 #include "test_util.h"
 #include "test_util_common.h"
 
@@ -123,7 +125,25 @@ test_file_new (void)
 		TEST_EQ_P ((void *)nih_hash_lookup (source->files, "/tmp/foo"),
 			   file);
 
+		TEST_NE_P (file->job_entry, NULL);
+		TEST_ALLOC_PARENT (file->job_entry, file);
+		TEST_EQ_P (file->job_entry->file, file);
+		TEST_EQ_STR (file->job_entry->index->name, "foo");
+		TEST_EQ_P ((void *)nih_hash_lookup (conf_job_index, "foo"),
+			   file->job_entry->index);
+
+		TEST_NE_P (file->name_entry, NULL);
+		TEST_EQ_P (file->name_entry->file, file);
+		TEST_EQ_P ((void *)nih_hash_lookup (conf_file_index, "foo"),
+			   file->name_entry->index);
+
 		nih_free (file);
+
+		/* Freeing the only file with a name removes it from
+		 * the indexes.
+		 */
+		TEST_EQ_P (nih_hash_lookup (conf_job_index, "foo"), NULL);
+		TEST_EQ_P (nih_hash_lookup (conf_file_index, "foo"), NULL);
 	}
 
 	nih_free (source);
@@ -133,8 +153,8 @@ void
 test_source_reload_job_dir (void)
 {
 	ConfSource *source;
-	ConfFile   *file, *old_file;
-	JobClass   *job, *old_job;
+	ConfFile   *file, *old_file, *other_file;
+	JobClass   *job, *old_job, *other_job;
 	Job        *instance;
 	FILE       *f;
 	int         ret, fd, nfds;
@@ -142,6 +162,7 @@ test_source_reload_job_dir (void)
 	char        tmpname[PATH_MAX], filename[PATH_MAX];
 	fd_set      readfds, writefds, exceptfds;
 	NihError   *err;
+	struct timespec times[2];
 
 	TEST_FUNCTION_FEATURE ("conf_source_reload",
 			       "with job directory");
@@ -1326,6 +1347,116 @@ no_inotify:
 	nih_free (source);
 
 
+	/* Check that a mandatory reload keeps the ConfFile and JobClass
+	 * of files that have not changed, including one whose timestamp
+	 * changed but whose contents did not, while a file whose contents
+	 * changed without changing size is parsed again.
+	 */
+	TEST_FEATURE ("with reload of unchanged job directory");
+	times[0].tv_sec = times[1].tv_sec = time (NULL) - 3600;
+	times[0].tv_nsec = times[1].tv_nsec = 0;
+
+	strcpy (filename, dirname);
+	strcat (filename, "/foo.conf");
+	assert0 (utimensat (AT_FDCWD, filename, times, 0));
+
+	strcpy (filename, dirname);
+	strcat (filename, "/bar.conf");
+	assert0 (utimensat (AT_FDCWD, filename, times, 0));
+
+	strcpy (filename, dirname);
+	strcat (filename, "/frodo/bar.conf");
+	assert0 (utimensat (AT_FDCWD, filename, times, 0));
+
+	source = conf_source_new (NULL, dirname, CONF_JOB_DIR);
+	ret = conf_source_reload (source);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ_P (source->watch, NULL);
+
+	strcpy (filename, dirname);
+	strcat (filename, "/foo.conf");
+	old_file = (ConfFile *)nih_hash_lookup (source->files, filename);
+	TEST_NE_P (old_file, NULL);
+	old_job = old_file->job;
+	TEST_NE_P (old_job, NULL);
+	TEST_NE (old_file->fingerprint.ino, 0);
+	TEST_FALSE (old_file->fingerprint.racy);
+
+	strcpy (filename, dirname);
+	strcat (filename, "/bar.conf");
+	other_file = (ConfFile *)nih_hash_lookup (source->files, filename);
+	TEST_NE_P (other_file, NULL);
+	other_job = other_file->job;
+	TEST_NE_P (other_job, NULL);
+
+	times[0].tv_sec = times[1].tv_sec = time (NULL) - 1800;
+	assert0 (utimensat (AT_FDCWD, filename, times, 0));
+
+	strcpy (filename, dirname);
+	strcat (filename, "/frodo/bar.conf");
+
+	f = fopen (filename, "w");
+	fprintf (f, "exec /bin/tool --bar\n");
+	fclose (f);
+
+	ret = conf_source_reload (source);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (source->flag, FALSE);
+
+	strcpy (filename, dirname);
+	strcat (filename, "/foo.conf");
+	file = (ConfFile *)nih_hash_lookup (source->files, filename);
+
+	TEST_EQ_P (file, old_file);
+	TEST_EQ (file->flag, source->flag);
+	TEST_EQ_P (file->job, old_job);
+
+	job = (JobClass *)nih_hash_lookup (job_classes, "foo");
+	TEST_EQ_P (job, old_job);
+
+	nih_free (file);
+
+
+	strcpy (filename, dirname);
+	strcat (filename, "/bar.conf");
+	file = (ConfFile *)nih_hash_lookup (source->files, filename);
+
+	TEST_EQ_P (file, other_file);
+	TEST_EQ (file->flag, source->flag);
+	TEST_EQ_P (file->job, other_job);
+	TEST_EQ (file->fingerprint.mtime.tv_sec, times[0].tv_sec);
+
+	job = (JobClass *)nih_hash_lookup (job_classes, "bar");
+	TEST_EQ_P (job, other_job);
+
+	nih_free (file);
+
+
+	strcpy (filename, dirname);
+	strcat (filename, "/frodo/bar.conf");
+	file = (ConfFile *)nih_hash_lookup (source->files, filename);
+
+	TEST_ALLOC_SIZE (file, sizeof (ConfFile));
+	TEST_ALLOC_PARENT (file, source);
+	TEST_EQ (file->flag, source->flag);
+	TEST_NE_P (file->job, NULL);
+
+	job = (JobClass *)nih_hash_lookup (job_classes, "frodo/bar");
+	TEST_EQ_P (file->job, job);
+
+	TEST_NE_P (job->process[PROCESS_MAIN], NULL);
+	TEST_EQ_STR (job->process[PROCESS_MAIN]->command, "/bin/tool --bar");
+
+	nih_free (file);
+
+
+	TEST_HASH_EMPTY (source->files);
+
+	nih_free (source);
+
+
 	/* Check that a physical error parsing a file initially is caught,
 	 * and doesn't affect later jobs.
 	 */
@@ -5095,11 +5226,77 @@ test_select_job (void)
 	TEST_EQ_P (ptr, NULL);
 
 
+	/* Check that once the first file is freed, the job of the next
+	 * source is returned.
+	 */
+	TEST_FEATURE ("with first file freed");
+	nih_free (file1);
+
+	ptr = conf_select_job ("frodo", NULL);
+
+	TEST_EQ_P (ptr, class3);
+
+
 	nih_free (source3);
 	nih_free (source2);
 	nih_free (source1);
 }
 
+void
+test_file_find (void)
+{
+	ConfSource *source1, *source2;
+	ConfFile   *file1, *file2, *file3, *ptr;
+	Session    *session;
+
+	TEST_FUNCTION ("conf_file_find");
+	source1 = conf_source_new (NULL, "/tmp/bar", CONF_JOB_DIR);
+	file1 = conf_file_new (source1, "/tmp/bar/sub/frodo.conf");
+
+	source2 = conf_source_new (NULL, "/tmp/baz", CONF_JOB_DIR);
+	file2 = conf_file_new (source2, "/tmp/baz/frodo.conf");
+	file3 = conf_file_new (source2, "/tmp/baz/bilbo.conf");
+
+	/* Check that the file of the source with the highest priority is
+	 * found by its name, whatever directory it is in.
+	 */
+	TEST_FEATURE ("with multiple files");
+	ptr = conf_file_find ("frodo", NULL);
+
+	TEST_EQ_P (ptr, file1);
+
+
+	/* Check that a file of another session is not found. */
+	TEST_FEATURE ("with other session");
+	session = session_new (NULL, "/mychroot");
+	ptr = conf_file_find ("bilbo", session);
+
+	TEST_EQ_P (ptr, NULL);
+
+	nih_free (session);
+
+
+	/* Check that once a file is freed, the next is found. */
+	TEST_FEATURE ("with first file freed");
+	nih_free (file1);
+
+	ptr = conf_file_find ("frodo", NULL);
+
+	TEST_EQ_P (ptr, file2);
+
+
+	/* Check that when there is no match, NULL is returned. */
+	TEST_FEATURE ("with no match");
+	ptr = conf_file_find ("meep", NULL);
+
+	TEST_EQ_P (ptr, NULL);
+
+	TEST_EQ_P (conf_file_find ("bilbo", NULL), file3);
+
+	nih_free (source2);
+	nih_free (source1);
+}
+
 
 int
 main (int   argc,
@@ -5117,6 +5314,7 @@ main (int   argc,
 	test_override ();
 	test_file_destroy ();
 	test_select_job ();
+	test_file_find ();
 
 	return 0;
 }
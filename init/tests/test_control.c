@@ -57,9 +57,12 @@
 #include "blocked.h"
 #include "job_class.h"
 #include "job.h"
+#include "job_process.h"
 #include "conf.h"
 #include "control.h"
 #include "errors.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "test_util_common.h"
 
@@ -1200,6 +1203,182 @@ test_get_all_jobs (void)
 	}
 }
 
+void
+test_get_job_states (void)
+{
+	NihDBusMessage                  *message = NULL;
+	JobClass                        *class1, *class2;
+	Job                             *job;
+	NihError                        *error;
+	NihDBusError                    *dbus_error;
+	ControlGetJobStatesJobsElement **jobs;
+	int                              ret;
+
+	TEST_FUNCTION ("control_get_job_states");
+	nih_error_init ();
+	job_class_init ();
+
+	class1 = job_class_new (NULL, "frodo", NULL);
+	nih_hash_add (job_classes, &class1->entry);
+
+	class2 = job_class_new (NULL, "bilbo", NULL);
+	nih_hash_add (job_classes, &class2->entry);
+
+	job = job_new (class2, "");
+	job->goal = JOB_START;
+	job->state = JOB_POST_START;
+	job_process_set_pid (job, PROCESS_MAIN, 1000);
+	job_process_set_pid (job, PROCESS_POST_START, 1001);
+
+
+	/* Check that the states of all jobs are returned in an array
+	 * allocated as a child of the message structure, with an element
+	 * for each process of an instance and a single element with no
+	 * goal or state for a job with no instances.
+	 */
+	TEST_FEATURE ("with all jobs");
+	TEST_ALLOC_FAIL {
+		int found1 = FALSE, found2 = FALSE;
+
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_job_states (NULL, message, "", &jobs);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_ALLOC_PARENT (jobs, message);
+		TEST_ALLOC_SIZE (jobs, sizeof (ControlGetJobStatesJobsElement *) * 4);
+		TEST_EQ_P (jobs[3], NULL);
+
+		for (int i = 0; i < 3; i++) {
+			TEST_ALLOC_PARENT (jobs[i], jobs);
+
+			if (! strcmp (jobs[i]->item0, "frodo")) {
+				TEST_EQ_STR (jobs[i]->item1, "");
+				TEST_EQ_STR (jobs[i]->item2, "");
+				TEST_EQ_STR (jobs[i]->item3, "");
+				TEST_EQ_STR (jobs[i]->item4, "");
+				TEST_EQ (jobs[i]->item5, 0);
+				found1 = TRUE;
+			} else if (! found2) {
+				TEST_EQ_STR (jobs[i]->item0, "bilbo");
+				TEST_EQ_STR (jobs[i]->item1, "");
+				TEST_EQ_STR (jobs[i]->item2, "start");
+				TEST_EQ_STR (jobs[i]->item3, "post-start");
+				TEST_EQ_STR (jobs[i]->item4, "main");
+				TEST_EQ (jobs[i]->item5, 1000);
+
+				TEST_EQ_STR (jobs[i + 1]->item0, "bilbo");
+				TEST_EQ_STR (jobs[i + 1]->item1, "");
+				TEST_EQ_STR (jobs[i + 1]->item2, "start");
+				TEST_EQ_STR (jobs[i + 1]->item3, "post-start");
+				TEST_EQ_STR (jobs[i + 1]->item4, "post-start");
+				TEST_EQ (jobs[i + 1]->item5, 1001);
+				found2 = TRUE;
+				i++;
+			}
+		}
+
+		TEST_TRUE (found1);
+		TEST_TRUE (found2);
+
+		nih_free (message);
+	}
+
+
+	/* Check that only the states of the named job are returned when
+	 * a name is given.
+	 */
+	TEST_FEATURE ("with job name");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_job_states (NULL, message, "frodo", &jobs);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_ALLOC_PARENT (jobs, message);
+		TEST_ALLOC_SIZE (jobs, sizeof (ControlGetJobStatesJobsElement *) * 2);
+		TEST_EQ_STR (jobs[0]->item0, "frodo");
+		TEST_EQ_STR (jobs[0]->item2, "");
+		TEST_EQ_P (jobs[1], NULL);
+
+		nih_free (message);
+	}
+
+
+	/* Check that when given the name of an unknown job, the unknown
+	 * job D-Bus error is raised as for GetJobByName.
+	 */
+	TEST_FEATURE ("with unknown job");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_job_states (NULL, message, "sauron", &jobs);
+
+		TEST_LT (ret, 0);
+
+		error = nih_error_get ();
+
+		if (test_alloc_failed
+		    && (error->number == ENOMEM)) {
+			nih_free (error);
+			nih_free (message);
+			continue;
+		}
+
+		TEST_EQ (error->number, NIH_DBUS_ERROR);
+		TEST_ALLOC_SIZE (error, sizeof (NihDBusError));
+
+		dbus_error = (NihDBusError *)error;
+		TEST_EQ_STR (dbus_error->name,
+			     DBUS_INTERFACE_UPSTART ".Error.UnknownJob");
+
+		nih_free (error);
+
+		nih_free (message);
+	}
+
+	nih_free (class2);
+	nih_free (class1);
+}
+
 void
 test_emit_event (void)
 {
@@ -1673,6 +1852,221 @@ test_get_version (void)
 }
 
 
+void
+test_get_stats (void)
+{
+	NihDBusMessage               *message = NULL;
+	ControlGetStatsStatsElement **stats;
+	NihError                     *error;
+	int                           ret;
+
+	TEST_FUNCTION ("control_get_stats");
+	nih_error_init ();
+	job_class_init ();
+
+	/* Check that the function returns an element for every phase
+	 * giving its name, count, total, maximum and buckets, all as
+	 * children of the message structure.
+	 */
+	TEST_FEATURE ("with recorded durations");
+	stats_reset ();
+	stats_record (STATS_EVENT_POLL, stats_now () - 5000000);
+	stats_record (STATS_EVENT_POLL, stats_now () + 1000000000);
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_stats (NULL, message, &stats);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_ALLOC_PARENT (stats, message);
+
+		for (int i = 0; i < STATS_LAST; i++) {
+			TEST_NE_P (stats[i], NULL);
+			TEST_EQ_STR (stats[i]->item0, stats_phase_name (i));
+			TEST_EQ (stats[i]->item4_len, STATS_BUCKETS);
+		}
+		TEST_EQ_P (stats[STATS_LAST], NULL);
+
+		TEST_EQ (stats[STATS_EVENT_POLL]->item1, 2);
+		TEST_GE (stats[STATS_EVENT_POLL]->item2, 5000000);
+		TEST_EQ (stats[STATS_EVENT_POLL]->item3,
+			 stats[STATS_EVENT_POLL]->item2);
+		TEST_EQ (stats[STATS_EVENT_POLL]->item4[0], 1);
+		TEST_EQ (stats[STATS_EVENT_POLL]->item4[13], 1);
+
+		TEST_EQ (stats[STATS_SPAWN]->item1, 0);
+		TEST_EQ (stats[STATS_SPAWN]->item3, 0);
+
+		nih_free (message);
+	}
+
+	stats_reset ();
+}
+
+void
+test_get_log_stats (void)
+{
+	NihDBusMessage *message = NULL;
+	uint64_t        unflushed;
+	uint64_t        dropped;
+	int             ret;
+
+	TEST_FUNCTION ("control_get_log_stats");
+
+	/* Check that the function returns the number of bytes of job
+	 * output held until log files can be written and the number
+	 * dropped.
+	 */
+	TEST_FEATURE ("with unflushed output");
+	log_unflushed_bytes = 1024;
+	log_unflushed_dropped = 256;
+
+	message = nih_new (NULL, NihDBusMessage);
+	message->connection = NULL;
+	message->message = NULL;
+
+	ret = control_get_log_stats (NULL, message, &unflushed, &dropped);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (unflushed, 1024);
+	TEST_EQ (dropped, 256);
+
+	nih_free (message);
+
+	log_unflushed_bytes = 0;
+	log_unflushed_dropped = 0;
+}
+
+
+void
+test_get_trace (void)
+{
+	NihDBusMessage               *message = NULL;
+	ControlGetTraceTraceElement **trace;
+	NihError                     *error;
+	int                           ret;
+
+	TEST_FUNCTION ("control_get_trace");
+	nih_error_init ();
+	job_class_init ();
+
+
+	/* Check that the function returns an empty array when tracing is
+	 * not enabled.
+	 */
+	TEST_FEATURE ("with tracing disabled");
+	trace_size = 0;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_trace (NULL, message, &trace);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_ALLOC_PARENT (trace, message);
+		TEST_EQ_P (trace[0], NULL);
+
+		nih_free (message);
+	}
+
+
+	/* Check that the function returns each record, oldest first,
+	 * as children of the message structure.
+	 */
+	TEST_FEATURE ("with records");
+	trace_size = 16;
+
+	TEST_ALLOC_SAFE {
+		trace_record (TRACE_EVENT_HANDLING, "startup", NULL, NULL);
+		trace_record (TRACE_JOB_STATE, "foo", "", "starting");
+		trace_record (TRACE_EVENT_FINISHED, "startup", NULL, NULL);
+	}
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_trace (NULL, message, &trace);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_ALLOC_PARENT (trace, message);
+
+		TEST_NE_P (trace[0], NULL);
+		TEST_EQ_STR (trace[0]->item1, "event-handling");
+		TEST_EQ_STR (trace[0]->item2, "startup");
+		TEST_EQ_STR (trace[0]->item3, "");
+
+		TEST_NE_P (trace[1], NULL);
+		TEST_EQ_STR (trace[1]->item1, "job");
+		TEST_EQ_STR (trace[1]->item2, "foo");
+		TEST_EQ_STR (trace[1]->item3, "starting");
+		TEST_GE (trace[1]->item0, trace[0]->item0);
+
+		TEST_NE_P (trace[2], NULL);
+		TEST_EQ_STR (trace[2]->item1, "event-finished");
+		TEST_EQ_STR (trace[2]->item2, "startup");
+
+		TEST_EQ_P (trace[3], NULL);
+
+		nih_free (message);
+	}
+
+	trace_clear ();
+	trace_size = 0;
+}
+
+
 void
 test_get_log_priority (void)
 {
@@ -2716,11 +3110,16 @@ main (int   argc,
 
 	test_get_job_by_name ();
 	test_get_all_jobs ();
+	test_get_job_states ();
 
 	test_emit_event ();
 
 	test_get_version ();
 
+	test_get_stats ();
+	test_get_log_stats ();
+	test_get_trace ();
+
 	test_get_log_priority ();
 	test_set_log_priority ();
 
@@ -1108,6 +1108,65 @@ test_append (void)
 	}
 
 	nih_free (new_env);
+
+
+	/* Check that large tables, which are indexed before appending,
+	 * keep their order with replaced entries in their original
+	 * position, new entries at the end and removed entries gone.
+	 */
+	TEST_FEATURE ("with large tables");
+	unsetenv ("BAR");
+
+	new_env = nih_str_array_new (NULL);
+	for (int i = 20; i < 40; i++)
+		assert (environ_set (&new_env, NULL, NULL, TRUE,
+				     "VAR%d=new", i));
+	assert (environ_add (&new_env, NULL, NULL, TRUE, "FOO=apricot"));
+	assert (nih_str_array_add (&new_env, NULL, NULL, "BAR"));
+	assert (environ_add (&new_env, NULL, NULL, TRUE, "TEA=green"));
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			len = 0;
+			env = nih_str_array_new (NULL);
+			assert (environ_add (&env, NULL, &len, TRUE, "FOO=BAR"));
+			assert (environ_add (&env, NULL, &len, TRUE, "BAR=BAZ"));
+			for (int i = 0; i < 30; i++)
+				assert (environ_set (&env, NULL, &len, TRUE,
+						     "VAR%d=old", i));
+		}
+
+		ret = environ_append (&env, NULL, &len, TRUE, new_env);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			nih_free (env);
+			continue;
+		}
+
+		TEST_EQ_P (ret, env);
+		TEST_EQ (len, 42);
+
+		TEST_EQ_STR (env[0], "FOO=apricot");
+		for (int i = 0; i < 20; i++) {
+			nih_local char *expected = NULL;
+
+			expected = NIH_MUST (nih_sprintf (NULL, "VAR%d=old", i));
+			TEST_EQ_STR (env[i + 1], expected);
+		}
+		for (int i = 20; i < 40; i++) {
+			nih_local char *expected = NULL;
+
+			expected = NIH_MUST (nih_sprintf (NULL, "VAR%d=new", i));
+			TEST_EQ_STR (env[i + 1], expected);
+		}
+		TEST_EQ_STR (env[41], "TEA=green");
+		TEST_EQ_P (env[42], NULL);
+
+		nih_free (env);
+	}
+
+	nih_free (new_env);
 }
 
 
@@ -1312,6 +1371,295 @@ test_getn (void)
 }
 
 
+void
+test_table_new (void)
+{
+	EnvironTable  *table;
+	char         **env;
+
+	TEST_FUNCTION ("environ_table_new");
+
+	/* Check that we can index an empty array. */
+	TEST_FEATURE ("with empty environment");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			env = nih_str_array_new (NULL);
+		}
+
+		table = environ_table_new (env, env);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (table, NULL);
+			nih_free (env);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (table, sizeof (EnvironTable));
+		TEST_ALLOC_PARENT (table, env);
+		TEST_EQ_P (table->env, env);
+		TEST_EQ (table->len, 0);
+		TEST_ALLOC_PARENT (table->index, table);
+
+		nih_free (env);
+	}
+
+
+	/* Check that the entries of the array can be found, and that only
+	 * the first of duplicate entries is indexed.
+	 */
+	TEST_FEATURE ("with environment");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			env = nih_str_array_new (NULL);
+			assert (nih_str_array_add (&env, NULL, NULL, "FOO=BAR"));
+			assert (nih_str_array_add (&env, NULL, NULL, "BAR=BAZ"));
+			assert (nih_str_array_add (&env, NULL, NULL, "FOO=WIBBLE"));
+		}
+
+		table = environ_table_new (env, env);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (table, NULL);
+			nih_free (env);
+			continue;
+		}
+
+		TEST_EQ_P (table->env, env);
+		TEST_EQ (table->len, 3);
+
+		TEST_EQ_P (environ_table_lookup (table, "FOO", 3), &env[0]);
+		TEST_EQ_P (environ_table_lookup (table, "BAR", 3), &env[1]);
+
+		nih_free (env);
+	}
+}
+
+void
+test_table_add (void)
+{
+	EnvironTable  *table;
+	char         **env, **ret;
+
+	TEST_FUNCTION ("environ_table_add");
+
+	/* Check that a new variable is appended to the table and may be
+	 * looked up afterwards.
+	 */
+	TEST_FEATURE ("with new variable");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			env = nih_str_array_new (NULL);
+			table = environ_table_new (env, env);
+			assert (environ_table_add (table, TRUE, "FOO=BAR"));
+		}
+
+		ret = environ_table_add (table, TRUE, "FRODO=BAGGINS");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+
+			TEST_EQ (table->len, 1);
+			TEST_EQ_STR (table->env[0], "FOO=BAR");
+			TEST_EQ_P (table->env[1], NULL);
+			TEST_EQ_P (environ_table_lookup (table, "FRODO", 5),
+				   NULL);
+
+			nih_free (table->env);
+			continue;
+		}
+
+		TEST_EQ_P (ret, table->env);
+		TEST_ALLOC_PARENT (table, table->env);
+
+		TEST_EQ (table->len, 2);
+		TEST_EQ_STR (table->env[0], "FOO=BAR");
+		TEST_ALLOC_PARENT (table->env[1], table->env);
+		TEST_EQ_STR (table->env[1], "FRODO=BAGGINS");
+		TEST_EQ_P (table->env[2], NULL);
+
+		TEST_EQ_P (environ_table_lookup (table, "FRODO", 5),
+			   &table->env[1]);
+
+		nih_free (table->env);
+	}
+
+
+	/* Check that replacing a variable keeps its position. */
+	TEST_FEATURE ("with replacement variable");
+	env = nih_str_array_new (NULL);
+	table = environ_table_new (env, env);
+	assert (environ_table_add (table, TRUE, "FOO=BAR"));
+	assert (environ_table_add (table, TRUE, "BAR=BAZ"));
+
+	ret = environ_table_add (table, TRUE, "FOO=APRICOT");
+
+	TEST_EQ_P (ret, table->env);
+	TEST_EQ (table->len, 2);
+	TEST_EQ_STR (table->env[0], "FOO=APRICOT");
+	TEST_EQ_STR (table->env[1], "BAR=BAZ");
+	TEST_EQ_P (table->env[2], NULL);
+	TEST_EQ_STR (environ_table_get (table, "FOO"), "APRICOT");
+
+	nih_free (table->env);
+
+
+	/* Check that an existing variable is kept when not replacing. */
+	TEST_FEATURE ("with existing variable and no replace");
+	env = nih_str_array_new (NULL);
+	table = environ_table_new (env, env);
+	assert (environ_table_add (table, TRUE, "FOO=BAR"));
+
+	ret = environ_table_add (table, FALSE, "FOO=APRICOT");
+
+	TEST_EQ_P (ret, table->env);
+	TEST_EQ (table->len, 1);
+	TEST_EQ_STR (table->env[0], "FOO=BAR");
+	TEST_EQ_P (table->env[1], NULL);
+
+	nih_free (table->env);
+
+
+	/* Check that replacing a variable with one not set in our own
+	 * environment removes it, with the following entries still found.
+	 */
+	TEST_FEATURE ("with replacement variable not in environment");
+	unsetenv ("FOO");
+
+	env = nih_str_array_new (NULL);
+	table = environ_table_new (env, env);
+	assert (environ_table_add (table, TRUE, "FOO=BAR"));
+	assert (environ_table_add (table, TRUE, "BAR=BAZ"));
+	assert (environ_table_add (table, TRUE, "FRODO=BAGGINS"));
+
+	ret = environ_table_add (table, TRUE, "FOO");
+
+	TEST_EQ_P (ret, table->env);
+	TEST_EQ (table->len, 2);
+	TEST_EQ_STR (table->env[0], "BAR=BAZ");
+	TEST_EQ_STR (table->env[1], "FRODO=BAGGINS");
+	TEST_EQ_P (table->env[2], NULL);
+
+	TEST_EQ_P (environ_table_lookup (table, "FOO", 3), NULL);
+	TEST_EQ_P (environ_table_lookup (table, "BAR", 3), &table->env[0]);
+	TEST_EQ_P (environ_table_lookup (table, "FRODO", 5),
+		   &table->env[1]);
+
+	nih_free (table->env);
+}
+
+void
+test_table_remove (void)
+{
+	EnvironTable  *table;
+	char         **env;
+
+	TEST_FUNCTION ("environ_table_remove");
+
+	/* Check that every entry for the variable is removed, and that
+	 * the entries following them are still found.
+	 */
+	TEST_FEATURE ("with variable in table");
+	env = nih_str_array_new (NULL);
+	assert (nih_str_array_add (&env, NULL, NULL, "FOO=BAR"));
+	assert (nih_str_array_add (&env, NULL, NULL, "BAR=BAZ"));
+	assert (nih_str_array_add (&env, NULL, NULL, "FOO=WIBBLE"));
+	assert (nih_str_array_add (&env, NULL, NULL, "FRODO=BAGGINS"));
+	table = environ_table_new (env, env);
+	assert (table != NULL);
+
+	environ_table_remove (table, "FOO");
+
+	TEST_EQ (table->len, 2);
+	TEST_EQ_STR (table->env[0], "BAR=BAZ");
+	TEST_EQ_STR (table->env[1], "FRODO=BAGGINS");
+	TEST_EQ_P (table->env[2], NULL);
+
+	TEST_EQ_P (environ_table_lookup (table, "FOO", 3), NULL);
+	TEST_EQ_P (environ_table_lookup (table, "BAR", 3), &table->env[0]);
+	TEST_EQ_P (environ_table_lookup (table, "FRODO", 5),
+		   &table->env[1]);
+
+	nih_free (table->env);
+
+
+	/* Check that removing a variable not in the table, or one whose
+	 * name is a prefix of another, leaves the table unchanged.
+	 */
+	TEST_FEATURE ("with variable not in table");
+	env = nih_str_array_new (NULL);
+	assert (nih_str_array_add (&env, NULL, NULL, "FOOLISH=no"));
+	table = environ_table_new (env, env);
+	assert (table != NULL);
+
+	environ_table_remove (table, "FOO");
+
+	TEST_EQ (table->len, 1);
+	TEST_EQ_STR (table->env[0], "FOOLISH=no");
+	TEST_EQ_P (table->env[1], NULL);
+
+	nih_free (table->env);
+}
+
+void
+test_table_lookup (void)
+{
+	EnvironTable  *table;
+	char         **env;
+	char * const  *ret;
+
+	TEST_FUNCTION ("environ_table_lookup");
+	env = nih_str_array_new (NULL);
+	table = environ_table_new (env, env);
+
+
+	/* Check that an empty table always returns NULL. */
+	TEST_FEATURE ("with empty table");
+	ret = environ_table_lookup (table, "FOO", 3);
+
+	TEST_EQ_P (ret, NULL);
+
+
+	assert (environ_table_add (table, TRUE, "FOOLISH=no"));
+	assert (environ_table_add (table, TRUE, "BAR=BAZ"));
+
+
+	/* Check that a key that is present is returned. */
+	TEST_FEATURE ("with key to be found");
+	ret = environ_table_lookup (table, "BAR", 3);
+
+	TEST_EQ_P (ret, &table->env[1]);
+
+
+	/* Check that a key that doesn't exist returns NULL. */
+	TEST_FEATURE ("with key not found");
+	ret = environ_table_lookup (table, "MEEP", 4);
+
+	TEST_EQ_P (ret, NULL);
+
+
+	/* Check that the key is not prefix-matched. */
+	TEST_FEATURE ("with key that is prefix of another");
+	ret = environ_table_lookup (table, "FOO", 3);
+
+	TEST_EQ_P (ret, NULL);
+
+
+	/* Check that the length is honoured. */
+	TEST_FEATURE ("with longer key");
+	ret = environ_table_lookup (table, "FOOLISH", 3);
+
+	TEST_EQ_P (ret, NULL);
+
+
+	/* Check that the value can be retrieved. */
+	TEST_FEATURE ("with value");
+	TEST_EQ_STR (environ_table_getn (table, "FOOLISH", 7), "no");
+
+
+	nih_free (table->env);
+}
+
+
 void
 test_all_valid (void)
 {
@@ -2005,6 +2353,10 @@ main (int   argc,
 	test_lookup ();
 	test_get ();
 	test_getn ();
+	test_table_new ();
+	test_table_add ();
+	test_table_remove ();
+	test_table_lookup ();
 	test_all_valid ();
 	test_expand ();
 
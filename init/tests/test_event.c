@@ -37,10 +37,14 @@
 
 #include "control.h"
 #include "job.h"
+#include "job_process.h"
 #include "event.h"
 #include "blocked.h"
 
 
+extern int coalesce_signals;
+
+
 void
 test_new (void)
 {
@@ -89,6 +93,7 @@ test_new (void)
 
 		TEST_EQ_P (event->env, env);
 		TEST_ALLOC_PARENT (event->env, event);
+		TEST_EQ_P (event->table, NULL);
 
 		nih_free (event);
 	}
@@ -138,10 +143,14 @@ void
 test_poll (void)
 {
 	Event *event = NULL;
+	JobClass       *class = NULL;
+	Job            *job = NULL;
 	pid_t           dbus_pid;
 	DBusError       dbus_error;
 	DBusConnection *conn, *client_conn;
 	DBusMessage    *message;
+	DBusMessageIter iter, arrayiter, structiter, enviter;
+	const char     *str_value;
 	NihListEntry   *entry;
 
 	TEST_FUNCTION ("event_poll");
@@ -251,6 +260,101 @@ test_poll (void)
 		TEST_FREE (event);
 	}
 
+
+	/* Check that when signals are coalesced, goal and state changes
+	 * queued before the pass and the events emitted during it are
+	 * also sent as a single JobStatesChanged and EventsEmitted signal
+	 * after the individual signals.
+	 */
+	TEST_FEATURE ("with coalesced signals");
+	coalesce_signals = TRUE;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			class = job_class_new (NULL, "test", NULL);
+			job = job_new (class, "");
+			job->goal = JOB_START;
+			job->state = JOB_STARTING;
+
+			event = event_new (NULL, "test", NULL);
+			NIH_MUST (nih_str_array_add (&event->env, event,
+						     NULL, "FOO=BAR"));
+		}
+
+		TEST_FREE_TAG (event);
+
+		control_queue_job_state (job);
+
+		event_poll ();
+
+		TEST_FREE (event);
+
+		TEST_DBUS_MESSAGE (client_conn, message);
+		TEST_TRUE (dbus_message_is_signal (message, DBUS_INTERFACE_UPSTART,
+						   "EventEmitted"));
+
+		dbus_message_unref (message);
+
+		TEST_DBUS_MESSAGE (client_conn, message);
+		TEST_TRUE (dbus_message_is_signal (message, DBUS_INTERFACE_UPSTART,
+						   "JobStatesChanged"));
+
+		dbus_message_iter_init (message, &iter);
+		TEST_EQ (dbus_message_iter_get_arg_type (&iter), DBUS_TYPE_ARRAY);
+		dbus_message_iter_recurse (&iter, &arrayiter);
+
+		TEST_EQ (dbus_message_iter_get_arg_type (&arrayiter),
+			 DBUS_TYPE_STRUCT);
+		dbus_message_iter_recurse (&arrayiter, &structiter);
+
+		dbus_message_iter_get_basic (&structiter, &str_value);
+		TEST_EQ_STR (str_value, job->path);
+		dbus_message_iter_next (&structiter);
+
+		dbus_message_iter_get_basic (&structiter, &str_value);
+		TEST_EQ_STR (str_value, "start");
+		dbus_message_iter_next (&structiter);
+
+		dbus_message_iter_get_basic (&structiter, &str_value);
+		TEST_EQ_STR (str_value, "starting");
+
+		TEST_FALSE (dbus_message_iter_next (&arrayiter));
+
+		dbus_message_unref (message);
+
+		TEST_DBUS_MESSAGE (client_conn, message);
+		TEST_TRUE (dbus_message_is_signal (message, DBUS_INTERFACE_UPSTART,
+						   "EventsEmitted"));
+
+		dbus_message_iter_init (message, &iter);
+		TEST_EQ (dbus_message_iter_get_arg_type (&iter), DBUS_TYPE_ARRAY);
+		dbus_message_iter_recurse (&iter, &arrayiter);
+
+		TEST_EQ (dbus_message_iter_get_arg_type (&arrayiter),
+			 DBUS_TYPE_STRUCT);
+		dbus_message_iter_recurse (&arrayiter, &structiter);
+
+		dbus_message_iter_get_basic (&structiter, &str_value);
+		TEST_EQ_STR (str_value, "test");
+		dbus_message_iter_next (&structiter);
+
+		TEST_EQ (dbus_message_iter_get_arg_type (&structiter),
+			 DBUS_TYPE_ARRAY);
+		dbus_message_iter_recurse (&structiter, &enviter);
+
+		dbus_message_iter_get_basic (&enviter, &str_value);
+		TEST_EQ_STR (str_value, "FOO=BAR");
+
+		TEST_FALSE (dbus_message_iter_next (&enviter));
+		TEST_FALSE (dbus_message_iter_next (&arrayiter));
+
+		dbus_message_unref (message);
+
+		nih_free (class);
+	}
+
+	coalesce_signals = FALSE;
+
 	nih_free (entry);
 
 	TEST_DBUS_CLOSE (conn);
@@ -287,7 +391,7 @@ test_pending (void)
 			class->start_on = event_operator_new (
 				class, EVENT_MATCH, "test", NULL);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -345,7 +449,7 @@ test_pending_handle_jobs (void)
 			class->start_on = event_operator_new (
 				class, EVENT_MATCH, "wibble", NULL);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -391,7 +495,7 @@ test_pending_handle_jobs (void)
 			nih_tree_add (&class->start_on->node, &oper->node,
 				      NIH_TREE_RIGHT);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -456,7 +560,7 @@ test_pending_handle_jobs (void)
 			nih_tree_add (&class->start_on->node, &oper->node,
 				      NIH_TREE_RIGHT);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -573,7 +677,7 @@ test_pending_handle_jobs (void)
 			nih_tree_add (&class->start_on->node, &oper->node,
 				      NIH_TREE_RIGHT);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 
@@ -700,7 +804,7 @@ test_pending_handle_jobs (void)
 			nih_tree_add (&class->start_on->node, &oper->node,
 				      NIH_TREE_RIGHT);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 
 			job = job_new (class, "");
 			job->goal = JOB_STOP;
@@ -869,7 +973,7 @@ test_pending_handle_jobs (void)
 			nih_tree_add (&class->start_on->node, &oper->node,
 				      NIH_TREE_RIGHT);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 
 			job = job_new (class, "");
 			job->goal = JOB_START;
@@ -981,7 +1085,7 @@ test_pending_handle_jobs (void)
 			class->start_on = event_operator_new (
 				class, EVENT_MATCH, "wibble", NULL);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1061,7 +1165,7 @@ test_pending_handle_jobs (void)
 			class->start_on = event_operator_new (
 				class, EVENT_MATCH, "wibble", NULL);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 
 			job = job_new (class, "brandybuck");
 			job->goal = JOB_STOP;
@@ -1146,7 +1250,7 @@ test_pending_handle_jobs (void)
 			class->start_on = event_operator_new (
 				class, EVENT_MATCH, "wibble", NULL);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		TEST_DIVERT_STDERR (output) {
@@ -1196,7 +1300,7 @@ test_pending_handle_jobs (void)
 			job->goal = JOB_START;
 			job->state = JOB_RUNNING;
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1245,7 +1349,7 @@ test_pending_handle_jobs (void)
 			job->goal = JOB_START;
 			job->state = JOB_RUNNING;
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1321,7 +1425,7 @@ test_pending_handle_jobs (void)
 			job->goal = JOB_START;
 			job->state = JOB_RUNNING;
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1425,7 +1529,7 @@ test_pending_handle_jobs (void)
 			TEST_FREE_TAG (blocked2);
 			TEST_FREE_TAG (event4);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1536,7 +1640,7 @@ test_pending_handle_jobs (void)
 			TEST_FREE_TAG (blocked2);
 			TEST_FREE_TAG (event4);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1607,7 +1711,7 @@ test_pending_handle_jobs (void)
 			assert (nih_str_array_add (&(job->env), job,
 						   NULL, "COLOUR=GOLD"));
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1692,7 +1796,7 @@ test_finished (void)
 			class->start_on = event_operator_new (
 				class, EVENT_MATCH, "test/failed", NULL);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1727,7 +1831,7 @@ test_finished (void)
 			class->start_on = event_operator_new (
 				class, EVENT_MATCH, "test/failed", NULL);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1780,7 +1884,7 @@ test_finished (void)
 			nih_tree_add (&class->start_on->node, &oper->node,
 				      NIH_TREE_RIGHT);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1812,7 +1916,7 @@ test_finished (void)
 			job->state = JOB_STOPPING;
 			job->blocker = NULL;
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1846,7 +1950,7 @@ test_finished (void)
 			job->state = JOB_STARTING;
 			job->blocker = NULL;
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1886,7 +1990,7 @@ test_finished (void)
 
 			TEST_FREE_TAG (blocked);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1929,7 +2033,7 @@ test_finished (void)
 
 			TEST_FREE_TAG (blocked);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -1965,7 +2069,7 @@ test_finished (void)
 			job = job_new (class, "");
 			job->goal = JOB_STOP;
 			job->state = JOB_STOPPING;
-			job->pid[PROCESS_POST_STOP] = 0;
+			job_process_set_pid (job, PROCESS_POST_STOP, 0);
 
 			job->blocker = event;
 
@@ -1974,7 +2078,7 @@ test_finished (void)
 
 			TEST_FREE_TAG (blocked);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -2011,7 +2115,7 @@ test_finished (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_STARTING;
-			job->pid[PROCESS_PRE_START] = 0;
+			job_process_set_pid (job, PROCESS_PRE_START, 0);
 
 			job->blocker = event;
 
@@ -2020,7 +2124,7 @@ test_finished (void)
 
 			TEST_FREE_TAG (blocked);
 
-			nih_hash_add (job_classes, &class->entry);
+			job_class_add_safe (class);
 		}
 
 		event_poll ();
@@ -105,6 +105,9 @@ test_operator_new (void)
 		TEST_EQ_P (oper->env, env);
 		TEST_ALLOC_PARENT (oper->env, oper);
 
+		TEST_EQ (oper->num_matches, 2);
+		TEST_ALLOC_PARENT (oper->matches, oper);
+
 		TEST_EQ_P (oper->event, NULL);
 
 		nih_free (oper);
@@ -525,6 +528,118 @@ test_operator_update (void)
 	nih_free (oper3);
 }
 
+void
+test_operator_compile (void)
+{
+	EventOperator  *oper;
+	char          **env;
+	int             ret;
+
+	TEST_FUNCTION ("event_operator_compile");
+
+
+	/* Check that each environment entry is compiled into a match
+	 * recording the name, negation and kind of value found within it,
+	 * with the name and value pointing into the original string.
+	 */
+	TEST_FEATURE ("with environment");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			env = nih_str_array_new (NULL);
+			NIH_MUST (nih_str_array_add (&env, NULL,
+						     NULL, "foo"));
+			NIH_MUST (nih_str_array_add (&env, NULL,
+						     NULL, "BAR=fr?do"));
+			NIH_MUST (nih_str_array_add (&env, NULL,
+						     NULL, "BAZ!=$WIBBLE"));
+
+			oper = event_operator_new (NULL, EVENT_MATCH,
+						   "test", NULL);
+			oper->env = env;
+			nih_ref (oper->env, oper);
+			nih_discard (env);
+		}
+
+		ret = event_operator_compile (oper);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ_P (oper->matches, NULL);
+			TEST_EQ (oper->num_matches, 0);
+
+			nih_free (oper);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_EQ (oper->num_matches, 3);
+		TEST_ALLOC_PARENT (oper->matches, oper);
+
+		TEST_EQ_P (oper->matches[0].source, oper->env[0]);
+		TEST_EQ_P (oper->matches[0].key, NULL);
+		TEST_EQ (oper->matches[0].position, 0);
+		TEST_FALSE (oper->matches[0].negate);
+		TEST_EQ (oper->matches[0].type, EVENT_MATCH_LITERAL);
+		TEST_EQ_P (oper->matches[0].value, oper->env[0]);
+
+		TEST_EQ_P (oper->matches[1].source, oper->env[1]);
+		TEST_EQ_P (oper->matches[1].key, oper->env[1]);
+		TEST_EQ (oper->matches[1].keylen, 3);
+		TEST_FALSE (oper->matches[1].negate);
+		TEST_EQ (oper->matches[1].type, EVENT_MATCH_GLOB);
+		TEST_EQ_STR (oper->matches[1].value, "fr?do");
+
+		TEST_EQ_P (oper->matches[2].source, oper->env[2]);
+		TEST_EQ_P (oper->matches[2].key, oper->env[2]);
+		TEST_EQ (oper->matches[2].keylen, 3);
+		TEST_TRUE (oper->matches[2].negate);
+		TEST_EQ (oper->matches[2].type, EVENT_MATCH_EXPAND);
+		TEST_EQ_STR (oper->matches[2].value, "$WIBBLE");
+
+		nih_free (oper);
+	}
+
+
+	/* Check that an operator without environment compiles to no
+	 * matches at all.
+	 */
+	TEST_FEATURE ("without environment");
+	oper = event_operator_new (NULL, EVENT_MATCH, "test", NULL);
+
+	ret = event_operator_compile (oper);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ_P (oper->matches, NULL);
+	TEST_EQ (oper->num_matches, 0);
+
+	nih_free (oper);
+
+
+	/* Check that operators parsed from a job's start on condition
+	 * are compiled as they are parsed.
+	 */
+	TEST_FEATURE ("with parsed operator");
+	TEST_ALLOC_SAFE {
+		JobClass *class;
+		char      buf[] = "start on foo BAR=baz\n";
+		size_t    pos = 0, lineno = 1;
+
+		class = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				   &pos, &lineno);
+		TEST_NE_P (class, NULL);
+
+		oper = class->start_on;
+		TEST_EQ (oper->type, EVENT_MATCH);
+		TEST_EQ (oper->num_matches, 1);
+		TEST_EQ_P (oper->matches[0].source, oper->env[0]);
+		TEST_EQ (oper->matches[0].type, EVENT_MATCH_LITERAL);
+		TEST_EQ_STR (oper->matches[0].value, "baz");
+
+		nih_free (class);
+	}
+}
+
 void
 test_operator_match (void)
 {
@@ -752,6 +867,30 @@ test_operator_match (void)
 	TEST_TRUE (event_operator_match (oper, event, NULL));
 
 
+	/* Check that a value following a variable is matched by its
+	 * position among the values, not relative to where the variable
+	 * was found.
+	 */
+	TEST_FEATURE ("with value after variable list");
+	event->env = env1;
+	event->env[0] = "FRODO=foo";
+	event->env[1] = "BILBO=bar";
+	event->env[2] = "MERRY=baz";
+	event->env[3] = NULL;
+
+	oper->env = env2;
+	oper->env[0] = "foo";
+	oper->env[1] = "MERRY=baz";
+	oper->env[2] = "bar";
+	oper->env[3] = NULL;
+
+	TEST_TRUE (event_operator_match (oper, event, NULL));
+
+	oper->env[2] = "baz";
+
+	TEST_FALSE (event_operator_match (oper, event, NULL));
+
+
 	/* Check that unknown variable names never match. */
 	TEST_FEATURE ("with unknown variable in operator");
 	event->env = env1;
@@ -766,6 +905,31 @@ test_operator_match (void)
 	TEST_FALSE (event_operator_match (oper, event, NULL));
 
 
+	/* Check that a literal operator value must match the whole of
+	 * the event value, not merely a prefix of it.
+	 */
+	TEST_FEATURE ("with literal prefix of value");
+	event->env = env1;
+	event->env[0] = "FRODO=foo";
+	event->env[1] = "BILBO=bar";
+	event->env[2] = NULL;
+
+	oper->env = env2;
+	oper->env[0] = "BILBO=ba";
+	oper->env[1] = NULL;
+
+	TEST_FALSE (event_operator_match (oper, event, NULL));
+
+
+	/* Check that changing the operator environment after a match
+	 * causes it to be compiled again.
+	 */
+	TEST_FEATURE ("with operator environment changed after match");
+	oper->env[0] = "BILBO=bar";
+
+	TEST_TRUE (event_operator_match (oper, event, NULL));
+
+
 	/* Check that the operator environment may be globs. */
 	TEST_FEATURE ("with globs in operator environment");
 	event->env = env1;
@@ -831,6 +995,35 @@ test_operator_match (void)
 	TEST_FALSE (event_operator_match (oper, event, env));
 
 
+	/* Check that named variables are found using the index of the
+	 * event environment while it's being handled, and that only the
+	 * first entry for a variable is considered.
+	 */
+	TEST_FEATURE ("with indexed event environment");
+	event->env = env1;
+	event->env[0] = "FRODO=foo";
+	event->env[1] = "BILBO=bar";
+	event->env[2] = "FRODO=baz";
+	event->env[3] = NULL;
+
+	event->table = environ_table_new (NULL, event->env);
+	TEST_NE_P (event->table, NULL);
+
+	oper->env = env2;
+	oper->env[0] = "BILBO=bar";
+	oper->env[1] = "FRODO=foo";
+	oper->env[2] = NULL;
+
+	TEST_TRUE (event_operator_match (oper, event, NULL));
+
+	oper->env[1] = "FRODO=baz";
+
+	TEST_FALSE (event_operator_match (oper, event, NULL));
+
+	nih_free (event->table);
+	event->table = NULL;
+
+
 	nih_free (oper);
 	nih_free (event);
 }
@@ -1443,6 +1636,7 @@ main (int   argc,
 	test_operator_copy ();
 	test_operator_destroy ();
 	test_operator_update ();
+	test_operator_compile ();
 	test_operator_match ();
 	test_operator_handle ();
 	test_operator_environment ();
@@ -167,6 +167,12 @@ test_new (void)
 		TEST_EQ (job->trace_forks, 0);
 		TEST_EQ (job->trace_state, TRACE_NONE);
 
+		TEST_EQ (job->listen_fd, -1);
+		TEST_EQ (job->listen_socket, -1);
+
+		TEST_EQ (job->notify_fd, -1);
+		TEST_EQ_P (job->notify_watch, NULL);
+
 		TEST_NE_P (job->log, NULL);
 		TEST_ALLOC_SIZE (job->log, sizeof (Log *) * PROCESS_LAST);
 		for (i = 0; i < PROCESS_LAST; i++) {
@@ -533,7 +539,7 @@ test_change_goal (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_KILLED;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job_change_goal (job, JOB_START);
 
@@ -558,7 +564,7 @@ test_change_goal (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job_change_goal (job, JOB_START);
 
@@ -583,7 +589,7 @@ test_change_goal (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job_change_goal (job, JOB_STOP);
 
@@ -653,7 +659,7 @@ test_change_goal (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_PRE_START] = 1;
+		job_process_set_pid (job, PROCESS_PRE_START, 1);
 
 		job_change_goal (job, JOB_STOP);
 
@@ -1066,7 +1072,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SECURITY;
-		job->pid[PROCESS_PRE_START] = 0;
+		job_process_set_pid (job, PROCESS_PRE_START, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1133,7 +1139,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SECURITY;
-		job->pid[PROCESS_MAIN] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1209,7 +1215,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SECURITY;
-		job->pid[PROCESS_PRE_START] = 0;
+		job_process_set_pid (job, PROCESS_PRE_START, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1297,7 +1303,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_MAIN] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1367,7 +1373,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_MAIN] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1449,7 +1455,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_MAIN] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1590,7 +1596,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_MAIN] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1679,7 +1685,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_MAIN] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1747,8 +1753,8 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_POST_START] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_POST_START, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1815,7 +1821,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1879,7 +1885,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -1951,7 +1957,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -2012,7 +2018,7 @@ test_change_state (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -2080,8 +2086,8 @@ test_change_state (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_PRE_STOP] = 0;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_PRE_STOP, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -2148,7 +2154,7 @@ test_change_state (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -2221,7 +2227,7 @@ test_change_state (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -2306,7 +2312,7 @@ test_change_state (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -2387,7 +2393,7 @@ test_change_state (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -3061,7 +3067,7 @@ test_change_state (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_STOPPING;
-		job->pid[PROCESS_POST_STOP] = 0;
+		job_process_set_pid (job, PROCESS_POST_STOP, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -3125,7 +3131,7 @@ test_change_state (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_KILLED;
-		job->pid[PROCESS_POST_STOP] = 0;
+		job_process_set_pid (job, PROCESS_POST_STOP, 0);
 
 		job->blocker = NULL;
 		cause->failed = FALSE;
@@ -4188,7 +4194,7 @@ test_next_state (void)
 	TEST_FEATURE ("with running job and a goal of stop");
 	job->goal = JOB_STOP;
 	job->state = JOB_RUNNING;
-	job->pid[PROCESS_MAIN] = 1;
+	job_process_set_pid (job, PROCESS_MAIN, 1);
 
 	TEST_EQ (job_next_state (job), JOB_PRE_STOPPING);
 
@@ -4199,7 +4205,7 @@ test_next_state (void)
 	TEST_FEATURE ("with pre-stopping job and a goal of stop");
 	job->goal = JOB_STOP;
 	job->state = JOB_PRE_STOPPING;
-	job->pid[PROCESS_MAIN] = 1;
+	job_process_set_pid (job, PROCESS_MAIN, 1);
 
 	TEST_EQ (job_next_state (job), JOB_PRE_STOP);
 
@@ -4211,7 +4217,7 @@ test_next_state (void)
 	TEST_FEATURE ("with dead running job and a goal of stop");
 	job->goal = JOB_STOP;
 	job->state = JOB_RUNNING;
-	job->pid[PROCESS_MAIN] = 0;
+	job_process_set_pid (job, PROCESS_MAIN, 0);
 
 	TEST_EQ (job_next_state (job), JOB_STOPPING);
 
@@ -7138,7 +7144,7 @@ test_get_processes (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_PRE_START;
-			job->pid[PROCESS_PRE_START] = 1014;
+			job_process_set_pid (job, PROCESS_PRE_START, 1014);
 
 			message = nih_new (NULL, NihDBusMessage);
 			message->connection = NULL;
@@ -7193,7 +7199,7 @@ test_get_processes (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_POST_START;
-			job->pid[PROCESS_POST_START] = 2137;
+			job_process_set_pid (job, PROCESS_POST_START, 2137);
 
 			message = nih_new (NULL, NihDBusMessage);
 			message->connection = NULL;
@@ -7247,7 +7253,7 @@ test_get_processes (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_RUNNING;
-			job->pid[PROCESS_MAIN] = 3648;
+			job_process_set_pid (job, PROCESS_MAIN, 3648);
 
 			message = nih_new (NULL, NihDBusMessage);
 			message->connection = NULL;
@@ -7304,8 +7310,8 @@ test_get_processes (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_POST_START;
-			job->pid[PROCESS_POST_START] = 2137;
-			job->pid[PROCESS_MAIN] = 3648;
+			job_process_set_pid (job, PROCESS_POST_START, 2137);
+			job_process_set_pid (job, PROCESS_MAIN, 3648);
 
 			message = nih_new (NULL, NihDBusMessage);
 			message->connection = NULL;
@@ -7368,8 +7374,8 @@ test_get_processes (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_PRE_STOP;
-			job->pid[PROCESS_MAIN] = 3648;
-			job->pid[PROCESS_PRE_STOP] = 7864;
+			job_process_set_pid (job, PROCESS_MAIN, 3648);
+			job_process_set_pid (job, PROCESS_PRE_STOP, 7864);
 
 			message = nih_new (NULL, NihDBusMessage);
 			message->connection = NULL;
@@ -7430,7 +7436,7 @@ test_get_processes (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_PRE_STOP;
-			job->pid[PROCESS_PRE_STOP] = 7864;
+			job_process_set_pid (job, PROCESS_PRE_STOP, 7864);
 
 			message = nih_new (NULL, NihDBusMessage);
 			message->connection = NULL;
@@ -7484,7 +7490,7 @@ test_get_processes (void)
 			job = job_new (class, "");
 			job->goal = JOB_START;
 			job->state = JOB_POST_STOP;
-			job->pid[PROCESS_POST_STOP] = 9764;
+			job_process_set_pid (job, PROCESS_POST_STOP, 9764);
 
 			message = nih_new (NULL, NihDBusMessage);
 			message->connection = NULL;
@@ -7587,7 +7593,7 @@ test_deserialise_ptrace (void)
 		TEST_NE_P (job, NULL);
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 		job->trace_forks = 0;
 		job->trace_state = TRACE_NORMAL;
 
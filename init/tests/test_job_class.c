@@ -128,6 +128,9 @@ test_new (void)
 		TEST_EQ (class->respawn, FALSE);
 		TEST_EQ (class->respawn_limit, 10);
 		TEST_EQ (class->respawn_interval, 5);
+		TEST_EQ (class->respawn_delay, 0);
+		TEST_EQ (class->respawn_delay_max, 300);
+		TEST_EQ (class->respawn_stable, 300);
 
 		TEST_EQ_P (class->normalexit, NULL);
 		TEST_EQ (class->normalexit_len, 0);
@@ -149,10 +152,18 @@ test_new (void)
 
 		TEST_EQ_P (class->apparmor_switch, NULL);
 
+		TEST_EQ_P (class->concurrency_group, NULL);
+		TEST_EQ (class->concurrency_limit, 0);
+		TEST_EQ (class->priority, 0);
+
 		TEST_FALSE (class->deleted);
 
 		TEST_LIST_EMPTY (&class->cgroups);
 
+		TEST_LIST_EMPTY (&class->listen);
+		TEST_FALSE (class->listen_accept);
+		TEST_EQ (class->listen_serial, 0);
+
 		nih_free (class);
 	}
 }
@@ -780,6 +791,127 @@ test_reconsider (void)
 }
 
 
+void
+test_event_classes (void)
+{
+	ConfSource    *source;
+	ConfFile      *file1, *file2;
+	JobClass      *class1, *class2;
+	EventOperator *oper;
+	NihList       *classes;
+	NihListEntry  *entry;
+
+	TEST_FUNCTION ("job_class_event_classes");
+	job_class_init ();
+
+	source = conf_source_new (NULL, "/tmp/bar", CONF_JOB_DIR);
+
+	file1 = conf_file_new (source, "/tmp/bar/frodo");
+	class1 = file1->job = job_class_new (NULL, "frodo", NULL);
+	class1->console = CONSOLE_NONE;
+
+	class1->start_on = event_operator_new (class1, EVENT_AND, NULL, NULL);
+
+	oper = event_operator_new (class1->start_on, EVENT_MATCH,
+				   "wibble", NULL);
+	nih_tree_add (&class1->start_on->node, &oper->node, NIH_TREE_LEFT);
+
+	oper = event_operator_new (class1->start_on, EVENT_MATCH,
+				   "wobble", NULL);
+	nih_tree_add (&class1->start_on->node, &oper->node, NIH_TREE_RIGHT);
+
+	class1->stop_on = event_operator_new (class1, EVENT_MATCH,
+					      "wibble", NULL);
+
+	file2 = conf_file_new (source, "/tmp/bar/bilbo");
+	class2 = file2->job = job_class_new (NULL, "bilbo", NULL);
+	class2->console = CONSOLE_NONE;
+
+	class2->start_on = event_operator_new (class2, EVENT_MATCH,
+					       "wibble", NULL);
+
+
+	/* Check that an event no class refers to has no entry in the
+	 * index.
+	 */
+	TEST_FEATURE ("with unknown event");
+	TEST_EQ_P (job_class_event_classes ("wibble"), NULL);
+
+
+	/* Check that registering a class indexes it once under each
+	 * event named by its start on and stop on conditions, even when
+	 * the same event is named more than once.
+	 */
+	TEST_FEATURE ("with registered class");
+	TEST_TRUE (job_class_consider (class1));
+
+	classes = job_class_event_classes ("wibble");
+	TEST_NE_P (classes, NULL);
+	TEST_LIST_NOT_EMPTY (classes);
+
+	entry = (NihListEntry *)classes->next;
+	TEST_EQ_P (entry->data, class1);
+	TEST_EQ_P (entry->entry.next, classes);
+
+	classes = job_class_event_classes ("wobble");
+	TEST_NE_P (classes, NULL);
+
+	entry = (NihListEntry *)classes->next;
+	TEST_EQ_P (entry->data, class1);
+	TEST_EQ_P (entry->entry.next, classes);
+
+
+	/* Check that a second class naming the same event is added to
+	 * the same list.
+	 */
+	TEST_FEATURE ("with multiple classes");
+	TEST_TRUE (job_class_consider (class2));
+
+	classes = job_class_event_classes ("wibble");
+	TEST_NE_P (classes, NULL);
+
+	entry = (NihListEntry *)classes->next;
+	TEST_EQ_P (entry->data, class1);
+
+	entry = (NihListEntry *)entry->entry.next;
+	TEST_EQ_P (entry->data, class2);
+	TEST_EQ_P (entry->entry.next, classes);
+
+
+	/* Check that a class which is deregistered is removed from the
+	 * index, and that events no longer named by any class are
+	 * dropped from it.
+	 */
+	TEST_FEATURE ("with deregistered class");
+	TEST_FREE_TAG (class1);
+
+	nih_free (file1);
+
+	TEST_FREE (class1);
+	TEST_EQ_P (job_class_event_classes ("wobble"), NULL);
+
+	classes = job_class_event_classes ("wibble");
+	TEST_NE_P (classes, NULL);
+
+	entry = (NihListEntry *)classes->next;
+	TEST_EQ_P (entry->data, class2);
+	TEST_EQ_P (entry->entry.next, classes);
+
+
+	/* Check that freeing a registered class also removes it from the
+	 * index.
+	 */
+	TEST_FEATURE ("with freed class");
+	file2->job = NULL;
+	nih_free (class2);
+
+	classes = job_class_event_classes ("wibble");
+	TEST_TRUE (classes == NULL || NIH_LIST_EMPTY (classes));
+
+	nih_free (source);
+}
+
+
 void
 test_register (void)
 {
@@ -3786,6 +3918,7 @@ main (int   argc,
 	test_new ();
 	test_consider ();
 	test_reconsider ();
+	test_event_classes ();
 	test_register ();
 	test_unregister ();
 	test_environment ();
@@ -216,6 +216,8 @@ enum child_tests {
 
 pid_t pty_child_pid;
 
+extern int disable_clone_spawn;
+
 static char *argv0;
 
 static int get_available_pty_count (void) __attribute__((unused));
@@ -4363,6 +4365,50 @@ test_spawn (void)
 	nih_free (class);
 
 
+	/* Check that a job spawned with fork() rather than clone() has
+	 * the same process tree.
+	 */
+	TEST_FEATURE ("with clone spawning disabled");
+	TEST_HASH_EMPTY (job_classes);
+
+	sprintf (function, "%d", TEST_PIDS);
+
+	disable_clone_spawn = TRUE;
+
+	class = job_class_new (NULL, "test", NULL);
+	class->console = CONSOLE_NONE;
+	job   = job_new (class, "");
+
+	pid = job_process_spawn_with_fd (job, args, NULL, FALSE, -1, PROCESS_MAIN, &job_process_fd);
+	TEST_GT (pid, 0);
+
+	waitpid (pid, NULL, 0);
+	output = fopen (filename, "r");
+
+	TEST_NE (pid, getpid ());
+
+	sprintf (buf, "pid: %d\n", pid);
+	TEST_FILE_EQ (output, buf);
+
+	sprintf (buf, "ppid: %d\n", getpid ());
+	TEST_FILE_EQ (output, buf);
+
+	sprintf (buf, "pgrp: %d\n", pid);
+	TEST_FILE_EQ (output, buf);
+
+	sprintf (buf, "sid: %d\n", pid);
+	TEST_FILE_EQ (output, buf);
+
+	TEST_FILE_END (output);
+
+	fclose (output);
+	assert0 (unlink (filename));
+
+	disable_clone_spawn = FALSE;
+
+	nih_free (class);
+
+
 	/* Check that a job spawned with no console has the file descriptors
 	 * bound to the /dev/null device.
 	 */
@@ -4489,6 +4535,9 @@ test_spawn (void)
 	pid = job_process_spawn_with_fd (job, args, env, FALSE, -1, PROCESS_MAIN, &job_process_fd);
 	TEST_GT (pid, 0);
 
+	/* Our own environment must be untouched by the child */
+	TEST_EQ_STR (getenv ("BAR"), "baz");
+
 	waitpid (pid, NULL, 0);
 	output = fopen (filename, "r");
 
@@ -4812,9 +4861,9 @@ test_spawn (void)
 	args[2] = filebuf;
 	args[3] = NULL;
 
-	job->pid[PROCESS_MAIN] = job_process_spawn_with_fd (job, args, NULL,
-							    FALSE, -1, PROCESS_MAIN, &job_process_fd);
-	pid = job->pid[PROCESS_MAIN];
+	pid = job_process_spawn_with_fd (job, args, NULL,
+					 FALSE, -1, PROCESS_MAIN, &job_process_fd);
+	job_process_set_pid (job, PROCESS_MAIN, pid);
 	TEST_GT (pid, 0);
 
 	/* The main process is now running, but paused. It should have
@@ -4839,9 +4888,9 @@ test_spawn (void)
 	args[2] = filebuf;
 	args[3] = NULL;
 
-	job->pid[PROCESS_POST_START] = job_process_spawn_with_fd (job, args, NULL,
-								  FALSE, -1, PROCESS_POST_START, &job_process_fd);
-	pid = job->pid[PROCESS_POST_START];
+	pid = job_process_spawn_with_fd (job, args, NULL,
+					 FALSE, -1, PROCESS_POST_START, &job_process_fd);
+	job_process_set_pid (job, PROCESS_POST_START, pid);
 	TEST_GT (pid, 0);
 
 	/* wait for post-start process to end */
@@ -5607,6 +5656,7 @@ test_handler (void)
 	unsigned long   data;
 	struct timespec now;
 	char            dirname[PATH_MAX];
+	char            message[80];
 	nih_local char *logfile = NULL;
 	int             fds[2] = { -1, -1};
 	NihIo          *io = NULL;
@@ -5634,7 +5684,7 @@ test_handler (void)
 					       "foo", NULL);
 	class->stop_on = event_operator_new (class, EVENT_MATCH,
 					      "foo", NULL);
-	nih_hash_add (job_classes, &class->entry);
+	job_class_add_safe (class);
 
 	event = event_new (NULL, "foo", NULL);
 
@@ -5654,7 +5704,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -5705,7 +5755,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -5770,7 +5820,7 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_KILLED;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -5821,7 +5871,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_KILLED;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -5905,8 +5955,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_MAIN] = 0;
-		job->pid[PROCESS_PRE_START] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 0);
+		job_process_set_pid (job, PROCESS_PRE_START, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -5970,7 +6020,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_PRE_START] = 1;
+		job_process_set_pid (job, PROCESS_PRE_START, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6045,7 +6095,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_START;
-		job->pid[PROCESS_PRE_START] = 1;
+		job_process_set_pid (job, PROCESS_PRE_START, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6124,7 +6174,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6212,7 +6262,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6302,7 +6352,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6359,6 +6409,250 @@ test_handler (void)
 	class->respawn = FALSE;
 
 
+	/* Check that a job with a respawn delay that would otherwise be
+	 * respawning too fast is respawned anyway, with the initial delay,
+	 * leaving the respawn count alone.
+	 */
+	TEST_FEATURE ("with respawn delay of running process");
+	class->respawn = TRUE;
+	class->respawn_limit = 5;
+	class->respawn_interval = 10;
+	class->respawn_delay = 2;
+	class->respawn_delay_max = 8;
+	class->respawn_stable = 60;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+
+			assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+			job->respawn_count = 5;
+			job->respawn_time = now.tv_sec - 5;
+		}
+
+		job->goal = JOB_START;
+		job->state = JOB_RUNNING;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+
+		job->blocker = NULL;
+		event->failed = FALSE;
+
+		job->failed = FALSE;
+		job->failed_process = PROCESS_INVALID;
+		job->exit_status = 0;
+
+		TEST_DIVERT_STDERR (output) {
+			job_process_handler (NULL, 1, NIH_CHILD_EXITED, 1);
+		}
+		rewind (output);
+
+		TEST_EQ (job->goal, JOB_START);
+		TEST_EQ (job->state, JOB_STOPPING);
+		TEST_EQ (job->pid[PROCESS_MAIN], 0);
+
+		TEST_NE_P (job->respawn_timer, NULL);
+		TEST_EQ (job->respawn_timer->timeout, 2);
+		TEST_EQ (job->respawn_backoff, 2);
+		TEST_EQ (job->respawn_count, 5);
+
+		TEST_NE_P (job->blocker, NULL);
+
+		blocked = (Blocked *)job->blocker->blocking.next;
+		nih_free (blocked);
+
+		TEST_EQ (job->failed, FALSE);
+
+		TEST_FILE_EQ (output, ("test: test main process (1) "
+				       "terminated with status 1\n"));
+		TEST_FILE_EQ (output, ("test: test main process ended, "
+				       "respawning in 2 seconds\n"));
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		nih_free (job);
+	}
+
+	class->respawn = FALSE;
+	class->respawn_delay = 0;
+
+
+	/* Check that the delay is doubled each time a job with a respawn
+	 * delay is respawned, but never exceeds the maximum, less up to a
+	 * quarter taken off at random.
+	 */
+	TEST_FEATURE ("with repeated respawn delay");
+	class->respawn = TRUE;
+	class->respawn_limit = 5;
+	class->respawn_interval = 10;
+	class->respawn_delay = 2;
+	class->respawn_delay_max = 8;
+	class->respawn_stable = 60;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+
+			assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+			job->respawn_backoff = 4;
+			job->respawn_time = now.tv_sec;
+		}
+
+		job->goal = JOB_START;
+		job->state = JOB_RUNNING;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+
+		job->blocker = NULL;
+		event->failed = FALSE;
+
+		job->failed = FALSE;
+		job->failed_process = PROCESS_INVALID;
+		job->exit_status = 0;
+
+		TEST_DIVERT_STDERR (output) {
+			job_process_handler (NULL, 1, NIH_CHILD_EXITED, 1);
+		}
+		rewind (output);
+
+		TEST_EQ (job->goal, JOB_START);
+		TEST_EQ (job->state, JOB_STOPPING);
+		TEST_EQ (job->pid[PROCESS_MAIN], 0);
+
+		TEST_NE_P (job->respawn_timer, NULL);
+		TEST_EQ (job->respawn_backoff, 8);
+		TEST_GE (job->respawn_timer->timeout, 6);
+		TEST_LE (job->respawn_timer->timeout, 8);
+
+		TEST_NE_P (job->blocker, NULL);
+
+		blocked = (Blocked *)job->blocker->blocking.next;
+		nih_free (blocked);
+
+		TEST_EQ (job->failed, FALSE);
+
+		TEST_FILE_EQ (output, ("test: test main process (1) "
+				       "terminated with status 1\n"));
+		sprintf (message, "test: test main process ended, "
+			 "respawning in %d seconds\n",
+			 (int)job->respawn_timer->timeout);
+		TEST_FILE_EQ (output, message);
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		nih_free (job);
+	}
+
+	class->respawn = FALSE;
+	class->respawn_delay = 0;
+
+
+	/* Check that the delay goes back to the initial value once the job
+	 * has run for the stable time since it was last respawned.
+	 */
+	TEST_FEATURE ("with respawn delay after stable run");
+	class->respawn = TRUE;
+	class->respawn_limit = 5;
+	class->respawn_interval = 10;
+	class->respawn_delay = 2;
+	class->respawn_delay_max = 8;
+	class->respawn_stable = 60;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+
+			assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+			job->respawn_backoff = 8;
+			job->respawn_time = now.tv_sec - 60;
+		}
+
+		job->goal = JOB_START;
+		job->state = JOB_RUNNING;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+
+		job->blocker = NULL;
+		event->failed = FALSE;
+
+		job->failed = FALSE;
+		job->failed_process = PROCESS_INVALID;
+		job->exit_status = 0;
+
+		TEST_DIVERT_STDERR (output) {
+			job_process_handler (NULL, 1, NIH_CHILD_EXITED, 1);
+		}
+		rewind (output);
+
+		TEST_EQ (job->goal, JOB_START);
+		TEST_EQ (job->state, JOB_STOPPING);
+		TEST_EQ (job->pid[PROCESS_MAIN], 0);
+
+		TEST_NE_P (job->respawn_timer, NULL);
+		TEST_EQ (job->respawn_backoff, 2);
+		TEST_EQ (job->respawn_timer->timeout, 2);
+
+		TEST_NE_P (job->blocker, NULL);
+
+		blocked = (Blocked *)job->blocker->blocking.next;
+		nih_free (blocked);
+
+		TEST_EQ (job->failed, FALSE);
+
+		TEST_FILE_EQ (output, ("test: test main process (1) "
+				       "terminated with status 1\n"));
+		TEST_FILE_EQ (output, ("test: test main process ended, "
+				       "respawning in 2 seconds\n"));
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		nih_free (job);
+	}
+
+	class->respawn = FALSE;
+	class->respawn_delay = 0;
+
+
+	/* Check that when the respawn timer of a job held in the post-stop
+	 * state expires, the job is started again and the time of the
+	 * respawn recorded.
+	 */
+	TEST_FEATURE ("with respawn timer expired");
+	class->respawn = TRUE;
+	class->respawn_delay = 2;
+
+	TEST_ALLOC_FAIL {
+		NihTimer *timer;
+
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+		}
+
+		job->goal = JOB_START;
+		job->state = JOB_POST_STOP;
+
+		job_process_set_respawn_timer (job, 2);
+		timer = job->respawn_timer;
+
+		assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+		timer->callback (timer->data, timer);
+		nih_free (timer);
+
+		TEST_EQ_P (job->respawn_timer, NULL);
+		TEST_GE (job->respawn_time, now.tv_sec);
+		TEST_EQ (job->goal, JOB_START);
+		TEST_EQ (job->state, JOB_STARTING);
+
+		TEST_NE_P (job->blocker, NULL);
+
+		nih_free (job);
+	}
+
+	class->respawn = FALSE;
+	class->respawn_delay = 0;
+
+
 	/* Check that we can catch a running task exiting with a "normal"
 	 * exit code, and even if it's marked respawn, set the goal to
 	 * stop and transition into the stopping state.
@@ -6379,7 +6673,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6449,7 +6743,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6530,7 +6824,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6598,7 +6892,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6669,7 +6963,7 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_KILLED;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6720,7 +7014,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6788,7 +7082,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6860,7 +7154,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6924,7 +7218,7 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_POST_STOP;
-		job->pid[PROCESS_POST_STOP] = 1;
+		job_process_set_pid (job, PROCESS_POST_STOP, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -6969,7 +7263,7 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_POST_STOP;
-		job->pid[PROCESS_POST_STOP] = 1;
+		job_process_set_pid (job, PROCESS_POST_STOP, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7022,7 +7316,7 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_POST_STOP;
-		job->pid[PROCESS_POST_STOP] = 1;
+		job_process_set_pid (job, PROCESS_POST_STOP, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7077,8 +7371,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_POST_START] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_POST_START, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7142,7 +7436,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7211,8 +7505,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_POST_START] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_POST_START, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7271,8 +7565,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_POST_START] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_POST_START, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7362,8 +7656,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_POST_START] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_POST_START, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7462,8 +7756,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_POST_START] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_POST_START, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7569,8 +7863,8 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_PRE_STOP;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_PRE_STOP] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_PRE_STOP, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7647,7 +7941,7 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_PRE_STOP;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7715,8 +8009,8 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_PRE_STOP;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_PRE_STOP] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_PRE_STOP, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7779,8 +8073,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_PRE_STOP;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_PRE_STOP] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_PRE_STOP, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7889,8 +8183,8 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_PRE_STOP;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_PRE_STOP] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_PRE_STOP, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -7988,7 +8282,7 @@ test_handler (void)
 
 		job->goal = JOB_STOP;
 		job->state = JOB_STOPPING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -8060,8 +8354,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = 1;
-		job->pid[PROCESS_POST_START] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
+		job_process_set_pid (job, PROCESS_POST_START, pid);
 
 		TEST_FREE_TAG (blocked);
 
@@ -8133,8 +8427,8 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_POST_START;
-		job->pid[PROCESS_MAIN] = pid;
-		job->pid[PROCESS_POST_START] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
+		job_process_set_pid (job, PROCESS_POST_START, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -8204,7 +8498,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_FREE_TAG (blocked);
 
@@ -8273,7 +8567,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_FREE_TAG (blocked);
 
@@ -8345,7 +8639,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_FREE_TAG (blocked);
 
@@ -8411,7 +8705,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid,
@@ -8458,7 +8752,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid,
@@ -8506,7 +8800,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid,
@@ -8555,7 +8849,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid,
@@ -8605,7 +8899,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid,
@@ -8680,7 +8974,7 @@ test_handler (void)
 		/* Now carry on with the test */
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid, NIH_CHILD_PTRACE,
@@ -8749,7 +9043,7 @@ test_handler (void)
 		/* Now carry on with the test */
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid, NIH_CHILD_PTRACE,
@@ -8808,7 +9102,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid, NIH_CHILD_PTRACE,
@@ -8863,7 +9157,7 @@ test_handler (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_SPAWNED;
-		job->pid[PROCESS_MAIN] = pid;
+		job_process_set_pid (job, PROCESS_MAIN, pid);
 
 		TEST_DIVERT_STDERR (output) {
 			job_process_handler (NULL, pid, NIH_CHILD_PTRACE,
@@ -9206,20 +9500,20 @@ test_find (void)
 	nih_hash_add (job_classes, &class3->entry);
 
 	job1 = job_new (class1, "foo");
-	job1->pid[PROCESS_MAIN] = 10;
-	job1->pid[PROCESS_POST_START] = 15;
+	job_process_set_pid (job1, PROCESS_MAIN, 10);
+	job_process_set_pid (job1, PROCESS_POST_START, 15);
 
 	job2 = job_new (class1, "bar");
 
 	job3 = job_new (class2, "foo");
-	job3->pid[PROCESS_PRE_START] = 20;
+	job_process_set_pid (job3, PROCESS_PRE_START, 20);
 
 	job4 = job_new (class2, "bar");
-	job4->pid[PROCESS_MAIN] = 25;
-	job4->pid[PROCESS_PRE_STOP] = 30;
+	job_process_set_pid (job4, PROCESS_MAIN, 25);
+	job_process_set_pid (job4, PROCESS_PRE_STOP, 30);
 
 	job5 = job_new (class3, "");
-	job5->pid[PROCESS_POST_STOP] = 35;
+	job_process_set_pid (job5, PROCESS_POST_STOP, 35);
 
 
 	/* Check that we can find a job that exists by the pid of its
@@ -9334,7 +9628,7 @@ test_utmp (void)
 					       "foo", NULL);
 	class->stop_on = event_operator_new (class, EVENT_MATCH,
 					      "foo", NULL);
-	nih_hash_add (job_classes, &class->entry);
+	job_class_add_safe (class);
 
 	event = event_new (NULL, "foo", NULL);
 
@@ -9355,7 +9649,7 @@ test_utmp (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -9420,7 +9714,7 @@ test_utmp (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 1;
+		job_process_set_pid (job, PROCESS_MAIN, 1);
 
 		TEST_FREE_TAG (blocked);
 
@@ -9488,7 +9782,7 @@ test_utmp (void)
 
 		job->goal = JOB_START;
 		job->state = JOB_RUNNING;
-		job->pid[PROCESS_MAIN] = 2;
+		job_process_set_pid (job, PROCESS_MAIN, 2);
 
 		TEST_FREE_TAG (blocked);
 
@@ -0,0 +1,437 @@
+/* upstart
+ *
+ * test_listen.c - test suite for init/listen.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/io.h>
+#include <nih/main.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "event.h"
+#include "listen.h"
+
+
+void
+test_socket_new (void)
+{
+	JobClass     *class;
+	ListenSocket *sock;
+
+	TEST_FUNCTION ("listen_socket_new");
+	class = job_class_new (NULL, "foo", NULL);
+
+	/* Check that a socket is allocated beneath the class, added to
+	 * its list of sockets, and is not yet open.
+	 */
+	TEST_FEATURE ("with inet socket");
+	TEST_ALLOC_FAIL {
+		sock = listen_socket_new (class, LISTEN_INET, "127.0.0.1", 8080);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (sock, NULL);
+			TEST_LIST_EMPTY (&class->listen);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (sock, sizeof (ListenSocket));
+		TEST_ALLOC_PARENT (sock, class);
+		TEST_EQ_P (class->listen.next, &sock->entry);
+		TEST_EQ_P (sock->class, class);
+		TEST_EQ (sock->type, LISTEN_INET);
+		TEST_EQ_STR (sock->address, "127.0.0.1");
+		TEST_ALLOC_PARENT (sock->address, sock);
+		TEST_EQ (sock->port, 8080);
+		TEST_EQ (sock->max_instances, LISTEN_DEFAULT_MAX_INSTANCES);
+		TEST_LT (sock->fd, 0);
+		TEST_EQ_P (sock->watch, NULL);
+
+		nih_free (sock);
+	}
+
+	nih_free (class);
+}
+
+void
+test_socket_open (void)
+{
+	JobClass     *class;
+	ListenSocket *sock;
+	char          dirname[PATH_MAX];
+	char          path[PATH_MAX];
+	struct stat   statbuf;
+	int           fd;
+
+	TEST_FUNCTION ("listen_socket_open");
+	class = job_class_new (NULL, "foo", NULL);
+
+	TEST_FILENAME (dirname);
+	assert0 (mkdir (dirname, 0755));
+
+	sprintf (path, "%s/socket", dirname);
+
+
+	/* Check that a unix socket is bound at its path, replacing a stale
+	 * file there, and is left listening, non-blocking and close-on-exec.
+	 */
+	TEST_FEATURE ("with unix socket");
+	fd = open (path, O_CREAT | O_WRONLY, 0644);
+	TEST_GE (fd, 0);
+	close (fd);
+
+	sock = listen_socket_new (class, LISTEN_UNIX, path, 0);
+
+	TEST_EQ (listen_socket_open (sock), 0);
+
+	TEST_GE (sock->fd, 0);
+	TEST_TRUE (fcntl (sock->fd, F_GETFD) & FD_CLOEXEC);
+	TEST_TRUE (fcntl (sock->fd, F_GETFL) & O_NONBLOCK);
+
+	assert0 (stat (path, &statbuf));
+	TEST_TRUE (S_ISSOCK (statbuf.st_mode));
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	TEST_GE (fd, 0);
+
+	{
+		struct sockaddr_un addr;
+
+		memset (&addr, 0, sizeof (addr));
+		addr.sun_family = AF_UNIX;
+		strcpy (addr.sun_path, path);
+
+		TEST_EQ (connect (fd, (struct sockaddr *)&addr,
+				  sizeof (addr)), 0);
+	}
+
+	close (fd);
+
+	/* The socket is closed, but its path kept, when freed */
+	nih_free (sock);
+
+	assert0 (stat (path, &statbuf));
+	assert0 (unlink (path));
+	assert0 (rmdir (dirname));
+
+	nih_free (class);
+}
+
+void
+test_job_fds (void)
+{
+	JobClass     *class;
+	ListenSocket *sock1, *sock2;
+	Job          *job;
+	int           fds[LISTEN_MAX_SOCKETS];
+
+	TEST_FUNCTION ("listen_job_fds");
+	class = job_class_new (NULL, "foo", NULL);
+
+	sock1 = listen_socket_new (class, LISTEN_INET, "127.0.0.1", 8080);
+	sock2 = listen_socket_new (class, LISTEN_UNIX, "@foo", 0);
+	sock1->fd = 10;
+	sock2->fd = 11;
+
+	job = job_new (class, "");
+
+
+	/* Check that the main process of a single daemon is passed each
+	 * open socket in the order they were declared.
+	 */
+	TEST_FEATURE ("with main process");
+	TEST_EQ (listen_job_fds (job, PROCESS_MAIN, fds), 2);
+	TEST_EQ (fds[0], 10);
+	TEST_EQ (fds[1], 11);
+
+
+	/* Check that a socket that could not be opened is skipped. */
+	TEST_FEATURE ("with socket not open");
+	sock1->fd = -1;
+
+	TEST_EQ (listen_job_fds (job, PROCESS_MAIN, fds), 1);
+	TEST_EQ (fds[0], 11);
+
+	sock1->fd = 10;
+
+
+	/* Check that other processes of the job are passed nothing. */
+	TEST_FEATURE ("with pre-start process");
+	TEST_EQ (listen_job_fds (job, PROCESS_PRE_START, fds), 0);
+
+
+	/* Check that in accept mode the main process is passed only the
+	 * connection accepted for it, and nothing once it has been.
+	 */
+	TEST_FEATURE ("with accept mode");
+	class->listen_accept = TRUE;
+	job->listen_fd = 12;
+
+	TEST_EQ (listen_job_fds (job, PROCESS_MAIN, fds), 1);
+	TEST_EQ (fds[0], 12);
+
+	job->listen_fd = -1;
+
+	TEST_EQ (listen_job_fds (job, PROCESS_MAIN, fds), 0);
+
+
+	sock1->fd = -1;
+	sock2->fd = -1;
+
+	nih_free (job);
+	nih_free (class);
+}
+
+void
+test_class_open (void)
+{
+	JobClass     *class;
+	ListenSocket *sock;
+	Job          *job;
+	char          dirname[PATH_MAX];
+	char          path[PATH_MAX];
+
+	TEST_FUNCTION ("listen_class_open");
+	nih_io_init ();
+
+	TEST_FILENAME (dirname);
+	assert0 (mkdir (dirname, 0755));
+
+	sprintf (path, "%s/socket", dirname);
+
+	class = job_class_new (NULL, "foo", NULL);
+	sock = listen_socket_new (class, LISTEN_UNIX, path, 0);
+
+
+	/* Check that the sockets of a class are opened and watched for
+	 * connections when it is registered.
+	 */
+	TEST_FEATURE ("with no instances");
+	listen_class_open (class);
+
+	TEST_GE (sock->fd, 0);
+	TEST_NE_P (sock->watch, NULL);
+	TEST_EQ (sock->watch->fd, sock->fd);
+	TEST_EQ (sock->watch->events, NIH_IO_READ);
+
+
+	/* Check that the watch of a single daemon is disabled while an
+	 * instance exists, and enabled again once it is discarded.
+	 */
+	TEST_FEATURE ("with single daemon running");
+	listen_class_close (class);
+
+	job = job_new (class, "");
+
+	listen_class_open (class);
+
+	TEST_GE (sock->fd, 0);
+	TEST_NE_P (sock->watch, NULL);
+	TEST_EQ (sock->watch->events, 0);
+
+	nih_free (job);
+	listen_class_resume (class);
+
+	TEST_EQ (sock->watch->events, NIH_IO_READ);
+
+
+	/* Check that in accept mode the watch is disabled while the socket
+	 * has its maximum number of instances, and enabled again once one
+	 * of them is discarded.
+	 */
+	TEST_FEATURE ("with accept mode at maximum instances");
+	listen_class_close (class);
+
+	class->listen_accept = TRUE;
+	sock->max_instances = 2;
+
+	job = job_new (class, "1");
+	job->listen_socket = 0;
+
+	listen_class_open (class);
+
+	TEST_EQ (sock->watch->events, NIH_IO_READ);
+
+	listen_class_close (class);
+
+	job = job_new (class, "2");
+	job->listen_socket = 0;
+
+	listen_class_open (class);
+
+	TEST_EQ (sock->watch->events, 0);
+
+	listen_class_resume (class);
+
+	TEST_EQ (sock->watch->events, 0);
+
+	nih_free (job);
+	listen_class_resume (class);
+
+	TEST_EQ (sock->watch->events, NIH_IO_READ);
+
+
+	/* Check that closing the class frees the watch and closes the
+	 * socket.
+	 */
+	TEST_FEATURE ("with class closed");
+	listen_class_close (class);
+
+	TEST_LT (sock->fd, 0);
+	TEST_EQ_P (sock->watch, NULL);
+
+	nih_free (class);
+
+	assert0 (unlink (path));
+	assert0 (rmdir (dirname));
+}
+
+void
+test_class_handover (void)
+{
+	JobClass     *from;
+	JobClass     *to;
+	ListenSocket *sock1;
+	ListenSocket *sock2;
+	ListenSocket *sock3;
+	ListenSocket *sock4;
+	char          dirname[PATH_MAX];
+	char          path1[PATH_MAX];
+	char          path2[PATH_MAX];
+	char          path3[PATH_MAX];
+	struct stat   statbuf;
+	ino_t         ino;
+	int           fd;
+
+	TEST_FUNCTION ("listen_class_handover");
+	nih_io_init ();
+
+	TEST_FILENAME (dirname);
+	assert0 (mkdir (dirname, 0755));
+
+	sprintf (path1, "%s/socket1", dirname);
+	sprintf (path2, "%s/socket2", dirname);
+	sprintf (path3, "%s/socket3", dirname);
+
+
+	/* Check that an open socket is passed to the socket of the new
+	 * class with the same address, without the socket file being
+	 * bound again, and that a socket the new class doesn't listen on
+	 * is closed.
+	 */
+	TEST_FEATURE ("with replacement class");
+	from = job_class_new (NULL, "foo", NULL);
+	sock1 = listen_socket_new (from, LISTEN_UNIX, path1, 0);
+	sock2 = listen_socket_new (from, LISTEN_UNIX, path2, 0);
+
+	to = job_class_new (NULL, "foo", NULL);
+	sock3 = listen_socket_new (to, LISTEN_UNIX, path1, 0);
+	sock4 = listen_socket_new (to, LISTEN_UNIX, path3, 0);
+
+	listen_class_open (from);
+
+	fd = sock1->fd;
+	TEST_GE (fd, 0);
+	TEST_GE (sock2->fd, 0);
+
+	assert0 (stat (path1, &statbuf));
+	ino = statbuf.st_ino;
+
+	listen_class_handover (from, to);
+
+	TEST_LT (sock1->fd, 0);
+	TEST_EQ_P (sock1->watch, NULL);
+	TEST_LT (sock2->fd, 0);
+	TEST_EQ_P (sock2->watch, NULL);
+
+	TEST_EQ (sock3->fd, fd);
+	TEST_EQ_P (sock3->watch, NULL);
+	TEST_LT (sock4->fd, 0);
+
+	listen_class_open (to);
+
+	TEST_EQ (sock3->fd, fd);
+	TEST_NE_P (sock3->watch, NULL);
+	TEST_EQ (sock3->watch->fd, fd);
+	TEST_GE (sock4->fd, 0);
+
+	assert0 (stat (path1, &statbuf));
+	TEST_EQ (statbuf.st_ino, ino);
+
+	nih_free (from);
+	nih_free (to);
+
+
+	/* Check that without a replacement class the sockets are simply
+	 * closed.
+	 */
+	TEST_FEATURE ("with no replacement class");
+	from = job_class_new (NULL, "foo", NULL);
+	sock1 = listen_socket_new (from, LISTEN_UNIX, path1, 0);
+
+	listen_class_open (from);
+	TEST_GE (sock1->fd, 0);
+
+	listen_class_handover (from, NULL);
+
+	TEST_LT (sock1->fd, 0);
+	TEST_EQ_P (sock1->watch, NULL);
+
+	nih_free (from);
+
+	assert0 (unlink (path1));
+	assert0 (unlink (path2));
+	assert0 (unlink (path3));
+	assert0 (rmdir (dirname));
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	/* run tests in legacy (pre-session support) mode */
+	setenv ("UPSTART_NO_SESSIONS", "1", 1);
+
+	nih_main_init (argv[0]);
+
+	test_socket_new ();
+	test_socket_open ();
+	test_job_fds ();
+	test_class_open ();
+	test_class_handover ();
+
+	return 0;
+}
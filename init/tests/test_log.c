@@ -24,8 +24,10 @@
 #include <errno.h>
 #include <pty.h>
 #include <libgen.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/wait.h>
 #include <nih/test.h>
 #include <nih/timer.h>
 #include <nih/child.h>
@@ -35,6 +37,12 @@
 #include "test_util_common.h"
 
 extern int log_flushed;
+extern int log_batch_size;
+extern int log_rotate_size;
+extern int log_rotate_count;
+extern int log_rotate_compress;
+extern int log_unflushed_limit;
+extern int log_unflushed_total_limit;
 
 /*
  * To help with understanding the TEST_ALLOC_FAIL peculiarities
@@ -1446,6 +1454,561 @@ test_log_destroy (void)
 	TEST_FREE (log->unflushed);
 }
 
+void
+test_log_batch (void)
+{
+	Log         *log;
+	char         str[] = "hello, world!";
+	char         filename[1024];
+	char         dirname[1024];
+	ssize_t      ret;
+	struct stat  statbuf;
+	FILE        *output;
+	int          pty_master;
+	int          pty_slave;
+
+	TEST_FUNCTION ("log_io_reader batching");
+
+	TEST_FILENAME (dirname);
+	TEST_EQ (mkdir (dirname, 0755), 0);
+	TEST_GT (sprintf (filename, "%s/test.log", dirname), 0);
+
+	log_batch_size = 1024;
+
+	/************************************************************/
+	TEST_FEATURE ("output held back until job ends");
+
+	TEST_EQ (openpty (&pty_master, &pty_slave, NULL, NULL, NULL), 0);
+
+	log = log_new (NULL, filename, pty_master, 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (pty_slave, str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (pty_slave, "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	/* Nothing written yet, the output is waiting in the NihIo */
+	TEST_LT (stat (filename, &statbuf), 0);
+	TEST_NE_P (log->batch_timer, NULL);
+	TEST_EQ (log->io->recv_buf->len, strlen (str) + 2);
+	TEST_EQ (log->unflushed->len, 0);
+
+	close (pty_slave);
+	ret = log_handle_unflushed (NULL, log);
+	TEST_EQ (ret, 1);
+	TEST_TRUE (NIH_LIST_EMPTY (log_unflushed_files));
+
+	TEST_EQ_P (log->batch_timer, NULL);
+
+	nih_free (log);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+
+	TEST_FILE_EQ (output, "hello, world!\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	TEST_EQ (unlink (filename), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("output written when batch timer expires");
+
+	TEST_EQ (openpty (&pty_master, &pty_slave, NULL, NULL, NULL), 0);
+
+	log = log_new (NULL, filename, pty_master, 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (pty_slave, str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (pty_slave, "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	TEST_LT (stat (filename, &statbuf), 0);
+	TEST_NE_P (log->batch_timer, NULL);
+
+	/* Make the timer due now rather than waiting for it */
+	log->batch_timer->due = 0;
+	nih_timer_poll ();
+
+	TEST_EQ_P (log->batch_timer, NULL);
+	TEST_EQ (log->io->recv_buf->len, 0);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+
+	TEST_FILE_EQ (output, "hello, world!\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	close (pty_slave);
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("output written once batch size reached");
+
+	log_batch_size = 8;
+
+	TEST_EQ (openpty (&pty_master, &pty_slave, NULL, NULL, NULL), 0);
+
+	log = log_new (NULL, filename, pty_master, 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (pty_slave, str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (pty_slave, "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	TEST_EQ_P (log->batch_timer, NULL);
+	TEST_EQ (log->io->recv_buf->len, 0);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+
+	TEST_FILE_EQ (output, "hello, world!\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	close (pty_slave);
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+	TEST_EQ (rmdir (dirname), 0);
+
+	log_batch_size = 0;
+}
+
+void
+test_log_splice (void)
+{
+	Log         *log;
+	char         str[] = "hello, world!";
+	char         filename[1024];
+	char         dirname[1024];
+	ssize_t      ret;
+	FILE        *output;
+	int          fds[2];
+	struct stat  statbuf;
+	char        *buffer;
+
+	TEST_FUNCTION ("log_new with pipe");
+
+	TEST_FILENAME (dirname);
+	TEST_EQ (mkdir (dirname, 0755), 0);
+	TEST_GT (sprintf (filename, "%s/test.log", dirname), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("output spliced into log file");
+
+	TEST_EQ (pipe (fds), 0);
+
+	log = log_new (NULL, filename, fds[0], 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (fds[1], str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (fds[1], "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	/* Written without passing through the NihIo */
+	TEST_EQ (log->io->recv_buf->len, 0);
+	TEST_EQ (log->unflushed->len, 0);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+
+	TEST_FILE_EQ (output, "hello, world!\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	/* The log file is still appended to when written normally */
+	TEST_TRUE (fcntl (log->fd, F_GETFL) & O_APPEND);
+
+	/* Closing the pipe reads as end of file rather than an error */
+	close (fds[1]);
+
+	TEST_WATCH_UPDATE ();
+
+	TEST_EQ_P (log->io, NULL);
+	TEST_TRUE (log->remote_closed);
+
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+	TEST_EQ (rmdir (dirname), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("output spliced a chunk at a time");
+
+	TEST_EQ (mkdir (dirname, 0755), 0);
+	TEST_EQ (pipe (fds), 0);
+	TEST_GE (fcntl (fds[1], F_SETPIPE_SZ, LOG_SPLICE_SIZE * 4),
+		 LOG_SPLICE_SIZE * 3);
+
+	log = log_new (NULL, filename, fds[0], 0);
+	TEST_NE_P (log, NULL);
+
+	buffer = nih_alloc (NULL, LOG_SPLICE_SIZE * 3);
+	TEST_NE_P (buffer, NULL);
+	memset (buffer, 'x', LOG_SPLICE_SIZE * 3);
+
+	ret = write (fds[1], buffer, LOG_SPLICE_SIZE * 3);
+	TEST_EQ (ret, LOG_SPLICE_SIZE * 3);
+
+	/* Each wakeup moves no more than one chunk into the log file */
+	for (int i = 1; i <= 3; i++) {
+		TEST_WATCH_UPDATE ();
+
+		TEST_EQ (stat (filename, &statbuf), 0);
+		TEST_EQ (statbuf.st_size, LOG_SPLICE_SIZE * i);
+	}
+
+	TEST_EQ (log->io->recv_buf->len, 0);
+
+	close (fds[1]);
+
+	TEST_WATCH_UPDATE ();
+
+	TEST_EQ_P (log->io, NULL);
+
+	nih_free (buffer);
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+	TEST_EQ (rmdir (dirname), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("output kept when log file cannot be written");
+
+	TEST_EQ (pipe (fds), 0);
+
+	log = log_new (NULL, filename, fds[0], 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (fds[1], str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (fds[1], "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	/* Directory doesn't exist, so the output was read instead */
+	TEST_EQ (log->unflushed->len, strlen (str) + 1);
+	TEST_EQ_MEM (log->unflushed->buf, "hello, world!\n",
+		     strlen (str) + 1);
+
+	/* Once the log file can be written, the unflushed output must
+	 * reach it before anything newer.
+	 */
+	TEST_EQ (mkdir (dirname, 0755), 0);
+
+	ret = write (fds[1], str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (fds[1], "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	TEST_EQ (log->unflushed->len, 0);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+
+	TEST_FILE_EQ (output, "hello, world!\n");
+	TEST_FILE_EQ (output, "hello, world!\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	close (fds[1]);
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+	TEST_EQ (rmdir (dirname), 0);
+}
+
+void
+test_log_unflushed_limit (void)
+{
+	Log         *log;
+	char         str[] = "hello, world!";
+	char         filename[1024];
+	char         dirname[1024];
+	ssize_t      ret;
+	FILE        *output;
+	int          fds[2];
+
+	TEST_FUNCTION ("log_io_reader unflushed limits");
+
+	TEST_FILENAME (dirname);
+	TEST_GT (sprintf (filename, "%s/test.log", dirname), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("newest output kept within log limit");
+
+	log_unflushed_limit = 8;
+	log_unflushed_dropped = 0;
+
+	TEST_EQ (pipe (fds), 0);
+
+	log = log_new (NULL, filename, fds[0], 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (fds[1], str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (fds[1], "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	/* Directory doesn't exist, so only the newest output is kept */
+	TEST_EQ (log->unflushed->len, 8);
+	TEST_EQ_MEM (log->unflushed->buf, " world!\n", 8);
+	TEST_EQ (log->dropped, 6);
+	TEST_EQ (log_unflushed_bytes, 8);
+	TEST_EQ (log_unflushed_dropped, 6);
+
+	/* Once the log file can be written, the kept output follows a
+	 * line saying how much was dropped.
+	 */
+	TEST_EQ (mkdir (dirname, 0755), 0);
+
+	ret = write (fds[1], str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (fds[1], "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	TEST_EQ (log->unflushed->len, 0);
+	TEST_EQ (log->dropped, 0);
+	TEST_EQ (log_unflushed_bytes, 0);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+
+	TEST_FILE_EQ (output, "[6 bytes of output dropped while log was not writeable]\n");
+	TEST_FILE_EQ (output, " world!\n");
+	TEST_FILE_EQ (output, "hello, world!\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	close (fds[1]);
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+	TEST_EQ (rmdir (dirname), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("output dropped within total limit");
+
+	log_unflushed_limit = 0;
+	log_unflushed_total_limit = 10;
+	log_unflushed_dropped = 0;
+
+	/* Pretend other logs already hold some output */
+	log_unflushed_bytes = 4;
+
+	TEST_EQ (pipe (fds), 0);
+
+	log = log_new (NULL, filename, fds[0], 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (fds[1], str, strlen (str));
+	TEST_GT (ret, 0);
+	ret = write (fds[1], "\n", 1);
+	TEST_EQ (ret, 1);
+
+	TEST_WATCH_UPDATE ();
+
+	TEST_EQ (log->unflushed->len, 6);
+	TEST_EQ_MEM (log->unflushed->buf, "orld!\n", 6);
+	TEST_EQ (log->dropped, 8);
+	TEST_EQ (log_unflushed_bytes, 10);
+	TEST_EQ (log_unflushed_dropped, 8);
+
+	/* Output that can't be flushed is no longer counted once the
+	 * log is freed.
+	 */
+	close (fds[1]);
+	nih_free (log);
+
+	TEST_EQ (log_unflushed_bytes, 4);
+
+	log_unflushed_bytes = 0;
+	log_unflushed_dropped = 0;
+	log_unflushed_limit = LOG_UNFLUSHED_DEFAULT_LIMIT;
+	log_unflushed_total_limit = LOG_UNFLUSHED_DEFAULT_TOTAL_LIMIT;
+}
+
+void
+test_log_rotate (void)
+{
+	Log         *log;
+	char         filename[1024];
+	char         rotated[1024];
+	char         dirname[1024];
+	ssize_t      ret;
+	struct stat  statbuf;
+	FILE        *output;
+	int          pty_master;
+	int          pty_slave;
+	siginfo_t    info;
+
+	TEST_FUNCTION ("log_file_open rotation");
+
+	TEST_FILENAME (dirname);
+	TEST_EQ (mkdir (dirname, 0755), 0);
+	TEST_GT (sprintf (filename, "%s/test.log", dirname), 0);
+	TEST_GT (sprintf (rotated, "%s.1", filename), 0);
+
+	log_rotate_size = 10;
+	log_rotate_count = 1;
+
+	/************************************************************/
+	TEST_FEATURE ("log file rotated once size reached");
+
+	TEST_EQ (openpty (&pty_master, &pty_slave, NULL, NULL, NULL), 0);
+
+	log = log_new (NULL, filename, pty_master, 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (pty_slave, "hello, world!\n", 14);
+	TEST_EQ (ret, 14);
+	TEST_WATCH_UPDATE ();
+
+	/* Not yet rotated since the file was empty before writing */
+	TEST_LT (stat (rotated, &statbuf), 0);
+
+	ret = write (pty_slave, "The end?\n", 9);
+	TEST_EQ (ret, 9);
+	TEST_WATCH_UPDATE ();
+
+	output = fopen (rotated, "r");
+	TEST_NE_P (output, NULL);
+	TEST_FILE_EQ (output, "hello, world!\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+	TEST_FILE_EQ (output, "The end?\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	/************************************************************/
+	TEST_FEATURE ("oldest rotated log file removed");
+
+	ret = write (pty_slave, "again\n", 6);
+	TEST_EQ (ret, 6);
+	TEST_WATCH_UPDATE ();
+
+	output = fopen (rotated, "r");
+	TEST_NE_P (output, NULL);
+	TEST_FILE_EQ (output, "The end?\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+	TEST_FILE_EQ (output, "again\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	TEST_GT (sprintf (rotated, "%s.2", filename), 0);
+	TEST_LT (stat (rotated, &statbuf), 0);
+	TEST_GT (sprintf (rotated, "%s.1", filename), 0);
+
+	close (pty_slave);
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+	TEST_EQ (unlink (rotated), 0);
+
+	/************************************************************/
+	TEST_FEATURE ("log file not rotated while compressing");
+
+	log_rotate_count = 2;
+	log_rotate_compress = TRUE;
+
+	TEST_EQ (openpty (&pty_master, &pty_slave, NULL, NULL, NULL), 0);
+
+	log = log_new (NULL, filename, pty_master, 0);
+	TEST_NE_P (log, NULL);
+
+	ret = write (pty_slave, "hello, world!\n", 14);
+	TEST_EQ (ret, 14);
+	TEST_WATCH_UPDATE ();
+
+	ret = write (pty_slave, "The end?\n", 9);
+	TEST_EQ (ret, 9);
+	TEST_WATCH_UPDATE ();
+
+	/* The compression child hasn't been reaped, so the log file
+	 * must not be rotated again even though it is due.
+	 */
+	ret = write (pty_slave, "again\n", 6);
+	TEST_EQ (ret, 6);
+	TEST_WATCH_UPDATE ();
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+	TEST_FILE_EQ (output, "The end?\r\n");
+	TEST_FILE_EQ (output, "again\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	TEST_GT (sprintf (rotated, "%s.2.gz", filename), 0);
+	TEST_LT (stat (rotated, &statbuf), 0);
+
+	/* Once it has been, the log file is rotated as usual */
+	assert0 (waitid (P_ALL, 0, &info, WEXITED | WNOWAIT));
+	nih_child_poll ();
+
+	TEST_GT (sprintf (rotated, "%s.1.gz", filename), 0);
+	TEST_EQ (stat (rotated, &statbuf), 0);
+
+	ret = write (pty_slave, "more\n", 5);
+	TEST_EQ (ret, 5);
+	TEST_WATCH_UPDATE ();
+
+	assert0 (waitid (P_ALL, 0, &info, WEXITED | WNOWAIT));
+	nih_child_poll ();
+
+	output = fopen (filename, "r");
+	TEST_NE_P (output, NULL);
+	TEST_FILE_EQ (output, "more\r\n");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	TEST_EQ (stat (rotated, &statbuf), 0);
+	TEST_EQ (unlink (rotated), 0);
+
+	TEST_GT (sprintf (rotated, "%s.2.gz", filename), 0);
+	TEST_EQ (stat (rotated, &statbuf), 0);
+	TEST_EQ (unlink (rotated), 0);
+
+	close (pty_slave);
+	nih_free (log);
+
+	TEST_EQ (unlink (filename), 0);
+	TEST_EQ (rmdir (dirname), 0);
+
+	log_rotate_size = 0;
+	log_rotate_count = LOG_ROTATE_DEFAULT_COUNT;
+	log_rotate_compress = FALSE;
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -1455,6 +2018,10 @@ main (int   argc,
 
 	test_log_new ();
 	test_log_destroy ();
+	test_log_batch ();
+	test_log_splice ();
+	test_log_unflushed_limit ();
+	test_log_rotate ();
 
 	return 0;
 }
@@ -0,0 +1,448 @@
+/* upstart
+ *
+ * test_notify.c - test suite for init/notify.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/list.h>
+#include <nih/io.h>
+#include <nih/main.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "job_process.h"
+#include "event.h"
+#include "notify.h"
+
+
+/**
+ * spawned_job:
+ * @class: job class.
+ *
+ * Creates an instance of @class in the spawned state, as though its main
+ * process had just been started and is yet to report that it's ready.
+ *
+ * Returns: new job.
+ **/
+static Job *
+spawned_job (JobClass *class)
+{
+	Job *job;
+
+	job = job_new (class, "");
+	job->goal = JOB_START;
+	job->state = JOB_SPAWNED;
+	job_process_set_pid (job, PROCESS_MAIN, 1000);
+
+	return job;
+}
+
+/**
+ * free_job:
+ * @job: job to free.
+ *
+ * Frees @job without it trying to kill its made-up main process, and
+ * discards any events it emitted.
+ **/
+static void
+free_job (Job *job)
+{
+	job_process_set_pid (job, PROCESS_MAIN, 0);
+	nih_free (job);
+
+	NIH_LIST_FOREACH_SAFE (events, iter) {
+		Event *event = (Event *)iter;
+
+		nih_free (event);
+	}
+}
+
+
+void
+test_job_open (void)
+{
+	JobClass       *class;
+	Job            *job;
+	nih_local char *address = NULL;
+	int             fd;
+
+	TEST_FUNCTION ("notify_job_open");
+	nih_io_init ();
+
+	class = job_class_new (NULL, "foo", NULL);
+	class->expect = EXPECT_NOTIFY;
+
+
+	/* Check that a job is given a close-on-exec datagram socket in the
+	 * abstract namespace, watched for messages.
+	 */
+	TEST_FEATURE ("with no socket");
+	job = job_new (class, "");
+
+	TEST_EQ (notify_job_open (job), 0);
+
+	TEST_GE (job->notify_fd, 0);
+	TEST_TRUE (fcntl (job->notify_fd, F_GETFD) & FD_CLOEXEC);
+	TEST_NE_P (job->notify_watch, NULL);
+	TEST_EQ (job->notify_watch->fd, job->notify_fd);
+
+	address = notify_job_address (NULL, job);
+	TEST_NE_P (address, NULL);
+	TEST_EQ (address[0], '@');
+	TEST_GT (strlen (address), 1);
+
+
+	/* Check that a job which already has a socket keeps it. */
+	TEST_FEATURE ("with existing socket");
+	fd = job->notify_fd;
+
+	TEST_EQ (notify_job_open (job), 0);
+
+	TEST_EQ (job->notify_fd, fd);
+
+
+	/* Check that closing the socket frees the watch. */
+	TEST_FEATURE ("with socket closed");
+	notify_job_close (job);
+
+	TEST_LT (job->notify_fd, 0);
+	TEST_EQ_P (job->notify_watch, NULL);
+
+	nih_free (job);
+	nih_free (class);
+}
+
+void
+test_job_message (void)
+{
+	JobClass *class;
+	Job      *job;
+	pid_t     pid;
+
+	TEST_FUNCTION ("notify_job_message");
+	event_init ();
+	job_process_init ();
+
+	class = job_class_new (NULL, "foo", NULL);
+	class->expect = EXPECT_NOTIFY;
+	class->process[PROCESS_MAIN] = process_new (class);
+	class->process[PROCESS_MAIN]->command = "echo";
+
+
+	/* Check that READY=1 moves a spawned job on to running, closing
+	 * its notify socket.
+	 */
+	TEST_FEATURE ("with ready");
+	job = spawned_job (class);
+	assert0 (notify_job_open (job));
+
+	TEST_EQ (notify_job_message (job, 1000, geteuid (),
+				     "READY=1\n", 8), 1);
+
+	TEST_EQ (job->state, JOB_RUNNING);
+	TEST_EQ (job->pid[PROCESS_MAIN], 1000);
+	TEST_LT (job->notify_fd, 0);
+	TEST_EQ_P (job->notify_watch, NULL);
+
+	free_job (job);
+
+
+	/* Check that READY=1 received while the job is still spawning, before
+	 * the main process is known to have been spawned, is remembered and
+	 * moves the job on to running once it has been.
+	 */
+	TEST_FEATURE ("with ready before spawned");
+	job = spawned_job (class);
+	job->state = JOB_SPAWNING;
+	assert0 (notify_job_open (job));
+
+	TEST_EQ (notify_job_message (job, 1000, geteuid (),
+				     "READY=1", 7), 0);
+
+	TEST_EQ (job->state, JOB_SPAWNING);
+	TEST_TRUE (job->notify_ready);
+	TEST_GE (job->notify_fd, 0);
+
+	job_change_state (job, JOB_SPAWNED);
+
+	TEST_EQ (job->state, JOB_RUNNING);
+	TEST_FALSE (job->notify_ready);
+	TEST_LT (job->notify_fd, 0);
+	TEST_EQ_P (job->notify_watch, NULL);
+
+	free_job (job);
+
+
+	/* Check that a job that has not reported readiness waits in the
+	 * spawned state.
+	 */
+	TEST_FEATURE ("with no ready before spawned");
+	job = spawned_job (class);
+	job->state = JOB_SPAWNING;
+	assert0 (notify_job_open (job));
+
+	job_change_state (job, JOB_SPAWNED);
+
+	TEST_EQ (job->state, JOB_SPAWNED);
+	TEST_GE (job->notify_fd, 0);
+
+	free_job (job);
+
+
+	/* Check that MAINPID= replaces the main process being supervised,
+	 * but doesn't move the job on without READY=1.
+	 */
+	TEST_FEATURE ("with main process");
+	job = spawned_job (class);
+	assert0 (notify_job_open (job));
+
+	TEST_EQ (notify_job_message (job, 1000, geteuid (),
+				     "STATUS=Forking\nMAINPID=", 23), 0);
+
+	TEST_EQ (job->state, JOB_SPAWNED);
+	TEST_EQ (job->pid[PROCESS_MAIN], 1000);
+
+	{
+		char msg[64];
+
+		sprintf (msg, "MAINPID=%d", getpid ());
+
+		TEST_EQ (notify_job_message (job, 1000, geteuid (),
+					     msg, strlen (msg)), 0);
+	}
+
+	TEST_EQ (job->state, JOB_SPAWNED);
+	TEST_EQ (job->pid[PROCESS_MAIN], getpid ());
+	TEST_EQ_P (job_process_find (getpid (), NULL), job);
+	TEST_GE (job->notify_fd, 0);
+
+	free_job (job);
+
+
+	/* Check that MAINPID= naming a process that was not started by the
+	 * main process, and runs as another user than the job, is ignored.
+	 */
+	TEST_FEATURE ("with main process of other user");
+	class->setuid = "nosuchuser";
+	job = spawned_job (class);
+	job->notify_uid = getuid () + 1;
+
+	TEST_CHILD (pid) {
+		pause ();
+	}
+
+	job_process_set_pid (job, PROCESS_MAIN, pid);
+
+	{
+		char msg[64];
+
+		sprintf (msg, "MAINPID=%d", getpid ());
+
+		TEST_EQ (notify_job_message (job, 1000, geteuid (),
+					     msg, strlen (msg)), 0);
+	}
+
+	TEST_EQ (job->pid[PROCESS_MAIN], pid);
+
+	kill (pid, SIGTERM);
+	waitpid (pid, NULL, 0);
+
+	free_job (job);
+
+
+	/* Check that MAINPID= naming a process started by the main process
+	 * is accepted even when it runs as another user than the job.
+	 */
+	TEST_FEATURE ("with main process started by job");
+	job = spawned_job (class);
+	job->notify_uid = getuid () + 1;
+	job_process_set_pid (job, PROCESS_MAIN, getpid ());
+
+	TEST_CHILD (pid) {
+		pause ();
+	}
+
+	{
+		char msg[64];
+
+		sprintf (msg, "MAINPID=%d", pid);
+
+		TEST_EQ (notify_job_message (job, 1000, geteuid (),
+					     msg, strlen (msg)), 0);
+	}
+
+	TEST_EQ (job->pid[PROCESS_MAIN], pid);
+
+	kill (pid, SIGTERM);
+	waitpid (pid, NULL, 0);
+
+	free_job (job);
+	class->setuid = NULL;
+
+
+	/* Check that a message from a user other than ourselves or that
+	 * of the job is ignored.
+	 */
+	TEST_FEATURE ("with other user");
+	job = spawned_job (class);
+
+	if (geteuid () != 65534) {
+		TEST_EQ (notify_job_message (job, 1000, 65534,
+					     "READY=1", 7), 0);
+
+		TEST_EQ (job->state, JOB_SPAWNED);
+	}
+
+	free_job (job);
+
+
+	/* Check that a message from the user the job runs as is accepted,
+	 * that user having been recorded when the job was spawned rather
+	 * than looked up by name.
+	 */
+	TEST_FEATURE ("with job user");
+	class->setuid = "nosuchuser";
+	job = spawned_job (class);
+	assert0 (notify_job_open (job));
+	job->notify_uid = 65534;
+
+	if (geteuid () != 65534) {
+		TEST_EQ (notify_job_message (job, 1000, 65534,
+					     "READY=1", 7), 1);
+
+		TEST_EQ (job->state, JOB_RUNNING);
+	}
+
+	free_job (job);
+
+
+	/* Check that the user the job runs as is taken from its main
+	 * process once spawned.
+	 */
+	TEST_FEATURE ("with job spawned");
+	job = spawned_job (class);
+	job_process_set_pid (job, PROCESS_MAIN, getpid ());
+	assert0 (notify_job_open (job));
+
+	notify_job_spawned (job);
+
+	if (geteuid ()) {
+		TEST_EQ (job->notify_uid, getuid ());
+	} else {
+		TEST_EQ (job->notify_uid, (uid_t)-1);
+	}
+
+	free_job (job);
+	class->setuid = NULL;
+
+
+	/* Check that a message for a job that is already running is
+	 * ignored.
+	 */
+	TEST_FEATURE ("with running job");
+	job = spawned_job (class);
+	job->state = JOB_RUNNING;
+
+	TEST_EQ (notify_job_message (job, 1000, geteuid (),
+				     "READY=1\nMAINPID=1234", 20), 0);
+
+	TEST_EQ (job->state, JOB_RUNNING);
+	TEST_EQ (job->pid[PROCESS_MAIN], 1000);
+
+	free_job (job);
+
+
+	/* Check that a message sent to the socket named by the address is
+	 * received and handled.
+	 */
+	TEST_FEATURE ("with message sent to socket");
+	job = spawned_job (class);
+	assert0 (notify_job_open (job));
+
+	{
+		nih_local char     *address = NULL;
+		struct sockaddr_un  addr;
+		fd_set              readfds, writefds, exceptfds;
+		int                 nfds = 0;
+		int                 fd;
+
+		address = notify_job_address (NULL, job);
+		TEST_NE_P (address, NULL);
+
+		memset (&addr, 0, sizeof (addr));
+		addr.sun_family = AF_UNIX;
+		memcpy (addr.sun_path, address, strlen (address));
+		addr.sun_path[0] = '\0';
+
+		fd = socket (AF_UNIX, SOCK_DGRAM, 0);
+		TEST_GE (fd, 0);
+
+		TEST_EQ (sendto (fd, "READY=1", 7, 0, (struct sockaddr *)&addr,
+				 offsetof (struct sockaddr_un, sun_path)
+				 + strlen (address)), 7);
+
+		close (fd);
+
+		FD_ZERO (&readfds);
+		FD_ZERO (&writefds);
+		FD_ZERO (&exceptfds);
+
+		nih_io_select_fds (&nfds, &readfds, &writefds, &exceptfds);
+		nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+	}
+
+	TEST_EQ (job->state, JOB_RUNNING);
+	TEST_LT (job->notify_fd, 0);
+
+	free_job (job);
+
+
+	nih_free (class);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	/* run tests in legacy (pre-session support) mode */
+	setenv ("UPSTART_NO_SESSIONS", "1", 1);
+
+	nih_main_init (argv[0]);
+
+	test_job_open ();
+	test_job_message ();
+
+	return 0;
+}
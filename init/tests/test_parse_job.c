@@ -37,6 +37,7 @@
 #include "parse_job.h"
 #include "errors.h"
 #include "apparmor.h"
+#include "listen.h"
 
 #ifdef ENABLE_CGROUPS
 
@@ -4328,6 +4329,39 @@ test_stanza_expect (void)
 	}
 
 
+	/* Check that expect notify sets the job's expect member to
+	 * EXPECT_NOTIFY.
+	 */
+	TEST_FEATURE ("with notify argument");
+	strcpy (buf, "expect notify\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->expect, EXPECT_NOTIFY);
+
+		nih_free (job);
+	}
+
+
 	/* Check that expect none sets the job's expect member to
 	 * EXPECT_NONE.
 	 */
@@ -4836,6 +4870,243 @@ test_stanza_respawn (void)
 	nih_free (err);
 
 
+	/* Check that a respawn stanza with the delay argument and a single
+	 * value sets the initial delay, leaving the default maximum, which
+	 * is also used as the stable time.
+	 */
+	TEST_FEATURE ("with delay");
+	strcpy (buf, "respawn delay 2\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->respawn_delay, 2);
+		TEST_EQ (job->respawn_delay_max, 300);
+		TEST_EQ (job->respawn_stable, 300);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a respawn stanza with the delay argument and two values
+	 * sets the initial and maximum delay, and the stable time to the
+	 * maximum.
+	 */
+	TEST_FEATURE ("with delay and maximum");
+	strcpy (buf, "respawn delay 2 60\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->respawn_delay, 2);
+		TEST_EQ (job->respawn_delay_max, 60);
+		TEST_EQ (job->respawn_stable, 60);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a respawn stanza with the delay argument and three
+	 * values sets the stable time as well.
+	 */
+	TEST_FEATURE ("with delay, maximum and stable time");
+	strcpy (buf, "respawn delay 2 60 600\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->respawn_delay, 2);
+		TEST_EQ (job->respawn_delay_max, 60);
+		TEST_EQ (job->respawn_stable, 600);
+
+		nih_free (job);
+	}
+
+
+	/* Check that an initial delay larger than the default maximum
+	 * raises the maximum to match.
+	 */
+	TEST_FEATURE ("with delay larger than default maximum");
+	strcpy (buf, "respawn delay 600\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->respawn_delay, 600);
+		TEST_EQ (job->respawn_delay_max, 600);
+		TEST_EQ (job->respawn_stable, 600);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a respawn stanza with the delay argument but no
+	 * values results in a syntax error.
+	 */
+	TEST_FEATURE ("with delay and missing arguments");
+	strcpy (buf, "respawn delay\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 13);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn delay stanza with a non-integer value
+	 * results in a syntax error.
+	 */
+	TEST_FEATURE ("with delay and non-integer argument");
+	strcpy (buf, "respawn delay 2 foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_INTERVAL);
+	TEST_EQ (pos, 16);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn delay stanza with a negative value results
+	 * in a syntax error.
+	 */
+	TEST_FEATURE ("with delay and negative argument");
+	strcpy (buf, "respawn delay -2\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_INTERVAL);
+	TEST_EQ (pos, 14);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn delay stanza with a maximum less than the
+	 * initial delay results in a syntax error.
+	 */
+	TEST_FEATURE ("with maximum less than delay");
+	strcpy (buf, "respawn delay 10 5\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_INTERVAL);
+	TEST_EQ (pos, 17);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn delay stanza with an extra argument results
+	 * in a syntax error.
+	 */
+	TEST_FEATURE ("with extra argument to delay");
+	strcpy (buf, "respawn delay 1 60 600 foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNEXPECTED_TOKEN);
+	TEST_EQ (pos, 23);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
 	/* Check that a respawn stanza with an unknown second argument
 	 * results in a syntax error.
 	 */
@@ -8826,6 +9097,621 @@ test_stanza_usage (void)
 	nih_free (err);
 }
 
+void
+test_stanza_concurrency (void)
+{
+	JobClass*job;
+	NihError *err;
+	size_t    pos, lineno;
+	char      buf[1024];
+
+	TEST_FUNCTION ("stanza_concurrency");
+
+	/* Check that a concurrency stanza with a single argument results
+	 * in the group being stored in the job with no limit of its own.
+	 */
+	TEST_FEATURE ("with group");
+	strcpy (buf, "concurrency disk\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->concurrency_group, job);
+		TEST_EQ_STR (job->concurrency_group, "disk");
+		TEST_EQ (job->concurrency_limit, 0);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a concurrency stanza with a group and limit results
+	 * in both being stored in the job.
+	 */
+	TEST_FEATURE ("with group and limit");
+	strcpy (buf, "concurrency disk 4\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->concurrency_group, job);
+		TEST_EQ_STR (job->concurrency_group, "disk");
+		TEST_EQ (job->concurrency_limit, 4);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a concurrency stanza with an unlimited limit results
+	 * in the group being stored with no limit.
+	 */
+	TEST_FEATURE ("with unlimited");
+	strcpy (buf, "concurrency disk unlimited\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ_STR (job->concurrency_group, "disk");
+		TEST_EQ (job->concurrency_limit, 0);
+
+		nih_free (job);
+	}
+
+
+	/* Check that the last of multiple concurrency stanzas is used.
+	 */
+	TEST_FEATURE ("with multiple stanzas");
+	strcpy (buf, "concurrency disk 4\n");
+	strcat (buf, "concurrency net\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 3);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->concurrency_group, job);
+		TEST_EQ_STR (job->concurrency_group, "net");
+		TEST_EQ (job->concurrency_limit, 0);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a concurrency stanza without an argument results in
+	 * a syntax error.
+	 */
+	TEST_FEATURE ("with missing argument");
+	strcpy (buf, "concurrency\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 11);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a concurrency stanza with a limit of zero results in
+	 * a syntax error.
+	 */
+	TEST_FEATURE ("with zero limit");
+	strcpy (buf, "concurrency disk 0\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_LIMIT);
+	TEST_EQ (pos, 17);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a concurrency stanza with a non-integer limit results
+	 * in a syntax error.
+	 */
+	TEST_FEATURE ("with non-integer limit");
+	strcpy (buf, "concurrency disk foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_LIMIT);
+	TEST_EQ (pos, 17);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a concurrency stanza with an extra third argument
+	 * results in a syntax error.
+	 */
+	TEST_FEATURE ("with extra argument");
+	strcpy (buf, "concurrency disk 4 foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNEXPECTED_TOKEN);
+	TEST_EQ (pos, 19);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+}
+
+void
+test_stanza_priority (void)
+{
+	JobClass*job;
+	NihError *err;
+	size_t    pos, lineno;
+	char      buf[1024];
+
+	TEST_FUNCTION ("stanza_priority");
+
+	/* Check that a priority stanza with a positive argument results
+	 * in it being stored in the job.
+	 */
+	TEST_FEATURE ("with positive argument");
+	strcpy (buf, "priority 10\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->priority, 10);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a priority stanza with a negative argument results
+	 * in it being stored in the job.
+	 */
+	TEST_FEATURE ("with negative argument");
+	strcpy (buf, "priority -10\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->priority, -10);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a priority stanza without an argument results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with missing argument");
+	strcpy (buf, "priority\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 8);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a priority stanza with a non-integer argument results
+	 * in a syntax error.
+	 */
+	TEST_FEATURE ("with non-integer argument");
+	strcpy (buf, "priority foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_PRIORITY);
+	TEST_EQ (pos, 9);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+}
+
+void
+test_stanza_listen (void)
+{
+	JobClass     *job;
+	ListenSocket *sock;
+	NihError     *err;
+	size_t        pos, lineno;
+	char          buf[1024];
+	int           i;
+
+	TEST_FUNCTION ("stanza_listen");
+
+	/* Check that a listen stanza with the inet argument and an address
+	 * and port adds a socket to the job.
+	 */
+	TEST_FEATURE ("with inet socket");
+	strcpy (buf, "listen inet 127.0.0.1 8080\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_LIST_NOT_EMPTY (&job->listen);
+
+		sock = (ListenSocket *)job->listen.next;
+		TEST_ALLOC_PARENT (sock, job);
+		TEST_EQ (sock->type, LISTEN_INET);
+		TEST_EQ_STR (sock->address, "127.0.0.1");
+		TEST_EQ (sock->port, 8080);
+		TEST_EQ (sock->max_instances, LISTEN_DEFAULT_MAX_INSTANCES);
+		TEST_LT (sock->fd, 0);
+		TEST_EQ_P (sock->entry.next, &job->listen);
+
+		TEST_FALSE (job->listen_accept);
+
+		nih_free (job);
+	}
+
+
+	/* Check that multiple listen stanzas add sockets in order, and
+	 * that the accept argument sets accept mode.
+	 */
+	TEST_FEATURE ("with multiple sockets and accept");
+	strcpy (buf, "listen unix /run/foo.sock\n");
+	strcat (buf, "listen unix @foo\n");
+	strcat (buf, "listen accept\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 4);
+
+		sock = (ListenSocket *)job->listen.next;
+		TEST_EQ (sock->type, LISTEN_UNIX);
+		TEST_EQ_STR (sock->address, "/run/foo.sock");
+
+		sock = (ListenSocket *)sock->entry.next;
+		TEST_EQ (sock->type, LISTEN_UNIX);
+		TEST_EQ_STR (sock->address, "@foo");
+		TEST_EQ_P (sock->entry.next, &job->listen);
+
+		TEST_TRUE (job->listen_accept);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a final argument to a listen stanza sets the maximum
+	 * number of instances of the socket, and that "unlimited" removes
+	 * the limit.
+	 */
+	TEST_FEATURE ("with maximum instances");
+	strcpy (buf, "listen inet 127.0.0.1 8080 10
+");
+	strcat (buf, "listen unix @foo unlimited
+");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 3);
+
+		sock = (ListenSocket *)job->listen.next;
+		TEST_EQ (sock->type, LISTEN_INET);
+		TEST_EQ (sock->port, 8080);
+		TEST_EQ (sock->max_instances, 10);
+
+		sock = (ListenSocket *)sock->entry.next;
+		TEST_EQ (sock->type, LISTEN_UNIX);
+		TEST_EQ_STR (sock->address, "@foo");
+		TEST_EQ (sock->max_instances, 0);
+		TEST_EQ_P (sock->entry.next, &job->listen);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a listen stanza with a maximum number of instances
+	 * that isn't a positive integer results in a syntax error.
+	 */
+	TEST_FEATURE ("with illegal maximum instances");
+	strcpy (buf, "listen unix @foo 0\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_LIMIT);
+	TEST_EQ (pos, 17);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a listen stanza with an unknown argument results in
+	 * a syntax error.
+	 */
+	TEST_FEATURE ("with unknown argument");
+	strcpy (buf, "listen tcp 127.0.0.1 8080\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
+	TEST_EQ (pos, 7);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a listen stanza with an address that isn't an IPv4
+	 * address results in a syntax error.
+	 */
+	TEST_FEATURE ("with illegal inet address");
+	strcpy (buf, "listen inet localhost 8080\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_ADDRESS);
+	TEST_EQ (pos, 12);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a listen stanza with a port out of range results in
+	 * a syntax error.
+	 */
+	TEST_FEATURE ("with illegal port");
+	strcpy (buf, "listen inet 127.0.0.1 65536\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_ADDRESS);
+	TEST_EQ (pos, 22);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a listen stanza with a relative unix path results in
+	 * a syntax error.
+	 */
+	TEST_FEATURE ("with relative unix path");
+	strcpy (buf, "listen unix foo.sock\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_ADDRESS);
+	TEST_EQ (pos, 12);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a listen stanza without an address results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with missing address");
+	strcpy (buf, "listen unix\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 11);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that more listen stanzas than there are descriptors to
+	 * pass them in results in an error.
+	 */
+	TEST_FEATURE ("with too many sockets");
+	strcpy (buf, "");
+	for (i = 0; i <= LISTEN_MAX_SOCKETS; i++)
+		sprintf (buf + strlen (buf), "listen unix @foo%d\n", i);
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_TOO_MANY_SOCKETS);
+	TEST_EQ (lineno, LISTEN_MAX_SOCKETS + 1);
+	nih_free (err);
+}
+
 #ifdef ENABLE_CGROUPS
 
 void
@@ -9754,6 +10640,9 @@ main (int   argc,
 	test_stanza_setuid ();
 	test_stanza_setgid ();
 	test_stanza_usage ();
+	test_stanza_concurrency ();
+	test_stanza_priority ();
+	test_stanza_listen ();
 
 #ifdef ENABLE_CGROUPS
 	test_stanza_cgroup ();
@@ -0,0 +1,425 @@
+/* upstart
+ *
+ * test_schedule.c - test suite for init/schedule.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <stdlib.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/string.h>
+#include <nih/main.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "event.h"
+#include "event_operator.h"
+#include "schedule.h"
+
+
+/**
+ * finish_starting:
+ * @job: job blocked by an event.
+ *
+ * Unblocks @job as though the event blocking it had finished, taking it
+ * on to the next state it rests in.
+ **/
+static void
+finish_starting (Job *job)
+{
+	job->blocker = NULL;
+	job_change_state (job, job_next_state (job));
+}
+
+/**
+ * hold_starting:
+ * @job: job to hold.
+ *
+ * Places @job part way through starting, as though it were running its
+ * pre-start process, so that it is counted as starting.
+ **/
+static void
+hold_starting (Job *job)
+{
+	job->goal = JOB_START;
+	job->state = JOB_PRE_START;
+	schedule_job_state (job);
+}
+
+/**
+ * finish_pre_start:
+ * @job: job held by hold_starting().
+ *
+ * Moves @job on as though its pre-start process had finished, taking it
+ * through to running since it has no other processes.
+ **/
+static void
+finish_pre_start (Job *job)
+{
+	job_change_state (job, job_next_state (job));
+}
+
+/**
+ * free_events:
+ *
+ * Discards the events emitted by the jobs in each test.
+ **/
+static void
+free_events (void)
+{
+	NIH_LIST_FOREACH_SAFE (events, iter) {
+		Event *event = (Event *)iter;
+
+		nih_free (event);
+	}
+}
+
+
+void
+test_starting_state (void)
+{
+	TEST_FUNCTION ("schedule_starting_state");
+
+	TEST_FALSE (schedule_starting_state (JOB_WAITING));
+	TEST_FALSE (schedule_starting_state (JOB_STARTING));
+	TEST_TRUE (schedule_starting_state (JOB_SECURITY_SPAWNING));
+	TEST_TRUE (schedule_starting_state (JOB_PRE_START));
+	TEST_TRUE (schedule_starting_state (JOB_POST_START));
+	TEST_FALSE (schedule_starting_state (JOB_RUNNING));
+	TEST_FALSE (schedule_starting_state (JOB_STOPPING));
+}
+
+void
+test_job_admit (void)
+{
+	JobClass *class1, *class2, *class3, *class4;
+	Job      *job1, *job2, *job3;
+
+	TEST_FUNCTION ("schedule_job_admit");
+	event_init ();
+	job_class_init ();
+	schedule_init ();
+
+	class1 = job_class_new (NULL, "foo", NULL);
+	class2 = job_class_new (NULL, "bar", NULL);
+	class3 = job_class_new (NULL, "baz", NULL);
+
+
+	/* Check that with no limits, every job is started at once, and
+	 * is not counted as starting while its starting event is handled.
+	 */
+	TEST_FEATURE ("with no limit");
+	schedule_limit = 0;
+
+	job1 = job_new (class1, "");
+	job2 = job_new (class2, "");
+
+	job_change_goal (job1, JOB_START);
+	job_change_goal (job2, JOB_START);
+
+	TEST_EQ (job1->state, JOB_STARTING);
+	TEST_EQ (job2->state, JOB_STARTING);
+	TEST_EQ (schedule_starting, 0);
+	TEST_LIST_EMPTY (schedule_queue);
+
+	finish_starting (job1);
+	finish_starting (job2);
+
+	TEST_EQ (job1->state, JOB_RUNNING);
+	TEST_EQ (job2->state, JOB_RUNNING);
+	TEST_EQ (schedule_starting, 0);
+
+	nih_free (job1);
+	nih_free (job2);
+	free_events ();
+
+
+	/* Check that a job that would exceed the limit once its starting
+	 * event has finished is held back in the starting state with a
+	 * goal of start, and is started once the job ahead of it is
+	 * running.
+	 */
+	TEST_FEATURE ("with limit");
+	schedule_limit = 1;
+
+	job1 = job_new (class1, "");
+	job2 = job_new (class2, "");
+
+	hold_starting (job1);
+	TEST_EQ (schedule_starting, 1);
+
+	job_change_goal (job2, JOB_START);
+	TEST_EQ (job2->state, JOB_STARTING);
+	TEST_EQ_P (job2->queued, NULL);
+
+	finish_starting (job2);
+
+	TEST_EQ (job2->goal, JOB_START);
+	TEST_EQ (job2->state, JOB_STARTING);
+	TEST_EQ_P (job2->blocker, NULL);
+	TEST_NE_P (job2->queued, NULL);
+	TEST_EQ (schedule_starting, 1);
+
+	finish_pre_start (job1);
+
+	TEST_EQ (job1->state, JOB_RUNNING);
+	TEST_EQ (job2->state, JOB_RUNNING);
+	TEST_EQ_P (job2->queued, NULL);
+	TEST_LIST_EMPTY (schedule_queue);
+	TEST_EQ (schedule_starting, 0);
+
+	nih_free (job1);
+	nih_free (job2);
+	free_events ();
+
+
+	/* Check that queued jobs are ordered highest priority first,
+	 * regardless of the order they were queued in.
+	 */
+	TEST_FEATURE ("with priority");
+	schedule_limit = 1;
+	class3->priority = 10;
+
+	job1 = job_new (class1, "");
+	job2 = job_new (class2, "");
+	job3 = job_new (class3, "");
+
+	hold_starting (job1);
+
+	job_change_goal (job2, JOB_START);
+	job_change_goal (job3, JOB_START);
+	finish_starting (job2);
+	finish_starting (job3);
+
+	TEST_EQ_P (schedule_queue->next, &job3->queued->entry);
+	TEST_EQ_P (schedule_queue->prev, &job2->queued->entry);
+
+	finish_pre_start (job1);
+
+	TEST_EQ (job3->state, JOB_RUNNING);
+	TEST_EQ (job2->state, JOB_RUNNING);
+	TEST_LIST_EMPTY (schedule_queue);
+
+	nih_free (job1);
+	nih_free (job2);
+	nih_free (job3);
+	free_events ();
+	class3->priority = 0;
+
+
+	/* Check that a job is held back when its concurrency group is
+	 * full, but that this doesn't hold back a job of another group
+	 * whose starting event finishes after it.
+	 */
+	TEST_FEATURE ("with group limit");
+	schedule_limit = 0;
+	class1->concurrency_group = "disk";
+	class1->concurrency_limit = 1;
+	class2->concurrency_group = "disk";
+	class2->concurrency_limit = 1;
+
+	job1 = job_new (class1, "");
+	job2 = job_new (class2, "");
+	job3 = job_new (class3, "");
+
+	hold_starting (job1);
+
+	job_change_goal (job2, JOB_START);
+	job_change_goal (job3, JOB_START);
+	finish_starting (job2);
+	finish_starting (job3);
+
+	TEST_EQ (job2->state, JOB_STARTING);
+	TEST_NE_P (job2->queued, NULL);
+	TEST_EQ (job3->state, JOB_RUNNING);
+	TEST_EQ (schedule_starting, 1);
+
+	finish_pre_start (job1);
+
+	TEST_EQ (job2->state, JOB_RUNNING);
+	TEST_EQ (schedule_starting, 0);
+
+	nih_free (job1);
+	nih_free (job2);
+	nih_free (job3);
+	free_events ();
+	class1->concurrency_group = NULL;
+	class2->concurrency_group = NULL;
+
+
+	/* Check that a job stopped while queued is left in the queue
+	 * until schedule_poll() begins stopping it, and is never started.
+	 */
+	TEST_FEATURE ("with job stopped while queued");
+	schedule_limit = 1;
+
+	job1 = job_new (class1, "");
+	job2 = job_new (class2, "");
+
+	hold_starting (job1);
+
+	job_change_goal (job2, JOB_START);
+	finish_starting (job2);
+	job_change_goal (job2, JOB_STOP);
+
+	TEST_EQ (job2->state, JOB_STARTING);
+	TEST_NE_P (job2->queued, NULL);
+
+	schedule_poll ();
+
+	TEST_EQ (job2->state, JOB_STOPPING);
+	TEST_EQ_P (job2->queued, NULL);
+	TEST_LIST_EMPTY (schedule_queue);
+	TEST_EQ (job1->state, JOB_PRE_START);
+
+	TEST_FREE_TAG (job2);
+
+	finish_starting (job2);
+
+	TEST_FREE (job2);
+
+	finish_pre_start (job1);
+
+	TEST_EQ (schedule_starting, 0);
+
+	nih_free (job1);
+	free_events ();
+
+
+	/* Check that freeing a starting job stops it being counted. */
+	TEST_FEATURE ("with starting job freed");
+	schedule_limit = 0;
+
+	job1 = job_new (class1, "");
+
+	hold_starting (job1);
+
+	TEST_EQ (schedule_starting, 1);
+
+	nih_free (job1);
+
+	TEST_EQ (schedule_starting, 0);
+
+	free_events ();
+
+
+	/* Check that a job started by the starting event of another is
+	 * not held back by it, since that event cannot finish until the
+	 * job started by it is running; with a limit of one, both jobs
+	 * must reach running.
+	 */
+	TEST_FEATURE ("with job started by starting event");
+	schedule_limit = 1;
+
+	class4 = job_class_new (NULL, "qux", NULL);
+	class4->start_on = event_operator_new (class4, EVENT_MATCH,
+					       "starting", NULL);
+	NIH_MUST (nih_str_array_add (&class4->start_on->env,
+				     class4->start_on, NULL, "foo"));
+	job_class_add_safe (class4);
+
+	job1 = job_new (class1, "");
+
+	job_change_goal (job1, JOB_START);
+
+	event_poll ();
+
+	TEST_EQ (job1->state, JOB_RUNNING);
+
+	job2 = (Job *)nih_hash_lookup (class4->instances, "");
+	TEST_NE_P (job2, NULL);
+	TEST_EQ (job2->state, JOB_RUNNING);
+
+	TEST_LIST_EMPTY (schedule_queue);
+	TEST_EQ (schedule_starting, 0);
+
+	nih_free (job1);
+	nih_free (class4);
+	free_events ();
+
+
+	schedule_limit = 0;
+
+	nih_free (class1);
+	nih_free (class2);
+	nih_free (class3);
+}
+
+void
+test_job_restore (void)
+{
+	JobClass *class;
+	Job      *job1, *job2;
+
+	TEST_FUNCTION ("schedule_job_restore");
+	schedule_init ();
+
+	class = job_class_new (NULL, "foo", NULL);
+
+
+	/* Check that a job restored part way through starting is counted,
+	 * and one restored in the starting state but no longer blocked by
+	 * its starting event is queued again.
+	 */
+	TEST_FEATURE ("with starting and queued jobs");
+	job1 = job_new (class, "one");
+	job1->goal = JOB_START;
+	job1->state = JOB_PRE_START;
+
+	job2 = job_new (class, "two");
+	job2->goal = JOB_START;
+	job2->state = JOB_STARTING;
+
+	schedule_job_restore (job1);
+	schedule_job_restore (job2);
+
+	TEST_EQ (schedule_starting, 1);
+	TEST_TRUE (job1->scheduled);
+	TEST_EQ_P (job1->queued, NULL);
+	TEST_NE_P (job2->queued, NULL);
+	TEST_EQ_P (schedule_queue->next, &job2->queued->entry);
+
+	nih_free (job1);
+	nih_free (job2);
+
+	TEST_EQ (schedule_starting, 0);
+	TEST_LIST_EMPTY (schedule_queue);
+
+	nih_free (class);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	/* run tests in legacy (pre-session support) mode */
+	setenv ("UPSTART_NO_SESSIONS", "1", 1);
+
+	nih_main_init (argv[0]);
+
+	test_starting_state ();
+	test_job_admit ();
+	test_job_restore ();
+
+	return 0;
+}
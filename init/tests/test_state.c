@@ -28,6 +28,8 @@
 #include <libgen.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <fcntl.h>
 #include <nih/test.h>
 #include <nih/timer.h>
 #include <nih/child.h>
@@ -45,6 +47,7 @@
 #include "conf.h"
 #include "job_class.h"
 #include "job.h"
+#include "job_process.h"
 #include "log.h"
 #include "blocked.h"
 #include "control.h"
@@ -437,6 +440,9 @@ log_diff (const Log *a, const Log *b)
 	if (obj_num_check (a, b, open_errno))
 		goto fail;
 
+	if (obj_num_check (a, b, dropped))
+		goto fail;
+
 	return 0;
 
 fail:
@@ -610,6 +616,15 @@ job_class_diff (const JobClass *a, const JobClass *b,
 	if (obj_num_check (a, b, respawn_interval))
 		goto fail;
 
+	if (obj_num_check (a, b, respawn_delay))
+		goto fail;
+
+	if (obj_num_check (a, b, respawn_delay_max))
+		goto fail;
+
+	if (obj_num_check (a, b, respawn_stable))
+		goto fail;
+
 	if (obj_num_check (a, b, normalexit_len))
 		goto fail;
 
@@ -663,6 +678,21 @@ job_class_diff (const JobClass *a, const JobClass *b,
 	if (obj_string_check (a, b, apparmor_switch))
 		goto fail;
 
+	if (obj_string_check (a, b, concurrency_group))
+		goto fail;
+
+	if (obj_num_check (a, b, concurrency_limit))
+		goto fail;
+
+	if (obj_num_check (a, b, priority))
+		goto fail;
+
+	if (obj_num_check (a, b, listen_accept))
+		goto fail;
+
+	if (obj_num_check (a, b, listen_serial))
+		goto fail;
+
 	return 0;
 
 fail:
@@ -784,6 +814,27 @@ job_diff (const Job *a, const Job *b, AlreadySeen seen, int check_class)
 	if (obj_num_check (a, b, respawn_count))
 		goto fail;
 
+	if (obj_num_check (a, b, respawn_backoff))
+		goto fail;
+
+	if (nih_timer_diff (a->respawn_timer, b->respawn_timer))
+		goto fail;
+
+	if (obj_num_check (a, b, listen_fd))
+		goto fail;
+
+	if (obj_num_check (a, b, listen_socket))
+		goto fail;
+
+	if (obj_num_check (a, b, notify_fd))
+		goto fail;
+
+	if (obj_num_check (a, b, notify_ready))
+		goto fail;
+
+	if (obj_num_check (a, b, notify_uid))
+		goto fail;
+
 	if (obj_num_check (a, b, trace_forks))
 		goto fail;
 
@@ -2251,8 +2302,8 @@ test_job_class_serialise (void)
 
 	job1->goal = JOB_START;
 	job1->state = JOB_PRE_STOP;
-	job1->pid[PROCESS_MAIN] = 1234;
-	job1->pid[PROCESS_PRE_STOP] = 5678;
+	job_process_set_pid (job1, PROCESS_MAIN, 1234);
+	job_process_set_pid (job1, PROCESS_PRE_STOP, 5678);
 
 	json = job_class_serialise (class);
 	TEST_NE_P (json, NULL);
@@ -2308,15 +2359,15 @@ test_job_class_serialise (void)
 
 	job1->goal = JOB_START;
 	job1->state = JOB_PRE_STOP;
-	job1->pid[PROCESS_MAIN] = 1234;
-	job1->pid[PROCESS_PRE_STOP] = 5678;
+	job_process_set_pid (job1, PROCESS_MAIN, 1234);
+	job_process_set_pid (job1, PROCESS_PRE_STOP, 5678);
 
 	job2->goal = JOB_STOP;
 	job2->state = JOB_WAITING;
 
 	job3->goal = JOB_START;
 	job3->state = JOB_RUNNING;
-	job3->pid[PROCESS_MAIN] = 1;
+	job_process_set_pid (job3, PROCESS_MAIN, 1);
 
 	json = job_class_serialise (class);
 	TEST_NE_P (json, NULL);
@@ -2827,6 +2878,420 @@ test_hex_encoding (void)
 	TEST_EQ (ret, 0);
 }
 
+void
+test_binary_encoding (void)
+{
+	nih_local NihIoBuffer  *buffer = NULL;
+	nih_local char         *str = NULL;
+	json_object            *json;
+	json_object            *array;
+	json_object            *nested;
+	json_object            *new_json;
+	json_object            *value;
+	char                    binary[] = { 'a', '\0', 'b' };
+	size_t                  len;
+
+	TEST_GROUP ("binary snapshot encoding");
+
+	json = json_object_new_object ();
+	TEST_NE_P (json, NULL);
+
+	json_object_object_add (json, "null", NULL);
+	json_object_object_add (json, "boolean",
+			json_object_new_boolean (TRUE));
+	json_object_object_add (json, "int",
+			json_object_new_int64 (-1234567890123LL));
+	json_object_object_add (json, "double",
+			json_object_new_double (0.5));
+	json_object_object_add (json, "string",
+			json_object_new_string ("hello world"));
+	json_object_object_add (json, "binary",
+			json_object_new_string_len (binary, sizeof (binary)));
+
+	array = json_object_new_array ();
+	json_object_array_add (array, json_object_new_int (1));
+	json_object_array_add (array, json_object_new_string (""));
+	nested = json_object_new_object ();
+	json_object_object_add (nested, "key", json_object_new_int (2));
+	json_object_array_add (array, nested);
+	json_object_object_add (json, "array", array);
+
+	/*******************************/
+	TEST_FEATURE ("round trip");
+
+	buffer = nih_io_buffer_new (NULL);
+	TEST_NE_P (buffer, NULL);
+
+	TEST_EQ (state_json_to_binary (buffer, json), 0);
+	TEST_GT (buffer->len, sizeof (StateBinaryHeader));
+	TEST_TRUE (state_is_binary (buffer->buf, buffer->len));
+
+	new_json = state_binary_to_json (buffer->buf, buffer->len);
+	TEST_NE_P (new_json, NULL);
+
+	TEST_EQ_STR (json_object_to_json_string (new_json),
+			json_object_to_json_string (json));
+
+	TEST_TRUE (json_object_object_get_ex (new_json, "binary", &value));
+	TEST_EQ (json_object_get_string_len (value), sizeof (binary));
+	TEST_EQ_MEM (json_object_get_string (value), binary, sizeof (binary));
+
+	json_object_put (new_json);
+
+	/*******************************/
+	TEST_FEATURE ("with truncated data");
+
+	for (len = 0; len < buffer->len; len++) {
+		new_json = state_binary_to_json (buffer->buf, len);
+		TEST_EQ_P (new_json, NULL);
+	}
+
+	/*******************************/
+	TEST_FEATURE ("with unknown version");
+
+	((StateBinaryHeader *)buffer->buf)->version = STATE_BINARY_VERSION + 1;
+
+	new_json = state_binary_to_json (buffer->buf, buffer->len);
+	TEST_EQ_P (new_json, NULL);
+
+	/*******************************/
+	TEST_FEATURE ("with JSON text");
+
+	str = NIH_MUST (nih_strdup (NULL, json_object_to_json_string (json)));
+
+	TEST_FALSE (state_is_binary (str, strlen (str)));
+
+	new_json = state_binary_to_json (str, strlen (str));
+	TEST_EQ_P (new_json, NULL);
+
+	json_object_put (json);
+
+	/*******************************/
+	TEST_FEATURE ("with upgrade data files");
+
+	for (TestDataFile *datafile = test_data_files;
+			datafile && datafile->filename;
+			datafile++) {
+		nih_local char         *path = NULL;
+		nih_local char         *json_string = NULL;
+		nih_local NihIoBuffer  *file_buffer = NULL;
+
+		path = NIH_MUST (nih_sprintf (NULL, "%s/%s",
+					TEST_DATA_DIR, datafile->filename));
+
+		json_string = nih_file_read (NULL, path, &len);
+		TEST_NE_P (json_string, NULL);
+
+		json = json_tokener_parse (json_string);
+		TEST_NE_P (json, NULL);
+
+		file_buffer = nih_io_buffer_new (NULL);
+		TEST_NE_P (file_buffer, NULL);
+
+		TEST_EQ (state_json_to_binary (file_buffer, json), 0);
+
+		new_json = state_binary_to_json (file_buffer->buf,
+						 file_buffer->len);
+		TEST_NE_P (new_json, NULL);
+
+		TEST_EQ_STR (json_object_to_json_string (new_json),
+				json_object_to_json_string (json));
+
+		json_object_put (new_json);
+		json_object_put (json);
+	}
+}
+
+void
+test_stream (void)
+{
+	char            filename[PATH_MAX];
+	int             fd;
+	ConfSource     *source;
+	ConfFile       *file;
+	JobClass       *class;
+	Job            *job;
+	Event          *event;
+	Blocked        *blocked;
+
+	TEST_FUNCTION ("state_write_stream");
+
+	conf_init ();
+	session_init ();
+	event_init ();
+	control_init ();
+	job_class_init ();
+
+	TEST_FILENAME (filename);
+
+	/*******************************/
+	TEST_FEATURE ("read back with state_read_objects");
+
+	TEST_LIST_EMPTY (sessions);
+	TEST_LIST_EMPTY (events);
+	TEST_LIST_EMPTY (conf_sources);
+	TEST_HASH_EMPTY (job_classes);
+
+	event = event_new (NULL, "Christmas", NULL);
+	TEST_NE_P (event, NULL);
+
+	source = conf_source_new (NULL, "/tmp/foo", CONF_JOB_DIR);
+	TEST_NE_P (source, NULL);
+
+	file = conf_file_new (source, "/tmp/foo/bar.conf");
+	TEST_NE_P (file, NULL);
+
+	class = file->job = job_class_new (NULL, "bar", NULL);
+	TEST_NE_P (class, NULL);
+	TEST_TRUE (job_class_consider (class));
+	TEST_HASH_NOT_EMPTY (job_classes);
+
+	fd = open (filename, O_CREAT | O_RDWR | O_TRUNC, 0600);
+	TEST_GT (fd, 0);
+
+	TEST_EQ (state_write_stream (fd), 0);
+	TEST_EQ (lseek (fd, 0, SEEK_SET), 0);
+
+	/* This will remove the class too */
+	nih_free (source);
+	nih_free (event);
+
+	TEST_LIST_EMPTY (events);
+	TEST_LIST_EMPTY (conf_sources);
+	TEST_HASH_EMPTY (job_classes);
+
+	job_class_environment_clear ();
+
+	TEST_EQ (state_read_objects (fd), 0);
+	close (fd);
+	assert0 (unlink (filename));
+
+	TEST_LIST_NOT_EMPTY (events);
+	TEST_LIST_NOT_EMPTY (conf_sources);
+	TEST_LIST_EMPTY (sessions);
+
+	event = (Event *)events->next;
+	TEST_EQ_STR (event->name, "Christmas");
+	nih_free (event);
+
+	class = (JobClass *)nih_hash_lookup (job_classes, "bar");
+	TEST_NE_P (class, NULL);
+
+	source = (ConfSource *)conf_sources->next;
+	TEST_EQ_STR (source->path, "/tmp/foo");
+
+	TEST_FREE_TAG (class);
+	nih_free (source);
+	TEST_FREE (class);
+
+	TEST_LIST_EMPTY (events);
+	TEST_LIST_EMPTY (conf_sources);
+	TEST_HASH_EMPTY (job_classes);
+
+	/*******************************/
+	/* Check that blocking entries are still recreated once the
+	 * events and job classes read have been pruned.
+	 */
+	TEST_FEATURE ("with blocked job");
+
+	event = event_new (NULL, "Christmas", NULL);
+	TEST_NE_P (event, NULL);
+
+	source = conf_source_new (NULL, "/tmp/foo", CONF_JOB_DIR);
+	TEST_NE_P (source, NULL);
+
+	file = conf_file_new (source, "/tmp/foo/bar.conf");
+	TEST_NE_P (file, NULL);
+
+	class = file->job = job_class_new (NULL, "bar", NULL);
+	TEST_NE_P (class, NULL);
+	TEST_TRUE (job_class_consider (class));
+
+	job = job_new (class, "");
+	TEST_NE_P (job, NULL);
+
+	blocked = blocked_new (event, BLOCKED_JOB, job);
+	TEST_NE_P (blocked, NULL);
+
+	nih_list_add (&event->blocking, &blocked->entry);
+	job->blocker = event;
+
+	fd = open (filename, O_CREAT | O_RDWR | O_TRUNC, 0600);
+	TEST_GT (fd, 0);
+
+	TEST_EQ (state_write_stream (fd), 0);
+	TEST_EQ (lseek (fd, 0, SEEK_SET), 0);
+
+	nih_free (source);
+	nih_free (event);
+
+	TEST_LIST_EMPTY (events);
+	TEST_HASH_EMPTY (job_classes);
+
+	job_class_environment_clear ();
+
+	TEST_EQ (state_read_objects (fd), 0);
+	close (fd);
+	assert0 (unlink (filename));
+
+	class = (JobClass *)nih_hash_lookup (job_classes, "bar");
+	TEST_NE_P (class, NULL);
+
+	job = (Job *)nih_hash_lookup (class->instances, "");
+	TEST_NE_P (job, NULL);
+
+	event = (Event *)events->next;
+	TEST_EQ_STR (event->name, "Christmas");
+	TEST_LIST_NOT_EMPTY (&event->blocking);
+
+	blocked = (Blocked *)event->blocking.next;
+	TEST_EQ (blocked->type, BLOCKED_JOB);
+	TEST_EQ_P (blocked->job, job);
+
+	nih_free (event);
+
+	source = (ConfSource *)conf_sources->next;
+	nih_free (source);
+
+	TEST_LIST_EMPTY (events);
+	TEST_LIST_EMPTY (conf_sources);
+	TEST_HASH_EMPTY (job_classes);
+}
+
+void
+test_reexec_ack (void)
+{
+	char               filename[PATH_MAX];
+	StateBinaryHeader  header;
+	char               value[16];
+	char               ack;
+	FILE              *output;
+	int                fds[2];
+	int                fd;
+	int                ret;
+
+	TEST_FUNCTION ("state_ack_memfd");
+
+	TEST_FILENAME (filename);
+
+	/*******************************/
+	/* Check that without a snapshot nothing is acknowledged and JSON
+	 * is read from the socket.
+	 */
+	TEST_FEATURE ("without snapshot");
+
+	assert0 (unsetenv (STATE_MEMFD_ENV));
+	assert0 (socketpair (AF_UNIX, SOCK_STREAM, 0, fds));
+
+	ret = state_ack_memfd (fds[0]);
+	TEST_EQ (ret, -1);
+
+	TEST_LT (recv (fds[1], &ack, 1, MSG_DONTWAIT), 0);
+	TEST_EQ (errno, EAGAIN);
+
+	close (fds[0]);
+	close (fds[1]);
+
+	/*******************************/
+	/* Check that a valid snapshot is acknowledged and returned, and
+	 * that the variable is removed from the environment.
+	 */
+	TEST_FEATURE ("with snapshot");
+
+	memcpy (header.magic, STATE_BINARY_MAGIC, STATE_BINARY_MAGIC_LEN);
+	header.version = STATE_BINARY_VERSION;
+	header.flags = 0;
+
+	fd = open (filename, O_CREAT | O_RDWR | O_TRUNC, 0600);
+	TEST_GT (fd, 0);
+	TEST_EQ (write (fd, &header, sizeof (header)), sizeof (header));
+
+	sprintf (value, "%d", fd);
+	assert0 (setenv (STATE_MEMFD_ENV, value, 1));
+	assert0 (socketpair (AF_UNIX, SOCK_STREAM, 0, fds));
+
+	ret = state_ack_memfd (fds[0]);
+	TEST_EQ (ret, fd);
+	TEST_EQ_P (getenv (STATE_MEMFD_ENV), NULL);
+
+	TEST_EQ (read (fds[1], &ack, 1), 1);
+	TEST_EQ (ack, STATE_ACK_BINARY);
+
+	close (fds[0]);
+	close (fds[1]);
+
+	/*******************************/
+	/* Check that a snapshot that cannot be read is refused, so that
+	 * JSON is sent instead.
+	 */
+	TEST_FEATURE ("with invalid snapshot");
+
+	header.version = STATE_BINARY_VERSION + 1;
+	TEST_EQ (pwrite (fd, &header, sizeof (header), 0), sizeof (header));
+
+	assert0 (setenv (STATE_MEMFD_ENV, value, 1));
+	assert0 (socketpair (AF_UNIX, SOCK_STREAM, 0, fds));
+
+	output = tmpfile ();
+	TEST_NE_P (output, NULL);
+
+	TEST_DIVERT_STDERR (output) {
+		ret = state_ack_memfd (fds[0]);
+	}
+	rewind (output);
+
+	TEST_EQ (ret, -1);
+	TEST_FILE_MATCH (output, "*Unable to read binary serialisation data - reading JSON\n");
+	TEST_FILE_END (output);
+	fclose (output);
+	TEST_EQ_P (getenv (STATE_MEMFD_ENV), NULL);
+
+	TEST_EQ (read (fds[1], &ack, 1), 1);
+	TEST_EQ (ack, STATE_ACK_JSON);
+
+	/* The snapshot was closed */
+	TEST_LT (fcntl (fd, F_GETFD), 0);
+
+	close (fds[0]);
+	close (fds[1]);
+	assert0 (unlink (filename));
+
+	/*******************************/
+
+	TEST_FUNCTION ("state_read_sync");
+
+	/*******************************/
+	/* Check that the wait ends once the other end is closed, and that
+	 * anything written first is discarded.
+	 */
+	TEST_FEATURE ("with other end closed");
+
+	assert0 (socketpair (AF_UNIX, SOCK_STREAM, 0, fds));
+	TEST_EQ (write (fds[1], "{}", 2), 2);
+	close (fds[1]);
+
+	ret = state_read_sync (fds[0]);
+	TEST_EQ (ret, 0);
+
+	close (fds[0]);
+
+	/*******************************/
+	/* Check that the wait times out if the other end is left open. */
+	TEST_FEATURE ("with other end open");
+
+	assert0 (socketpair (AF_UNIX, SOCK_STREAM, 0, fds));
+	TEST_EQ (setenv (STATE_WAIT_SECS_ENV, "1", 1), 0);
+
+	ret = state_read_sync (fds[0]);
+	TEST_LT (ret, 0);
+
+	TEST_EQ (unsetenv (STATE_WAIT_SECS_ENV), 0);
+	close (fds[0]);
+	close (fds[1]);
+
+	/*******************************/
+}
+
 void
 test_rlimit_encoding (void)
 {
@@ -4749,6 +5214,9 @@ main (int   argc,
 	test_int_arrays ();
 	test_string_arrays ();
 	test_hex_encoding ();
+	test_binary_encoding ();
+	test_stream ();
+	test_reexec_ack ();
 	test_rlimit_encoding ();
 	test_session_serialise ();
 	test_process_serialise ();
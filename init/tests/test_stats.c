@@ -0,0 +1,156 @@
+/* upstart
+ *
+ * test_stats.c - test suite for init/stats.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <string.h>
+
+#include "stats.h"
+
+
+void
+test_record (void)
+{
+	StatsHistogram *histogram;
+	uint64_t        start;
+
+	TEST_FUNCTION ("stats_record");
+	stats_reset ();
+
+	histogram = &stats_histograms[STATS_SPAWN];
+
+
+	/* Check that a duration of a few milliseconds is counted in the
+	 * bucket for its power of two in microseconds, and that the total
+	 * and maximum reflect it.
+	 */
+	TEST_FEATURE ("with duration of milliseconds");
+	start = stats_now () - 5000000;
+	stats_record (STATS_SPAWN, start);
+
+	TEST_EQ (histogram->count, 1);
+	TEST_GE (histogram->total, 5000000);
+	TEST_LT (histogram->total, 8192000);
+	TEST_EQ (histogram->max, histogram->total);
+	TEST_EQ (histogram->buckets[13], 1);
+
+	for (int i = 0; i < STATS_BUCKETS; i++) {
+		if (i != 13)
+			TEST_EQ (histogram->buckets[i], 0);
+	}
+
+	for (int i = 0; i < STATS_LAST; i++) {
+		if (i != STATS_SPAWN)
+			TEST_EQ (stats_histograms[i].count, 0);
+	}
+
+
+	/* Check that a start time in the future, as would follow the
+	 * clock failing, is counted as no time at all in the first bucket
+	 * and leaves the maximum alone.
+	 */
+	TEST_FEATURE ("with start in the future");
+	start = stats_now () + 1000000000;
+	stats_record (STATS_SPAWN, start);
+
+	TEST_EQ (histogram->count, 2);
+	TEST_EQ (histogram->max, histogram->total);
+	TEST_EQ (histogram->buckets[0], 1);
+	TEST_EQ (histogram->buckets[13], 1);
+
+
+	/* Check that a longer duration replaces the maximum but a shorter
+	 * one does not.
+	 */
+	TEST_FEATURE ("with longer and shorter durations");
+	start = stats_now () - 20000000;
+	stats_record (STATS_SPAWN, start);
+
+	TEST_EQ (histogram->count, 3);
+	TEST_GE (histogram->max, 20000000);
+	TEST_EQ (histogram->buckets[15], 1);
+
+	start = stats_now () - 2000;
+	stats_record (STATS_SPAWN, start);
+
+	TEST_EQ (histogram->count, 4);
+	TEST_LT (histogram->max, 32768000);
+	TEST_GE (histogram->max, 20000000);
+	TEST_GE (histogram->total, 25002000);
+
+	stats_reset ();
+}
+
+void
+test_reset (void)
+{
+	TEST_FUNCTION ("stats_reset");
+	stats_record (STATS_EVENT_POLL, stats_now ());
+	stats_record (STATS_CONF_RELOAD, stats_now ());
+
+	stats_reset ();
+
+	for (int i = 0; i < STATS_LAST; i++) {
+		TEST_EQ (stats_histograms[i].count, 0);
+		TEST_EQ (stats_histograms[i].total, 0);
+		TEST_EQ (stats_histograms[i].max, 0);
+
+		for (int j = 0; j < STATS_BUCKETS; j++)
+			TEST_EQ (stats_histograms[i].buckets[j], 0);
+	}
+}
+
+void
+test_phase_name (void)
+{
+	const char *name;
+
+	TEST_FUNCTION ("stats_phase_name");
+
+	/* Check that each phase has a name. */
+	TEST_FEATURE ("with known phases");
+	for (int i = 0; i < STATS_LAST; i++) {
+		name = stats_phase_name (i);
+
+		TEST_NE_P (name, NULL);
+	}
+
+	TEST_EQ_STR (stats_phase_name (STATS_EVENT_POLL), "event-poll");
+	TEST_EQ_STR (stats_phase_name (STATS_LOG_WRITE), "log-write");
+
+
+	/* Check that NULL is returned for an unknown phase. */
+	TEST_FEATURE ("with unknown phase");
+	name = stats_phase_name (STATS_LAST);
+
+	TEST_EQ_P (name, NULL);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_record ();
+	test_reset ();
+	test_phase_name ();
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/* upstart
+ *
+ * test_trace.c - test suite for init/trace.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <string.h>
+
+#include "trace.h"
+
+
+void
+test_record (void)
+{
+	const TraceRecord *record;
+	char               name[TRACE_NAME_MAX * 2];
+
+	TEST_FUNCTION ("trace_record");
+
+
+	/* Check that nothing is recorded when tracing is disabled. */
+	TEST_FEATURE ("with tracing disabled");
+	trace_size = 0;
+
+	trace_record (TRACE_JOB_STATE, "foo", "", "starting");
+
+	TEST_EQ (trace_count (), 0);
+
+
+	/* Check that a job state change is recorded with the instance
+	 * name in brackets after the job name, and an event with no
+	 * detail.
+	 */
+	TEST_FEATURE ("with job and event");
+	trace_size = 4;
+
+	trace_record (TRACE_JOB_STATE, "foo", "bar", "starting");
+	trace_record (TRACE_EVENT_HANDLING, "wibble", NULL, NULL);
+
+	TEST_EQ (trace_count (), 2);
+
+	record = trace_get (0);
+	TEST_EQ (record->type, TRACE_JOB_STATE);
+	TEST_EQ_STR (record->name, "foo (bar)");
+	TEST_EQ_STR (record->detail, "starting");
+
+	record = trace_get (1);
+	TEST_EQ (record->type, TRACE_EVENT_HANDLING);
+	TEST_EQ_STR (record->name, "wibble");
+	TEST_EQ_STR (record->detail, "");
+
+	TEST_GE (trace_get (1)->time, trace_get (0)->time);
+
+
+	/* Check that once the ring buffer is full the oldest records are
+	 * overwritten, and the remainder are returned oldest first.
+	 */
+	TEST_FEATURE ("with full ring buffer");
+	trace_record (TRACE_EVENT_FINISHED, "wibble", NULL, NULL);
+	trace_record (TRACE_JOB_STATE, "foo", "bar", "pre-start");
+	trace_record (TRACE_JOB_STATE, "foo", "bar", "spawned");
+
+	TEST_EQ (trace_count (), 4);
+
+	TEST_EQ_STR (trace_get (0)->name, "wibble");
+	TEST_EQ (trace_get (0)->type, TRACE_EVENT_HANDLING);
+	TEST_EQ (trace_get (1)->type, TRACE_EVENT_FINISHED);
+	TEST_EQ_STR (trace_get (2)->detail, "pre-start");
+	TEST_EQ_STR (trace_get (3)->detail, "spawned");
+
+
+	/* Check that a name too long for the record is truncated. */
+	TEST_FEATURE ("with long name");
+	memset (name, 'x', sizeof (name) - 1);
+	name[sizeof (name) - 1] = '\0';
+
+	trace_record (TRACE_EVENT_HANDLING, name, NULL, NULL);
+
+	record = trace_get (3);
+	TEST_EQ (strlen (record->name), TRACE_NAME_MAX - 1);
+	TEST_EQ (strncmp (record->name, name, TRACE_NAME_MAX - 1), 0);
+
+	trace_clear ();
+}
+
+void
+test_clear (void)
+{
+	TEST_FUNCTION ("trace_clear");
+	trace_size = 4;
+
+	trace_record (TRACE_EVENT_HANDLING, "wibble", NULL, NULL);
+	trace_clear ();
+
+	TEST_EQ (trace_count (), 0);
+
+	trace_record (TRACE_EVENT_FINISHED, "wibble", NULL, NULL);
+
+	TEST_EQ (trace_count (), 1);
+	TEST_EQ (trace_get (0)->type, TRACE_EVENT_FINISHED);
+
+	trace_clear ();
+}
+
+void
+test_type_name (void)
+{
+	TEST_FUNCTION ("trace_type_name");
+
+	TEST_EQ_STR (trace_type_name (TRACE_JOB_STATE), "job");
+	TEST_EQ_STR (trace_type_name (TRACE_EVENT_HANDLING), "event-handling");
+	TEST_EQ_STR (trace_type_name (TRACE_EVENT_FINISHED), "event-finished");
+	TEST_EQ_P (trace_type_name (TRACE_LAST), NULL);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_record ();
+	test_clear ();
+	test_type_name ();
+
+	return 0;
+}
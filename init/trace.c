@@ -0,0 +1,184 @@
+/* upstart
+ *
+ * trace.c - ring buffer of job and event transitions
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/logging.h>
+
+#include "trace.h"
+#include "stats.h"
+
+
+/**
+ * trace_size:
+ *
+ * Number of transitions kept in the trace ring buffer, once full the
+ * oldest are overwritten.  Zero, the default, disables tracing.
+ **/
+int trace_size = 0;
+
+/**
+ * trace_records:
+ *
+ * Ring buffer of trace_size records, allocated when the first
+ * transition is recorded.
+ **/
+static TraceRecord *trace_records = NULL;
+
+/**
+ * trace_head:
+ *
+ * Index in trace_records of the next record to be written.
+ **/
+static size_t trace_head = 0;
+
+/**
+ * trace_len:
+ *
+ * Number of records in trace_records that have been written.
+ **/
+static size_t trace_len = 0;
+
+
+/**
+ * trace_record:
+ * @type: kind of transition,
+ * @name: name of job or event,
+ * @instance: name of job instance, or NULL,
+ * @detail: state entered, or NULL.
+ *
+ * Records a transition of @type at the current time in the ring
+ * buffer, overwriting the oldest record if it is full.  @instance is
+ * appended to @name in brackets if it is not empty, as job_name()
+ * does.
+ *
+ * This returns immediately if tracing is not enabled, and never
+ * allocates once the ring buffer exists.
+ **/
+void
+trace_record (TraceType   type,
+	      const char *name,
+	      const char *instance,
+	      const char *detail)
+{
+	TraceRecord *record;
+
+	if (trace_size <= 0)
+		return;
+
+	nih_assert (type < TRACE_LAST);
+	nih_assert (name != NULL);
+
+	if (! trace_records)
+		trace_records = NIH_MUST (nih_alloc (NULL, sizeof (TraceRecord)
+						     * trace_size));
+
+	record = &trace_records[trace_head];
+
+	record->time = stats_now ();
+	record->type = type;
+
+	if (instance && *instance) {
+		snprintf (record->name, sizeof (record->name), "%s (%s)",
+			  name, instance);
+	} else {
+		snprintf (record->name, sizeof (record->name), "%s", name);
+	}
+
+	snprintf (record->detail, sizeof (record->detail), "%s",
+		  detail ? detail : "");
+
+	trace_head = (trace_head + 1) % trace_size;
+	if (trace_len < (size_t)trace_size)
+		trace_len++;
+}
+
+/**
+ * trace_count:
+ *
+ * Returns: number of records in the ring buffer.
+ **/
+size_t
+trace_count (void)
+{
+	return trace_len;
+}
+
+/**
+ * trace_get:
+ * @n: index of record.
+ *
+ * Returns the @n'th oldest record in the ring buffer, which must be
+ * less than trace_count().
+ *
+ * Returns: internal record.
+ **/
+const TraceRecord *
+trace_get (size_t n)
+{
+	nih_assert (n < trace_len);
+
+	return &trace_records[(trace_head + trace_size - trace_len + n)
+			      % trace_size];
+}
+
+/**
+ * trace_clear:
+ *
+ * Discards all records in the ring buffer.
+ **/
+void
+trace_clear (void)
+{
+	trace_head = 0;
+	trace_len = 0;
+}
+
+/**
+ * trace_type_name:
+ * @type: type to convert.
+ *
+ * Converts an enumerated trace record type into the string used for
+ * the D-Bus interface and by initctl.
+ *
+ * Returns: static string or NULL if type not known.
+ **/
+const char *
+trace_type_name (TraceType type)
+{
+	switch (type) {
+	case TRACE_JOB_STATE:
+		return N_("job");
+	case TRACE_EVENT_HANDLING:
+		return N_("event-handling");
+	case TRACE_EVENT_FINISHED:
+		return N_("event-finished");
+	default:
+		return NULL;
+	}
+}
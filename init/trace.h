@@ -0,0 +1,90 @@
+/* upstart
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_TRACE_H
+#define INIT_TRACE_H
+
+#include <stdint.h>
+
+#include <nih/macros.h>
+
+
+/**
+ * TRACE_NAME_MAX:
+ *
+ * Size of the buffer for the name of a job or event in each record;
+ * longer names are truncated.
+ **/
+#define TRACE_NAME_MAX 128
+
+/**
+ * TRACE_DETAIL_MAX:
+ *
+ * Size of the buffer for the detail of each record, large enough for
+ * the name of any job state.
+ **/
+#define TRACE_DETAIL_MAX 16
+
+
+/**
+ * TraceType:
+ *
+ * Kinds of transition recorded by the tracer.
+ **/
+typedef enum trace_type {
+	TRACE_JOB_STATE,
+	TRACE_EVENT_HANDLING,
+	TRACE_EVENT_FINISHED,
+	TRACE_LAST
+} TraceType;
+
+/**
+ * TraceRecord:
+ * @time: monotonic time of the transition in nanoseconds,
+ * @type: kind of transition,
+ * @name: name of job, with instance in brackets if any, or of event,
+ * @detail: state the job entered, empty for events.
+ *
+ * This structure is one entry in the trace ring buffer; it is fixed in
+ * size so that recording a transition never allocates.
+ **/
+typedef struct trace_record {
+	uint64_t  time;
+	TraceType type;
+	char      name[TRACE_NAME_MAX];
+	char      detail[TRACE_DETAIL_MAX];
+} TraceRecord;
+
+
+NIH_BEGIN_EXTERN
+
+extern int trace_size;
+
+void               trace_record    (TraceType type, const char *name,
+				    const char *instance, const char *detail);
+
+size_t             trace_count     (void);
+const TraceRecord *trace_get       (size_t n);
+void               trace_clear     (void);
+
+const char *       trace_type_name (TraceType type)
+	__attribute__ ((const));
+
+NIH_END_EXTERN
+
+#endif /* INIT_TRACE_H */
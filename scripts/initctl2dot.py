@@ -39,6 +39,13 @@
 #
 #  initctl2dot -o - | dot -Tpng -o upstart.png
 #
+# To highlight the chain of jobs and events that gated boot, boot with
+# "--trace-buffer=COUNT" on the kernel command-line and then:
+#
+#  initctl trace dump > trace.json
+#  initctl2dot -t trace.json -o - | dot -Tpng -o upstart.png
+#  initctl2dot -t trace.json --report -o -
+#
 # See also:
 #
 # - dot(1).
@@ -48,6 +55,7 @@
 
 import sys
 import re
+import json
 import fnmatch
 import os
 import datetime
@@ -66,6 +74,9 @@ upstart_session = None
 # list of jobs to restict output to
 restrictions_list = []
 
+# timings from "initctl trace dump" output, if given
+trace = None
+
 sanitise_table = str.maketrans({
     '-': '_',
     '$': 'dollar_',
@@ -86,6 +97,7 @@ default_color_event = 'thistle'
 default_color_job = '#DCDCDC'  # "Gainsboro"
 default_color_text = 'black'
 default_color_bg = 'white'
+default_color_critical = 'orange'
 
 default_outfile = 'upstart.dot'
 
@@ -122,6 +134,12 @@ def footer(ofh):
     else:
         details += "from '%s' on host %s)." % (cmd, os.uname()[1])
 
+    critical = ''
+    if trace:
+        critical = "Critical path to %s denoted by %s.\\n" \
+                   "Times are in ms since the first trace record.\\n" % \
+                   (trace['target'], options.color_critical)
+
     ofh.write("  overlap=false;\n"
               "  label=\"Generated on {datenow} by {script_name} {details}\\n"
               "Boxes of color {options.color_job} denote jobs.\\n"
@@ -130,9 +148,11 @@ def footer(ofh):
               "Emits denoted by {options.color_emits} lines.\\n"
               "Start on denoted by {options.color_start_on} lines.\\n"
               "Stop on denoted by {options.color_stop_on} lines.\\n"
+              "{critical}"
               "\";\n"
               "}}\n".format(options=options, datenow=datetime.datetime.now(),
-                            script_name=script_name, details=details))
+                            script_name=script_name, details=details,
+                            critical=critical))
 
 
 # Map punctuation to symbols palatable to graphviz
@@ -162,9 +182,20 @@ def mk_event_node_name(name):
 
 
 def show_event(ofh, name):
+    label = name
+    color = options.color_event
+
+    if trace and name in trace['events']:
+        event = trace['events'][name]
+        label += "\\n+%.1fms" % event['begin']
+        if event['end'] is not None:
+            label += ", handled in %.1fms" % (event['end'] - event['begin'])
+        if name in trace['critical events']:
+            color = options.color_critical
+
     str = "  %s [label=\"%s\", shape=diamond, fontcolor=\"%s\", " \
-          "fillcolor=\"%s\"," % (mk_event_node_name(name), name,
-                                 options.color_event_text, options.color_event)
+          "fillcolor=\"%s\"," % (mk_event_node_name(name), label,
+                                 options.color_event_text, color)
 
     if '*' in name:
         str += " style=\"dotted\""
@@ -209,11 +240,22 @@ def show_events(ofh):
 
 
 def show_job(ofh, name):
+    label = name
+    color = options.color_job
+
+    if trace and name in trace['jobs']:
+        job = trace['jobs'][name]
+        label += "\\n+%.1fms" % job['start']
+        if job['ready'] is not None:
+            label += ", ready after %.1fms, slack %.1fms" % \
+                     (job['ready'] - job['start'], job['slack'])
+        if name in trace['critical jobs']:
+            color = options.color_critical
+
     ofh.write("  %s [shape=\"record\", label=\"<job> %s | { <start> start on |"
               " <stop> stop on }\", fontcolor=\"%s\", style=\"filled\", "
-              " fillcolor=\"%s\"];\n" % (mk_job_node_name(name), name,
-                                         options.color_job_text,
-                                         options.color_job))
+              " fillcolor=\"%s\"];\n" % (mk_job_node_name(name), label,
+                                         options.color_job_text, color))
 
 
 def show_jobs(ofh):
@@ -259,22 +301,44 @@ def show_jobs(ofh):
                     show_job(ofh, k)
 
 
-def show_edge(ofh, from_node, to_node, color):
-    ofh.write("  %s -> %s [color=\"%s\"];\n" % (from_node, to_node, color))
+def show_edge(ofh, from_node, to_node, color, critical=False):
+    if critical:
+        ofh.write("  %s -> %s [color=\"%s\", penwidth=3];\n" %
+                  (from_node, to_node, options.color_critical))
+    else:
+        ofh.write("  %s -> %s [color=\"%s\"];\n" % (from_node, to_node, color))
+
+
+# Determine whether @job was started by @event with @event itself
+# emitted by @cause (any job if None), as part of the critical path.
+def is_critical(job, event, cause=None):
+    if not trace or job not in trace['critical jobs']:
+        return False
+
+    trigger = trace['jobs'][job]['trigger']
+    if not trigger or trigger['name'] != event:
+        return False
+
+    return cause is None or trigger['cause'] == cause
 
 
 def show_start_on_job_edge(ofh, from_job, to_job, relation):
+    critical = is_critical(from_job, relation, to_job)
+
     if relation == 'starting':
         show_edge(ofh, "%s:start" % mk_job_node_name(from_job),
-                  "%s:job" % mk_job_node_name(to_job),options.color_start_on)
+                  "%s:job" % mk_job_node_name(to_job),options.color_start_on,
+                  critical)
     else:
         show_edge(ofh, "%s:job" % mk_job_node_name(to_job),
-                  "%s:start" % mk_job_node_name(from_job), options.color_start_on)
+                  "%s:start" % mk_job_node_name(from_job), options.color_start_on,
+                  critical)
 
 
 def show_start_on_event_edge(ofh, from_job, to_event):
     show_edge(ofh, mk_event_node_name(to_event),
-              "%s:start" % mk_job_node_name(from_job), options.color_start_on)
+              "%s:start" % mk_job_node_name(from_job), options.color_start_on,
+              is_critical(from_job, to_event))
 
 
 def show_stop_on_job_edge(ofh, from_job, to_job):
@@ -288,8 +352,13 @@ def show_stop_on_event_edge(ofh, from_job, to_event):
 
 
 def show_job_emits_edge(ofh, from_job, to_event):
+    critical = False
+
+    if trace and to_event in trace['critical events']:
+        critical = trace['critical events'][to_event] == from_job
+
     show_edge(ofh, "%s:job" % mk_job_node_name(from_job),
-              mk_event_node_name(to_event), options.color_emits)
+              mk_event_node_name(to_event), options.color_emits, critical)
 
 
 def show_edges(ofh):
@@ -442,6 +511,222 @@ def read_data():
             jobs[job] = job_record
 
 
+# Read the output of "initctl trace dump" and return the start and
+# ready times of each job (by class, the first instance to start) and
+# the handling of each event, in milliseconds since the first record.
+def read_trace():
+    try:
+        if options.trace == '-':
+            data = json.load(sys.stdin)
+        else:
+            with open(options.trace, 'r') as fh:
+                data = json.load(fh)
+    except (IOError, ValueError) as e:
+        sys.exit("ERROR: cannot read trace file '%s': %s" % (options.trace, e))
+
+    threads = {}
+    job_times = {}
+    event_times = {}
+
+    for entry in data['traceEvents']:
+        if entry['ph'] == 'M' and entry['name'] == 'thread_name':
+            threads[entry['tid']] = entry['args']['name']
+
+    for entry in data['traceEvents']:
+        if entry.get('cat') == 'job' and entry['ph'] == 'X':
+            # Instances are shown as "job (instance)"
+            name = threads[entry['tid']].split(' (')[0]
+            begin = entry['ts'] / 1000.0
+            end = begin + entry['dur'] / 1000.0
+
+            if name not in job_times:
+                if entry['name'] != 'starting':
+                    continue
+                job_times[name] = {'start': begin, 'ready': None,
+                                   'last': end, 'instance': entry['tid']}
+                continue
+
+            job = job_times[name]
+            if job['instance'] != entry['tid'] or job['ready'] is not None:
+                continue
+
+            if entry['name'] == 'running':
+                job['ready'] = begin
+            else:
+                job['last'] = end
+
+        elif entry.get('cat') == 'event' and entry['ph'] == 'b':
+            event_times[entry['id']] = {'name': entry['name'],
+                                        'begin': entry['ts'] / 1000.0,
+                                        'end': None}
+
+        elif entry.get('cat') == 'event' and entry['ph'] == 'e':
+            if entry['id'] in event_times:
+                event_times[entry['id']]['end'] = entry['ts'] / 1000.0
+
+    # A job that stopped without running is ready when it stopped
+    for job in job_times.values():
+        if job['ready'] is None:
+            job['ready'] = job['last']
+
+    return job_times, sorted(event_times.values(), key=lambda e: e['begin'])
+
+
+# Determine the job most likely to have emitted @event, from the jobs
+# whose conditions name it as a job event or which declare they emit it,
+# as the one that reached the relevant state or started last before
+# the event was handled.
+def find_cause(job_times, event):
+    best = None
+    best_time = None
+
+    for job in jobs:
+        when = None
+        if job not in job_times:
+            continue
+
+        if event['name'] in ('starting', 'stopping', 'stopped'):
+            when = job_times[job]['start']
+        elif event['name'] == 'started':
+            when = job_times[job]['ready']
+        elif event['name'] in jobs[job]['emits']:
+            when = job_times[job]['start']
+
+        if when is None or when > event['begin']:
+            continue
+
+        if event['name'] in ('starting', 'started', 'stopping', 'stopped'):
+            # Only jobs some other job waits on can matter here
+            waited = False
+            for j in jobs:
+                if jobs[j]['start on']['job'].get(job) == event['name']:
+                    waited = True
+            if not waited:
+                continue
+
+        if best_time is None or when > best_time:
+            best = job
+            best_time = when
+
+    return best
+
+
+# Combine the timings in the trace with the start on conditions and
+# emits of each job to find the event that started each job, the job
+# that emitted each event, the critical path to the target job and the
+# slack of every job.
+def analyse_trace():
+    global trace
+
+    job_times, event_list = read_trace()
+
+    if not job_times:
+        sys.exit("ERROR: no jobs in trace")
+
+    if options.target:
+        if options.target not in job_times:
+            sys.exit("ERROR: job %s not in trace" % options.target)
+        target = options.target
+    else:
+        target = max(job_times, key=lambda j: job_times[j]['ready'])
+
+    for event in event_list:
+        event['cause'] = find_cause(job_times, event)
+
+    # The event that started a job is the last to begin handling
+    # before it started, that the job waits for and was not finished.
+    for name, job in job_times.items():
+        job['trigger'] = None
+        for event in event_list:
+            if event['begin'] > job['start']:
+                break
+            if event['end'] is not None and event['end'] < job['start']:
+                continue
+            if name in jobs and \
+               event['name'] not in jobs[name]['start on']['event'] and \
+               event['name'] not in jobs[name]['start on']['job'].values():
+                continue
+            job['trigger'] = event
+
+    # A job has slack until the first job waiting on it started, or if
+    # none did, until the target was ready.
+    end = job_times[target]['ready']
+    for name, job in job_times.items():
+        needed = None
+        for other, other_job in job_times.items():
+            if other not in jobs or other == name:
+                continue
+            waits = name in jobs[other]['start on']['job']
+            if name in jobs:
+                for e in jobs[name]['emits']:
+                    if e in jobs[other]['start on']['event']:
+                        waits = True
+            if waits and other_job['start'] >= job['ready']:
+                if needed is None or other_job['start'] < needed:
+                    needed = other_job['start']
+        if needed is None:
+            needed = end
+        job['slack'] = max(needed - job['ready'], 0.0)
+
+    path = []
+    critical_jobs = set()
+    critical_events = {}
+    name = target
+    while name is not None and name not in critical_jobs:
+        critical_jobs.add(name)
+        path.append(('job', name))
+        event = job_times[name]['trigger']
+        if event is None:
+            break
+        critical_events[event['name']] = event['cause']
+        path.append(('event', event))
+        name = event['cause']
+        if name is not None and name not in job_times:
+            break
+
+    events_by_name = {}
+    for event in event_list:
+        if event['name'] not in events_by_name:
+            events_by_name[event['name']] = event
+
+    trace = {
+        'target': target,
+        'jobs': job_times,
+        'events': events_by_name,
+        'event list': event_list,
+        'path': list(reversed(path)),
+        'critical jobs': critical_jobs,
+        'critical events': critical_events,
+    }
+
+
+def show_report(ofh):
+    ofh.write("Critical path to %s:\n" % trace['target'])
+    for kind, node in trace['path']:
+        if kind == 'event':
+            if node['end'] is None:
+                took = "unfinished"
+            else:
+                took = "handled in %.3fms" % (node['end'] - node['begin'])
+            ofh.write("  %10.3fms  event %s (%s)\n" %
+                      (node['begin'], node['name'], took))
+        else:
+            job = trace['jobs'][node]
+            ofh.write("  %10.3fms  job %s (ready after %.3fms)\n" %
+                      (job['start'], node, job['ready'] - job['start']))
+
+    ofh.write("\nSlack:\n")
+    for name in sorted(trace['jobs'],
+                       key=lambda j: (trace['jobs'][j]['slack'], j)):
+        ofh.write("  %10.3fms  %s\n" % (trace['jobs'][name]['slack'], name))
+
+    ofh.write("\nLongest waits for events:\n")
+    finished = [e for e in trace['event list'] if e['end'] is not None]
+    for event in sorted(finished, key=lambda e: e['begin'] - e['end'])[:10]:
+        ofh.write("  %10.3fms  %s\n" % (event['end'] - event['begin'],
+                                        event['name']))
+
+
 def main():
     global options
     global restrictions_list
@@ -515,6 +800,31 @@ def main():
                         help="Specify color for job boxes (default=%s)." %
                              default_color_job)
 
+    parser.add_argument("-t", "--trace",
+                        dest="trace",
+                        help="File containing the output of 'initctl trace "
+                        "dump' (or '-' for standard input) used to mark the "
+                        "critical path and annotate jobs and events with "
+                        "their timings.")
+
+    parser.add_argument("--target",
+                        dest="target",
+                        help="Job to find the critical path to (default is "
+                        "the last job in the trace to become ready).")
+
+    parser.add_argument("--report",
+                        dest="report",
+                        action="store_true",
+                        help="Write a text report of the critical path, "
+                        "slack of each job and longest waits for events "
+                        "rather than a dot file (requires --trace).")
+
+    parser.add_argument("--color-critical",
+                        dest="color_critical",
+                        help="Specify color for jobs, events and lines on "
+                        "the critical path (default=%s)." %
+                             default_color_critical)
+
     parser.add_argument("--user",
                         dest="system",
                         default=None,
@@ -536,10 +846,14 @@ def main():
                         color_event_text=default_color_text,
                         color_text=default_color_text,
                         color_bg=default_color_bg,
+                        color_critical=default_color_critical,
                         outfile=default_outfile)
 
     options = parser.parse_args()
 
+    if options.report and not options.trace:
+        sys.exit("ERROR: --report requires --trace")
+
     if options.outfile == '-':
         ofh = sys.stdout
     else:
@@ -573,6 +887,13 @@ def main():
         if not job in jobs:
             sys.exit("ERROR: unknown job %s" % job)
 
+    if options.trace:
+        analyse_trace()
+
+    if options.report:
+        show_report(ofh)
+        return
+
     header(ofh)
     show_events(ofh)
     show_jobs(ofh)
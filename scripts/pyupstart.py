@@ -392,6 +392,42 @@ class Upstart:
         """
         return json.loads(self.get_state_json())
 
+    def job_states(self, name=''):
+        """
+        Obtain the goal, state and processes of every job instance in
+        a single call.
+
+        @name: name of job to restrict results to, or '' for all jobs.
+
+        Returns: list of dictionaries with 'job', 'instance', 'goal',
+        'state' and 'processes' keys, the latter being a map of
+        job process names to pids. Jobs with no instances have an
+        empty goal and state.
+        """
+        states = []
+
+        for job, instance, goal, state, process, pid in \
+                self.proxy.GetJobStates(name):
+            # convert back to natural types
+            entry = {
+                'job': str(job),
+                'instance': str(instance),
+                'goal': str(goal),
+                'state': str(state),
+                'processes': {},
+            }
+
+            if states and states[-1]['job'] == entry['job'] \
+                    and states[-1]['instance'] == entry['instance']:
+                entry = states[-1]
+            else:
+                states.append(entry)
+
+            if process:
+                entry['processes'][str(process)] = int(pid)
+
+        return states
+
     def get_sessions(self):
         """
         Returns dictionary of session details.
@@ -742,25 +778,34 @@ class Job:
 
         assert(name in self.instance_names)
 
-        instance = self._get_dbus_instance(name)
-        assert (instance)
+        return self._instance_pids(name)
 
-        properties = dbus.Interface(instance, FREEDESKTOP_PROPERTIES)
-        assert (properties)
+    def instance_pids(self):
+        """
+        Obtain the processes of every instance of the job in a single
+        call.
 
-        # don't assert as there may not be any processes
-        procs = properties.Get(INSTANCE_INTERFACE_NAME, 'processes')
+        Returns: Map of D-Bus encoded instance names to maps of job
+        process names to pids.
+        """
+        job_name = '{}/{}'.format(self.subdir_name, self.name)
 
-        pid_map = {}
+        return {dbus_encode(state['instance']): state['processes']
+                for state in self.upstart.job_states(job_name)}
 
-        for proc in procs:
-            # convert back to natural types
-            job_proc = str(proc[0])
-            job_pid = int(proc[1])
+    def _instance_pids(self, name, instance_pids=None):
+        """
+        @name: D-Bus encoded instance name.
+        @instance_pids: result of instance_pids() to look @name up in,
+         or None to obtain it.
 
-            pid_map[job_proc] = job_pid
+        Returns: Map of job process names to pids for instance @name.
+        """
+        if instance_pids is None:
+            instance_pids = self.instance_pids()
 
-        return pid_map
+        # don't assert as there may not be any processes
+        return instance_pids.get(name, {})
 
     def running(self, name):
         """
@@ -945,19 +990,15 @@ class JobInstance:
         """
         self.instance.Restart(wait)
 
-    def pids(self):
-        procs = self.properties.Get(INSTANCE_INTERFACE_NAME, 'processes')
-
-        pid_map = {}
-
-        for proc in procs:
-            # convert back to natural types
-            job_proc = str(proc[0])
-            job_pid = int(proc[1])
-
-            pid_map[job_proc] = job_pid
+    def pids(self, instance_pids=None):
+        """
+        @instance_pids: result of Job.instance_pids() to look the
+         instance up in, or None to obtain it. Pass it when handling
+         several instances of a job, to avoid a D-Bus call for each.
 
-        return pid_map
+        Returns: Map of job process names to pids.
+        """
+        return self.job._instance_pids(self.instance_name, instance_pids)
 
     def destroy(self):
         """
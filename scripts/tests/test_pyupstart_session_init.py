@@ -504,6 +504,7 @@ class TestSessionInit(TestSessionUpstart):
 
         # expected since there is only a single instance of the job
         self.assertEqual(inst.pids(), pids)
+        self.assertEqual(inst.pids(job.instance_pids()), pids)
 
         inst.stop()
         self.stop_session_init()
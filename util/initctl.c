@@ -26,6 +26,7 @@
 
 #include <sys/types.h>
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -71,6 +72,9 @@ char *        job_status   (const void *parent,
 char *        job_usage    (const void *parent,
 			    NihDBusProxy *job_class)
 	__attribute__ ((warn_unused_result));
+char *        job_states_status (const void *parent,
+				 UpstartGetJobStatesJobsElement ***jobs)
+	__attribute__ ((warn_unused_result));
 
 /* Prototypes for static functions */
 static void   start_reply_handler (char **job_path, NihDBusMessage *message,
@@ -106,6 +110,22 @@ static int    tree_filter (void *data, NihTree *node);
 static void   display_check_errors (const char *job_class,
 		const char *condition, NihTree *node);
 
+static uint64_t stats_percentile (const UpstartGetStatsStatsElement *stats,
+				  int percent);
+
+static char * trace_json_string (const void *parent, const char *str)
+	__attribute__ ((warn_unused_result, malloc));
+static void   trace_span_line   (char ***lines, TraceSpan *span,
+				 uint64_t time);
+static void   trace_dump        (UpstartGetTraceTraceElement **trace);
+static char * trace_ms          (const void *parent, uint64_t ns)
+	__attribute__ ((warn_unused_result, malloc));
+static int    trace_slack_cmp   (const void *a, const void *b);
+static int    trace_wait_cmp    (const void *a, const void *b);
+static int    trace_analyse     (UpstartGetTraceTraceElement **trace,
+				 const char *target)
+	__attribute__ ((warn_unused_result));
+
 static int    allow_job (const char *job);
 static int    allow_event (const char *event);
 static char **get_job_details (void)
@@ -141,6 +161,9 @@ int list_env_action                      (NihCommand *command, char * const *arg
 int unset_env_action                     (NihCommand *command, char * const *args);
 int reset_env_action                     (NihCommand *command, char * const *args);
 int list_sessions_action                 (NihCommand *command, char * const *args);
+int stats_action                         (NihCommand *command, char * const *args);
+int log_stats_action                     (NihCommand *command, char * const *args);
+int trace_action                         (NihCommand *command, char * const *args);
 
 /**
  * use_dbus:
@@ -239,6 +262,22 @@ CheckConfigData check_config_data;
  **/
 int apply_globally = FALSE;
 
+/**
+ * show_histogram:
+ *
+ * If TRUE, the stats command shows the count in each bucket of every
+ * histogram as well as its summary.
+ **/
+int show_histogram = FALSE;
+
+/**
+ * reset_stats:
+ *
+ * If TRUE, the stats command discards the durations recorded by the
+ * init daemon once they have been shown.
+ **/
+int reset_stats = FALSE;
+
 /**
  * NihOption setter function to handle selection of appropriate D-Bus
  * bus.
@@ -533,6 +572,112 @@ job_status (const void *  parent,
 	return str;
 }
 
+/**
+ * job_states_status:
+ * @parent: parent object for new string,
+ * @jobs: pointer to GetJobStates reply elements.
+ *
+ * Constructs a string defining the status of the instance, or job with
+ * no instances, described by the elements at @jobs, in the same form
+ * as job_status(); @jobs is advanced past those elements.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: newly allocated string or NULL on raised error.
+ **/
+char *
+job_states_status (const void                       *parent,
+		   UpstartGetJobStatesJobsElement ***jobs)
+{
+	UpstartGetJobStatesJobsElement  *first;
+	UpstartGetJobStatesJobsElement **job;
+	char                            *str = NULL;
+
+	nih_assert (jobs != NULL);
+	nih_assert (*jobs != NULL);
+	nih_assert (**jobs != NULL);
+
+	first = **jobs;
+
+	if (*first->item1) {
+		str = nih_sprintf (parent, "%s (%s)",
+				   first->item0, first->item1);
+	} else {
+		str = nih_strdup (parent, first->item0);
+	}
+	if (! str)
+		nih_return_no_memory_error (NULL);
+
+	/* A job with no instances has no goal or state */
+	if (! *first->item2) {
+		*jobs = *jobs + 1;
+
+		if (! nih_strcat (&str, parent, " stop/waiting")) {
+			nih_error_raise_no_memory ();
+			nih_free (str);
+			return NULL;
+		}
+
+		return str;
+	}
+
+	if (! nih_strcat_sprintf (&str, parent, " %s/%s",
+				  first->item2, first->item3)) {
+		nih_error_raise_no_memory ();
+		nih_free (str);
+		return NULL;
+	}
+
+	/* Following elements for the same instance give its other
+	 * processes, the first is always the main process if there is
+	 * one; as with job_status(), prefix it if it's not one of the
+	 * standard processes.
+	 */
+	for (job = *jobs; *job; job++) {
+		if ((job != *jobs)
+		    && (strcmp ((*job)->item0, first->item0)
+			|| strcmp ((*job)->item1, first->item1)))
+			break;
+
+		if (! *(*job)->item4)
+			continue;
+
+		if (job != *jobs) {
+			if (! nih_strcat_sprintf (&str, parent, "\n\t%s process %d",
+						  (*job)->item4,
+						  (*job)->item5)) {
+				nih_error_raise_no_memory ();
+				nih_free (str);
+				return NULL;
+			}
+		} else if (strcmp ((*job)->item4, "main")
+			   && strcmp ((*job)->item4, "pre-start")
+			   && strcmp ((*job)->item4, "post-stop")) {
+			if (! nih_strcat_sprintf (&str, parent, ", (%s) process %d",
+						  (*job)->item4,
+						  (*job)->item5)) {
+				nih_error_raise_no_memory ();
+				nih_free (str);
+				return NULL;
+			}
+		} else {
+			if (! nih_strcat_sprintf (&str, parent, ", process %d",
+						  (*job)->item5)) {
+				nih_error_raise_no_memory ();
+				nih_free (str);
+				return NULL;
+			}
+		}
+	}
+
+	*jobs = job;
+
+	return str;
+}
+
 /**
  * job_usage:
  * @parent: parent object,
@@ -1094,6 +1239,7 @@ status_action (NihCommand *  command,
 	nih_local char *        job_path = NULL;
 	nih_local NihDBusProxy *job = NULL;
 	nih_local char *        status = NULL;
+	nih_local UpstartGetJobStatesJobsElement **jobs = NULL;
 	NihError *              err;
 	NihDBusError *          dbus_err;
 
@@ -1117,6 +1263,39 @@ status_action (NihCommand *  command,
 	if (! upstart)
 		return 1;
 
+	/* When given just a job name, get the states of its instances in
+	 * a single call and output the status if it has a running instance
+	 * with no name.  Otherwise, or if init is too old to support this,
+	 * look up the instance to determine its status as usual.
+	 */
+	if (! upstart_instance && ! args[1]) {
+		if (upstart_get_job_states_sync (NULL, upstart, upstart_job,
+						 &jobs) < 0) {
+			dbus_err = (NihDBusError *)nih_error_get ();
+			if ((dbus_err->number != NIH_DBUS_ERROR)
+			    || strcmp (dbus_err->name, DBUS_ERROR_UNKNOWN_METHOD)) {
+				nih_error_raise_error ((NihError *)dbus_err);
+				goto error;
+			}
+
+			nih_free (dbus_err);
+		}
+
+		for (UpstartGetJobStatesJobsElement **element = jobs;
+		     element && *element; element++) {
+			if (*(*element)->item1 || ! *(*element)->item2)
+				continue;
+
+			status = job_states_status (NULL, &element);
+			if (! status)
+				goto error;
+
+			nih_message ("%s", status);
+
+			return 0;
+		}
+	}
+
 	/* Obtain a proxy to the job */
 	if (upstart_get_job_by_name_sync (NULL, upstart, upstart_job,
 					  &job_class_path) < 0)
@@ -1196,6 +1375,7 @@ list_action (NihCommand *  command,
 {
 	nih_local NihDBusProxy *upstart = NULL;
 	nih_local char **       job_class_paths = NULL;
+	nih_local UpstartGetJobStatesJobsElement **jobs = NULL;
 	NihError *              err;
 	NihDBusError *          dbus_err;
 
@@ -1206,6 +1386,34 @@ list_action (NihCommand *  command,
 	if (! upstart)
 		return 1;
 
+	/* Obtain the states of all jobs and their instances in a single
+	 * call, unless init is too old to support it in which case we
+	 * query each job and instance in turn.
+	 */
+	if (upstart_get_job_states_sync (NULL, upstart, "", &jobs) == 0) {
+		for (UpstartGetJobStatesJobsElement **job = jobs;
+		     job && *job; ) {
+			nih_local char *status = NULL;
+
+			status = job_states_status (NULL, &job);
+			if (! status)
+				goto error;
+
+			nih_message ("%s", status);
+		}
+
+		return 0;
+	}
+
+	dbus_err = (NihDBusError *)nih_error_get ();
+	if ((dbus_err->number != NIH_DBUS_ERROR)
+	    || strcmp (dbus_err->name, DBUS_ERROR_UNKNOWN_METHOD)) {
+		nih_error_raise_error ((NihError *)dbus_err);
+		goto error;
+	}
+
+	nih_free (dbus_err);
+
 	/* Obtain a list of jobs */
 	if (upstart_get_all_jobs_sync (NULL, upstart, &job_class_paths) < 0)
 		goto error;
@@ -1894,6 +2102,814 @@ error:
 }
 
 
+/**
+ * stats_percentile:
+ * @stats: histogram returned by GetStats,
+ * @percent: percentage of durations.
+ *
+ * Estimates the duration within which @percent of the durations in
+ * @stats fell, as the upper bound of the bucket holding that duration
+ * or the longest duration recorded if that is less.
+ *
+ * Returns: duration in microseconds.
+ **/
+static uint64_t
+stats_percentile (const UpstartGetStatsStatsElement *stats,
+		  int                                percent)
+{
+	uint64_t target;
+	uint64_t seen = 0;
+	uint64_t max;
+
+	nih_assert (stats != NULL);
+
+	max = stats->item3 / 1000;
+
+	nih_assert (percent > 0);
+	nih_assert (percent <= 100);
+
+	/* Rank of the duration, rounded up */
+	target = (stats->item1 * percent + 99) / 100;
+
+	for (size_t i = 0; i < stats->item4_len; i++) {
+		uint64_t bound = (uint64_t)1 << i;
+
+		seen += stats->item4[i];
+		if (seen >= target)
+			return (i + 1 < stats->item4_len) && (bound < max)
+				? bound : max;
+	}
+
+	return max;
+}
+
+/**
+ * stats_action:
+ * @command: NihCommand invoked,
+ * @args: command-line arguments.
+ *
+ * This function is called for the "stats" command.
+ *
+ * Returns: command exit status.
+ **/
+int
+stats_action (NihCommand *  command,
+	      char * const *args)
+{
+	nih_local NihDBusProxy                 *upstart = NULL;
+	nih_local UpstartGetStatsStatsElement **stats = NULL;
+	NihError *                              err;
+
+	nih_assert (command != NULL);
+	nih_assert (args != NULL);
+
+	upstart = upstart_open (NULL);
+	if (! upstart)
+		return 1;
+
+	if (upstart_get_stats_sync (NULL, upstart, &stats) < 0)
+		goto error;
+
+	for (UpstartGetStatsStatsElement **s = stats; s && *s; s++) {
+		if (! (*s)->item1) {
+			nih_message ("%s: count=0", (*s)->item0);
+			continue;
+		}
+
+		nih_message ("%s: count=%" PRIu64 " mean=%" PRIu64 "us"
+			     " p50=%" PRIu64 "us p90=%" PRIu64 "us"
+			     " p99=%" PRIu64 "us max=%" PRIu64 "us",
+			     (*s)->item0, (*s)->item1,
+			     (*s)->item2 / (*s)->item1 / 1000,
+			     stats_percentile (*s, 50),
+			     stats_percentile (*s, 90),
+			     stats_percentile (*s, 99),
+			     (*s)->item3 / 1000);
+
+		if (! show_histogram)
+			continue;
+
+		for (size_t i = 0; i < (*s)->item4_len; i++) {
+			if (! (*s)->item4[i])
+				continue;
+
+			if (i + 1 == (*s)->item4_len) {
+				nih_message ("  >=%" PRIu64 "us: %" PRIu64,
+					     (uint64_t)1 << (i - 1),
+					     (*s)->item4[i]);
+			} else {
+				nih_message ("  <%" PRIu64 "us: %" PRIu64,
+					     (uint64_t)1 << i,
+					     (*s)->item4[i]);
+			}
+		}
+	}
+
+	if (reset_stats && (upstart_reset_stats_sync (NULL, upstart) < 0))
+		goto error;
+
+	return 0;
+
+error:
+	err = nih_error_get ();
+	nih_error ("%s", err->message);
+	nih_free (err);
+
+	return 1;
+}
+
+
+/**
+ * log_stats_action:
+ * @command: NihCommand invoked,
+ * @args: command-line arguments.
+ *
+ * This function is called for the "log-stats" command.
+ *
+ * Returns: command exit status.
+ **/
+int
+log_stats_action (NihCommand *  command,
+		  char * const *args)
+{
+	nih_local NihDBusProxy *upstart = NULL;
+	uint64_t                unflushed;
+	uint64_t                dropped;
+	NihError *              err;
+
+	nih_assert (command != NULL);
+	nih_assert (args != NULL);
+
+	upstart = upstart_open (NULL);
+	if (! upstart)
+		return 1;
+
+	if (upstart_get_log_stats_sync (NULL, upstart,
+					&unflushed, &dropped) < 0)
+		goto error;
+
+	nih_message ("unflushed=%" PRIu64 " dropped=%" PRIu64,
+		     unflushed, dropped);
+
+	return 0;
+
+error:
+	err = nih_error_get ();
+	nih_error ("%s", err->message);
+	nih_free (err);
+
+	return 1;
+}
+
+
+/**
+ * trace_json_string:
+ * @parent: parent object for new string,
+ * @str: string to quote.
+ *
+ * Quotes @str as a JSON string, escaping quotes, backslashes and
+ * control characters.
+ *
+ * Returns: newly allocated string.
+ **/
+static char *
+trace_json_string (const void *parent,
+		   const char *str)
+{
+	char *json;
+
+	nih_assert (str != NULL);
+
+	json = NIH_MUST (nih_strdup (parent, "\""));
+
+	for (const char *c = str; *c; c++) {
+		if ((*c == '"') || (*c == '\\')) {
+			NIH_MUST (nih_strcat_sprintf (&json, parent, "\\%c", *c));
+		} else if ((unsigned char)*c < 0x20) {
+			NIH_MUST (nih_strcat_sprintf (&json, parent, "\\u%04x",
+						      (unsigned char)*c));
+		} else {
+			NIH_MUST (nih_strncat (&json, parent, c, 1));
+		}
+	}
+
+	NIH_MUST (nih_strcat (&json, parent, "\""));
+
+	return json;
+}
+
+/**
+ * trace_span_line:
+ * @lines: array of output lines,
+ * @span: job being traced,
+ * @ts: time @span left its state.
+ *
+ * Appends a complete event to @lines for the time @span spent in its
+ * current state, ending at @ts.
+ **/
+static void
+trace_span_line (char      ***lines,
+		 TraceSpan   *span,
+		 uint64_t     ts)
+{
+	nih_local char *state = NULL;
+	uint64_t        dur;
+
+	nih_assert (lines != NULL);
+	nih_assert (span != NULL);
+	nih_assert (span->state != NULL);
+
+	state = trace_json_string (NULL, span->state);
+	dur = ts - span->since;
+
+	NIH_MUST (nih_str_array_addp (lines, NULL, NULL,
+		NIH_MUST (nih_sprintf (*lines,
+			"{\"name\":%s,\"cat\":\"job\",\"ph\":\"X\","
+			"\"pid\":1,\"tid\":%d,"
+			"\"ts\":%" PRIu64 ".%03" PRIu64 ","
+			"\"dur\":%" PRIu64 ".%03" PRIu64 "}",
+			state, span->id,
+			span->since / 1000, span->since % 1000,
+			dur / 1000, dur % 1000))));
+}
+
+/**
+ * trace_dump:
+ * @trace: records returned by GetTrace.
+ *
+ * Outputs @trace in the Chrome trace event format.  Each job is shown
+ * as a thread with a complete event for each state it passed through,
+ * and the handling of each event as an asynchronous event.  Times are
+ * relative to the first record.
+ **/
+static void
+trace_dump (UpstartGetTraceTraceElement **trace)
+{
+	nih_local NihHash  *jobs = NULL;
+	nih_local NihList  *events = NULL;
+	nih_local char    **lines = NULL;
+	uint64_t            first = 0;
+	uint64_t            ts = 0;
+	int                 ids = 0;
+
+	nih_assert (trace != NULL);
+
+	jobs = NIH_MUST (nih_hash_string_new (NULL, 0));
+	events = NIH_MUST (nih_list_new (NULL));
+	lines = NIH_MUST (nih_str_array_new (NULL));
+
+	NIH_MUST (nih_str_array_add (&lines, NULL, NULL,
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+		"\"args\":{\"name\":\"events\"}}"));
+
+	if (trace[0])
+		first = trace[0]->item0;
+
+	for (UpstartGetTraceTraceElement **t = trace; *t; t++) {
+		nih_local char *name = NULL;
+		TraceSpan      *span;
+
+		ts = ((*t)->item0 > first) ? (*t)->item0 - first : 0;
+		name = trace_json_string (NULL, (*t)->item2);
+
+		if (! strcmp ((*t)->item1, "job")) {
+			span = (TraceSpan *)nih_hash_lookup (jobs, (*t)->item2);
+			if (! span) {
+				span = NIH_MUST (nih_new (jobs, TraceSpan));
+				nih_list_init (&span->entry);
+				nih_alloc_set_destructor (span, nih_list_destroy);
+
+				span->name = NIH_MUST (nih_strdup (span,
+								   (*t)->item2));
+				span->id = ++ids;
+				span->state = NULL;
+
+				nih_hash_add (jobs, &span->entry);
+
+				NIH_MUST (nih_str_array_addp (&lines, NULL, NULL,
+					NIH_MUST (nih_sprintf (lines,
+						"{\"name\":\"thread_name\","
+						"\"ph\":\"M\",\"pid\":1,"
+						"\"tid\":%d,"
+						"\"args\":{\"name\":%s}}",
+						span->id, name))));
+			}
+
+			if (span->state) {
+				trace_span_line (&lines, span, ts);
+				nih_free (span->state);
+				span->state = NULL;
+			}
+
+			/* A job that is waiting has stopped, so is not
+			 * shown until it next changes state.
+			 */
+			if (strcmp ((*t)->item3, "waiting"))
+				span->state = NIH_MUST (nih_strdup (span,
+							(*t)->item3));
+			span->since = ts;
+
+		} else if (! strcmp ((*t)->item1, "event-handling")) {
+			span = NIH_MUST (nih_new (events, TraceSpan));
+			nih_list_init (&span->entry);
+			nih_alloc_set_destructor (span, nih_list_destroy);
+
+			span->name = NIH_MUST (nih_strdup (span, (*t)->item2));
+			span->id = ++ids;
+			span->since = ts;
+			span->state = NULL;
+
+			nih_list_add (events, &span->entry);
+
+			NIH_MUST (nih_str_array_addp (&lines, NULL, NULL,
+				NIH_MUST (nih_sprintf (lines,
+					"{\"name\":%s,\"cat\":\"event\","
+					"\"ph\":\"b\",\"id\":%d,"
+					"\"pid\":1,\"tid\":0,"
+					"\"ts\":%" PRIu64 ".%03" PRIu64 "}",
+					name, span->id,
+					ts / 1000, ts % 1000))));
+
+		} else if (! strcmp ((*t)->item1, "event-finished")) {
+			/* Finish the earliest event of this name still
+			 * being handled; there may be none if it began
+			 * before the oldest record.
+			 */
+			NIH_LIST_FOREACH (events, iter) {
+				TraceSpan *event = (TraceSpan *)iter;
+
+				if (strcmp (event->name, (*t)->item2))
+					continue;
+
+				NIH_MUST (nih_str_array_addp (&lines, NULL, NULL,
+					NIH_MUST (nih_sprintf (lines,
+						"{\"name\":%s,\"cat\":\"event\","
+						"\"ph\":\"e\",\"id\":%d,"
+						"\"pid\":1,\"tid\":0,"
+						"\"ts\":%" PRIu64 ".%03" PRIu64 "}",
+						name, event->id,
+						ts / 1000, ts % 1000))));
+
+				nih_free (event);
+				break;
+			}
+		}
+	}
+
+	/* Jobs still in a state at the end of the trace are shown as
+	 * being in it until the last record.
+	 */
+	NIH_HASH_FOREACH (jobs, iter) {
+		TraceSpan *span = (TraceSpan *)iter;
+
+		if (span->state)
+			trace_span_line (&lines, span, ts);
+	}
+
+	nih_message ("{\"traceEvents\":[");
+	for (char **line = lines; *line; line++)
+		nih_message ("%s%s", *line, line[1] ? "," : "");
+	nih_message ("],\"displayTimeUnit\":\"ms\"}");
+}
+
+/**
+ * trace_ms:
+ * @parent: parent object for new string,
+ * @ns: time in nanoseconds.
+ *
+ * Formats @ns as milliseconds to the microsecond.
+ *
+ * Returns: newly allocated string.
+ **/
+static char *
+trace_ms (const void *parent,
+	  uint64_t    ns)
+{
+	return NIH_MUST (nih_sprintf (parent, "%" PRIu64 ".%03" PRIu64 "ms",
+				      ns / 1000000, (ns / 1000) % 1000));
+}
+
+/**
+ * trace_slack_cmp:
+ * @a: pointer to first TraceJob pointer,
+ * @b: pointer to second TraceJob pointer.
+ *
+ * qsort() function to sort jobs by their slack, least first.
+ *
+ * Returns: negative, zero or positive as @a has less, the same or more
+ * slack than @b.
+ **/
+static int
+trace_slack_cmp (const void *a,
+		 const void *b)
+{
+	const TraceJob *job_a = *(TraceJob * const *)a;
+	const TraceJob *job_b = *(TraceJob * const *)b;
+
+	if (job_a->slack != job_b->slack)
+		return (job_a->slack < job_b->slack) ? -1 : 1;
+
+	return strcmp (job_a->name, job_b->name);
+}
+
+/**
+ * trace_wait_cmp:
+ * @a: pointer to first TraceEvent pointer,
+ * @b: pointer to second TraceEvent pointer.
+ *
+ * qsort() function to sort finished events by the time taken to handle
+ * them, longest first.
+ *
+ * Returns: negative, zero or positive as @a took longer, the same time
+ * or less time than @b.
+ **/
+static int
+trace_wait_cmp (const void *a,
+		const void *b)
+{
+	const TraceEvent *event_a = *(TraceEvent * const *)a;
+	const TraceEvent *event_b = *(TraceEvent * const *)b;
+	uint64_t          wait_a = event_a->end - event_a->begin;
+	uint64_t          wait_b = event_b->end - event_b->begin;
+
+	if (wait_a != wait_b)
+		return (wait_a > wait_b) ? -1 : 1;
+
+	return (event_a->begin < event_b->begin) ? -1
+		: (event_a->begin > event_b->begin);
+}
+
+/**
+ * trace_analyse:
+ * @trace: records returned by GetTrace,
+ * @target: name of job to find the critical path to, or NULL.
+ *
+ * Outputs the chain of jobs and events that gated @target, or the last
+ * job to become ready if NULL, followed by the slack of every job and
+ * the events whose handling took longest.
+ *
+ * Since init handles events one at a time, a job that became starting
+ * while an event was being handled was started by that event; and the
+ * starting, started, stopping and stopped events are handled in the
+ * order the job state changes that emitted them were recorded.  This
+ * is enough to link each job to the job that gated it without reading
+ * any job configuration.
+ *
+ * A job is considered ready when it first became running, or went
+ * back to waiting without, after it started.  Its slack is the time
+ * from then until the first job it started became starting, or for a
+ * job that started none, until @target became ready.
+ *
+ * Returns: zero on success, negative value if there is no such job.
+ **/
+static int
+trace_analyse (UpstartGetTraceTraceElement **trace,
+	       const char                   *target)
+{
+	nih_local NihHash     *jobs = NULL;
+	nih_local NihList     *events = NULL;
+	nih_local NihList     *emitted = NULL;
+	nih_local TraceJob   **sorted_jobs = NULL;
+	nih_local TraceEvent **sorted_events = NULL;
+	nih_local void       **path = NULL;
+	TraceJob              *end = NULL;
+	uint64_t               first = 0;
+	size_t                 len = 0;
+	size_t                 path_len = 0;
+
+	nih_assert (trace != NULL);
+
+	jobs = NIH_MUST (nih_hash_string_new (NULL, 0));
+	events = NIH_MUST (nih_list_new (NULL));
+	emitted = NIH_MUST (nih_list_new (NULL));
+
+	if (trace[0])
+		first = trace[0]->item0;
+
+	for (UpstartGetTraceTraceElement **t = trace; *t; t++) {
+		uint64_t ts;
+
+		ts = ((*t)->item0 > first) ? (*t)->item0 - first : 0;
+		len++;
+
+		if (! strcmp ((*t)->item1, "job")) {
+			TraceJob   *job;
+			TraceEvent *pending;
+			const char *event_name = NULL;
+
+			job = (TraceJob *)nih_hash_lookup (jobs, (*t)->item2);
+			if (! job) {
+				job = NIH_MUST (nih_new (jobs, TraceJob));
+				memset (job, 0, sizeof (TraceJob));
+				nih_list_init (&job->entry);
+				nih_alloc_set_destructor (job, nih_list_destroy);
+
+				job->name = NIH_MUST (nih_strdup (job,
+								  (*t)->item2));
+
+				nih_hash_add (jobs, &job->entry);
+			}
+
+			/* Remember the job that will have emitted the
+			 * next event of this name to be handled.
+			 */
+			if (! strcmp ((*t)->item3, "starting")) {
+				event_name = JOB_STARTING_EVENT;
+			} else if (! strcmp ((*t)->item3, "running")) {
+				event_name = JOB_STARTED_EVENT;
+			} else if (! strcmp ((*t)->item3, "stopping")) {
+				event_name = JOB_STOPPING_EVENT;
+			} else if (! strcmp ((*t)->item3, "waiting")) {
+				event_name = JOB_STOPPED_EVENT;
+			}
+
+			if (event_name) {
+				pending = NIH_MUST (nih_new (emitted, TraceEvent));
+				memset (pending, 0, sizeof (TraceEvent));
+				nih_list_init (&pending->entry);
+				nih_alloc_set_destructor (pending, nih_list_destroy);
+
+				pending->name = NIH_MUST (nih_strdup (pending,
+								      event_name));
+				pending->cause = job;
+
+				nih_list_add (emitted, &pending->entry);
+			}
+
+			if ((! job->started)
+			    && (! strcmp ((*t)->item3, "starting"))) {
+				job->started = TRUE;
+				job->start = ts;
+
+				/* The event most recently begun that is
+				 * still being handled started the job.
+				 */
+				NIH_LIST_FOREACH (events, iter) {
+					TraceEvent *event = (TraceEvent *)iter;
+
+					if (! event->finished)
+						job->trigger = event;
+				}
+
+			} else if (job->started && (! job->ready)
+				   && ((! strcmp ((*t)->item3, "running"))
+				       || (! strcmp ((*t)->item3, "waiting")))) {
+				job->ready = TRUE;
+				job->ready_time = ts;
+			}
+
+		} else if (! strcmp ((*t)->item1, "event-handling")) {
+			TraceEvent *event;
+
+			event = NIH_MUST (nih_new (events, TraceEvent));
+			memset (event, 0, sizeof (TraceEvent));
+			nih_list_init (&event->entry);
+			nih_alloc_set_destructor (event, nih_list_destroy);
+
+			event->name = NIH_MUST (nih_strdup (event, (*t)->item2));
+			event->begin = ts;
+
+			NIH_LIST_FOREACH (emitted, iter) {
+				TraceEvent *pending = (TraceEvent *)iter;
+
+				if (strcmp (pending->name, event->name))
+					continue;
+
+				event->cause = pending->cause;
+				nih_free (pending);
+				break;
+			}
+
+			nih_list_add (events, &event->entry);
+
+		} else if (! strcmp ((*t)->item1, "event-finished")) {
+			NIH_LIST_FOREACH (events, iter) {
+				TraceEvent *event = (TraceEvent *)iter;
+
+				if (event->finished
+				    || strcmp (event->name, (*t)->item2))
+					continue;
+
+				event->finished = TRUE;
+				event->end = ts;
+				break;
+			}
+		}
+	}
+
+	if (target) {
+		end = (TraceJob *)nih_hash_lookup (jobs, target);
+		if (! (end && end->ready)) {
+			fprintf (stderr, _("%s: job not ready in trace: %s\n"),
+				 program_name, target);
+			return -1;
+		}
+	} else {
+		NIH_HASH_FOREACH (jobs, iter) {
+			TraceJob *job = (TraceJob *)iter;
+
+			if (job->ready
+			    && ((! end) || (job->ready_time > end->ready_time)))
+				end = job;
+		}
+
+		if (! end) {
+			fprintf (stderr, _("%s: no jobs ready in trace\n"),
+				 program_name);
+			return -1;
+		}
+	}
+
+	/* Walk back from the target through the event that started each
+	 * job and the job that emitted each event; each step is earlier
+	 * than the last so there can be no more steps than records.
+	 */
+	path = NIH_MUST (nih_alloc (NULL, sizeof (void *) * 2 * (len + 1)));
+
+	for (TraceJob *job = end; job && (path_len < 2 * len); ) {
+		path[path_len++] = job;
+
+		if (! job->trigger)
+			break;
+
+		path[path_len++] = job->trigger;
+
+		if ((! job->trigger->cause)
+		    || (job->trigger->cause->start > job->start))
+			break;
+
+		job = job->trigger->cause;
+	}
+
+	nih_message (_("Critical path to %s:"), end->name);
+
+	for (size_t i = path_len; i > 0; i--) {
+		nih_local char *when = NULL;
+		nih_local char *took = NULL;
+
+		/* Jobs and events alternate, starting with a job */
+		if ((i - 1) % 2) {
+			TraceEvent *event = path[i - 1];
+
+			when = trace_ms (NULL, event->begin);
+			if (event->finished) {
+				took = trace_ms (NULL, event->end - event->begin);
+				nih_message (_("  %12s  event %s (handled in %s)"),
+					     when, event->name, took);
+			} else {
+				nih_message (_("  %12s  event %s (unfinished)"),
+					     when, event->name);
+			}
+		} else {
+			TraceJob *job = path[i - 1];
+
+			when = trace_ms (NULL, job->start);
+			took = trace_ms (NULL, job->ready_time - job->start);
+			nih_message (_("  %12s  job %s (ready after %s)"),
+				     when, job->name, took);
+		}
+	}
+
+	/* Note the earliest time each job was needed by a job that an
+	 * event it emitted started.
+	 */
+	NIH_HASH_FOREACH (jobs, iter) {
+		TraceJob *job = (TraceJob *)iter;
+		TraceJob *cause;
+
+		if (! (job->started && job->trigger && job->trigger->cause))
+			continue;
+
+		cause = job->trigger->cause;
+		if ((! cause->needed) || (job->start < cause->needed_time)) {
+			cause->needed = TRUE;
+			cause->needed_time = job->start;
+		}
+	}
+
+	sorted_jobs = NIH_MUST (nih_alloc (NULL, sizeof (TraceJob *)
+					   * (len + 1)));
+	len = 0;
+
+	NIH_HASH_FOREACH (jobs, iter) {
+		TraceJob *job = (TraceJob *)iter;
+		uint64_t  needed;
+
+		if (! job->ready)
+			continue;
+
+		needed = job->needed ? job->needed_time : end->ready_time;
+		job->slack = (needed > job->ready_time)
+			? needed - job->ready_time : 0;
+
+		sorted_jobs[len++] = job;
+	}
+
+	qsort (sorted_jobs, len, sizeof (TraceJob *), trace_slack_cmp);
+
+	nih_message ("%s", "");
+	nih_message (_("Slack:"));
+
+	for (size_t i = 0; i < len; i++) {
+		nih_local char *slack = NULL;
+
+		slack = trace_ms (NULL, sorted_jobs[i]->slack);
+		nih_message ("  %12s  %s", slack, sorted_jobs[i]->name);
+	}
+
+	len = 0;
+	NIH_LIST_FOREACH (events, iter)
+		len++;
+
+	sorted_events = NIH_MUST (nih_alloc (NULL, sizeof (TraceEvent *)
+					     * (len + 1)));
+	len = 0;
+
+	NIH_LIST_FOREACH (events, iter) {
+		TraceEvent *event = (TraceEvent *)iter;
+
+		if (event->finished)
+			sorted_events[len++] = event;
+	}
+
+	qsort (sorted_events, len, sizeof (TraceEvent *), trace_wait_cmp);
+
+	nih_message ("%s", "");
+	nih_message (_("Longest waits for events:"));
+
+	for (size_t i = 0; (i < len) && (i < 10); i++) {
+		nih_local char *took = NULL;
+
+		took = trace_ms (NULL, (sorted_events[i]->end
+					- sorted_events[i]->begin));
+		nih_message ("  %12s  %s", took, sorted_events[i]->name);
+	}
+
+	return 0;
+}
+
+/**
+ * trace_action:
+ * @command: NihCommand invoked,
+ * @args: command-line arguments.
+ *
+ * This function is called for the "trace" command.
+ *
+ * The "dump" action outputs the records of the init daemon's tracer in
+ * the Chrome trace event format, and the "analyse" action outputs the
+ * critical path to a job, the slack of each job and the events waited
+ * on longest.
+ *
+ * Returns: command exit status.
+ **/
+int
+trace_action (NihCommand *  command,
+	      char * const *args)
+{
+	nih_local NihDBusProxy                 *upstart = NULL;
+	nih_local UpstartGetTraceTraceElement **trace = NULL;
+	NihError *                              err;
+
+	nih_assert (command != NULL);
+	nih_assert (args != NULL);
+
+	if (! args[0]) {
+		fprintf (stderr, _("%s: missing action\n"), program_name);
+		nih_main_suggest_help ();
+		return 1;
+	}
+
+	if (strcmp (args[0], "dump") && strcmp (args[0], "analyse")) {
+		fprintf (stderr, _("%s: unknown action: %s\n"), program_name,
+			 args[0]);
+		nih_main_suggest_help ();
+		return 1;
+	}
+
+	upstart = upstart_open (NULL);
+	if (! upstart)
+		return 1;
+
+	if (upstart_get_trace_sync (NULL, upstart, &trace) < 0)
+		goto error;
+
+	if (! strcmp (args[0], "dump")) {
+		trace_dump (trace);
+	} else if (trace_analyse (trace, args[1]) < 0) {
+		return 1;
+	}
+
+	return 0;
+
+error:
+	err = nih_error_get ();
+	nih_error ("%s", err->message);
+	nih_free (err);
+
+	return 1;
+}
+
+
 /**
  * check_config_action:
  * @command: NihCommand invoked,
@@ -3051,6 +4067,38 @@ NihOption log_priority_options[] = {
 	NIH_OPTION_LAST
 };
 
+/**
+ * trace_options:
+ *
+ * Command-line options accepted for the trace command.
+ **/
+NihOption trace_options[] = {
+	NIH_OPTION_LAST
+};
+
+/**
+ * stats_options:
+ *
+ * Command-line options accepted for the stats command.
+ **/
+NihOption stats_options[] = {
+	{ 0, "histogram", N_("show the count in each bucket of every histogram"),
+	  NULL, NULL, &show_histogram, NULL },
+	{ 0, "reset", N_("discard the recorded durations after showing them"),
+	  NULL, NULL, &reset_stats, NULL },
+
+	NIH_OPTION_LAST
+};
+
+/**
+ * log_stats_options:
+ *
+ * Command-line options accepted for the log-stats command.
+ **/
+NihOption log_stats_options[] = {
+	NIH_OPTION_LAST
+};
+
 
 /**
  * show_config_options:
@@ -3259,6 +4307,35 @@ static NihCommand commands[] = {
 	     "\n"
 	     "Without arguments, this outputs the current log priority."),
 	  NULL, log_priority_options, log_priority_action },
+	{ "stats", NULL,
+	  N_("Show how long the init daemon spends in each of its phases."),
+	  N_("For each timed phase of the init daemon (handling the event "
+	     "queue, matching an event against jobs, spawning a process, "
+	     "writing job output and reloading configuration) this outputs "
+	     "the number of times it has run, the mean, approximate 50th, "
+	     "90th and 99th percentiles and the longest duration, all in "
+	     "microseconds.  Percentiles are the upper bound of the "
+	     "power-of-two histogram bucket they fall in."),
+	  NULL, stats_options, stats_action },
+	{ "log-stats", NULL,
+	  N_("Show how much job output the init daemon holds in memory."),
+	  N_("Outputs the number of bytes of job output the init daemon "
+	     "holds in memory until log files can be written, and the "
+	     "number of bytes it has dropped since it started to stay "
+	     "within its limits on that."),
+	  NULL, log_stats_options, log_stats_action },
+	{ "trace", N_("dump|analyse [JOB]"),
+	  N_("Output or analyse the job and event trace of the init daemon."),
+	  N_("The init daemon records job state changes and the handling "
+	     "of events when started with --trace-buffer.  The `dump' "
+	     "action outputs the recorded trace as JSON in the Chrome "
+	     "trace event format, which may be loaded into a trace viewer "
+	     "to see which jobs took longest to start.\n"
+	     "\n"
+	     "The `analyse' action outputs the chain of jobs and events "
+	     "that gated JOB, or the last job to become ready, the slack "
+	     "of each job, and the events that took longest to handle."),
+	  NULL, trace_options, trace_action },
 
 	{ "show-config", N_("[CONF]"),
 	  N_("Show emits, start on and stop on details for job configurations."),
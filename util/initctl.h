@@ -365,6 +365,95 @@ typedef struct check_config_data {
 } CheckConfigData;
 
 
+/**
+ * TraceSpan:
+ *
+ * @entry: list header,
+ * @name: name of job or event,
+ * @id: thread id of job, or async id of event, in the trace output,
+ * @since: time @state was entered or event handling began, in
+ *   nanoseconds since the first record,
+ * @state: state job is in, or NULL if waiting.
+ *
+ * Used by trace_action() to track each job, and each event being
+ * handled, between records.
+ *
+ * Notes:
+ *
+ * @name must follow @entry so that jobs may be kept in a hash keyed on
+ * it.
+ **/
+typedef struct trace_span {
+	NihList   entry;
+
+	char     *name;
+	int       id;
+	uint64_t  since;
+	char     *state;
+} TraceSpan;
+
+
+/**
+ * TraceJob:
+ *
+ * @entry: list header,
+ * @name: name of job,
+ * @started: TRUE once the job has been seen starting,
+ * @start: time the job first became starting,
+ * @ready: TRUE once the job has been seen running, or stopped,
+ *   after starting,
+ * @ready_time: time the job became ready,
+ * @trigger: event being handled when the job started, or NULL,
+ * @needed: TRUE if a job was started by an event the job emitted,
+ * @needed_time: earliest time such a job became starting,
+ * @slack: time between the job becoming ready and it being needed.
+ *
+ * Used by trace_analyse() to hold the timings of each job.  All times
+ * are in nanoseconds since the first record.
+ *
+ * Notes:
+ *
+ * @name must follow @entry so that jobs may be kept in a hash keyed on
+ * it.
+ **/
+typedef struct trace_job {
+	NihList             entry;
+
+	char               *name;
+	int                 started;
+	uint64_t            start;
+	int                 ready;
+	uint64_t            ready_time;
+	struct trace_event *trigger;
+	int                 needed;
+	uint64_t            needed_time;
+	uint64_t            slack;
+} TraceJob;
+
+/**
+ * TraceEvent:
+ *
+ * @entry: list header,
+ * @name: name of event,
+ * @begin: time handling of the event began,
+ * @finished: TRUE once handling of the event has finished,
+ * @end: time handling of the event finished,
+ * @cause: job whose change of state emitted the event, or NULL.
+ *
+ * Used by trace_analyse() to hold the timings of each event, and
+ * before it is handled, the job expected to emit it.
+ **/
+typedef struct trace_event {
+	NihList   entry;
+
+	char     *name;
+	uint64_t  begin;
+	int       finished;
+	uint64_t  end;
+	TraceJob *cause;
+} TraceEvent;
+
+
 /**
  * ConditionHandlerData:
  *
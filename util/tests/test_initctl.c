@@ -61,6 +61,8 @@ extern int dbus_bus_type;
 extern char *dest_name;
 extern const char *dest_address;
 extern int no_wait;
+extern int show_histogram;
+extern int reset_stats;
 
 extern NihDBusProxy *upstart_open (const void *parent)
 	__attribute__ ((warn_unused_result));
@@ -78,6 +80,9 @@ extern int emit_action                 (NihCommand *command, char * const *args)
 extern int reload_configuration_action (NihCommand *command, char * const *args);
 extern int version_action              (NihCommand *command, char * const *args);
 extern int log_priority_action         (NihCommand *command, char * const *args);
+extern int stats_action                (NihCommand *command, char * const *args);
+extern int log_stats_action            (NihCommand *command, char * const *args);
+extern int trace_action                (NihCommand *command, char * const *args);
 extern int usage_action                (NihCommand *command, char * const *args);
 
 
@@ -9470,6 +9475,38 @@ test_status_action (void)
 	TEST_FEATURE ("with single argument");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that status falls back
+			 * to the individual queries.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "test");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
 			/* Expect the GetJobByName method call on the
 			 * manager object, make sure the job name is passed
 			 * and reply with a path.
@@ -9778,6 +9815,197 @@ test_status_action (void)
 	}
 
 
+	/* Check that the status action with a single argument uses the
+	 * GetJobStates method to obtain the status of a running instance
+	 * of the job in a single call, outputting it with its processes.
+	 */
+	TEST_FEATURE ("with GetJobStates reply");
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetJobStates method call on the
+			 * manager object, make sure the job name is passed
+			 * and reply with the job states.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "test");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+								  (DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_INT32_AS_STRING
+								   DBUS_STRUCT_END_CHAR_AS_STRING),
+								  &arrayiter);
+
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
+
+				str_value = "test";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "post-start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "main";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				int32_value = 3648;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
+
+				dbus_message_iter_close_container (&arrayiter, &structiter);
+
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
+
+				str_value = "test";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "post-start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "post-start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				int32_value = 3649;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
+
+				dbus_message_iter_close_container (&arrayiter, &structiter);
+
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
+
+				str_value = "test";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "foo";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "running";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "main";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				int32_value = 3650;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
+
+				dbus_message_iter_close_container (&arrayiter, &structiter);
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = "test";
+		args[1] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = status_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		if (test_alloc_failed
+		    && (ret != 0)) {
+			TEST_FILE_END (output);
+			TEST_FILE_RESET (output);
+
+			TEST_FILE_EQ (errors, "test: Cannot allocate memory\n");
+			TEST_FILE_END (errors);
+			TEST_FILE_RESET (errors);
+
+			kill (server_pid, SIGTERM);
+			waitpid (server_pid, NULL, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_FILE_EQ (output, "test start/post-start, process 3648\n");
+		TEST_FILE_EQ (output, "\tpost-start process 3649\n");
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		waitpid (server_pid, &status, 0);
+		TEST_TRUE (WIFEXITED (status));
+		TEST_EQ (WEXITSTATUS (status), 0);
+	}
+
+
 	/* Check that additional arguments to the status action are passed
 	 * as entries in the environment to GetInstance.
 	 */
@@ -10424,6 +10652,38 @@ test_status_action (void)
 	TEST_FEATURE ("with unknown instance");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that status falls back
+			 * to the individual queries.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "test");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
 			/* Expect the GetJobByName method call on the
 			 * manager object, make sure the job name is passed
 			 * and reply with a path.
@@ -10589,15 +10849,16 @@ test_status_action (void)
 	TEST_FEATURE ("with error reply to GetJobByName");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
-			/* Expect the GetJobByName method call on the
-			 * manager object, make sure the job name is passed
-			 * and reply with an error.
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that status falls back
+			 * to the individual queries.
 			 */
 			TEST_DBUS_MESSAGE (server_conn, method_call);
 
 			TEST_TRUE (dbus_message_is_method_call (method_call,
 								DBUS_INTERFACE_UPSTART,
-								"GetJobByName"));
+								"GetJobStates"));
 
 			TEST_EQ_STR (dbus_message_get_path (method_call),
 							    DBUS_PATH_UPSTART);
@@ -10620,14 +10881,45 @@ test_status_action (void)
 			dbus_message_unref (method_call);
 			dbus_message_unref (reply);
 
-			TEST_DBUS_CLOSE (server_conn);
+			/* Expect the GetJobByName method call on the
+			 * manager object, make sure the job name is passed
+			 * and reply with an error.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
 
-			dbus_shutdown ();
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobByName"));
 
-			exit (0);
-		}
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
 
-		memset (&command, 0, sizeof command);
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "test");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
 
 		args[0] = "test";
 		args[1] = NULL;
@@ -10661,6 +10953,38 @@ test_status_action (void)
 	TEST_FEATURE ("with error reply to GetInstance");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that status falls back
+			 * to the individual queries.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "test");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
 			/* Expect the GetJobByName method call on the
 			 * manager object, make sure the job name is passed
 			 * and reply with a path.
@@ -10769,6 +11093,38 @@ test_status_action (void)
 	TEST_FEATURE ("with error reply to status query");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that status falls back
+			 * to the individual queries.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "test");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
 			/* Expect the GetJobByName method call on the
 			 * manager object, make sure the job name is passed
 			 * and reply with a path.
@@ -13667,6 +14023,7 @@ test_list_action (void)
 	pid_t           server_pid;
 	DBusMessage *   method_call;
 	DBusMessage *   reply = NULL;
+	const char *    name_value;
 	const char *    str_value;
 	const char *    interface;
 	const char *    property;
@@ -13703,142 +14060,428 @@ test_list_action (void)
 	errors = tmpfile ();
 
 
-	/* Check that the list action makes the GetAllJobs method call
-	 * to obtain a list of paths, then for each job calls the
-	 * GetAllInstances method call to obtain a list of the instances.
-	 * If there are instances, the job name and instance properties are
-	 * requested and output; if there are not instances, only the
-	 * job name is requested and output.
+	/* Check that the list action uses the GetJobStates method to
+	 * obtain the states of all jobs and their instances in a single
+	 * call, outputting a line for each instance and for each job with
+	 * no instances.
 	 */
-	TEST_FEATURE ("with valid reply");
+	TEST_FEATURE ("with GetJobStates reply");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
-			/* Expect the GetAllJobs method call on the
-			 * manager object, reply with a list of interesting
-			 * paths.
+			/* Expect the GetJobStates method call on the
+			 * manager object, make sure the job name is passed
+			 * and reply with the job states.
 			 */
 			TEST_DBUS_MESSAGE (server_conn, method_call);
 
 			TEST_TRUE (dbus_message_is_method_call (method_call,
 								DBUS_INTERFACE_UPSTART,
-								"GetAllJobs"));
+								"GetJobStates"));
 
 			TEST_EQ_STR (dbus_message_get_path (method_call),
 							    DBUS_PATH_UPSTART);
 
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "");
+
 			TEST_ALLOC_SAFE {
 				reply = dbus_message_new_method_return (method_call);
 
 				dbus_message_iter_init_append (reply, &iter);
 
 				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
-								  DBUS_TYPE_OBJECT_PATH_AS_STRING,
+								  (DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_STRING_AS_STRING
+								   DBUS_TYPE_INT32_AS_STRING
+								   DBUS_STRUCT_END_CHAR_AS_STRING),
 								  &arrayiter);
 
-				str_value = DBUS_PATH_UPSTART "/jobs/frodo";
-				dbus_message_iter_append_basic (&arrayiter,
-								DBUS_TYPE_OBJECT_PATH,
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
+
+				str_value = "frodo";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
 								&str_value);
 
-				str_value = DBUS_PATH_UPSTART "/jobs/bilbo";
-				dbus_message_iter_append_basic (&arrayiter,
-								DBUS_TYPE_OBJECT_PATH,
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
 								&str_value);
 
-				str_value = DBUS_PATH_UPSTART "/jobs/drogo";
-				dbus_message_iter_append_basic (&arrayiter,
-								DBUS_TYPE_OBJECT_PATH,
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
 								&str_value);
 
-				dbus_message_iter_close_container (&iter, &arrayiter);
-			}
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			dbus_connection_send (server_conn, reply, NULL);
-			dbus_connection_flush (server_conn);
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			dbus_message_unref (method_call);
-			dbus_message_unref (reply);
+				int32_value = 0;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
 
-			/* Expect the GetAllInstances method call on the
-			 * first job object, reply with an empty list.
-			 */
-			TEST_DBUS_MESSAGE (server_conn, method_call);
+				dbus_message_iter_close_container (&arrayiter, &structiter);
 
-			TEST_TRUE (dbus_message_is_method_call (method_call,
-								DBUS_INTERFACE_UPSTART_JOB,
-								"GetAllInstances"));
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
 
-			TEST_EQ_STR (dbus_message_get_path (method_call),
-							    DBUS_PATH_UPSTART "/jobs/frodo");
+				str_value = "bilbo";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			TEST_ALLOC_SAFE {
-				reply = dbus_message_new_method_return (method_call);
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-				dbus_message_iter_init_append (reply, &iter);
+				str_value = "stop";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
-								  DBUS_TYPE_OBJECT_PATH_AS_STRING,
-								  &arrayiter);
+				str_value = "pre-stop";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-				dbus_message_iter_close_container (&iter, &arrayiter);
-			}
+				str_value = "main";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			dbus_connection_send (server_conn, reply, NULL);
-			dbus_connection_flush (server_conn);
+				int32_value = 1000;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
 
-			dbus_message_unref (method_call);
-			dbus_message_unref (reply);
+				dbus_message_iter_close_container (&arrayiter, &structiter);
 
-			/* Expect the Get call for the name of the
-			 * first job, reply with the name.
-			 */
-			TEST_DBUS_MESSAGE (server_conn, method_call);
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
 
-			TEST_TRUE (dbus_message_is_method_call (method_call,
-								DBUS_INTERFACE_PROPERTIES,
-								"Get"));
+				str_value = "bilbo";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			TEST_EQ_STR (dbus_message_get_path (method_call),
-				     DBUS_PATH_UPSTART "/jobs/frodo");
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			TEST_TRUE (dbus_message_get_args (method_call, NULL,
-							  DBUS_TYPE_STRING, &interface,
-							  DBUS_TYPE_STRING, &property,
-							  DBUS_TYPE_INVALID));
+				str_value = "stop";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			TEST_EQ_STR (interface, DBUS_INTERFACE_UPSTART_JOB);
-			TEST_EQ_STR (property, "name");
+				str_value = "pre-stop";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			TEST_ALLOC_SAFE {
-				reply = dbus_message_new_method_return (method_call);
+				str_value = "pre-stop";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-				dbus_message_iter_init_append (reply, &iter);
+				int32_value = 1001;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
 
-				dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT,
-								  DBUS_TYPE_STRING_AS_STRING,
-								  &subiter);
+				dbus_message_iter_close_container (&arrayiter, &structiter);
 
-				str_value = "frodo";
-				dbus_message_iter_append_basic (&subiter, DBUS_TYPE_STRING,
-								&str_value);
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
 
-				dbus_message_iter_close_container (&iter, &subiter);
-			}
+				str_value = "drogo";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			dbus_connection_send (server_conn, reply, NULL);
-			dbus_connection_flush (server_conn);
+				str_value = "foo";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			dbus_message_unref (method_call);
-			dbus_message_unref (reply);
+				str_value = "start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			/* Expect the GetAllInstances method call on the
-			 * second job object, reply with a single instance.
-			 */
-			TEST_DBUS_MESSAGE (server_conn, method_call);
+				str_value = "running";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
 
-			TEST_TRUE (dbus_message_is_method_call (method_call,
-								DBUS_INTERFACE_UPSTART_JOB,
-								"GetAllInstances"));
+				str_value = "";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				int32_value = 0;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
+
+				dbus_message_iter_close_container (&arrayiter, &structiter);
+
+				dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+								  NULL,
+								  &structiter);
+
+				str_value = "drogo";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "bar";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "start";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "spawned";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				str_value = "security";
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				int32_value = 1002;
+				dbus_message_iter_append_basic (&structiter, DBUS_TYPE_INT32,
+								&int32_value);
+
+				dbus_message_iter_close_container (&arrayiter, &structiter);
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = list_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		if (test_alloc_failed
+		    && (ret != 0)) {
+			TEST_FILE_END (output);
+			TEST_FILE_RESET (output);
+
+			TEST_FILE_EQ (errors, "test: Cannot allocate memory\n");
+			TEST_FILE_END (errors);
+			TEST_FILE_RESET (errors);
+
+			kill (server_pid, SIGTERM);
+			waitpid (server_pid, NULL, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_FILE_EQ (output, "frodo stop/waiting\n");
+		TEST_FILE_EQ (output, "bilbo stop/pre-stop, process 1000\n");
+		TEST_FILE_EQ (output, "\tpre-stop process 1001\n");
+		TEST_FILE_EQ (output, "drogo (foo) start/running\n");
+		TEST_FILE_EQ (output, "drogo (bar) start/spawned, (security) process 1002\n");
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		waitpid (server_pid, &status, 0);
+		TEST_TRUE (WIFEXITED (status));
+		TEST_EQ (WEXITSTATUS (status), 0);
+	}
+
+
+	/* Check that the list action makes the GetAllJobs method call
+	 * to obtain a list of paths, then for each job calls the
+	 * GetAllInstances method call to obtain a list of the instances.
+	 * If there are instances, the job name and instance properties are
+	 * requested and output; if there are not instances, only the
+	 * job name is requested and output.
+	 */
+	TEST_FEATURE ("with valid reply");
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that list falls back
+			 * to the individual queries.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			/* Expect the GetAllJobs method call on the
+			 * manager object, reply with a list of interesting
+			 * paths.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetAllJobs"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+								  DBUS_TYPE_OBJECT_PATH_AS_STRING,
+								  &arrayiter);
+
+				str_value = DBUS_PATH_UPSTART "/jobs/frodo";
+				dbus_message_iter_append_basic (&arrayiter,
+								DBUS_TYPE_OBJECT_PATH,
+								&str_value);
+
+				str_value = DBUS_PATH_UPSTART "/jobs/bilbo";
+				dbus_message_iter_append_basic (&arrayiter,
+								DBUS_TYPE_OBJECT_PATH,
+								&str_value);
+
+				str_value = DBUS_PATH_UPSTART "/jobs/drogo";
+				dbus_message_iter_append_basic (&arrayiter,
+								DBUS_TYPE_OBJECT_PATH,
+								&str_value);
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			/* Expect the GetAllInstances method call on the
+			 * first job object, reply with an empty list.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART_JOB,
+								"GetAllInstances"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART "/jobs/frodo");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+								  DBUS_TYPE_OBJECT_PATH_AS_STRING,
+								  &arrayiter);
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			/* Expect the Get call for the name of the
+			 * first job, reply with the name.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_PROPERTIES,
+								"Get"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+				     DBUS_PATH_UPSTART "/jobs/frodo");
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &interface,
+							  DBUS_TYPE_STRING, &property,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (interface, DBUS_INTERFACE_UPSTART_JOB);
+			TEST_EQ_STR (property, "name");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT,
+								  DBUS_TYPE_STRING_AS_STRING,
+								  &subiter);
+
+				str_value = "frodo";
+				dbus_message_iter_append_basic (&subiter, DBUS_TYPE_STRING,
+								&str_value);
+
+				dbus_message_iter_close_container (&iter, &subiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			/* Expect the GetAllInstances method call on the
+			 * second job object, reply with a single instance.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART_JOB,
+								"GetAllInstances"));
 
 			TEST_EQ_STR (dbus_message_get_path (method_call),
 							    DBUS_PATH_UPSTART "/jobs/bilbo");
@@ -14544,9 +15187,41 @@ test_list_action (void)
 	TEST_FEATURE ("with error reply to GetAllInstances");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
-			/* Expect the GetAllJobs method call on the
-			 * manager object, reply with a list of interesting
-			 * paths.
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that list falls back
+			 * to the individual queries.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			/* Expect the GetAllJobs method call on the
+			 * manager object, reply with a list of interesting
+			 * paths.
 			 */
 			TEST_DBUS_MESSAGE (server_conn, method_call);
 
@@ -14887,6 +15562,38 @@ test_list_action (void)
 	TEST_FEATURE ("with error reply to GetAllJobs");
 	TEST_ALLOC_FAIL {
 		TEST_CHILD (server_pid) {
+			/* Expect the GetJobStates method call on the
+			 * manager object, reply with an unknown method error
+			 * as an older init would so that list falls back
+			 * to the individual queries.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetJobStates"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_TRUE (dbus_message_get_args (method_call, NULL,
+							  DBUS_TYPE_STRING, &name_value,
+							  DBUS_TYPE_INVALID));
+
+			TEST_EQ_STR (name_value, "");
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
 			/* Expect the GetAllJobs method call on the
 			 * manager object, reply with an error.
 			 */
@@ -16209,6 +16916,877 @@ test_log_priority_action (void)
 }
 
 
+void
+test_stats_action (void)
+{
+	pid_t           dbus_pid;
+	DBusConnection *server_conn;
+	FILE *          output;
+	FILE *          errors;
+	pid_t           server_pid;
+	DBusMessage *   method_call;
+	DBusMessage *   reply = NULL;
+	DBusMessageIter iter;
+	DBusMessageIter arrayiter;
+	DBusMessageIter structiter;
+	DBusMessageIter subiter;
+	uint64_t        buckets[32];
+	NihCommand      command;
+	char *          args[1];
+	int             ret = 0;
+	int             status;
+
+	TEST_FUNCTION ("stats_action");
+	TEST_DBUS (dbus_pid);
+	TEST_DBUS_OPEN (server_conn);
+
+	assert (dbus_bus_request_name (server_conn, DBUS_SERVICE_UPSTART,
+				       0, NULL)
+			== DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER);
+
+	TEST_DBUS_MESSAGE (server_conn, method_call);
+	assert (dbus_message_is_signal (method_call, DBUS_INTERFACE_DBUS,
+					"NameAcquired"));
+	dbus_message_unref (method_call);
+
+	dbus_bus_type = DBUS_BUS_SYSTEM;
+	dest_name = DBUS_SERVICE_UPSTART;
+	dest_address = DBUS_ADDRESS_UPSTART;
+
+	output = tmpfile ();
+	errors = tmpfile ();
+
+
+	/* Check that the stats action calls GetStats and prints a line
+	 * for each phase with its count, mean, percentiles rounded up to
+	 * their bucket but no more than the maximum, and maximum, in
+	 * microseconds; and only the count of a phase with no durations.
+	 */
+	TEST_FEATURE ("with valid reply");
+	show_histogram = FALSE;
+
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetStats call, reply with a histogram
+			 * for event-poll with two durations under 2us, one
+			 * of about 10ms and one of 20ms, and an empty one
+			 * for spawn.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetStats"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+								  "(stttat)",
+								  &arrayiter);
+
+				for (int i = 0; i < 2; i++) {
+					const char *name;
+					uint64_t    count, total, max;
+
+					memset (buckets, 0, sizeof (buckets));
+
+					if (! i) {
+						name = "event-poll";
+						count = 4;
+						total = 30002000;
+						max = 20000000;
+						buckets[1] = 2;
+						buckets[14] = 1;
+						buckets[15] = 1;
+					} else {
+						name = "spawn";
+						count = total = max = 0;
+					}
+
+					dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+									  NULL, &structiter);
+
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&name);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&count);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&total);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&max);
+
+					dbus_message_iter_open_container (&structiter, DBUS_TYPE_ARRAY,
+									  DBUS_TYPE_UINT64_AS_STRING,
+									  &subiter);
+
+					for (int j = 0; j < 32; j++)
+						dbus_message_iter_append_basic (&subiter, DBUS_TYPE_UINT64,
+										&buckets[j]);
+
+					dbus_message_iter_close_container (&structiter, &subiter);
+
+					dbus_message_iter_close_container (&arrayiter, &structiter);
+				}
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = stats_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		if (test_alloc_failed
+		    && (ret != 0)) {
+			TEST_FILE_END (output);
+			TEST_FILE_RESET (output);
+
+			TEST_FILE_EQ (errors, "test: Cannot allocate memory\n");
+			TEST_FILE_END (errors);
+			TEST_FILE_RESET (errors);
+
+			kill (server_pid, SIGTERM);
+			waitpid (server_pid, NULL, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_FILE_EQ (output, ("event-poll: count=4 mean=7500us"
+				       " p50=2us p90=20000us p99=20000us"
+				       " max=20000us\n"));
+		TEST_FILE_EQ (output, "spawn: count=0\n");
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		waitpid (server_pid, &status, 0);
+		TEST_TRUE (WIFEXITED (status));
+		TEST_EQ (WEXITSTATUS (status), 0);
+	}
+
+	show_histogram = FALSE;
+
+
+	/* Check that with the --histogram option the stats action also
+	 * prints the upper bound and count of each non-empty bucket
+	 * below the line for its phase.
+	 */
+	TEST_FEATURE ("with histogram option");
+	show_histogram = TRUE;
+
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetStats call, reply with a histogram
+			 * for event-poll with two durations under 2us, one
+			 * of about 10ms and one of 20ms, and an empty one
+			 * for spawn.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetStats"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+								  "(stttat)",
+								  &arrayiter);
+
+				for (int i = 0; i < 2; i++) {
+					const char *name;
+					uint64_t    count, total, max;
+
+					memset (buckets, 0, sizeof (buckets));
+
+					if (! i) {
+						name = "event-poll";
+						count = 4;
+						total = 30002000;
+						max = 20000000;
+						buckets[1] = 2;
+						buckets[14] = 1;
+						buckets[15] = 1;
+					} else {
+						name = "spawn";
+						count = total = max = 0;
+					}
+
+					dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+									  NULL, &structiter);
+
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&name);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&count);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&total);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&max);
+
+					dbus_message_iter_open_container (&structiter, DBUS_TYPE_ARRAY,
+									  DBUS_TYPE_UINT64_AS_STRING,
+									  &subiter);
+
+					for (int j = 0; j < 32; j++)
+						dbus_message_iter_append_basic (&subiter, DBUS_TYPE_UINT64,
+										&buckets[j]);
+
+					dbus_message_iter_close_container (&structiter, &subiter);
+
+					dbus_message_iter_close_container (&arrayiter, &structiter);
+				}
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = stats_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		if (test_alloc_failed
+		    && (ret != 0)) {
+			TEST_FILE_END (output);
+			TEST_FILE_RESET (output);
+
+			TEST_FILE_EQ (errors, "test: Cannot allocate memory\n");
+			TEST_FILE_END (errors);
+			TEST_FILE_RESET (errors);
+
+			kill (server_pid, SIGTERM);
+			waitpid (server_pid, NULL, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_FILE_EQ (output, ("event-poll: count=4 mean=7500us"
+				       " p50=2us p90=20000us p99=20000us"
+				       " max=20000us\n"));
+		TEST_FILE_EQ (output, "  <2us: 2\n");
+		TEST_FILE_EQ (output, "  <16384us: 1\n");
+		TEST_FILE_EQ (output, "  <32768us: 1\n");
+		TEST_FILE_EQ (output, "spawn: count=0\n");
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		waitpid (server_pid, &status, 0);
+		TEST_TRUE (WIFEXITED (status));
+		TEST_EQ (WEXITSTATUS (status), 0);
+	}
+
+	show_histogram = FALSE;
+
+
+	/* Check that if an error is received from the GetStats call, the
+	 * message attached is printed to standard error and the command
+	 * exits.
+	 */
+	TEST_FEATURE ("with error reply");
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetStats call, reply with an error as
+			 * an older init daemon would.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetStats"));
+
+			TEST_ALLOC_SAFE {
+				reply = dbus_message_new_error (method_call,
+								DBUS_ERROR_UNKNOWN_METHOD,
+								"Unknown method");
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = stats_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		TEST_GT (ret, 0);
+
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_MATCH (errors, "test: *\n");
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		kill (server_pid, SIGTERM);
+		waitpid (server_pid, NULL, 0);
+	}
+
+
+	fclose (errors);
+	fclose (output);
+
+	TEST_DBUS_CLOSE (server_conn);
+	TEST_DBUS_END (dbus_pid);
+
+	dbus_shutdown ();
+}
+
+
+void
+test_log_stats_action (void)
+{
+	pid_t           dbus_pid;
+	DBusConnection *server_conn;
+	FILE *          output;
+	FILE *          errors;
+	pid_t           server_pid;
+	DBusMessage *   method_call;
+	DBusMessage *   reply = NULL;
+	uint64_t        unflushed;
+	uint64_t        dropped;
+	NihCommand      command;
+	char *          args[1];
+	int             ret = 0;
+	int             status;
+
+	TEST_FUNCTION ("log_stats_action");
+	TEST_DBUS (dbus_pid);
+	TEST_DBUS_OPEN (server_conn);
+
+	assert (dbus_bus_request_name (server_conn, DBUS_SERVICE_UPSTART,
+				       0, NULL)
+			== DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER);
+
+	TEST_DBUS_MESSAGE (server_conn, method_call);
+	assert (dbus_message_is_signal (method_call, DBUS_INTERFACE_DBUS,
+					"NameAcquired"));
+	dbus_message_unref (method_call);
+
+	dbus_bus_type = DBUS_BUS_SYSTEM;
+	dest_name = DBUS_SERVICE_UPSTART;
+	dest_address = DBUS_ADDRESS_UPSTART;
+
+	output = tmpfile ();
+	errors = tmpfile ();
+
+
+	/* Check that the log-stats action calls GetLogStats and prints
+	 * the number of bytes held and dropped.
+	 */
+	TEST_FEATURE ("with valid reply");
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetLogStats call, reply with the
+			 * counters.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetLogStats"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_ALLOC_SAFE {
+				unflushed = 4096;
+				dropped = 123;
+
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_append_args (reply,
+							  DBUS_TYPE_UINT64, &unflushed,
+							  DBUS_TYPE_UINT64, &dropped,
+							  DBUS_TYPE_INVALID);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = log_stats_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		if (test_alloc_failed
+		    && (ret != 0)) {
+			TEST_FILE_END (output);
+			TEST_FILE_RESET (output);
+
+			TEST_FILE_EQ (errors, "test: Cannot allocate memory\n");
+			TEST_FILE_END (errors);
+			TEST_FILE_RESET (errors);
+
+			kill (server_pid, SIGTERM);
+			waitpid (server_pid, NULL, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_FILE_EQ (output, "unflushed=4096 dropped=123\n");
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		waitpid (server_pid, &status, 0);
+		TEST_TRUE (WIFEXITED (status));
+		TEST_EQ (WEXITSTATUS (status), 0);
+	}
+
+
+	fclose (errors);
+	fclose (output);
+
+	TEST_DBUS_CLOSE (server_conn);
+	TEST_DBUS_END (dbus_pid);
+
+	dbus_shutdown ();
+}
+
+
+void
+test_trace_action (void)
+{
+	pid_t           dbus_pid;
+	DBusConnection *server_conn;
+	FILE *          output;
+	FILE *          errors;
+	pid_t           server_pid;
+	DBusMessage *   method_call;
+	DBusMessage *   reply = NULL;
+	DBusMessageIter iter;
+	DBusMessageIter arrayiter;
+	DBusMessageIter structiter;
+	NihCommand      command;
+	char *          args[2];
+	int             ret = 0;
+	int             status;
+
+	TEST_FUNCTION ("trace_action");
+	TEST_DBUS (dbus_pid);
+	TEST_DBUS_OPEN (server_conn);
+
+	assert (dbus_bus_request_name (server_conn, DBUS_SERVICE_UPSTART,
+				       0, NULL)
+			== DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER);
+
+	TEST_DBUS_MESSAGE (server_conn, method_call);
+	assert (dbus_message_is_signal (method_call, DBUS_INTERFACE_DBUS,
+					"NameAcquired"));
+	dbus_message_unref (method_call);
+
+	dbus_bus_type = DBUS_BUS_SYSTEM;
+	dest_name = DBUS_SERVICE_UPSTART;
+	dest_address = DBUS_ADDRESS_UPSTART;
+
+	output = tmpfile ();
+	errors = tmpfile ();
+
+
+	/* Check that the dump action calls GetTrace and outputs the
+	 * records as Chrome trace events: a thread for each job with a
+	 * complete event for each state other than waiting, and an
+	 * asynchronous event for the handling of each event, with times
+	 * in microseconds since the first record.
+	 */
+	TEST_FEATURE ("with dump action");
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetTrace call, reply with the startup
+			 * event starting a job which becomes running and
+			 * later stops.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetTrace"));
+
+			TEST_EQ_STR (dbus_message_get_path (method_call),
+							    DBUS_PATH_UPSTART);
+
+			TEST_ALLOC_SAFE {
+				const char *types[] = { "event-handling", "job",
+							"job", "event-finished",
+							"job" };
+				const char *names[] = { "startup", "foo", "foo",
+							"startup", "foo" };
+				const char *details[] = { "", "starting",
+							  "running", "",
+							  "waiting" };
+				uint64_t    times[] = { 1000000000, 1000500000,
+							1002000000, 1003000000,
+							1004000000 };
+
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+								  "(tsss)",
+								  &arrayiter);
+
+				for (int i = 0; i < 5; i++) {
+					dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+									  NULL, &structiter);
+
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&times[i]);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&types[i]);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&names[i]);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&details[i]);
+
+					dbus_message_iter_close_container (&arrayiter, &structiter);
+				}
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = "dump";
+		args[1] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = trace_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		if (test_alloc_failed
+		    && (ret != 0)) {
+			TEST_FILE_END (output);
+			TEST_FILE_RESET (output);
+
+			TEST_FILE_EQ (errors, "test: Cannot allocate memory\n");
+			TEST_FILE_END (errors);
+			TEST_FILE_RESET (errors);
+
+			kill (server_pid, SIGTERM);
+			waitpid (server_pid, NULL, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_FILE_EQ (output, "{\"traceEvents\":[\n");
+		TEST_FILE_EQ (output, ("{\"name\":\"thread_name\",\"ph\":\"M\","
+				       "\"pid\":1,\"tid\":0,"
+				       "\"args\":{\"name\":\"events\"}},\n"));
+		TEST_FILE_EQ (output, ("{\"name\":\"startup\",\"cat\":\"event\","
+				       "\"ph\":\"b\",\"id\":1,\"pid\":1,\"tid\":0,"
+				       "\"ts\":0.000},\n"));
+		TEST_FILE_EQ (output, ("{\"name\":\"thread_name\",\"ph\":\"M\","
+				       "\"pid\":1,\"tid\":2,"
+				       "\"args\":{\"name\":\"foo\"}},\n"));
+		TEST_FILE_EQ (output, ("{\"name\":\"starting\",\"cat\":\"job\","
+				       "\"ph\":\"X\",\"pid\":1,\"tid\":2,"
+				       "\"ts\":500.000,\"dur\":1500.000},\n"));
+		TEST_FILE_EQ (output, ("{\"name\":\"startup\",\"cat\":\"event\","
+				       "\"ph\":\"e\",\"id\":1,\"pid\":1,\"tid\":0,"
+				       "\"ts\":3000.000},\n"));
+		TEST_FILE_EQ (output, ("{\"name\":\"running\",\"cat\":\"job\","
+				       "\"ph\":\"X\",\"pid\":1,\"tid\":2,"
+				       "\"ts\":2000.000,\"dur\":2000.000}\n"));
+		TEST_FILE_EQ (output, "],\"displayTimeUnit\":\"ms\"}\n");
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		waitpid (server_pid, &status, 0);
+		TEST_TRUE (WIFEXITED (status));
+		TEST_EQ (WEXITSTATUS (status), 0);
+	}
+
+
+	/* Check that the analyse action calls GetTrace and outputs the
+	 * chain of jobs and events that led to the last job becoming
+	 * ready, linking each job to the event being handled when it
+	 * started and each job event to the job state change that
+	 * emitted it; then the slack of each job and the events that took
+	 * longest to handle.
+	 */
+	TEST_FEATURE ("with analyse action");
+	TEST_ALLOC_FAIL {
+		TEST_CHILD (server_pid) {
+			/* Expect the GetTrace call, reply with the startup
+			 * event starting two jobs, the second of which
+			 * starts a third once running.
+			 */
+			TEST_DBUS_MESSAGE (server_conn, method_call);
+
+			TEST_TRUE (dbus_message_is_method_call (method_call,
+								DBUS_INTERFACE_UPSTART,
+								"GetTrace"));
+
+			TEST_ALLOC_SAFE {
+				const char *types[] = { "event-handling", "job", "job",
+							"job", "event-handling", "event-finished",
+							"job", "event-handling", "job",
+							"event-finished", "job", "event-finished" };
+				const char *names[] = { "startup", "foo", "baz", "baz",
+							"started", "started", "foo", "started",
+							"bar", "startup", "bar", "started" };
+				const char *details[] = { "", "starting", "starting", "running",
+							  "", "", "running", "",
+							  "starting", "", "running", "" };
+				uint64_t    times[] = { 1000000000, 1000500000, 1000700000,
+							1001000000, 1001200000, 1001300000,
+							1002000000, 1002500000, 1002600000,
+							1003000000, 1005000000, 1006000000 };
+
+				reply = dbus_message_new_method_return (method_call);
+
+				dbus_message_iter_init_append (reply, &iter);
+
+				dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+								  "(tsss)",
+								  &arrayiter);
+
+				for (int i = 0; i < 12; i++) {
+					dbus_message_iter_open_container (&arrayiter, DBUS_TYPE_STRUCT,
+									  NULL, &structiter);
+
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_UINT64,
+									&times[i]);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&types[i]);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&names[i]);
+					dbus_message_iter_append_basic (&structiter, DBUS_TYPE_STRING,
+									&details[i]);
+
+					dbus_message_iter_close_container (&arrayiter, &structiter);
+				}
+
+				dbus_message_iter_close_container (&iter, &arrayiter);
+			}
+
+			dbus_connection_send (server_conn, reply, NULL);
+			dbus_connection_flush (server_conn);
+
+			dbus_message_unref (method_call);
+			dbus_message_unref (reply);
+
+			TEST_DBUS_CLOSE (server_conn);
+
+			dbus_shutdown ();
+
+			exit (0);
+		}
+
+		memset (&command, 0, sizeof command);
+
+		args[0] = "analyse";
+		args[1] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = trace_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		if (test_alloc_failed
+		    && (ret != 0)) {
+			TEST_FILE_END (output);
+			TEST_FILE_RESET (output);
+
+			TEST_FILE_EQ (errors, "test: Cannot allocate memory\n");
+			TEST_FILE_END (errors);
+			TEST_FILE_RESET (errors);
+
+			kill (server_pid, SIGTERM);
+			waitpid (server_pid, NULL, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_FILE_EQ (output, "Critical path to bar:\n");
+		TEST_FILE_EQ (output, "       0.000ms  event startup (handled in 3.000ms)\n");
+		TEST_FILE_EQ (output, "       0.500ms  job foo (ready after 1.500ms)\n");
+		TEST_FILE_EQ (output, "       2.500ms  event started (handled in 3.500ms)\n");
+		TEST_FILE_EQ (output, "       2.600ms  job bar (ready after 2.400ms)\n");
+		TEST_FILE_EQ (output, "\n");
+		TEST_FILE_EQ (output, "Slack:\n");
+		TEST_FILE_EQ (output, "       0.000ms  bar\n");
+		TEST_FILE_EQ (output, "       0.600ms  foo\n");
+		TEST_FILE_EQ (output, "       4.000ms  baz\n");
+		TEST_FILE_EQ (output, "\n");
+		TEST_FILE_EQ (output, "Longest waits for events:\n");
+		TEST_FILE_EQ (output, "       3.500ms  started\n");
+		TEST_FILE_EQ (output, "       3.000ms  startup\n");
+		TEST_FILE_EQ (output, "       0.100ms  started\n");
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+
+		waitpid (server_pid, &status, 0);
+		TEST_TRUE (WIFEXITED (status));
+		TEST_EQ (WEXITSTATUS (status), 0);
+	}
+
+
+	/* Check that an unknown action results in an error being output
+	 * to stderr along with a suggestion of help.
+	 */
+	TEST_FEATURE ("with unknown action");
+	TEST_ALLOC_FAIL {
+		memset (&command, 0, sizeof command);
+
+		args[0] = "wibble";
+		args[1] = NULL;
+
+		TEST_DIVERT_STDOUT (output) {
+			TEST_DIVERT_STDERR (errors) {
+				ret = trace_action (&command, args);
+			}
+		}
+		rewind (output);
+		rewind (errors);
+
+		TEST_GT (ret, 0);
+
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		TEST_FILE_EQ (errors, "test: unknown action: wibble\n");
+		TEST_FILE_EQ (errors, "Try `test --help' for more information.\n");
+		TEST_FILE_END (errors);
+		TEST_FILE_RESET (errors);
+	}
+
+
+	fclose (errors);
+	fclose (output);
+
+	TEST_DBUS_CLOSE (server_conn);
+	TEST_DBUS_END (dbus_pid);
+
+	dbus_shutdown ();
+}
+
+
 void
 test_usage (void)
 {
@@ -18417,6 +19995,9 @@ main (int   argc,
 	test_reload_configuration_action ();
 	test_version_action ();
 	test_log_priority_action ();
+	test_stats_action ();
+	test_log_stats_action ();
+	test_trace_action ();
 	test_usage ();
 
 	test_job_env ();